@@ -0,0 +1,263 @@
+#pragma once
+
+//Client-side circuit breaker and retry budget for calls to the LicenseSpring servers. Each endpoint class
+//(activation, check, consumption and versions) gets its own breaker. After a few network failures in a row
+//the breaker opens, and calls to that endpoint fail straight away with CircuitOpenException instead of
+//waiting for a network timeout, so the application can fall back to its local license right away. Once the
+//open period is over, a single probe call is let through to see if the server is back.
+//Retries use capped exponential backoff with full jitter, and are limited by a retry budget so that a whole
+//fleet of clients doesn't multiply its traffic during a backend incident.
+#include <LicenseSpring/Exceptions.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+enum class Endpoint
+{
+    Activation,
+    Check,
+    Consumption,
+    Versions,
+    Count
+};
+
+inline const char* endpointName( Endpoint endpoint )
+{
+    switch ( endpoint )
+    {
+        case Endpoint::Activation: return "activation";
+        case Endpoint::Check: return "check";
+        case Endpoint::Consumption: return "consumption";
+        case Endpoint::Versions: return "versions";
+        default: return "unknown";
+    }
+}
+
+//Thrown instead of making a request while the circuit for an endpoint is open.
+class CircuitOpenException : public std::runtime_error
+{
+public:
+    explicit CircuitOpenException( Endpoint endpoint )
+        : std::runtime_error( std::string( "LicenseSpring " ) + endpointName( endpoint ) + " service is unavailable, not retrying yet" ),
+          m_endpoint( endpoint )
+    {}
+
+    Endpoint endpoint() const { return m_endpoint; }
+
+private:
+    Endpoint m_endpoint;
+};
+
+struct CircuitBreakerPolicy
+{
+    int failureThreshold = 5; //consecutive network failures before the circuit opens
+    std::chrono::milliseconds baseOpenTime = std::chrono::seconds( 5 ); //first open period, doubles each time the probe fails
+    std::chrono::milliseconds maxOpenTime = std::chrono::minutes( 5 );
+    int maxAttempts = 3; //attempts per call, including the first one
+    std::chrono::milliseconds baseBackoff = std::chrono::milliseconds( 200 );
+    std::chrono::milliseconds maxBackoff = std::chrono::seconds( 5 );
+    double retryBudget = 10.0; //each failure takes a token, each success gives back retryCredit
+    double retryCredit = 0.1; //retries are only allowed while more than half the budget is left
+};
+
+class CircuitBreaker
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    enum State { Closed, Open, HalfOpen };
+
+    explicit CircuitBreaker( const CircuitBreakerPolicy& policy = CircuitBreakerPolicy() )
+        : m_policy( policy ), m_tokens( policy.retryBudget ), m_random( std::random_device()() )
+    {}
+
+    //Returns false if the call should fail fast. In the half-open state only one probe is let through.
+    bool allowRequest()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_state == Open && clock_t::now() >= m_openUntil )
+        {
+            m_state = HalfOpen;
+            m_probing = false;
+        }
+        if ( m_state == Open )
+            return false;
+        if ( m_state == HalfOpen )
+        {
+            if ( m_probing )
+                return false;
+            m_probing = true;
+        }
+        return true;
+    }
+
+    void onSuccess()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_state = Closed;
+        m_probing = false;
+        m_failures = 0;
+        m_trips = 0;
+        m_tokens = std::min( m_policy.retryBudget, m_tokens + m_policy.retryCredit );
+    }
+
+    void onNetworkFailure()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_tokens = std::max( 0.0, m_tokens - 1.0 );
+        m_failures++;
+        if ( m_state == HalfOpen || m_failures >= m_policy.failureThreshold )
+            trip();
+    }
+
+    //For a call that failed without telling us anything about the server (e.g. a bug in the caller's code):
+    //counts as neither success nor failure, it only frees the half-open probe slot for the next call.
+    void onUnrelatedFailure()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_probing = false;
+    }
+
+    //Whether another attempt fits in the retry budget.
+    bool canRetry()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_state == Closed && m_tokens > m_policy.retryBudget / 2;
+    }
+
+    //Capped exponential backoff with full jitter: a random delay in [0, min(maxBackoff, baseBackoff * 2^attempt)].
+    std::chrono::milliseconds backoff( int attempt )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto cap = m_policy.baseBackoff * ( 1LL << std::min( attempt, 20 ) );
+        cap = std::min<std::chrono::milliseconds>( cap, m_policy.maxBackoff );
+        std::uniform_int_distribution<long long> jitter( 0, cap.count() );
+        return std::chrono::milliseconds( jitter( m_random ) );
+    }
+
+    State state()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_state;
+    }
+
+    const CircuitBreakerPolicy& policy() const { return m_policy; }
+
+private:
+    //Opens the circuit. Each failed probe doubles the open period (with jitter so a fleet of clients
+    //doesn't probe in lockstep), up to maxOpenTime.
+    void trip()
+    {
+        auto period = m_policy.baseOpenTime * ( 1LL << std::min( m_trips, 20 ) );
+        period = std::min<std::chrono::milliseconds>( period, m_policy.maxOpenTime );
+        std::uniform_real_distribution<double> jitter( 0.5, 1.0 );
+        m_openUntil = clock_t::now() + std::chrono::milliseconds( (long long)( period.count() * jitter( m_random ) ) );
+        m_state = Open;
+        m_probing = false;
+        m_trips++;
+    }
+
+    CircuitBreakerPolicy m_policy;
+    std::mutex m_mutex;
+    State m_state = Closed;
+    bool m_probing = false;
+    int m_failures = 0;
+    int m_trips = 0;
+    double m_tokens;
+    clock_t::time_point m_openUntil;
+    std::mt19937 m_random;
+};
+
+//One circuit breaker per endpoint class. Use call() around any online LicenseSpring call:
+//
+//    networkGuard.call( Endpoint::Check, [ & ]() { license->check(); } );
+//
+//Network failures (no internet, timeouts, server errors) are retried within the budget and count towards
+//opening the circuit. Any other LicenseSpringException (license expired, not found, ...) means the server
+//answered, so it counts as a success for the breaker and is rethrown untouched. Other exceptions say nothing
+//about the server and are rethrown without counting either way.
+class NetworkGuard
+{
+public:
+    explicit NetworkGuard( const CircuitBreakerPolicy& policy = CircuitBreakerPolicy() )
+    {
+        for ( auto& breaker : m_breakers )
+            breaker.reset( new CircuitBreaker( policy ) );
+    }
+
+    CircuitBreaker& breaker( Endpoint endpoint ) { return *m_breakers[ (int)endpoint ]; }
+
+    bool isOpen( Endpoint endpoint ) { return breaker( endpoint ).state() == CircuitBreaker::Open; }
+
+    template <typename Call>
+    auto call( Endpoint endpoint, Call call ) -> decltype( call() )
+    {
+        CircuitBreaker& cb = breaker( endpoint );
+        for ( int attempt = 0; ; attempt++ )
+        {
+            if ( !cb.allowRequest() )
+                throw CircuitOpenException( endpoint );
+            try
+            {
+                return finish( cb, call );
+            }
+            catch ( const LicenseSpring::NoInternetException& ) { cb.onNetworkFailure(); if ( !retry( cb, attempt ) ) throw; }
+            catch ( const LicenseSpring::NetworkTimeoutException& ) { cb.onNetworkFailure(); if ( !retry( cb, attempt ) ) throw; }
+            catch ( const LicenseSpring::LicenseServerException& ) { cb.onNetworkFailure(); if ( !retry( cb, attempt ) ) throw; }
+            catch ( const LicenseSpring::LicenseSpringException& ) { cb.onSuccess(); throw; }
+            catch ( ... ) { cb.onUnrelatedFailure(); throw; }
+        }
+    }
+
+    //Same as call(), but instead of throwing when the server could not be reached (circuit open or network
+    //failure after retries) it returns false, so the caller can carry on with its local license.
+    //Other LicenseSpringExceptions are still thrown.
+    template <typename Call>
+    bool tryCall( Endpoint endpoint, Call call )
+    {
+        try
+        {
+            this->call( endpoint, call );
+            return true;
+        }
+        catch ( const CircuitOpenException& ) {}
+        catch ( const LicenseSpring::NoInternetException& ) {}
+        catch ( const LicenseSpring::NetworkTimeoutException& ) {}
+        catch ( const LicenseSpring::LicenseServerException& ) {}
+        return false;
+    }
+
+private:
+    template <typename Call>
+    static auto finish( CircuitBreaker& cb, Call& call ) -> decltype( call() )
+    {
+        if constexpr ( std::is_void<decltype( call() )>::value )
+        {
+            call();
+            cb.onSuccess();
+        }
+        else
+        {
+            auto result = call();
+            cb.onSuccess();
+            return result;
+        }
+    }
+
+    //Sleeps for the backoff period and returns true if another attempt should be made.
+    static bool retry( CircuitBreaker& cb, int attempt )
+    {
+        if ( attempt + 1 >= cb.policy().maxAttempts || !cb.canRetry() )
+            return false;
+        std::this_thread::sleep_for( cb.backoff( attempt ) );
+        return true;
+    }
+
+    std::unique_ptr<CircuitBreaker> m_breakers[ (int)Endpoint::Count ];
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+//Where the helpers in these samples get the time from, and how they wait for it. Everything that waits for or
+//compares against a deadline (renewing a floating license, license and trial expiry, an idle logout) takes a
+//Clock, which is the real clock unless you pass something else. Pass a SimulatedClock and time only moves when
+//you say so: a test can step through a day of floating renewals, or months of license deadlines, in milliseconds
+//and get the same result every run.
+//
+//The SDK keeps its own time (the license watchdog, ClockTamperedException), a SimulatedClock doesn't change that.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class Clock
+{
+public:
+    using system_time = std::chrono::system_clock::time_point;
+    using steady_time = std::chrono::steady_clock::time_point;
+
+    virtual ~Clock() {}
+
+    //Wall clock time, for dates like a license's expiry.
+    virtual system_time now() = 0;
+
+    //Time that never jumps, for measuring durations and scheduling.
+    virtual steady_time steadyNow() = 0;
+
+    virtual void sleepFor( std::chrono::milliseconds duration ) = 0;
+
+    //Whether now() can jump (the user or NTP changing the system clock) while steadyNow() doesn't, so a wait for a
+    //wall clock time should check back now and then.
+    virtual bool wallClockCanJump() { return true; }
+
+    //Waits on cv until pred() is true or the clock reaches deadline, like cv.wait_until( lock, deadline, pred ).
+    //Returns pred().
+    virtual bool waitUntil( std::unique_lock<std::mutex>& lock, std::condition_variable& cv, steady_time deadline,
+        const std::function<bool()>& pred ) = 0;
+
+    bool waitFor( std::unique_lock<std::mutex>& lock, std::condition_variable& cv, std::chrono::milliseconds duration,
+        const std::function<bool()>& pred )
+    {
+        return waitUntil( lock, cv, steadyNow() + duration, pred );
+    }
+
+    //Milliseconds since the epoch.
+    int64_t epochMillis()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( now().time_since_epoch() ).count();
+    }
+
+    time_t timeT()
+    {
+        return std::chrono::system_clock::to_time_t( now() );
+    }
+};
+
+class SystemClock : public Clock
+{
+public:
+    //The one the helpers use when they aren't given a clock.
+    static std::shared_ptr<Clock> instance()
+    {
+        static std::shared_ptr<Clock> clock = std::make_shared<SystemClock>();
+        return clock;
+    }
+
+    system_time now() override { return std::chrono::system_clock::now(); }
+
+    steady_time steadyNow() override { return std::chrono::steady_clock::now(); }
+
+    void sleepFor( std::chrono::milliseconds duration ) override { std::this_thread::sleep_for( duration ); }
+
+    bool waitUntil( std::unique_lock<std::mutex>& lock, std::condition_variable& cv, steady_time deadline,
+        const std::function<bool()>& pred ) override
+    {
+        return cv.wait_until( lock, deadline, pred );
+    }
+};
+
+//A clock that only moves when advance() (or sleepFor()) is called.
+//
+//advance() doesn't just jump: it moves to each deadline a thread is waiting for in turn, and lets that thread run
+//until it waits again before moving on. A background thread that renews something every minute therefore renews
+//exactly 60 times when you advance an hour, at the same virtual times on every run.
+//
+//Moving the time wakes up the threads in waitUntil() by notifying their condition variable while holding their
+//mutex, so don't call advance() or sleepFor() while holding a mutex that a thread waits with on this clock.
+class SimulatedClock : public Clock
+{
+public:
+    explicit SimulatedClock( system_time start = std::chrono::system_clock::now() )
+        : m_systemStart( start ), m_steadyStart( std::chrono::steady_clock::now() )
+    {}
+
+    //These don't take the clock's lock, code waiting on the clock calls them while holding its own.
+    system_time now() override
+    {
+        return m_systemStart + std::chrono::duration_cast<std::chrono::system_clock::duration>( elapsed() );
+    }
+
+    steady_time steadyNow() override
+    {
+        return m_steadyStart + elapsed();
+    }
+
+    //Time passes for the caller only, the threads it wakes up aren't waited for. Use it from inside the code under
+    //test, e.g. in a mock server call that should take a while.
+    void sleepFor( std::chrono::milliseconds duration ) override
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        setElapsedLocked( elapsed() + duration );
+        notifyLocked();
+    }
+
+    bool wallClockCanJump() override { return false; }
+
+    void advance( std::chrono::steady_clock::duration duration )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        steady_time target = m_steadyStart + elapsed() + duration;
+        while ( true )
+        {
+            //The earliest deadline someone is waiting for, if it isn't after target.
+            steady_time next = target;
+            bool found = false;
+            for ( auto& waiter : m_waiters )
+                if ( waiter.second.deadline <= next )
+                {
+                    next = waiter.second.deadline;
+                    found = true;
+                }
+            setElapsedLocked( std::max( elapsed(), next - m_steadyStart ) );
+            if ( !found )
+            {
+                notifyLocked();
+                return;
+            }
+
+            //Wake it up, and wait until it's waiting again. If it doesn't come back, it's done (e.g. the thread
+            //ended), and we carry on after a moment of real time.
+            size_t waiting = m_waiters.size();
+            notifyLocked();
+            m_changed.wait_for( lock, std::chrono::milliseconds( 100 ), [ this, waiting ]()
+                {
+                    steady_time now = m_steadyStart + elapsed();
+                    for ( auto& waiter : m_waiters )
+                        if ( waiter.second.deadline <= now )
+                            return false;
+                    return m_waiters.size() >= waiting;
+                } );
+        }
+    }
+
+    //Waits (in real time) until count threads are waiting on this clock, e.g. until a background thread a test
+    //just started is ready. Returns false if that doesn't happen within timeout.
+    bool waitForWaiters( size_t count, std::chrono::milliseconds timeout = std::chrono::seconds( 5 ) )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        return m_changed.wait_for( lock, timeout, [ this, count ]() { return m_waiters.size() >= count; } );
+    }
+
+    bool waitUntil( std::unique_lock<std::mutex>& lock, std::condition_variable& cv, steady_time deadline,
+        const std::function<bool()>& pred ) override
+    {
+        //advance() takes the clock's lock and then ours to notify cv, so we never take the clock's lock while
+        //holding ours. Holding ours while notifying means the notification can't slip in between checking the time
+        //and starting to wait.
+        uint64_t id;
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> clockLock( m_mutex );
+            id = ++m_nextId;
+            m_waiters[ id ] = Waiter{ lock.mutex(), &cv, deadline };
+            m_changed.notify_all();
+        }
+        lock.lock();
+        while ( !pred() && steadyNow() < deadline )
+            cv.wait( lock );
+
+        //advance() may be about to notify us, so cv and its mutex stay untouched until we're off the list.
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> clockLock( m_mutex );
+            m_waiters.erase( id );
+            m_changed.notify_all();
+        }
+        lock.lock();
+        return pred();
+    }
+
+private:
+    struct Waiter
+    {
+        std::mutex* mutex;
+        std::condition_variable* cv;
+        steady_time deadline;
+    };
+
+    std::chrono::steady_clock::duration elapsed() const
+    {
+        return std::chrono::steady_clock::duration( m_elapsed.load( std::memory_order_acquire ) );
+    }
+
+    void setElapsedLocked( std::chrono::steady_clock::duration elapsed )
+    {
+        m_elapsed.store( elapsed.count(), std::memory_order_release );
+    }
+
+    void notifyLocked()
+    {
+        for ( auto& waiter : m_waiters )
+        {
+            std::lock_guard<std::mutex> waiterLock( *waiter.second.mutex );
+            waiter.second.cv->notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    system_time m_systemStart;
+    steady_time m_steadyStart;
+    std::atomic<std::chrono::steady_clock::duration::rep> m_elapsed{ 0 };
+    std::map<uint64_t, Waiter> m_waiters;
+    uint64_t m_nextId = 0;
+};
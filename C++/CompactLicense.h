@@ -0,0 +1,414 @@
+#pragma once
+
+//A compact in-memory form of licenses, for a server that keeps hundreds of thousands of them at once. Holding on
+//to each License::ptr_t keeps everything the SDK read about it alive: a std::string for the key and every custom
+//field, device variable, feature code and user name, and a tm (36+ bytes) for every date. A server with 100k of
+//them spends most of its memory on strings it has many copies of and on data it hardly ever looks at.
+//
+//CompactLicenseTable keeps only what license checks need, packed:
+//  - Strings are interned: each distinct one (product code, feature code, license key) is stored once, in blocks
+//    that never move, and records refer to it by a 32-bit id.
+//  - Dates are seconds since the epoch in 32 bits (good until 2106), 0 for none, instead of tm.
+//  - Flags are bits, counts are 32 bits.
+//  - Features are a small array sorted by code id, searched with a binary search.
+//  - Cold data (the license user, custom fields, device variables) isn't kept at all. cold() loads it when it's
+//    asked for, through a loader the app gives the table, e.g. from a LicenseStore (see LicenseStore.h).
+//A record is 56 bytes, plus 20 per feature.
+//
+//    CompactLicenseTable table( loadColdData );
+//    uint32_t index = table.add( license, "PRODUCT" ); //copies what it needs, the License can go
+//    ...
+//    uint32_t index = table.find( "XXXX-XXXX-XXXX-XXXX" );
+//    if ( index != CompactLicenseTable::npos && table.usable( index, now ) ) ...
+//
+//The table can be read from many threads while one thread adds and updates licenses.
+#include <LicenseSpring/LicenseManager.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+//Each distinct string stored once and referred to by an id. Strings live in blocks that are never moved or freed,
+//so a string_view from get() stays valid for as long as the pool. Not thread safe on its own, the table locks it.
+class StringPool
+{
+public:
+    static constexpr uint32_t none = 0xFFFFFFFFu;
+
+    //The id of s, adding it if it's new.
+    uint32_t intern( std::string_view s )
+    {
+        uint32_t hash = hashOf( s );
+        if ( m_slots.empty() )
+            grow();
+        size_t slot = findSlot( s, hash );
+        if ( m_slots[ slot ] != 0 )
+            return m_slots[ slot ] - 1;
+        if ( ( m_entries.size() + 1 ) * 2 > m_slots.size() )
+        {
+            grow();
+            slot = findSlot( s, hash );
+        }
+        uint32_t id = (uint32_t)m_entries.size();
+        m_entries.push_back( Entry{ store( s ), (uint32_t)s.size(), hash } );
+        m_slots[ slot ] = id + 1;
+        return id;
+    }
+
+    //The id of s, or none if it was never interned.
+    uint32_t find( std::string_view s ) const
+    {
+        if ( m_entries.empty() )
+            return none;
+        uint32_t id = m_slots[ findSlot( s, hashOf( s ) ) ];
+        return id == 0 ? none : id - 1;
+    }
+
+    std::string_view get( uint32_t id ) const
+    {
+        return id < m_entries.size() ? std::string_view( m_entries[ id ].data, m_entries[ id ].size ) : std::string_view();
+    }
+
+    size_t size() const { return m_entries.size(); }
+
+    //Heap bytes held: the blocks, the entries and the hash slots.
+    size_t memoryBytes() const
+    {
+        return m_blockBytes + m_entries.capacity() * sizeof( Entry ) + m_slots.capacity() * sizeof( uint32_t ) +
+            m_blocks.capacity() * sizeof( m_blocks[0] );
+    }
+
+private:
+    static constexpr size_t blockSize = 64 * 1024;
+
+    struct Entry
+    {
+        const char* data;
+        uint32_t size;
+        uint32_t hash;
+    };
+
+    //FNV-1a
+    static uint32_t hashOf( std::string_view s )
+    {
+        uint32_t hash = 2166136261u;
+        for ( unsigned char c : s )
+            hash = ( hash ^ c ) * 16777619u;
+        return hash;
+    }
+
+    //The slot holding s, or the empty slot it would go in. Slots hold id + 1, 0 is empty.
+    size_t findSlot( std::string_view s, uint32_t hash ) const
+    {
+        size_t mask = m_slots.size() - 1;
+        for ( size_t slot = hash & mask; ; slot = ( slot + 1 ) & mask )
+        {
+            uint32_t id = m_slots[ slot ];
+            if ( id == 0 )
+                return slot;
+            const Entry& entry = m_entries[ id - 1 ];
+            if ( entry.hash == hash && entry.size == s.size() && memcmp( entry.data, s.data(), s.size() ) == 0 )
+                return slot;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<uint32_t> slots( std::max<size_t>( 1024, m_slots.size() * 2 ), 0 );
+        size_t mask = slots.size() - 1;
+        for ( uint32_t id = 0; id < m_entries.size(); id++ )
+        {
+            size_t slot = m_entries[ id ].hash & mask;
+            while ( slots[ slot ] != 0 )
+                slot = ( slot + 1 ) & mask;
+            slots[ slot ] = id + 1;
+        }
+        m_slots.swap( slots );
+    }
+
+    const char* store( std::string_view s )
+    {
+        if ( s.size() > blockSize / 4 )
+        {
+            //Big strings get a block of their own, so they don't waste the rest of a shared one.
+            m_blocks.emplace_back( new char[ s.size() ] );
+            m_blockBytes += s.size();
+            memcpy( m_blocks.back().get(), s.data(), s.size() );
+            return m_blocks.back().get();
+        }
+        if ( m_current == nullptr || m_used + s.size() > blockSize )
+        {
+            m_blocks.emplace_back( new char[ blockSize ] );
+            m_blockBytes += blockSize;
+            m_current = m_blocks.back().get();
+            m_used = 0;
+        }
+        char* data = m_current + m_used;
+        memcpy( data, s.data(), s.size() );
+        m_used += s.size();
+        return data;
+    }
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_slots;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char* m_current = nullptr;
+    size_t m_used = 0;
+    size_t m_blockBytes = 0;
+};
+
+struct CompactFeature
+{
+    uint32_t code; //interned
+    uint32_t expiresAt; //seconds since the epoch, 0 if it doesn't expire
+    int32_t maxConsumption;
+    int32_t totalConsumption;
+    uint8_t type; //LicenseSpring::LicenseFeatureType
+    bool expired;
+};
+
+struct CompactLicense
+{
+    enum Flag : uint16_t
+    {
+        Active = 1 << 0,
+        Enabled = 1 << 1,
+        Expired = 1 << 2,
+        Trial = 1 << 3,
+        Floating = 1 << 4,
+        MaintenanceExpired = 1 << 5
+    };
+
+    uint32_t key = StringPool::none; //interned
+    uint32_t product = StringPool::none; //interned
+    uint32_t validUntil = 0; //seconds since the epoch, 0 if it doesn't expire
+    uint32_t maintenanceUntil = 0;
+    uint32_t lastCheck = 0;
+    int32_t maxActivations = 0;
+    int32_t timesActivated = 0;
+    int32_t maxConsumption = 0;
+    int32_t totalConsumption = 0;
+    int32_t maxOverages = 0;
+    uint16_t floatingTimeout = 0; //minutes
+    uint16_t flags = 0;
+    uint16_t featureCount = 0;
+    std::unique_ptr<CompactFeature[]> features; //sorted by code id
+
+    bool has( Flag flag ) const { return ( flags & flag ) != 0; }
+
+    //Active, enabled and not expired as of now (seconds since the epoch).
+    bool usable( int64_t now ) const
+    {
+        return has( Active ) && has( Enabled ) && !has( Expired ) && ( validUntil == 0 || now < (int64_t)validUntil );
+    }
+
+    const CompactFeature* feature( uint32_t code ) const
+    {
+        const CompactFeature* begin = features.get();
+        const CompactFeature* end = begin + featureCount;
+        const CompactFeature* found = std::lower_bound( begin, end, code,
+            []( const CompactFeature& feature, uint32_t code ) { return feature.code < code; } );
+        return found != end && found->code == code ? found : nullptr;
+    }
+};
+
+//What isn't kept in the table, loaded when it's asked for.
+struct LicenseColdData
+{
+    std::string firstName;
+    std::string lastName;
+    std::string email;
+    std::vector<std::pair<std::string, std::string>> customFields;
+    std::vector<std::pair<std::string, std::string>> deviceVariables;
+};
+
+class CompactLicenseTable
+{
+public:
+    static constexpr uint32_t npos = 0xFFFFFFFFu;
+
+    //Loads a license's cold data by its key, for cold(). Throw if it can't be loaded.
+    using ColdLoader = std::function<LicenseColdData( const std::string& licenseKey )>;
+
+    explicit CompactLicenseTable( ColdLoader loader = nullptr ) : m_loader( loader ) {}
+
+    //Adds the license, or replaces it if its key is already in the table, and returns its index. Only reads the
+    //hot fields, the License can be dropped afterwards.
+    uint32_t add( const LicenseSpring::License::ptr_t& license, const std::string& productCode )
+    {
+        CompactLicense record;
+        uint16_t flags = 0;
+        flags |= license->isActive() ? CompactLicense::Active : 0;
+        flags |= license->isEnabled() ? CompactLicense::Enabled : 0;
+        flags |= license->isExpired() ? CompactLicense::Expired : 0;
+        flags |= license->isTrial() ? CompactLicense::Trial : 0;
+        flags |= license->isFloating() ? CompactLicense::Floating : 0;
+        flags |= license->isMaintenancePeriodExpired() ? CompactLicense::MaintenanceExpired : 0;
+        record.flags = flags;
+        record.validUntil = fromDate( license->validityDate() );
+        record.maintenanceUntil = fromDate( license->maintenancePeriod() );
+        record.lastCheck = fromDate( license->lastCheckDate() );
+        record.maxActivations = license->maxActivations();
+        record.timesActivated = license->timesActivated();
+        record.maxConsumption = license->maxConsumption();
+        record.totalConsumption = license->totalConsumption();
+        record.maxOverages = license->maxOverages();
+        record.floatingTimeout = (uint16_t)std::min( license->floatingTimeout(), 0xFFFF );
+
+        std::vector<std::pair<std::string, CompactFeature>> features;
+        for ( const LicenseSpring::LicenseFeature& feature : license->features() )
+            features.emplace_back( feature.code(), CompactFeature{ 0, fromDate( feature.expiryDate() ), feature.maxConsumption(),
+                feature.totalConsumption(), (uint8_t)feature.featureType(), feature.isExpired() } );
+        return add( license->key(), productCode, std::move( record ), features );
+    }
+
+    //Adds a license from its parts: record without its key, product and features, which are filled in here.
+    uint32_t add( const std::string& key, const std::string& productCode, CompactLicense record,
+        const std::vector<std::pair<std::string, CompactFeature>>& features )
+    {
+        std::unique_lock<std::shared_mutex> lock = lockForWriting();
+        record.key = m_strings.intern( key );
+        record.product = m_strings.intern( productCode );
+        record.featureCount = (uint16_t)std::min<size_t>( features.size(), 0xFFFF );
+        if ( record.featureCount > 0 )
+        {
+            record.features.reset( new CompactFeature[ record.featureCount ] );
+            for ( uint16_t i = 0; i < record.featureCount; i++ )
+            {
+                record.features[ i ] = features[ i ].second;
+                record.features[ i ].code = m_strings.intern( features[ i ].first );
+            }
+            std::sort( record.features.get(), record.features.get() + record.featureCount,
+                []( const CompactFeature& a, const CompactFeature& b ) { return a.code < b.code; } );
+        }
+        if ( m_indexOfString.size() < m_strings.size() )
+            m_indexOfString.resize( m_strings.size(), npos );
+        uint32_t index = m_indexOfString[ record.key ];
+        if ( index == npos )
+        {
+            index = (uint32_t)m_records.size();
+            m_indexOfString[ record.key ] = index;
+            m_records.push_back( std::move( record ) );
+        }
+        else
+            m_records[ index ] = std::move( record );
+        return index;
+    }
+
+    //The index of the license with this key, or npos.
+    uint32_t find( std::string_view key ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        uint32_t id = m_strings.find( key );
+        return id < m_indexOfString.size() ? m_indexOfString[ id ] : npos;
+    }
+
+    //Reads the record under the table's lock. Don't keep the reference past f, an add() may move it.
+    template <typename F>
+    auto read( uint32_t index, F f ) const -> decltype( f( std::declval<const CompactLicense&>() ) )
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        return f( m_records.at( index ) );
+    }
+
+    bool usable( uint32_t index, int64_t now ) const
+    {
+        return read( index, [ now ]( const CompactLicense& record ) { return record.usable( now ); } );
+    }
+
+    //The feature with this code, or false if the license doesn't have it.
+    bool feature( uint32_t index, std::string_view code, CompactFeature& feature ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        uint32_t id = m_strings.find( code );
+        const CompactFeature* found = id == StringPool::none ? nullptr : m_records.at( index ).feature( id );
+        if ( found != nullptr )
+            feature = *found;
+        return found != nullptr;
+    }
+
+    //Interned strings never move, so these stay valid for as long as the table.
+    std::string_view key( uint32_t index ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        return m_strings.get( m_records.at( index ).key );
+    }
+
+    std::string_view product( uint32_t index ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        return m_strings.get( m_records.at( index ).product );
+    }
+
+    std::string_view string( uint32_t id ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        return m_strings.get( id );
+    }
+
+    //Loads the license's cold data through the loader. Nothing is cached, so keep the result while it's needed.
+    LicenseColdData cold( uint32_t index ) const
+    {
+        if ( !m_loader )
+            throw std::logic_error( "the license table has no loader for cold data" );
+        return m_loader( std::string( key( index ) ) );
+    }
+
+    size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        return m_records.size();
+    }
+
+    //Heap bytes the table holds, without the allocator's own overhead.
+    size_t memoryBytes() const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        size_t bytes = m_records.capacity() * sizeof( CompactLicense ) + m_indexOfString.capacity() * sizeof( uint32_t ) +
+            m_strings.memoryBytes();
+        for ( const CompactLicense& record : m_records )
+            bytes += record.featureCount * sizeof( CompactFeature );
+        return bytes;
+    }
+
+    //Dates from the license are in local time, like ExpiryScheduler::fromDate() reads them. Dates that were never
+    //set (the year 1900) are 0, it doesn't expire. A date that is set but can't be read or doesn't fit in 32 bits
+    //(after 2106) is 1, long gone: 0 would turn a license we can't read the expiry of into one that never expires.
+    static uint32_t fromDate( tm date )
+    {
+        if ( date.tm_year < 70 )
+            return 0;
+        time_t t = mktime( &date );
+        return t == (time_t)-1 || t <= 0 || (int64_t)t > 0xFFFFFFFFLL ? 1 : (uint32_t)t;
+    }
+
+private:
+    //Readers go through m_gate so a steady stream of them can't keep add() out, see LicenseStore.h.
+    std::shared_lock<std::shared_mutex> lockForReading() const
+    {
+        std::lock_guard<std::mutex> gate( m_gate );
+        return std::shared_lock<std::shared_mutex>( m_mutex );
+    }
+
+    std::unique_lock<std::shared_mutex> lockForWriting()
+    {
+        std::lock_guard<std::mutex> gate( m_gate );
+        return std::unique_lock<std::shared_mutex>( m_mutex );
+    }
+
+    ColdLoader m_loader;
+    mutable std::shared_mutex m_mutex;
+    mutable std::mutex m_gate;
+    StringPool m_strings;
+    std::vector<CompactLicense> m_records;
+    std::vector<uint32_t> m_indexOfString; //string id -> index of the license with that key, npos for other strings
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+//One request for a whole periodic sync. Refreshing a license in the samples takes a round trip per call: check(),
+//syncConsumption( -1 ), syncFeatureConsumption() for each feature, sendDeviceVariables() and
+//getDeviceVariables( true ). CompositeSync collects consumptions and device variables as they happen, and sync()
+//sends all of them, with the check and the fetch of the device variables, as one POST to /api/v4/sync. An hourly
+//sync becomes one round trip instead of seven or eight.
+//
+//The LicenseSpring API doesn't have /api/v4/sync (yet), only the local mock does (see MockLicenseApi::sync in
+//MockServer.h for the request and the answer), so like the mock this is Linux only and for trying the idea out.
+//Against the real servers, keep using the SDK calls.
+//
+//Every batch of changes goes out with a sync_id. If a sync fails in a way that leaves us not knowing whether the
+//server applied it (no answer, a timeout, a 5xx), the next sync() sends that same batch again under the same id,
+//and the server answers a repeated id with what it answered the first time instead of applying it again. What was
+//added in the meantime goes with the sync after that.
+//
+//    CompositeSync sync( licenseKey, hardwareId, post );
+//    sync.addConsumption( 1 );
+//    sync.addFeatureConsumption( "feature1", 2 );
+//    sync.setVariable( "last_session", "42" );
+//    SyncResult result = sync.sync(); //one round trip
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "MockServer.h"
+
+//A part of a sync the server refused, e.g. a feature consumption over the feature's limit. The rest of the sync
+//still went through.
+struct SyncRejection
+{
+    std::string part; //"consumptions" or "feature_consumptions.<code>"
+    std::string code; //the error code the separate endpoint would have answered with
+    std::string message;
+};
+
+struct SyncResult
+{
+    uint64_t version = 0; //the license's version after the sync, sent with the next one
+    //The license changed since the last sync other than by our own consumptions (or this is the first sync), and
+    //licenseFields has the top level of the license as the check endpoint would answer it.
+    bool licenseChanged = false;
+    MockParams licenseFields;
+    long long totalConsumptions = -1; //-1 if no consumptions were sent
+    std::map<std::string, long long> featureConsumptions; //totals of the features consumptions were sent for
+    bool fetchedVariables = false;
+    std::map<std::string, std::string> variables;
+    std::vector<SyncRejection> rejected;
+};
+
+//The server answered the sync with an error for the whole of it, e.g. the license is disabled or isn't active
+//on this device. code() is the error code the check endpoint would have answered with.
+class CompositeSyncException : public std::runtime_error
+{
+public:
+    CompositeSyncException( int status, const std::string& code, const std::string& message )
+        : std::runtime_error( message ), m_status( status ), m_code( code )
+    {}
+
+    int status() const { return m_status; }
+    const std::string& code() const { return m_code; }
+
+private:
+    int m_status;
+    std::string m_code;
+};
+
+class CompositeSync
+{
+public:
+    //Sends body to path on the license server and returns the HTTP status, with the answer's body in response.
+    //Throws std::runtime_error if the server can't be reached.
+    using Post = std::function<int( const std::string& path, const std::string& body, std::string& response )>;
+
+    //knownVersion is the version of the license we have, from the last sync. 0 gets the whole license back.
+    CompositeSync( const std::string& licenseKey, const std::string& hardwareId, Post post, uint64_t knownVersion = 0 )
+        : m_licenseKey( licenseKey ), m_hardwareId( hardwareId ), m_post( post ), m_version( knownVersion )
+    {
+        //Sync ids only have to be unique per license, a random prefix keeps two processes (or a restarted one) on
+        //the same license apart.
+        std::random_device random;
+        char prefix[ 17 ];
+        snprintf( prefix, sizeof( prefix ), "%08x%08x", (unsigned)random(), (unsigned)random() );
+        m_clientId = prefix;
+    }
+
+    void addConsumption( int64_t amount )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending.consumptions += amount;
+    }
+
+    void addFeatureConsumption( const std::string& code, int64_t amount )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending.features[ code ] += amount;
+    }
+
+    //Only the latest value of a variable is sent.
+    void setVariable( const std::string& name, const std::string& value )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending.variables[ name ] = value;
+    }
+
+    //Sends everything added since the last sync and checks the license, in one round trip, and with
+    //fetchVariables gets the device's variables back too.
+    //
+    //If the server can't be reached or fails (a 5xx), it may still have applied the sync, so the batch is kept as
+    //it is and the next sync() sends it again under the same sync_id; the exception (CompositeSyncException for a
+    //5xx) is passed on. If the server refuses the whole sync (a 4xx), nothing was applied: the batch goes back into
+    //the pending changes, and CompositeSyncException is thrown. Parts the server refused while applying the rest,
+    //e.g. a feature consumption over its limit, are not kept or sent again, they're listed in SyncResult::rejected
+    //for the app to deal with.
+    SyncResult sync( bool fetchVariables = true )
+    {
+        std::lock_guard<std::mutex> syncing( m_syncMutex );
+        uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( m_sendingId.empty() )
+            {
+                m_sending = Pending();
+                std::swap( m_sending, m_pending );
+                m_sendingId = m_clientId + "-" + std::to_string( ++m_sequence );
+            }
+            version = m_version;
+        }
+
+        std::string response;
+        int status = m_post( "/api/v4/sync", requestBody( m_sending, m_sendingId, version, fetchVariables ), response );
+        if ( status != 200 )
+        {
+            if ( status < 500 )
+            {
+                putBack( m_sending );
+                m_sendingId.clear();
+            }
+            MockParams error;
+            parseJsonObject( response.data(), response.data() + response.size(), error );
+            throw CompositeSyncException( status, mockParam( error, "code", "" ),
+                mockParam( error, "message", "License server answered with HTTP " + std::to_string( status ) ) );
+        }
+
+        SyncResult result = parseResult( response );
+        m_sendingId.clear();
+        m_sending = Pending();
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_version = result.version;
+        return result;
+    }
+
+    uint64_t version() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_version;
+    }
+
+    //The request body for the pending changes, see MockLicenseApi::sync. Parts with nothing to send are left out,
+    //and so is the sync_id, which sync() only picks when it sends them.
+    std::string requestBody( bool fetchVariables = true ) const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return requestBody( m_pending, "", m_version, fetchVariables );
+    }
+
+private:
+    struct Pending
+    {
+        int64_t consumptions = 0;
+        std::map<std::string, int64_t> features;
+        std::map<std::string, std::string> variables;
+    };
+
+    std::string requestBody( const Pending& pending, const std::string& syncId, uint64_t version, bool fetchVariables ) const
+    {
+        std::string body = "{\"license_key\":\"" + jsonEscape( m_licenseKey ) + "\",\"hardware_id\":\"" +
+            jsonEscape( m_hardwareId ) + "\",\"version\":" + std::to_string( version );
+        if ( !syncId.empty() )
+            body += ",\"sync_id\":\"" + syncId + "\"";
+        if ( pending.consumptions != 0 )
+            body += ",\"consumptions\":" + std::to_string( pending.consumptions );
+        if ( !pending.features.empty() )
+        {
+            const char* separator = "{\"";
+            body += ",\"feature_consumptions\":";
+            for ( const auto& feature : pending.features )
+            {
+                body += separator + jsonEscape( feature.first ) + "\":" + std::to_string( feature.second );
+                separator = ",\"";
+            }
+            body += "}";
+        }
+        if ( !pending.variables.empty() )
+        {
+            const char* separator = "{\"";
+            body += ",\"variables\":";
+            for ( const auto& variable : pending.variables )
+            {
+                body += separator + jsonEscape( variable.first ) + "\":\"" + jsonEscape( variable.second ) + "\"";
+                separator = ",\"";
+            }
+            body += "}";
+        }
+        if ( fetchVariables )
+            body += ",\"get_variables\":true";
+        return body + "}";
+    }
+
+    //Merges a sync the server refused back in front of what was added while it was out. Variables set in the
+    //meantime are newer, so they win.
+    void putBack( const Pending& sent )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending.consumptions += sent.consumptions;
+        for ( const auto& feature : sent.features )
+            m_pending.features[ feature.first ] += feature.second;
+        for ( const auto& variable : sent.variables )
+            m_pending.variables.insert( variable );
+    }
+
+    static SyncResult parseResult( const std::string& response )
+    {
+        MockParams fields;
+        if ( !parseJsonObject( response.data(), response.data() + response.size(), fields ) )
+            throw std::runtime_error( "could not read the sync answer" );
+        SyncResult result;
+        result.version = (uint64_t)mockIntParam( fields, "version", 0 );
+        result.totalConsumptions = mockIntParam( fields, "total_consumptions", -1 );
+        if ( const std::string* license = mockParam( fields, "license" ) )
+        {
+            result.licenseChanged = true;
+            parseJsonObject( license->data(), license->data() + license->size(), result.licenseFields );
+        }
+        if ( const std::string* features = mockParam( fields, "feature_consumptions" ) )
+        {
+            MockParams totals;
+            parseJsonObject( features->data(), features->data() + features->size(), totals );
+            for ( const auto& total : totals )
+                result.featureConsumptions[ total.first ] = atoll( total.second.c_str() );
+        }
+        if ( const std::string* variables = mockParam( fields, "variables" ) )
+        {
+            result.fetchedVariables = true;
+            eachObject( *variables, [ &result ]( const MockParams& variable )
+                {
+                    result.variables[ mockParam( variable, "variable", "" ) ] = mockParam( variable, "value", "" );
+                } );
+        }
+        if ( const std::string* rejected = mockParam( fields, "rejected" ) )
+        {
+            eachObject( *rejected, [ &result ]( const MockParams& part )
+                {
+                    MockParams error;
+                    std::string raw = mockParam( part, "error", "{}" );
+                    parseJsonObject( raw.data(), raw.data() + raw.size(), error );
+                    result.rejected.push_back( SyncRejection{ mockParam( part, "part", "" ), mockParam( error, "code", "" ),
+                        mockParam( error, "message", "" ) } );
+                } );
+        }
+        return result;
+    }
+
+    //Calls f with the top level of each object in a JSON array of objects.
+    static void eachObject( const std::string& array, const std::function<void( const MockParams& )>& f )
+    {
+        int depth = 0;
+        bool inString = false;
+        size_t start = 0;
+        for ( size_t i = 0; i < array.size(); i++ )
+        {
+            char c = array[ i ];
+            if ( inString )
+            {
+                if ( c == '\\' )
+                    i++;
+                else if ( c == '"' )
+                    inString = false;
+            }
+            else if ( c == '"' )
+                inString = true;
+            else if ( c == '{' && depth++ == 0 )
+                start = i;
+            else if ( c == '}' && --depth == 0 )
+            {
+                MockParams object;
+                if ( parseJsonObject( array.data() + start, array.data() + i + 1, object ) )
+                    f( object );
+            }
+        }
+    }
+
+    std::string m_licenseKey;
+    std::string m_hardwareId;
+    Post m_post;
+
+    mutable std::mutex m_mutex;
+    Pending m_pending;
+    uint64_t m_version;
+    std::mutex m_syncMutex; //one sync at a time, so a failed one is put back before the next takes the pending changes
+    //The batch sync() is sending, and its sync_id. The id stays set until the server has answered it, so a batch
+    //that may have been applied is sent again as it was. Only sync() uses these, under m_syncMutex.
+    std::string m_clientId;
+    uint64_t m_sequence = 0;
+    Pending m_sending;
+    std::string m_sendingId;
+};
@@ -0,0 +1,405 @@
+#pragma once
+
+//Append-only journal of consumption deltas. Saving every updateConsumption( 1, true ) or
+//updateFeatureConsumption( code, 1, true ) rewrites the whole local license file, which at thousands of events
+//per second means a lot of disk writes and fsyncs, and a crash in the middle of a rewrite can leave a corrupt
+//license file. Instead, each consumption is appended here as a small record, and the journal is folded into the
+//license file every now and then with a single rewrite (see compact()).
+//
+//File layout: an 8 byte header ("LSCJRNL1") followed by records, each framed as
+//    uint32 payload length | uint32 CRC-32 of payload | payload
+//    payload = uint64 seq | int32 delta | uint16 feature code length | feature code (empty for the license itself)
+//Appends are group committed: the writer (on a WorkerPool, or the journal's own thread) writes everything appended
+//since its last write in one go and fsyncs once, so many threads appending at once share one fsync. On open,
+//records are read back until the first record that is cut short or fails its CRC (the tail of a write that was
+//interrupted by a crash), and the file is truncated there.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+#include "WorkerPool.h"
+
+class ConsumptionJournal
+{
+public:
+    //Consumptions per feature code that are in the journal but not yet in the license file. The empty code is
+    //the license's own consumption.
+    using Totals = std::map<std::string, int64_t>;
+
+    //appliedThrough is the sequence number of the last record already folded into the license file (see
+    //compact()). Records up to it are skipped when the journal is read back. The writer runs on pool at high
+    //priority if one is given, since appendDurable() callers are waiting for it.
+    ConsumptionJournal( const std::string& path, uint64_t appliedThrough = 0, WorkerPool* pool = nullptr )
+        : m_path( path ), m_lastSeq( appliedThrough ), m_durableSeq( appliedThrough ), m_loop( pool, TaskPriority::High )
+    {
+        openAndRecover( appliedThrough );
+        m_loop.start( [ this ]() { return writeStep(); } );
+    }
+
+    ~ConsumptionJournal()
+    {
+        m_loop.stop();
+        //Whatever was appended since the last group goes out now, without waiting for the window.
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if ( !m_buffer.empty() && !m_failed )
+            writeGroup( lock );
+        closeFile();
+    }
+
+    ConsumptionJournal( const ConsumptionJournal& ) = delete;
+    ConsumptionJournal& operator=( const ConsumptionJournal& ) = delete;
+
+    //Adds a record and returns its sequence number straight away. The record is durable once waitDurable( seq )
+    //returns. After a failed write the journal takes no more records, and this throws std::runtime_error.
+    uint64_t append( const std::string& feature, int32_t delta )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_failed )
+            throw std::runtime_error( "could not write consumption journal " + m_path );
+        uint64_t seq = ++m_lastSeq;
+        bool first = m_buffer.empty();
+        frame( m_buffer, seq, feature, delta );
+        m_bufferTotals[feature] += delta;
+        //Later appends join the group the first one started, so only the first wakes the writer.
+        if ( first )
+            m_loop.wake();
+        return seq;
+    }
+
+    void waitDurable( uint64_t seq )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_durable.wait( lock, [ this, seq ]() { return m_durableSeq >= seq || m_failed; } );
+        if ( m_durableSeq < seq )
+            throw std::runtime_error( "could not write consumption journal " + m_path );
+    }
+
+    //Appends and waits for the record to hit the disk.
+    uint64_t appendDurable( const std::string& feature, int32_t delta )
+    {
+        uint64_t seq = append( feature, delta );
+        waitDurable( seq );
+        return seq;
+    }
+
+    //How long the writer waits for more records before writing a group. 0 writes as soon as anything arrives,
+    //which still groups whatever was appended while the previous fsync was running.
+    void setGroupCommitWindow( std::chrono::microseconds window )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_window = window;
+    }
+
+    //Only records that made it to disk are counted.
+    Totals unapplied() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_unapplied;
+    }
+
+    uint64_t lastSeq() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_lastSeq;
+    }
+
+    uint64_t fsyncCount() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_fsyncs;
+    }
+
+    //Folds the journal into the license file. apply() gets the summed consumptions and the sequence number of
+    //the last record they cover, and must write both to the license file in one save (so that after a crash we
+    //know which records are already in it). After apply() returns the journal is emptied. Appends wait while
+    //this runs.
+    void compact( const std::function<void( const Totals&, uint64_t )>& apply )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_durable.wait( lock, [ this ]() { return ( m_buffer.empty() || m_failed ) && !m_writing; } );
+        if ( m_unapplied.empty() )
+            return;
+        apply( m_unapplied, m_durableSeq );
+        m_unapplied.clear();
+        truncateTo( s_headerSize );
+        syncFile();
+        m_fileSize = s_headerSize;
+    }
+
+    //Bytes thrown away when the journal was opened, i.e. the torn tail of an interrupted write.
+    size_t recoveredBytes() const { return m_recoveredBytes; }
+
+    static uint32_t crc32( const uint8_t* data, size_t size )
+    {
+        static uint32_t table[256] = {};
+        static std::once_flag once;
+        std::call_once( once, []()
+            {
+                for ( uint32_t i = 0; i < 256; i++ )
+                {
+                    uint32_t c = i;
+                    for ( int k = 0; k < 8; k++ )
+                        c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+                    table[i] = c;
+                }
+            } );
+        uint32_t crc = 0xFFFFFFFFu;
+        for ( size_t i = 0; i < size; i++ )
+            crc = table[ ( crc ^ data[i] ) & 0xFF ] ^ ( crc >> 8 );
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+private:
+    static constexpr const char* s_header = "LSCJRNL1";
+    static constexpr size_t s_headerSize = 8;
+    static constexpr size_t s_frameHeader = 8;
+    static constexpr size_t s_maxPayload = 8 + 4 + 2 + 0xFFFF;
+
+    static void put( std::vector<uint8_t>& out, const void* data, size_t size )
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>( data );
+        out.insert( out.end(), bytes, bytes + size );
+    }
+
+    static void frame( std::vector<uint8_t>& out, uint64_t seq, const std::string& feature, int32_t delta )
+    {
+        uint16_t codeLength = (uint16_t)std::min<size_t>( feature.size(), 0xFFFF );
+        std::vector<uint8_t> payload;
+        payload.reserve( 14 + codeLength );
+        put( payload, &seq, sizeof( seq ) );
+        put( payload, &delta, sizeof( delta ) );
+        put( payload, &codeLength, sizeof( codeLength ) );
+        put( payload, feature.data(), codeLength );
+
+        uint32_t length = (uint32_t)payload.size();
+        uint32_t crc = crc32( payload.data(), payload.size() );
+        put( out, &length, sizeof( length ) );
+        put( out, &crc, sizeof( crc ) );
+        put( out, payload.data(), payload.size() );
+    }
+
+    void openAndRecover( uint64_t appliedThrough )
+    {
+#ifdef _WIN32
+        m_fd = _open( m_path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+        m_fd = ::open( m_path.c_str(), O_RDWR | O_CREAT, 0644 );
+#endif
+        if ( m_fd < 0 )
+            throw std::runtime_error( "could not open consumption journal " + m_path );
+
+        std::vector<uint8_t> data;
+        uint8_t chunk[65536];
+        for ( ;; )
+        {
+            auto n = readFile( chunk, sizeof( chunk ) );
+            if ( n <= 0 )
+                break;
+            data.insert( data.end(), chunk, chunk + n );
+        }
+
+        size_t good = 0;
+        if ( data.size() >= s_headerSize && memcmp( data.data(), s_header, s_headerSize ) == 0 )
+        {
+            size_t pos = s_headerSize;
+            good = pos;
+            while ( pos + s_frameHeader <= data.size() )
+            {
+                uint32_t length, crc;
+                memcpy( &length, &data[pos], 4 );
+                memcpy( &crc, &data[pos + 4], 4 );
+                if ( length < 14 || length > s_maxPayload || pos + s_frameHeader + length > data.size() )
+                    break;
+                const uint8_t* payload = &data[pos + s_frameHeader];
+                if ( crc32( payload, length ) != crc )
+                    break;
+
+                uint64_t seq;
+                int32_t delta;
+                uint16_t codeLength;
+                memcpy( &seq, payload, 8 );
+                memcpy( &delta, payload + 8, 4 );
+                memcpy( &codeLength, payload + 12, 2 );
+                if ( 14u + codeLength != length )
+                    break;
+                if ( seq > appliedThrough )
+                {
+                    m_unapplied[ std::string( (const char*)payload + 14, codeLength ) ] += delta;
+                    m_lastSeq = std::max( m_lastSeq, seq );
+                }
+                pos += s_frameHeader + length;
+                good = pos;
+            }
+        }
+        m_recoveredBytes = data.size() - good;
+        m_durableSeq = m_lastSeq;
+
+        //Anything after the last good record is a torn write, so we cut it off. A missing or damaged header means
+        //the journal is unusable and it starts over.
+        if ( good == 0 )
+        {
+            truncateTo( 0 );
+            writeFile( (const uint8_t*)s_header, s_headerSize );
+        }
+        else if ( good < data.size() )
+            truncateTo( good );
+        m_fileSize = good == 0 ? s_headerSize : good;
+        seekEnd();
+        syncFile();
+    }
+
+    //One turn of the writer (see BackgroundLoop in WorkerPool.h): the first record of a group opens the window,
+    //and when it closes the group is written.
+    Clock::steady_time writeStep()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if ( m_buffer.empty() || m_failed )
+            return BackgroundLoop::idle();
+        if ( m_window.count() > 0 && !m_windowOpen )
+        {
+            m_windowOpen = true;
+            return std::chrono::steady_clock::now() + m_window;
+        }
+        m_windowOpen = false;
+        writeGroup( lock );
+        return BackgroundLoop::idle();
+    }
+
+    //A group's consumptions only count as unapplied once it's on disk. If the write fails, part of the group may
+    //have made it, so the file is cut back to the end of the last good group: otherwise records appended after
+    //it would sit behind a torn frame, and be lost when the journal is read back even though they were reported
+    //durable. The journal then refuses further appends, and the failed group's consumptions are dropped, so a
+    //caller that retries after the exception doesn't count them twice.
+    void writeGroup( std::unique_lock<std::mutex>& lock )
+    {
+        std::vector<uint8_t> group;
+        group.swap( m_buffer );
+        Totals groupTotals;
+        groupTotals.swap( m_bufferTotals );
+        uint64_t groupEnd = m_lastSeq;
+        m_writing = true;
+        lock.unlock();
+
+        bool ok = writeFile( group.data(), group.size() ) && syncFile();
+        if ( !ok )
+        {
+            truncateTo( m_fileSize );
+            syncFile();
+        }
+
+        lock.lock();
+        m_writing = false;
+        m_fsyncs++;
+        if ( ok )
+        {
+            m_durableSeq = groupEnd;
+            m_fileSize += group.size();
+            for ( const auto& total : groupTotals )
+                m_unapplied[ total.first ] += total.second;
+        }
+        else
+        {
+            m_failed = true;
+            m_buffer.clear();
+            m_bufferTotals.clear();
+        }
+        m_durable.notify_all();
+    }
+
+    long long readFile( uint8_t* data, size_t size )
+    {
+#ifdef _WIN32
+        return _read( m_fd, data, (unsigned)size );
+#else
+        return ::read( m_fd, data, size );
+#endif
+    }
+
+    bool writeFile( const uint8_t* data, size_t size )
+    {
+        while ( size > 0 )
+        {
+#ifdef _WIN32
+            int n = _write( m_fd, data, (unsigned)size );
+#else
+            ssize_t n = ::write( m_fd, data, size );
+#endif
+            if ( n <= 0 )
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool syncFile()
+    {
+#ifdef _WIN32
+        return _commit( m_fd ) == 0;
+#else
+        return fdatasync( m_fd ) == 0;
+#endif
+    }
+
+    bool truncateTo( size_t size )
+    {
+#ifdef _WIN32
+        bool ok = _chsize( m_fd, (long)size ) == 0;
+#else
+        bool ok = ftruncate( m_fd, size ) == 0;
+#endif
+        seekEnd();
+        return ok;
+    }
+
+    void seekEnd()
+    {
+#ifdef _WIN32
+        _lseek( m_fd, 0, SEEK_END );
+#else
+        lseek( m_fd, 0, SEEK_END );
+#endif
+    }
+
+    void closeFile()
+    {
+#ifdef _WIN32
+        _close( m_fd );
+#else
+        ::close( m_fd );
+#endif
+    }
+
+    std::string m_path;
+    int m_fd = -1;
+    size_t m_recoveredBytes = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_durable;
+    std::vector<uint8_t> m_buffer;
+    Totals m_bufferTotals; //consumptions in m_buffer, not on disk yet
+    Totals m_unapplied;
+    size_t m_fileSize = 0; //end of the last group that made it to disk
+    uint64_t m_lastSeq;
+    uint64_t m_durableSeq;
+    uint64_t m_fsyncs = 0;
+    bool m_writing = false;
+    bool m_failed = false;
+    bool m_windowOpen = false;
+    std::chrono::microseconds m_window = std::chrono::microseconds( 0 );
+    BackgroundLoop m_loop; //declared last, so it's stopped before the rest goes away
+};
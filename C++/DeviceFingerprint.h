@@ -0,0 +1,592 @@
+#pragma once
+
+//The device's hardware ID and network info, worked out once and cached in a small file instead of on every startup.
+//With options.collectNetworkInfo( true ), the SDK goes through the hardware and every network adapter each time the
+//app starts, which on machines with many adapters (VDI hosts, servers with virtual NICs) takes hundreds of
+//milliseconds before the app can do anything.
+//
+//    DeviceFingerprint device( DeviceFingerprint::defaultCachePath( appName ), sharedKey, []()
+//        {
+//            return ...->getDeviceId(); //the SDK's own hardware ID, only asked for when the cache is stale
+//        } );
+//    options.setHardwareID( device.hardwareId() ); //from the cache, or from the SDK now if the cache is stale
+//    options.collectNetworkInfo( false );          //we collect it ourselves, off the startup path
+//    device.prefetchNetworkInfo();                 //starts collecting in the background if it isn't cached
+//    ...
+//    device.sendNetworkInfo( license );            //only this waits for it
+//
+//The hardware ID is always the one the SDK works out, we only remember it, so devices that were activated before
+//keep their activations. The cache is only used while its invalidation key matches: the boot ID and a hash of the
+//network adapters' names and MAC addresses. Both are cheap to read, and a reboot or an adapter coming or going
+//means the network info may have changed, so everything is worked out again.
+//
+//The cache lives in the user's own cache folder (see defaultCachePath()), readable only by the user, and is signed
+//with a key only the app knows, bound to this machine. A cache that was edited, or copied from another device, fails
+//the signature and is ignored, so the ID comes from the SDK again. The key is in the app, so this keeps out casual
+//edits and copied files, not someone who takes the app apart.
+#include <LicenseSpring/LicenseManager.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+#include <windows.h>
+#include <direct.h>
+#pragma comment( lib, "iphlpapi.lib" )
+#pragma comment( lib, "ws2_32.lib" )
+#else
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct NetworkAdapterInfo
+{
+    std::string name;
+    std::string mac;
+    std::vector<std::string> addresses; //IPv4 and IPv6, as text
+};
+
+struct DeviceNetworkInfo
+{
+    std::string hostname;
+    std::vector<NetworkAdapterInfo> adapters;
+
+    //Addresses and MACs of all adapters, comma separated, e.g. for device variables.
+    std::string addresses() const
+    {
+        std::string text;
+        for ( const NetworkAdapterInfo& adapter : adapters )
+            for ( const std::string& address : adapter.addresses )
+                text += ( text.empty() ? "" : "," ) + address;
+        return text;
+    }
+
+    std::string macs() const
+    {
+        std::string text;
+        for ( const NetworkAdapterInfo& adapter : adapters )
+            if ( !adapter.mac.empty() )
+                text += ( text.empty() ? "" : "," ) + adapter.mac;
+        return text;
+    }
+};
+
+class DeviceFingerprint
+{
+public:
+    //cachePath is where to keep the cache, see defaultCachePath(), an empty path means no cache. secret signs the
+    //cache, e.g. your shared key. computeId returns the SDK's own hardware ID.
+    DeviceFingerprint( const std::string& cachePath, const std::string& secret, std::function<std::string()> computeId )
+        : m_cachePath( cachePath ), m_secret( secret ), m_computeId( computeId )
+    {
+        load();
+    }
+
+    //A file in the user's own cache folder: %LOCALAPPDATA%\appName\device.cache on Windows, otherwise
+    //$XDG_CACHE_HOME/appName/device.cache or ~/.cache/appName/device.cache. Creates the folder, readable only by the
+    //user. Empty if there's no such folder, e.g. a service account without a home.
+    static std::string defaultCachePath( const std::string& appName )
+    {
+#ifdef _WIN32
+        const char* base = getenv( "LOCALAPPDATA" );
+        if ( base == nullptr || *base == 0 )
+            return "";
+        std::string folder = std::string( base ) + "\\" + appName;
+        _mkdir( folder.c_str() );
+        return folder + "\\device.cache";
+#else
+        std::string folder;
+        const char* cache = getenv( "XDG_CACHE_HOME" );
+        const char* home = getenv( "HOME" );
+        if ( cache != nullptr && *cache == '/' )
+            folder = cache;
+        else if ( home != nullptr && *home == '/' )
+        {
+            folder = std::string( home ) + "/.cache";
+            mkdir( folder.c_str(), 0700 );
+        }
+        else
+            return "";
+        folder += "/" + appName;
+        mkdir( folder.c_str(), 0700 );
+        return folder + "/device.cache";
+#endif
+    }
+
+    ~DeviceFingerprint()
+    {
+        //Don't leave the background collection running after we're gone.
+        if ( m_networkInfo.valid() )
+            m_networkInfo.wait();
+    }
+
+    //The hardware ID to pass to ExtendedOptions::setHardwareID(). From the cache when it's still valid, otherwise
+    //asked from the SDK now (without the network info, which is the slow part) and saved.
+    std::string hardwareId()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_hardwareId.empty() )
+        {
+            m_hardwareId = m_computeId();
+            saveLocked();
+        }
+        return m_hardwareId;
+    }
+
+    //Whether the cache was valid when we started.
+    bool cacheHit() const { return m_cacheHit; }
+
+    //Starts collecting the network info in the background, unless it's cached. Call it early, e.g. right after
+    //creating the configuration, so it's likely done by the time something sends it.
+    void prefetchNetworkInfo()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        prefetchLocked();
+    }
+
+    //The network info, waiting for it to be collected if it isn't cached.
+    DeviceNetworkInfo networkInfo()
+    {
+        std::shared_future<DeviceNetworkInfo> collecting;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            prefetchLocked();
+            collecting = m_networkInfo;
+        }
+        return collecting.get();
+    }
+
+    //Sends the network info to the LicenseSpring servers as device variables, since the SDK doesn't collect it
+    //with collectNetworkInfo( false ). Goes online, so call it where the app already does, e.g. after activation.
+    void sendNetworkInfo( LicenseSpring::License::ptr_t license )
+    {
+        DeviceNetworkInfo info = networkInfo();
+        license->addDeviceVariable( "hostname", info.hostname );
+        license->addDeviceVariable( "ip_addresses", info.addresses() );
+        license->addDeviceVariable( "mac_addresses", info.macs() );
+        license->sendDeviceVariables();
+    }
+
+    //Changes when the device reboots or its network adapters change. Reads only a few small system files (or, on
+    //Windows, the adapter list without DNS and address details), so it's cheap enough to check on every startup.
+    static std::string invalidationKey()
+    {
+        return bootId() + "/" + toHex( hash( adapterList() ) );
+    }
+
+private:
+    void prefetchLocked()
+    {
+        if ( m_networkInfo.valid() )
+            return;
+        m_networkInfo = std::async( std::launch::async, [ this ]()
+            {
+                DeviceNetworkInfo info = collectNetworkInfo();
+                std::lock_guard<std::mutex> lock( m_mutex );
+                m_cachedNetworkInfo = info;
+                m_networkInfoCached = true;
+                saveLocked();
+                return info;
+            } ).share();
+    }
+
+    //Cache file: one "name value" pair a line, adapters as "adapter name mac address address ...", and last
+    //"signature" and the signature of everything before it.
+    void load()
+    {
+        if ( m_cachePath.empty() )
+            return;
+        std::ifstream in( m_cachePath, std::ios::binary );
+        std::string text( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+        size_t at = text.rfind( "signature " );
+        if ( at == std::string::npos || text.substr( at + 10, 64 ) != sign( text.substr( 0, at ) ) )
+            return;
+        std::istringstream file( text.substr( 0, at ) );
+        std::string line, key;
+        if ( !std::getline( file, line ) || line != "key " + invalidationKey() )
+            return;
+        DeviceNetworkInfo info;
+        bool hasNetworkInfo = false;
+        std::string hardwareId;
+        while ( std::getline( file, line ) )
+        {
+            std::istringstream fields( line );
+            fields >> key;
+            if ( key == "hardware_id" )
+                fields >> hardwareId;
+            else if ( key == "hostname" )
+            {
+                fields >> info.hostname;
+                hasNetworkInfo = true;
+            }
+            else if ( key == "adapter" )
+            {
+                NetworkAdapterInfo adapter;
+                fields >> adapter.name >> adapter.mac;
+                if ( adapter.mac == "-" )
+                    adapter.mac.clear();
+                std::string address;
+                while ( fields >> address )
+                    adapter.addresses.push_back( address );
+                info.adapters.push_back( adapter );
+            }
+        }
+        if ( hardwareId.empty() )
+            return;
+        m_hardwareId = hardwareId;
+        m_cacheHit = true;
+        if ( hasNetworkInfo )
+        {
+            std::promise<DeviceNetworkInfo> cached;
+            cached.set_value( info );
+            m_networkInfo = cached.get_future().share();
+            m_cachedNetworkInfo = info;
+            m_networkInfoCached = true;
+        }
+    }
+
+    //Written to a temporary file first and renamed, so a crash can't leave half a cache behind.
+    void saveLocked()
+    {
+        if ( m_cachePath.empty() )
+            return;
+        std::string temporary = m_cachePath + ".tmp";
+        std::ostringstream file;
+        file << "key " << invalidationKey() << "\n";
+        file << "hardware_id " << m_hardwareId << "\n";
+        if ( m_networkInfoCached )
+        {
+            file << "hostname " << m_cachedNetworkInfo.hostname << "\n";
+            for ( const NetworkAdapterInfo& adapter : m_cachedNetworkInfo.adapters )
+            {
+                file << "adapter " << adapter.name << " " << ( adapter.mac.empty() ? "-" : adapter.mac );
+                for ( const std::string& address : adapter.addresses )
+                    file << " " << address;
+                file << "\n";
+            }
+        }
+        std::string text = file.str();
+        text += "signature " + sign( text ) + "\n";
+
+#ifdef _WIN32
+        //%LOCALAPPDATA% is already only readable by the user.
+        {
+            std::ofstream out( temporary, std::ios::binary | std::ios::trunc );
+            out.write( text.data(), (std::streamsize)text.size() );
+            if ( !out )
+                return; //no cache, we'll just work it out again next time
+        }
+        std::remove( m_cachePath.c_str() ); //rename() doesn't replace on Windows
+#else
+        int fd = ::open( temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+        if ( fd < 0 )
+            return;
+        fchmod( fd, 0600 ); //in case the temporary file was left behind by someone else's umask
+        bool written = ::write( fd, text.data(), text.size() ) == (ssize_t)text.size();
+        ::close( fd );
+        if ( !written )
+        {
+            std::remove( temporary.c_str() );
+            return;
+        }
+#endif
+        std::rename( temporary.c_str(), m_cachePath.c_str() );
+    }
+
+    //HMAC-SHA256 of the cache's contents and this machine's ID, keyed with the app's secret, as hex.
+    std::string sign( const std::string& text ) const
+    {
+        std::string key = m_secret.size() > 64 ? sha256( m_secret ) : m_secret;
+        key.resize( 64, 0 );
+        std::string inner = key, outer = key;
+        for ( size_t i = 0; i < 64; i++ )
+        {
+            inner[ i ] ^= 0x36;
+            outer[ i ] ^= 0x5c;
+        }
+        std::string mac = sha256( outer + sha256( inner + machineId() + "\n" + text ) );
+        std::string hex;
+        char part[ 3 ];
+        for ( unsigned char c : mac )
+        {
+            snprintf( part, sizeof( part ), "%02x", c );
+            hex += part;
+        }
+        return hex;
+    }
+
+    static std::string sha256( const std::string& data )
+    {
+        static const uint32_t k[ 64 ] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+        uint32_t h[ 8 ] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+            0x5be0cd19 };
+        auto rotate = []( uint32_t x, int n ) { return ( x >> n ) | ( x << ( 32 - n ) ); };
+
+        std::string message = data;
+        uint64_t bits = (uint64_t)data.size() * 8;
+        message += (char)0x80;
+        while ( message.size() % 64 != 56 )
+            message += (char)0;
+        for ( int i = 7; i >= 0; i-- )
+            message += (char)( bits >> ( i * 8 ) );
+
+        for ( size_t block = 0; block < message.size(); block += 64 )
+        {
+            uint32_t w[ 64 ];
+            for ( int i = 0; i < 16; i++ )
+            {
+                const unsigned char* bytes = (const unsigned char*)message.data() + block + i * 4;
+                w[ i ] = (uint32_t)bytes[ 0 ] << 24 | (uint32_t)bytes[ 1 ] << 16 | (uint32_t)bytes[ 2 ] << 8 | bytes[ 3 ];
+            }
+            for ( int i = 16; i < 64; i++ )
+                w[ i ] = w[ i - 16 ] + ( rotate( w[ i - 15 ], 7 ) ^ rotate( w[ i - 15 ], 18 ) ^ ( w[ i - 15 ] >> 3 ) ) +
+                    w[ i - 7 ] + ( rotate( w[ i - 2 ], 17 ) ^ rotate( w[ i - 2 ], 19 ) ^ ( w[ i - 2 ] >> 10 ) );
+            uint32_t v[ 8 ];
+            std::copy( h, h + 8, v );
+            for ( int i = 0; i < 64; i++ )
+            {
+                uint32_t t1 = v[ 7 ] + ( rotate( v[ 4 ], 6 ) ^ rotate( v[ 4 ], 11 ) ^ rotate( v[ 4 ], 25 ) ) +
+                    ( ( v[ 4 ] & v[ 5 ] ) ^ ( ~v[ 4 ] & v[ 6 ] ) ) + k[ i ] + w[ i ];
+                uint32_t t2 = ( rotate( v[ 0 ], 2 ) ^ rotate( v[ 0 ], 13 ) ^ rotate( v[ 0 ], 22 ) ) +
+                    ( ( v[ 0 ] & v[ 1 ] ) ^ ( v[ 0 ] & v[ 2 ] ) ^ ( v[ 1 ] & v[ 2 ] ) );
+                std::copy_backward( v, v + 7, v + 8 );
+                v[ 4 ] += t1;
+                v[ 0 ] = t1 + t2;
+            }
+            for ( int i = 0; i < 8; i++ )
+                h[ i ] += v[ i ];
+        }
+
+        std::string digest;
+        for ( uint32_t word : h )
+            for ( int shift = 24; shift >= 0; shift -= 8 )
+                digest += (char)( word >> shift );
+        return digest;
+    }
+
+    static uint64_t hash( const std::string& text, uint64_t seed = 0xcbf29ce484222325ull )
+    {
+        //FNV-1a, it only has to tell inputs apart.
+        uint64_t value = seed;
+        for ( unsigned char c : text )
+        {
+            value ^= c;
+            value *= 0x100000001b3ull;
+        }
+        return value;
+    }
+
+    static std::string toHex( uint64_t value )
+    {
+        char text[ 17 ];
+        snprintf( text, sizeof( text ), "%016llx", (unsigned long long)value );
+        return text;
+    }
+
+    static std::string readLine( const std::string& path )
+    {
+        std::ifstream file( path );
+        std::string line;
+        std::getline( file, line );
+        return line;
+    }
+
+    static std::string hostname()
+    {
+        char name[ 256 ] = {};
+        gethostname( name, sizeof( name ) - 1 );
+        return name;
+    }
+
+    static std::string formatMac( const unsigned char* bytes, size_t length )
+    {
+        std::string mac;
+        char part[ 4 ];
+        for ( size_t i = 0; i < length; ++i )
+        {
+            snprintf( part, sizeof( part ), i == 0 ? "%02x" : ":%02x", bytes[ i ] );
+            mac += part;
+        }
+        return mac;
+    }
+
+#ifdef _WIN32
+    static std::string bootId()
+    {
+        //Windows has no boot ID, the boot time (to the minute, so it doesn't wobble) does the same job.
+        FILETIME now;
+        GetSystemTimeAsFileTime( &now );
+        uint64_t nowMs = ( ( (uint64_t)now.dwHighDateTime << 32 ) | now.dwLowDateTime ) / 10000;
+        return std::to_string( ( nowMs - GetTickCount64() ) / 60000 );
+    }
+
+    static std::string machineId()
+    {
+        char value[ 128 ] = {};
+        DWORD size = sizeof( value );
+        RegGetValueA( HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Cryptography", "MachineGuid",
+            RRF_RT_REG_SZ | RRF_SUBKEY_WOW6464KEY, nullptr, value, &size );
+        return value;
+    }
+
+    static std::vector<char> adapterBuffer( ULONG flags )
+    {
+        ULONG size = 16 * 1024;
+        std::vector<char> buffer( size );
+        ULONG result;
+        while ( ( result = GetAdaptersAddresses( AF_UNSPEC, flags, nullptr, (IP_ADAPTER_ADDRESSES*)buffer.data(), &size ) ) == ERROR_BUFFER_OVERFLOW )
+            buffer.resize( size );
+        if ( result != NO_ERROR )
+            buffer.clear();
+        return buffer;
+    }
+
+    static const ULONG listFlags = GAA_FLAG_SKIP_UNICAST | GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST |
+        GAA_FLAG_SKIP_DNS_SERVER | GAA_FLAG_SKIP_FRIENDLY_NAME;
+
+    static std::string adapterList()
+    {
+        std::vector<std::string> entries;
+        std::vector<char> buffer = adapterBuffer( listFlags );
+        for ( auto adapter = buffer.empty() ? nullptr : (IP_ADAPTER_ADDRESSES*)buffer.data(); adapter != nullptr; adapter = adapter->Next )
+            entries.push_back( std::string( adapter->AdapterName ) + "=" + formatMac( adapter->PhysicalAddress, adapter->PhysicalAddressLength ) );
+        std::sort( entries.begin(), entries.end() );
+        std::string list;
+        for ( const std::string& entry : entries )
+            list += entry + ";";
+        return list;
+    }
+
+    static DeviceNetworkInfo collectNetworkInfo()
+    {
+        WSADATA wsa;
+        WSAStartup( MAKEWORD( 2, 2 ), &wsa ); //for gethostname()
+        DeviceNetworkInfo info;
+        info.hostname = hostname();
+        std::vector<char> buffer = adapterBuffer( GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER );
+        for ( auto adapter = buffer.empty() ? nullptr : (IP_ADAPTER_ADDRESSES*)buffer.data(); adapter != nullptr; adapter = adapter->Next )
+        {
+            if ( adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK )
+                continue;
+            NetworkAdapterInfo entry;
+            entry.name = adapter->AdapterName;
+            entry.mac = formatMac( adapter->PhysicalAddress, adapter->PhysicalAddressLength );
+            for ( auto address = adapter->FirstUnicastAddress; address != nullptr; address = address->Next )
+            {
+                char text[ INET6_ADDRSTRLEN ] = {};
+                DWORD length = sizeof( text );
+                if ( WSAAddressToStringA( address->Address.lpSockaddr, address->Address.iSockaddrLength, nullptr, text, &length ) == 0 )
+                    entry.addresses.push_back( text );
+            }
+            info.adapters.push_back( entry );
+        }
+        WSACleanup();
+        return info;
+    }
+#else
+    static std::string bootId()
+    {
+        return readLine( "/proc/sys/kernel/random/boot_id" );
+    }
+
+    static std::string machineId()
+    {
+        std::string id = readLine( "/etc/machine-id" );
+        return id.empty() ? readLine( "/var/lib/dbus/machine-id" ) : id;
+    }
+
+    //Adapter names, sorted. Just a directory listing, nothing is opened.
+    static std::vector<std::string> adapterNames()
+    {
+        std::vector<std::string> names;
+        if ( DIR* dir = opendir( "/sys/class/net" ) )
+        {
+            while ( dirent* entry = readdir( dir ) )
+                if ( entry->d_name[ 0 ] != '.' )
+                    names.push_back( entry->d_name );
+            closedir( dir );
+        }
+        std::sort( names.begin(), names.end() );
+        return names;
+    }
+
+    static std::string adapterList()
+    {
+        std::string list;
+        for ( const std::string& name : adapterNames() )
+            list += name + "=" + readLine( "/sys/class/net/" + name + "/address" ) + ";";
+        return list;
+    }
+
+    static DeviceNetworkInfo collectNetworkInfo()
+    {
+        DeviceNetworkInfo info;
+        info.hostname = hostname();
+        for ( const std::string& name : adapterNames() )
+        {
+            if ( name == "lo" )
+                continue;
+            NetworkAdapterInfo adapter;
+            adapter.name = name;
+            adapter.mac = readLine( "/sys/class/net/" + name + "/address" );
+            info.adapters.push_back( adapter );
+        }
+        ifaddrs* addresses = nullptr;
+        if ( getifaddrs( &addresses ) != 0 )
+            return info;
+        for ( ifaddrs* address = addresses; address != nullptr; address = address->ifa_next )
+        {
+            if ( address->ifa_addr == nullptr || ( address->ifa_addr->sa_family != AF_INET && address->ifa_addr->sa_family != AF_INET6 ) )
+                continue;
+            char text[ INET6_ADDRSTRLEN ] = {};
+            const void* raw = address->ifa_addr->sa_family == AF_INET
+                ? (const void*)&( (sockaddr_in*)address->ifa_addr )->sin_addr
+                : (const void*)&( (sockaddr_in6*)address->ifa_addr )->sin6_addr;
+            inet_ntop( address->ifa_addr->sa_family, raw, text, sizeof( text ) );
+            for ( NetworkAdapterInfo& adapter : info.adapters )
+                if ( adapter.name == address->ifa_name )
+                    adapter.addresses.push_back( text );
+        }
+        freeifaddrs( addresses );
+        return info;
+    }
+#endif
+
+    std::string m_cachePath;
+    std::string m_secret;
+    std::function<std::string()> m_computeId;
+    std::mutex m_mutex;
+    std::string m_hardwareId;
+    bool m_cacheHit = false;
+    std::shared_future<DeviceNetworkInfo> m_networkInfo;
+    DeviceNetworkInfo m_cachedNetworkInfo;
+    bool m_networkInfoCached = false;
+};
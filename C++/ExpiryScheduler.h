@@ -0,0 +1,294 @@
+#pragma once
+
+//All of a license's deadlines in one place: when the license expires, when the maintenance period ends, when
+//each feature expires, when the trial ends and when the floating registration times out. They're read from the
+//license and converted to epoch milliseconds once per sync, instead of calling mktime() or isExpired() every time
+//we want to know. Checking a deadline is then one integer compare, and a timer thread fires callbacks at the
+//moment each one passes, in order, from a min-heap.
+#include <LicenseSpring/LicenseManager.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Clock.h"
+
+enum class DeadlineKind
+{
+    License,
+    Maintenance,
+    Feature,
+    Trial,
+    FloatingTimeout
+};
+
+inline const char* deadlineName( DeadlineKind kind )
+{
+    switch ( kind )
+    {
+    case DeadlineKind::License: return "license";
+    case DeadlineKind::Maintenance: return "maintenance period";
+    case DeadlineKind::Feature: return "feature";
+    case DeadlineKind::Trial: return "trial";
+    case DeadlineKind::FloatingTimeout: return "floating timeout";
+    }
+    return "unknown";
+}
+
+//What a deadline that isn't set is at.
+const int64_t noDeadline = std::numeric_limits<int64_t>::max();
+
+class ExpiryScheduler
+{
+public:
+    //Milliseconds since the epoch, on the scheduler's clock.
+    int64_t now()
+    {
+        return m_clock->epochMillis();
+    }
+
+    //Dates from the license are in local time, like version.cpp treats them. A date that was never set comes back
+    //as all zeroes (the year 1900), which means there's no deadline.
+    static int64_t fromDate( tm date )
+    {
+        if ( date.tm_year < 70 )
+            return noDeadline;
+        time_t t = mktime( &date );
+        return t == (time_t)-1 ? noDeadline : (int64_t)t * 1000;
+    }
+
+    //A deadline that can be checked without locking anything, from any thread. It follows the scheduler: when a
+    //sync moves the deadline, expired() sees the new one.
+    class Deadline
+    {
+    public:
+        Deadline() : m_at( std::make_shared<std::atomic<int64_t>>( noDeadline ) ), m_clock( SystemClock::instance() ) {}
+
+        bool expired() const
+        {
+            return expired( m_clock->epochMillis() );
+        }
+
+        bool expired( int64_t at ) const
+        {
+            return at >= m_at->load( std::memory_order_relaxed );
+        }
+
+        int64_t at() const { return m_at->load( std::memory_order_relaxed ); }
+
+    private:
+        friend class ExpiryScheduler;
+        Deadline( std::shared_ptr<std::atomic<int64_t>> at, std::shared_ptr<Clock> clock ) : m_at( at ), m_clock( clock ) {}
+        std::shared_ptr<std::atomic<int64_t>> m_at;
+        std::shared_ptr<Clock> m_clock;
+    };
+
+    //Called on the scheduler's thread with the kind of deadline, the feature code for features, and when it was.
+    using Callback = std::function<void( DeadlineKind, const std::string&, int64_t )>;
+
+    //Pass a SimulatedClock to see what happens when the deadlines pass without waiting for them, see Clock.h.
+    explicit ExpiryScheduler( std::shared_ptr<Clock> clock = SystemClock::instance() ) : m_clock( clock ) {}
+
+    ~ExpiryScheduler()
+    {
+        stop();
+    }
+
+    //Reads every deadline from the license. Call it after each check or sync, the floating timeout is counted
+    //from now, since a check registers a floating license again.
+    void sync( LicenseSpring::License::ptr_t license )
+    {
+        if ( license == nullptr )
+        {
+            clear();
+            return;
+        }
+        int64_t validity = fromDate( license->validityDate() );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        setLocked( DeadlineKind::License, "", validity );
+        setLocked( DeadlineKind::Trial, "", license->isTrial() ? validity : noDeadline );
+        setLocked( DeadlineKind::Maintenance, "", fromDate( license->maintenancePeriod() ) );
+        setLocked( DeadlineKind::FloatingTimeout, "",
+            license->isFloating() ? now() + (int64_t)license->floatingTimeout() * 60 * 1000 : noDeadline );
+
+        //Features that are no longer on the license don't expire any more.
+        std::map<std::string, int64_t> features;
+        for ( const LicenseSpring::LicenseFeature& feature : license->features() )
+            features[ feature.code() ] = fromDate( feature.expiryDate() );
+        for ( auto& entry : m_deadlines )
+            if ( entry.first.first == DeadlineKind::Feature && features.count( entry.first.second ) == 0 )
+                features[ entry.first.second ] = noDeadline;
+        for ( auto& feature : features )
+            setLocked( DeadlineKind::Feature, feature.first, feature.second );
+        updateNextLocked();
+    }
+
+    //Sets one deadline, e.g. the floating timeout after a registerFloatingLicense() outside a check.
+    void set( DeadlineKind kind, const std::string& feature, int64_t at )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        setLocked( kind, feature, at );
+        updateNextLocked();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        for ( auto& entry : m_deadlines )
+            setLocked( entry.first.first, entry.first.second, noDeadline );
+        updateNextLocked();
+    }
+
+    //A handle for the hot path, e.g. a feature that checks its expiry on every use. Asking for a deadline that
+    //isn't set yet is fine, it'll follow along once a sync sets it.
+    Deadline deadline( DeadlineKind kind, const std::string& feature = "" )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return Deadline( entryLocked( kind, feature ), m_clock );
+    }
+
+    bool expired( DeadlineKind kind, const std::string& feature = "" )
+    {
+        return deadline( kind, feature ).expired();
+    }
+
+    //The earliest deadline that hasn't fired yet, or noDeadline. A loop that would rather check than get called
+    //back can compare the time against this, and only look closer when it has passed.
+    int64_t next() const
+    {
+        return m_next.load( std::memory_order_relaxed );
+    }
+
+    bool anyDue()
+    {
+        return anyDue( now() );
+    }
+
+    bool anyDue( int64_t at ) const
+    {
+        return at >= next();
+    }
+
+    void onExpiry( Callback callback )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_callbacks.push_back( callback );
+    }
+
+    //Starts the thread that fires the callbacks. Deadlines that already passed fire right away.
+    void start()
+    {
+        stop();
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stopping = false;
+        m_thread = std::thread( [ this ]() { run(); } );
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        if ( m_thread.joinable() )
+            m_thread.join();
+    }
+
+private:
+    using key_t = std::pair<DeadlineKind, std::string>;
+
+    struct Scheduled
+    {
+        int64_t at;
+        key_t key;
+        bool operator>( const Scheduled& other ) const { return at > other.at; }
+    };
+
+    std::shared_ptr<std::atomic<int64_t>>& entryLocked( DeadlineKind kind, const std::string& feature )
+    {
+        std::shared_ptr<std::atomic<int64_t>>& entry = m_deadlines[ key_t( kind, feature ) ];
+        if ( entry == nullptr )
+            entry = std::make_shared<std::atomic<int64_t>>( noDeadline );
+        return entry;
+    }
+
+    void setLocked( DeadlineKind kind, const std::string& feature, int64_t at )
+    {
+        std::shared_ptr<std::atomic<int64_t>>& entry = entryLocked( kind, feature );
+        if ( entry->load() == at )
+            return; //Unchanged, so it doesn't fire again either.
+        entry->store( at );
+        //The old heap entry stays where it is and is skipped when it comes up, since it no longer matches.
+        if ( at != noDeadline )
+            m_heap.push( Scheduled{ at, key_t( kind, feature ) } );
+        m_rescheduled = true;
+        m_wake.notify_all();
+    }
+
+    bool currentLocked( const Scheduled& scheduled )
+    {
+        return m_deadlines[ scheduled.key ]->load() == scheduled.at;
+    }
+
+    //Drops heap entries for deadlines that moved, and caches the earliest one that's left.
+    void updateNextLocked()
+    {
+        while ( !m_heap.empty() && !currentLocked( m_heap.top() ) )
+            m_heap.pop();
+        int64_t next = noDeadline;
+        if ( !m_heap.empty() )
+            next = m_heap.top().at;
+        m_next.store( next, std::memory_order_relaxed );
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( !m_stopping )
+        {
+            updateNextLocked();
+            int64_t at = now();
+            if ( m_heap.empty() || m_heap.top().at > at )
+            {
+                //We wake up at least once a minute in case the system clock was changed, or once a day on a clock
+                //where that can't happen.
+                int64_t wait = m_heap.empty() ? noDeadline : m_heap.top().at - at;
+                wait = std::min<int64_t>( wait, m_clock->wallClockCanJump() ? 60 * 1000 : 24 * 60 * 60 * 1000 );
+                m_rescheduled = false;
+                m_clock->waitFor( lock, m_wake, std::chrono::milliseconds( wait ), [ this ]() { return m_stopping || m_rescheduled; } );
+                continue;
+            }
+
+            Scheduled due = m_heap.top();
+            m_heap.pop();
+            updateNextLocked();
+            std::vector<Callback> callbacks = m_callbacks;
+            lock.unlock();
+            for ( Callback& callback : callbacks )
+                callback( due.key.first, due.key.second, due.at );
+            lock.lock();
+        }
+    }
+
+    std::shared_ptr<Clock> m_clock;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_rescheduled = false;
+    std::map<key_t, std::shared_ptr<std::atomic<int64_t>>> m_deadlines;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> m_heap;
+    std::atomic<int64_t> m_next{ noDeadline };
+    std::vector<Callback> m_callbacks;
+    bool m_stopping = true;
+    std::thread m_thread;
+};
@@ -0,0 +1,426 @@
+#pragma once
+
+//Validating license files collected from many machines, e.g. from air-gapped sites for a compliance audit.
+//LocalLicenseCheck() in offline.cpp and LicenseCheck() in chatbot.cpp check the one license of the device they
+//run on; a compliance job has tens of thousands of files, each from a different device, and wants to know for each
+//whether it's genuine, for the right product, bound to the device it was collected from and not expired.
+//
+//The scan is driven by a manifest: a row per collected file with the product it should be for and the hardware ID
+//of the device it came from (see DeviceFingerprint.h). Files are spread over every core, each thread mapping the
+//next file into memory and handing it to a LicenseFileValidator:
+//
+//    LicenseSpringValidator validator( apiKey, sharedKey, appName, appVersion );
+//    FleetScanner scanner( validator );
+//    FleetReport report = scanner.scan( files );
+//    report.writeSummary( std::cout, files );
+//
+//Each file gets a ScanOutcome, one for each way LocalLicenseCheck() can fail (ProductMismatchException,
+//DeviceNotLicensedException, ClockTamperedException, ...). While a file is mapped its bytes are hashed too, so the
+//report also lists files that are byte for byte the same license collected from different devices: a license
+//copied from one machine to another, which fails the device check on all but one of them.
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum class ScanOutcome
+{
+    Valid,
+    Unreadable,        //missing, or couldn't be opened
+    Corrupt,           //LocalLicenseException: not a license file, or cut short
+    SignatureMismatch, //SignatureMismatchException: changed after the server signed it
+    ProductMismatch,   //ProductMismatchException
+    DeviceNotLicensed, //DeviceNotLicensedException: not bound to the device it was collected from
+    ClockTampered,     //ClockTamperedException
+    VMNotAllowed,      //VMIsNotAllowedException
+    Inactive,          //LicenseStateException, and the license isn't active
+    Expired,           //LicenseStateException, and the license has expired
+    Disabled,          //LicenseStateException, and the license is disabled
+    Failed             //any other error
+};
+
+const size_t scanOutcomeCount = (size_t)ScanOutcome::Failed + 1;
+
+inline const char* scanOutcomeName( ScanOutcome outcome )
+{
+    switch ( outcome )
+    {
+    case ScanOutcome::Valid: return "valid";
+    case ScanOutcome::Unreadable: return "unreadable";
+    case ScanOutcome::Corrupt: return "corrupt";
+    case ScanOutcome::SignatureMismatch: return "signature mismatch";
+    case ScanOutcome::ProductMismatch: return "product mismatch";
+    case ScanOutcome::DeviceNotLicensed: return "device not licensed";
+    case ScanOutcome::ClockTampered: return "clock tampered";
+    case ScanOutcome::VMNotAllowed: return "VM not allowed";
+    case ScanOutcome::Inactive: return "inactive";
+    case ScanOutcome::Expired: return "expired";
+    case ScanOutcome::Disabled: return "disabled";
+    default: return "failed";
+    }
+}
+
+class FleetScanException : public std::runtime_error
+{
+public:
+    explicit FleetScanException( const std::string& message ) : std::runtime_error( message ) {}
+};
+
+//A row of the manifest.
+struct FleetFile
+{
+    std::string path;
+    std::string productCode; //the product the license should be for
+    std::string hardwareId;  //the device it was collected from
+};
+
+struct FileScanResult
+{
+    ScanOutcome outcome = ScanOutcome::Failed;
+    std::string message; //what the validator said, if the file isn't valid
+    uint64_t bytes = 0;
+    uint64_t digest = 0; //FNV-1a of the file's bytes, to find copies
+};
+
+//A license file mapped read-only into memory, unmapped when it goes out of scope.
+class MappedFile
+{
+public:
+    explicit MappedFile( const std::string& path )
+    {
+#ifdef _WIN32
+        m_file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        if ( m_file == INVALID_HANDLE_VALUE )
+            throw FleetScanException( "could not open " + path );
+        LARGE_INTEGER size;
+        GetFileSizeEx( m_file, &size );
+        m_size = (size_t)size.QuadPart;
+        if ( m_size == 0 )
+            return;
+        m_mapping = CreateFileMappingA( m_file, NULL, PAGE_READONLY, 0, 0, NULL );
+        if ( m_mapping != NULL )
+            m_data = static_cast<const uint8_t*>( MapViewOfFile( m_mapping, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+        m_file = open( path.c_str(), O_RDONLY );
+        if ( m_file < 0 )
+            throw FleetScanException( "could not open " + path );
+        struct stat info;
+        fstat( m_file, &info );
+        m_size = (size_t)info.st_size;
+        if ( m_size == 0 )
+            return;
+        void* memory = mmap( nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0 );
+        if ( memory != MAP_FAILED )
+            m_data = static_cast<const uint8_t*>( memory );
+#endif
+        if ( m_data == nullptr )
+        {
+            close();
+            throw FleetScanException( "could not map " + path );
+        }
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void close()
+    {
+#ifdef _WIN32
+        if ( m_data != nullptr )
+            UnmapViewOfFile( m_data );
+        if ( m_mapping != NULL )
+            CloseHandle( m_mapping );
+        if ( m_file != INVALID_HANDLE_VALUE )
+            CloseHandle( m_file );
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if ( m_data != nullptr )
+            munmap( const_cast<uint8_t*>( m_data ), m_size );
+        if ( m_file >= 0 )
+            ::close( m_file );
+        m_file = -1;
+#endif
+        m_data = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = NULL;
+#else
+    int m_file = -1;
+#endif
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+//Decides whether one license file is valid for the device it came from. Called from every scanning thread at once.
+class LicenseFileValidator
+{
+public:
+    virtual ~LicenseFileValidator() = default;
+    virtual ScanOutcome validate( const FleetFile& file, const MappedFile& contents, std::string& message ) = 0;
+};
+
+//Validates with the SDK, the way LocalLicenseCheck() does: a configuration for the file's product, with the file as
+//its license file and the hardware ID of the device it came from, then reloadLicense() and localCheck(). The SDK
+//reads the file itself, from the OS file cache the scanner's mapping just filled.
+//
+//localCheck() checks for a VM on the machine running it, which here is the one running the scan, so scan on
+//hardware if some of the licenses don't allow VMs.
+class LicenseSpringValidator : public LicenseFileValidator
+{
+public:
+    LicenseSpringValidator( const std::string& apiKey, const std::string& sharedKey, const std::string& appName,
+        const std::string& appVersion, const LicenseSpring::ExtendedOptions& options = LicenseSpring::ExtendedOptions() )
+        : m_apiKey( apiKey ), m_sharedKey( sharedKey ), m_appName( appName ), m_appVersion( appVersion ), m_options( options )
+    {
+        m_options.collectNetworkInfo( false );
+    }
+
+    ScanOutcome validate( const FleetFile& file, const MappedFile&, std::string& message ) override
+    {
+        using namespace LicenseSpring;
+        ExtendedOptions options = m_options;
+        options.setLicenseFilePath( std::wstring( file.path.begin(), file.path.end() ) );
+        if ( !file.hardwareId.empty() )
+            options.setHardwareID( file.hardwareId );
+        License::ptr_t license;
+        try
+        {
+            auto configuration = Configuration::Create( m_apiKey, m_sharedKey, file.productCode, m_appName, m_appVersion, options );
+            license = LicenseManager::create( configuration )->reloadLicense();
+            if ( license == nullptr )
+            {
+                message = "no license in the file";
+                return ScanOutcome::Corrupt;
+            }
+            license->localCheck();
+            return ScanOutcome::Valid;
+        }
+        catch ( LocalLicenseException ex ) { message = ex.what(); return ScanOutcome::Corrupt; }
+        catch ( SignatureMismatchException ex ) { message = ex.what(); return ScanOutcome::SignatureMismatch; }
+        catch ( ProductMismatchException ex ) { message = ex.what(); return ScanOutcome::ProductMismatch; }
+        catch ( DeviceNotLicensedException ex ) { message = ex.what(); return ScanOutcome::DeviceNotLicensed; }
+        catch ( ClockTamperedException ex ) { message = ex.what(); return ScanOutcome::ClockTampered; }
+        catch ( VMIsNotAllowedException ex ) { message = ex.what(); return ScanOutcome::VMNotAllowed; }
+        catch ( LicenseStateException ex )
+        {
+            message = ex.what();
+            if ( license != nullptr && !license->isEnabled() )
+                return ScanOutcome::Disabled;
+            if ( license != nullptr && license->isExpired() )
+                return ScanOutcome::Expired;
+            return ScanOutcome::Inactive;
+        }
+        catch ( LicenseSpringException ex ) { message = ex.what(); return ScanOutcome::Failed; }
+    }
+
+private:
+    std::string m_apiKey;
+    std::string m_sharedKey;
+    std::string m_appName;
+    std::string m_appVersion;
+    LicenseSpring::ExtendedOptions m_options;
+};
+
+struct FleetReport
+{
+    std::vector<FileScanResult> results; //one per manifest row, in the same order
+    std::array<size_t, scanOutcomeCount> counts{};
+    //Groups of rows whose files are the same bytes but were collected from different devices.
+    std::vector<std::vector<size_t>> copies;
+    uint64_t bytes = 0;
+    size_t threads = 0;
+    std::chrono::duration<double> elapsed{ 0 };
+
+    size_t count( ScanOutcome outcome ) const { return counts[ (size_t)outcome ]; }
+    double filesPerSecond() const { return elapsed.count() > 0 ? results.size() / elapsed.count() : 0; }
+
+    void writeSummary( std::ostream& out, const std::vector<FleetFile>& files, size_t listed = 20 ) const
+    {
+        out << results.size() << " license files, " << bytes / 1024 << " KB, scanned in " << elapsed.count() * 1000
+            << " ms on " << threads << " threads (" << (uint64_t)filesPerSecond() << " files/s)" << std::endl;
+        for ( size_t i = 0; i < scanOutcomeCount; i++ )
+            if ( counts[ i ] > 0 )
+                out << "  " << scanOutcomeName( (ScanOutcome)i ) << ": " << counts[ i ] << std::endl;
+
+        //Failures by product, so a product with many of them stands out.
+        std::map<std::string, size_t> failedByProduct;
+        for ( size_t i = 0; i < results.size(); i++ )
+            if ( results[ i ].outcome != ScanOutcome::Valid )
+                failedByProduct[ files[ i ].productCode ]++;
+        if ( !failedByProduct.empty() )
+        {
+            out << "Failures by product:" << std::endl;
+            for ( const auto& product : failedByProduct )
+                out << "  " << product.first << ": " << product.second << std::endl;
+        }
+
+        size_t shown = 0;
+        for ( size_t i = 0; i < results.size() && shown < listed; i++ )
+        {
+            if ( results[ i ].outcome == ScanOutcome::Valid )
+                continue;
+            out << ( shown == 0 ? "First failures:\n" : "" ) << "  " << files[ i ].path << ": "
+                << scanOutcomeName( results[ i ].outcome );
+            if ( !results[ i ].message.empty() )
+                out << ", " << results[ i ].message;
+            out << std::endl;
+            shown++;
+        }
+
+        if ( !copies.empty() )
+            out << copies.size() << " licenses were collected from more than one device:" << std::endl;
+        for ( size_t group = 0; group < copies.size() && group < listed; group++ )
+        {
+            out << " ";
+            for ( size_t row : copies[ group ] )
+                out << " " << files[ row ].path << " (" << files[ row ].hardwareId << ")";
+            out << std::endl;
+        }
+    }
+
+    //A line per file: path, product, hardware ID, outcome, message.
+    void writeCsv( std::ostream& out, const std::vector<FleetFile>& files ) const
+    {
+        out << "path,product,hardware_id,outcome,message" << std::endl;
+        for ( size_t i = 0; i < results.size(); i++ )
+            out << csvField( files[ i ].path ) << "," << csvField( files[ i ].productCode ) << ","
+                << csvField( files[ i ].hardwareId ) << "," << scanOutcomeName( results[ i ].outcome ) << ","
+                << csvField( results[ i ].message ) << std::endl;
+    }
+
+    //Quoted the way spreadsheets read it (RFC 4180): a path or a message can have commas, quotes or line breaks.
+    static std::string csvField( const std::string& value )
+    {
+        std::string quoted = "\"";
+        for ( char c : value )
+        {
+            if ( c == '"' )
+                quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+};
+
+class FleetScanner
+{
+public:
+    //threads = 0 uses every core.
+    explicit FleetScanner( LicenseFileValidator& validator, size_t threads = 0 ) : m_validator( validator ), m_threads( threads )
+    {
+        if ( m_threads == 0 )
+            m_threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    FleetReport scan( const std::vector<FleetFile>& files )
+    {
+        FleetReport report;
+        report.results.resize( files.size() );
+        report.threads = std::min( m_threads, std::max<size_t>( 1, files.size() ) );
+        auto start = std::chrono::steady_clock::now();
+
+        //Threads take the next few rows as they finish, so a run of slow files doesn't hold one thread back while
+        //the others sit idle. Each writes only its own rows' results.
+        std::atomic<size_t> next( 0 );
+        auto work = [ & ]()
+        {
+            const size_t rowsAtATime = 16;
+            for ( size_t first = next.fetch_add( rowsAtATime ); first < files.size(); first = next.fetch_add( rowsAtATime ) )
+                for ( size_t row = first; row < std::min( first + rowsAtATime, files.size() ); row++ )
+                    report.results[ row ] = scanFile( files[ row ] );
+        };
+        std::vector<std::thread> threads;
+        for ( size_t i = 1; i < report.threads; i++ )
+            threads.emplace_back( work );
+        work();
+        for ( std::thread& thread : threads )
+            thread.join();
+        report.elapsed = std::chrono::steady_clock::now() - start;
+
+        std::unordered_map<uint64_t, std::vector<size_t>> byDigest;
+        for ( size_t row = 0; row < files.size(); row++ )
+        {
+            const FileScanResult& result = report.results[ row ];
+            report.counts[ (size_t)result.outcome ]++;
+            report.bytes += result.bytes;
+            if ( result.bytes > 0 )
+                byDigest[ result.digest ].push_back( row );
+        }
+        for ( auto& same : byDigest )
+        {
+            const std::vector<size_t>& rows = same.second;
+            bool otherDevice = std::any_of( rows.begin(), rows.end(),
+                [ & ]( size_t row ) { return files[ row ].hardwareId != files[ rows[ 0 ] ].hardwareId; } );
+            if ( otherDevice )
+                report.copies.push_back( rows );
+        }
+        std::sort( report.copies.begin(), report.copies.end() );
+        return report;
+    }
+
+private:
+    FileScanResult scanFile( const FleetFile& file )
+    {
+        FileScanResult result;
+        try
+        {
+            MappedFile contents( file.path );
+            result.bytes = contents.size();
+            result.digest = digestOf( contents.data(), contents.size() );
+            result.outcome = m_validator.validate( file, contents, result.message );
+        }
+        catch ( FleetScanException ex )
+        {
+            result.outcome = ScanOutcome::Unreadable;
+            result.message = ex.what();
+        }
+        catch ( std::exception& ex )
+        {
+            result.outcome = ScanOutcome::Failed;
+            result.message = ex.what();
+        }
+        return result;
+    }
+
+    static uint64_t digestOf( const uint8_t* data, size_t size )
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for ( size_t i = 0; i < size; i++ )
+            hash = ( hash ^ data[ i ] ) * 1099511628211ull;
+        return hash;
+    }
+
+    LicenseFileValidator& m_validator;
+    size_t m_threads;
+};
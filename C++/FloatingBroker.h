@@ -0,0 +1,667 @@
+#pragma once
+
+//Local broker for floating license seats. When lots of short-lived processes on one machine each register and
+//release a floating license, every one of them pays a round trip to the LicenseSpring servers on startup, and the
+//server sees a register/release pair for every run. The broker is a long-running process that holds seats on their
+//behalf: local processes ask it for a seat over a Unix domain socket (see FloatingBrokerClient.h), and get one that
+//is already registered straight away. The broker keeps its seats registered with its own heartbeat, and only gives
+//a seat back to the server after it has been idle for a while, so a steady stream of short runs reuses the same
+//seats without touching the server.
+//
+//Protocol, one line per message:
+//    client: ACQUIRE [wait] <name>   ->   broker: OK <seat> | BUSY | ERR <message>
+//    client: RELEASE                 ->   broker: OK
+//    client: STATUS                  ->   broker: STATUS seats=<n> leased=<n> waiting=<n> cloud_registrations=<n> ...
+//A client holds at most one seat, and closing the connection (including the client crashing) gives it back.
+//With "wait", a client that can't get a seat right away is queued until one is free instead of getting BUSY.
+//
+//If no heartbeat gets through for a whole floating timeout, the server has dropped the seat. The broker forgets it
+//too, and registers a new one for the client that held it.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//How the broker gets seats from the server. Called from the broker's worker thread only, one call at a time.
+class SeatProvider
+{
+public:
+    virtual ~SeatProvider() = default;
+
+    //Registers a new seat with the server and returns an id for it. Throws if no seat is available.
+    virtual std::string acquire() = 0;
+
+    //Keeps a seat from timing out on the server.
+    virtual void heartbeat( const std::string& seat ) = 0;
+
+    //Gives a seat back to the server.
+    virtual void release( const std::string& seat ) = 0;
+
+    //How often heartbeat() has to be called, e.g. half the floating timeout.
+    virtual std::chrono::milliseconds heartbeatInterval() = 0;
+
+    //How long the server keeps a seat without a heartbeat. After that long without one getting through, the broker
+    //takes the server to have dropped the seat.
+    virtual std::chrono::milliseconds floatingTimeout() { return heartbeatInterval() * 2; }
+};
+
+struct FloatingBrokerPolicy
+{
+    size_t maxSeats = 4; //most seats the broker holds from the server at once
+    size_t minWarmSeats = 0; //seats kept registered even when nobody has used them for a long time
+    std::chrono::milliseconds idleHysteresis = std::chrono::minutes( 2 ); //how long an unused seat is kept before it's released
+};
+
+class FloatingBroker
+{
+public:
+    struct Stats
+    {
+        size_t seats = 0;
+        size_t leased = 0;
+        size_t waiting = 0;
+        uint64_t leases = 0; //seats handed to clients
+        uint64_t cloudRegistrations = 0; //seats registered with the server
+        uint64_t cloudReleases = 0;
+        uint64_t heartbeats = 0;
+    };
+
+    FloatingBroker( const std::string& socketPath, std::shared_ptr<SeatProvider> provider,
+        const FloatingBrokerPolicy& policy = FloatingBrokerPolicy() )
+        : m_socketPath( socketPath ), m_provider( provider ), m_policy( policy )
+    {
+        if ( pipe( m_wakePipe ) != 0 )
+            throw std::runtime_error( "could not create broker wake pipe" );
+        fcntl( m_wakePipe[0], F_SETFL, O_NONBLOCK );
+        fcntl( m_wakePipe[1], F_SETFL, O_NONBLOCK );
+        try
+        {
+            listen();
+        }
+        catch ( ... )
+        {
+            //The destructor won't run, so we close what we opened.
+            if ( m_listener >= 0 )
+                close( m_listener );
+            close( m_wakePipe[0] );
+            close( m_wakePipe[1] );
+            throw;
+        }
+        m_worker = std::thread( [ this ]() { work(); } );
+    }
+
+    ~FloatingBroker()
+    {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock( m_taskMutex );
+            m_workerStopping = true;
+        }
+        m_taskReady.notify_all();
+        m_worker.join();
+
+        //Seats still held go back to the server right away, as do idle ones the worker didn't get round to, and
+        //ones it registered that the event loop never picked up.
+        std::vector<std::string> held;
+        for ( const Seat& seat : m_seats )
+            held.push_back( seat.id );
+        for ( const Task& task : m_tasks )
+            if ( task.type == Task::Release )
+                held.push_back( task.seat );
+        for ( const Task& task : m_done )
+            if ( task.type == Task::Acquire && task.ok )
+                held.push_back( task.result );
+        for ( const std::string& seat : held )
+        {
+            try
+            {
+                m_provider->release( seat );
+            }
+            catch ( ... )
+            {
+            }
+        }
+        for ( auto& client : m_clients )
+            close( client.first );
+        close( m_listener );
+        close( m_wakePipe[0] );
+        close( m_wakePipe[1] );
+        unlink( m_socketPath.c_str() );
+    }
+
+    FloatingBroker( const FloatingBroker& ) = delete;
+    FloatingBroker& operator=( const FloatingBroker& ) = delete;
+
+    //Serves clients until stop() is called.
+    void run()
+    {
+        m_running = true;
+        while ( m_running )
+        {
+            std::vector<pollfd> fds;
+            fds.push_back( { m_wakePipe[0], POLLIN, 0 } );
+            fds.push_back( { m_listener, POLLIN, 0 } );
+            for ( auto& client : m_clients )
+                fds.push_back( { client.first, POLLIN, 0 } );
+
+            poll( fds.data(), fds.size(), (int)nextTimerMs() );
+
+            if ( fds[0].revents & POLLIN )
+                drainWakePipe();
+            finishTasks();
+            if ( fds[1].revents & POLLIN )
+                accept();
+            for ( size_t i = 2; i < fds.size(); i++ )
+            {
+                if ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) )
+                    readClient( fds[i].fd );
+            }
+            runTimers();
+        }
+    }
+
+    //Can be called from any thread, or a signal handler.
+    void stop()
+    {
+        m_running = false;
+        wake();
+    }
+
+    Stats stats()
+    {
+        std::lock_guard<std::mutex> lock( m_statsMutex );
+        return m_stats;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct Seat
+    {
+        std::string id;
+        int client = -1; //connection holding the seat, -1 while it's idle
+        clock_t::time_point idleSince;
+        clock_t::time_point nextHeartbeat;
+        clock_t::time_point lastHeartbeat; //or registration, the last time the server heard about the seat
+        bool heartbeating = false;
+    };
+
+    struct Client
+    {
+        std::string buffer; //partial line read so far
+        std::string name;
+        bool waiting = false;
+        bool acquiring = false; //a seat is being registered with the server for this client
+        bool replacing = false; //its seat was dropped by the server, and a new one is being registered for it
+    };
+
+    //Work for the worker thread. Server calls can take a while, so the event loop never makes them itself.
+    struct Task
+    {
+        enum Type { Acquire, Heartbeat, Release };
+
+        Task( Type type, const std::string& seat, int client = -1 ) : type( type ), seat( seat ), client( client ) {}
+
+        Type type;
+        std::string seat;
+        int client;
+        bool replacement = false; //an Acquire for a client whose seat the server dropped, see finishTasks()
+        //Filled in by the worker.
+        bool ok = false;
+        std::string result;
+    };
+
+    void listen()
+    {
+        m_listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+        if ( m_listener < 0 )
+            throw std::runtime_error( "could not create broker socket" );
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if ( m_socketPath.size() >= sizeof( address.sun_path ) )
+            throw std::runtime_error( "broker socket path is too long: " + m_socketPath );
+        strcpy( address.sun_path, m_socketPath.c_str() );
+        //A socket file left behind by a broker that crashed would make bind fail, but we mustn't take the socket
+        //away from a broker that's still running.
+        int probe = socket( AF_UNIX, SOCK_STREAM, 0 );
+        bool inUse = probe >= 0 && connect( probe, (sockaddr*)&address, sizeof( address ) ) == 0;
+        if ( probe >= 0 )
+            close( probe );
+        if ( inUse )
+            throw std::runtime_error( "a broker is already listening on " + m_socketPath );
+        unlink( m_socketPath.c_str() );
+        if ( bind( m_listener, (sockaddr*)&address, sizeof( address ) ) != 0 || ::listen( m_listener, 128 ) != 0 )
+            throw std::runtime_error( "could not listen on " + m_socketPath + ": " + strerror( errno ) );
+        fcntl( m_listener, F_SETFL, O_NONBLOCK );
+    }
+
+    void accept()
+    {
+        for ( ;; )
+        {
+            int fd = ::accept( m_listener, nullptr, nullptr );
+            if ( fd < 0 )
+                return;
+            m_clients[fd] = Client();
+        }
+    }
+
+    void readClient( int fd )
+    {
+        char data[512];
+        ssize_t n = read( fd, data, sizeof( data ) );
+        if ( n <= 0 )
+        {
+            disconnect( fd );
+            return;
+        }
+        Client& client = m_clients[fd];
+        client.buffer.append( data, n );
+        size_t end;
+        while ( m_clients.count( fd ) && ( end = client.buffer.find( '\n' ) ) != std::string::npos )
+        {
+            std::string line = client.buffer.substr( 0, end );
+            client.buffer.erase( 0, end + 1 );
+            handle( fd, line );
+        }
+        if ( m_clients.count( fd ) && client.buffer.size() > 4096 )
+            disconnect( fd );
+    }
+
+    void handle( int fd, const std::string& line )
+    {
+        std::istringstream in( line );
+        std::string command;
+        in >> command;
+        Client& client = m_clients[fd];
+
+        if ( command == "ACQUIRE" )
+        {
+            std::string word;
+            bool wait = false;
+            if ( in >> word && word == "wait" )
+                wait = true;
+            else
+                client.name = word;
+            if ( wait )
+                in >> client.name;
+
+            if ( seatOf( fd ) != nullptr )
+            {
+                reply( fd, "OK " + seatOf( fd )->id );
+                return;
+            }
+            //Already in line or having a seat registered: it gets one answer when that's done, a second ACQUIRE
+            //mustn't queue it twice.
+            if ( client.waiting || client.acquiring )
+                return;
+            //Its seat is being replaced, so that's the one it gets, with an answer this time.
+            if ( client.replacing )
+            {
+                client.replacing = false;
+                client.acquiring = true;
+                return;
+            }
+            //The fast path: a seat that's already registered and not in use.
+            for ( Seat& seat : m_seats )
+            {
+                if ( seat.client < 0 )
+                {
+                    lease( seat, fd );
+                    return;
+                }
+            }
+            if ( m_seats.size() + m_acquiring < m_policy.maxSeats )
+            {
+                client.acquiring = true;
+                m_acquiring++;
+                post( Task( Task::Acquire, std::string(), fd ) );
+            }
+            else if ( wait )
+            {
+                client.waiting = true;
+                m_waiting.push_back( fd );
+                updateStats();
+            }
+            else
+                reply( fd, "BUSY" );
+        }
+        else if ( command == "RELEASE" )
+        {
+            client.replacing = false;
+            returnSeat( fd );
+            reply( fd, "OK" );
+        }
+        else if ( command == "STATUS" )
+        {
+            Stats stats = this->stats();
+            std::ostringstream out;
+            out << "STATUS seats=" << stats.seats << " leased=" << stats.leased << " waiting=" << stats.waiting
+                << " leases=" << stats.leases << " cloud_registrations=" << stats.cloudRegistrations
+                << " cloud_releases=" << stats.cloudReleases << " heartbeats=" << stats.heartbeats;
+            reply( fd, out.str() );
+        }
+        else
+            reply( fd, "ERR unknown command" );
+    }
+
+    void disconnect( int fd )
+    {
+        returnSeat( fd );
+        m_waiting.erase( std::remove( m_waiting.begin(), m_waiting.end(), fd ), m_waiting.end() );
+        close( fd );
+        m_clients.erase( fd );
+        updateStats();
+    }
+
+    void reply( int fd, const std::string& line )
+    {
+        std::string message = line + "\n";
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL; //a client that went away mustn't kill the broker with SIGPIPE
+#else
+        const int flags = 0;
+#endif
+        //Replies are tiny, so a client that can't take one has stopped reading and we drop it.
+        if ( ::send( fd, message.data(), message.size(), flags ) != (ssize_t)message.size() )
+            shutdown( fd, SHUT_RDWR );
+    }
+
+    Seat* seatOf( int fd )
+    {
+        for ( Seat& seat : m_seats )
+            if ( seat.client == fd )
+                return &seat;
+        return nullptr;
+    }
+
+    void lease( Seat& seat, int fd )
+    {
+        seat.client = fd;
+        m_clients[fd].waiting = false;
+        {
+            std::lock_guard<std::mutex> lock( m_statsMutex );
+            m_stats.leases++;
+        }
+        updateStats();
+        reply( fd, "OK " + seat.id );
+    }
+
+    //The seat stays registered with the server. It goes to the next client in line, or waits for one.
+    void returnSeat( int fd )
+    {
+        Seat* seat = seatOf( fd );
+        if ( seat == nullptr )
+            return;
+        seat->client = -1;
+        seat->idleSince = clock_t::now();
+        if ( !m_waiting.empty() )
+        {
+            int next = m_waiting.front();
+            m_waiting.pop_front();
+            lease( *seat, next );
+        }
+        updateStats();
+    }
+
+    //Milliseconds until the next heartbeat or idle release is due.
+    long long nextTimerMs()
+    {
+        auto now = clock_t::now();
+        auto next = now + std::chrono::seconds( 10 );
+        size_t idle = 0;
+        for ( const Seat& seat : m_seats )
+        {
+            if ( !seat.heartbeating )
+                next = std::min( next, seat.nextHeartbeat );
+            if ( seat.client < 0 && ++idle > m_policy.minWarmSeats )
+                next = std::min( next, seat.idleSince + m_policy.idleHysteresis );
+        }
+        return std::max<long long>( 0, std::chrono::duration_cast<std::chrono::milliseconds>( next - now ).count() + 1 );
+    }
+
+    void runTimers()
+    {
+        auto now = clock_t::now();
+        for ( Seat& seat : m_seats )
+        {
+            if ( !seat.heartbeating && now >= seat.nextHeartbeat )
+            {
+                seat.heartbeating = true;
+                post( Task( Task::Heartbeat, seat.id ) );
+            }
+        }
+
+        //Idle seats past the hysteresis period go back to the server, oldest first, keeping minWarmSeats.
+        std::vector<Seat*> idle;
+        for ( Seat& seat : m_seats )
+            if ( seat.client < 0 )
+                idle.push_back( &seat );
+        std::sort( idle.begin(), idle.end(), []( Seat* a, Seat* b ) { return a->idleSince < b->idleSince; } );
+        std::vector<std::string> expired;
+        for ( size_t i = 0; i + m_policy.minWarmSeats < idle.size(); i++ )
+            if ( now - idle[i]->idleSince >= m_policy.idleHysteresis )
+                expired.push_back( idle[i]->id );
+        for ( const std::string& id : expired )
+        {
+            m_seats.erase( std::remove_if( m_seats.begin(), m_seats.end(), [ &id ]( const Seat& s ) { return s.id == id; } ), m_seats.end() );
+            post( Task( Task::Release, id ) );
+        }
+        if ( !expired.empty() )
+            updateStats();
+    }
+
+    void post( Task task )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_taskMutex );
+            m_tasks.push_back( task );
+        }
+        m_taskReady.notify_one();
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock( m_taskMutex );
+        for ( ;; )
+        {
+            m_taskReady.wait( lock, [ this ]() { return m_workerStopping || !m_tasks.empty(); } );
+            if ( m_workerStopping )
+                return;
+            Task task = m_tasks.front();
+            m_tasks.pop_front();
+            lock.unlock();
+
+            try
+            {
+                switch ( task.type )
+                {
+                    case Task::Acquire: task.result = m_provider->acquire(); break;
+                    case Task::Heartbeat: m_provider->heartbeat( task.seat ); break;
+                    case Task::Release: m_provider->release( task.seat ); break;
+                }
+                task.ok = true;
+            }
+            catch ( const std::exception& ex )
+            {
+                task.result = ex.what();
+            }
+
+            lock.lock();
+            m_done.push_back( task );
+            wake();
+        }
+    }
+
+    //Picks up what the worker has finished, on the event loop thread.
+    void finishTasks()
+    {
+        std::deque<Task> done;
+        {
+            std::lock_guard<std::mutex> lock( m_taskMutex );
+            done.swap( m_done );
+        }
+        for ( Task& task : done )
+        {
+            std::lock_guard<std::mutex> lock( m_statsMutex );
+            switch ( task.type )
+            {
+                case Task::Acquire: m_stats.cloudRegistrations += task.ok; break;
+                case Task::Heartbeat: m_stats.heartbeats += task.ok; break;
+                case Task::Release: m_stats.cloudReleases += task.ok; break;
+            }
+        }
+        std::vector<std::string> lost;
+        for ( Task& task : done )
+        {
+            if ( task.type == Task::Acquire )
+                finishAcquire( task );
+            else if ( task.type == Task::Heartbeat )
+            {
+                auto now = clock_t::now();
+                for ( Seat& seat : m_seats )
+                {
+                    if ( seat.id != task.seat )
+                        continue;
+                    seat.heartbeating = false;
+                    if ( task.ok )
+                        seat.lastHeartbeat = now;
+                    else if ( now - seat.lastHeartbeat >= m_provider->floatingTimeout() )
+                        lost.push_back( seat.id );
+                    //A failed heartbeat is retried sooner, the seat isn't lost until the server times it out.
+                    seat.nextHeartbeat = now + ( task.ok ? m_provider->heartbeatInterval() :
+                        std::min<std::chrono::milliseconds>( m_provider->heartbeatInterval(), std::chrono::seconds( 5 ) ) );
+                }
+            }
+        }
+        for ( const std::string& id : lost )
+            dropSeat( id );
+        updateStats();
+    }
+
+    //No heartbeat got through for a whole floating timeout, so the server has given the seat to someone else. It's
+    //released (so the provider forgets it, the server call itself may well fail) and, if a client holds it, a new
+    //one is registered for that client. The client isn't told: it keeps its lease either way.
+    void dropSeat( const std::string& id )
+    {
+        auto seat = std::find_if( m_seats.begin(), m_seats.end(), [ &id ]( const Seat& s ) { return s.id == id; } );
+        if ( seat == m_seats.end() )
+            return;
+        int client = seat->client;
+        m_seats.erase( seat );
+        post( Task( Task::Release, id ) );
+        if ( client >= 0 && m_clients.count( client ) )
+        {
+            m_clients[client].replacing = true;
+            Task task( Task::Acquire, std::string(), client );
+            task.replacement = true;
+            m_acquiring++;
+            post( task );
+        }
+    }
+
+    void finishAcquire( Task& task )
+    {
+        m_acquiring--;
+        auto it = m_clients.find( task.client );
+        bool clientWaiting = it != m_clients.end() && it->second.acquiring;
+        if ( clientWaiting )
+            it->second.acquiring = false;
+        //A replacement for a seat the server dropped (see dropSeat()) goes under the client's lease without an
+        //answer, it already has its OK. Unless it has given the seat back or left in the meantime.
+        bool replacing = task.replacement && it != m_clients.end() && it->second.replacing;
+        if ( replacing )
+            it->second.replacing = false;
+
+        if ( !task.ok )
+        {
+            if ( clientWaiting )
+                reply( task.client, "ERR " + task.result );
+            return;
+        }
+
+        Seat seat;
+        seat.id = task.result;
+        seat.idleSince = seat.lastHeartbeat = clock_t::now();
+        seat.nextHeartbeat = seat.lastHeartbeat + m_provider->heartbeatInterval();
+        m_seats.push_back( seat );
+        //If the client that asked for it has gone in the meantime, the seat goes to the next one in line, or
+        //stays warm for the next request.
+        if ( replacing )
+            m_seats.back().client = task.client;
+        else if ( clientWaiting )
+            lease( m_seats.back(), task.client );
+        else if ( !m_waiting.empty() )
+        {
+            int next = m_waiting.front();
+            m_waiting.pop_front();
+            lease( m_seats.back(), next );
+        }
+    }
+
+    void wake()
+    {
+        char byte = 1;
+        if ( write( m_wakePipe[1], &byte, 1 ) < 0 )
+        {
+            //The pipe is full, so the loop is going to wake up anyway.
+        }
+    }
+
+    void drainWakePipe()
+    {
+        char data[64];
+        while ( read( m_wakePipe[0], data, sizeof( data ) ) > 0 )
+        {
+        }
+    }
+
+    void updateStats()
+    {
+        std::lock_guard<std::mutex> lock( m_statsMutex );
+        m_stats.seats = m_seats.size();
+        m_stats.leased = std::count_if( m_seats.begin(), m_seats.end(), []( const Seat& s ) { return s.client >= 0; } );
+        m_stats.waiting = m_waiting.size();
+    }
+
+    std::string m_socketPath;
+    std::shared_ptr<SeatProvider> m_provider;
+    FloatingBrokerPolicy m_policy;
+
+    int m_listener = -1;
+    int m_wakePipe[2] = { -1, -1 };
+    std::atomic<bool> m_running{ false };
+
+    //Only touched by the event loop thread.
+    std::map<int, Client> m_clients;
+    std::vector<Seat> m_seats;
+    std::deque<int> m_waiting;
+    size_t m_acquiring = 0;
+
+    std::mutex m_taskMutex;
+    std::condition_variable m_taskReady;
+    std::deque<Task> m_tasks;
+    std::deque<Task> m_done;
+    bool m_workerStopping = false;
+    std::thread m_worker;
+
+    std::mutex m_statsMutex;
+    Stats m_stats;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+//Client side of the local floating seat broker (see FloatingBroker.h). Instead of registering a floating license
+//with the LicenseSpring servers itself, a process asks the broker running on the same machine for a seat:
+//
+//    FloatingSeatLease seat( "/tmp/licensespring_broker.sock" );
+//    if ( !seat.acquire( "my-tool", true ) )
+//        ... no seat
+//    ... do the work, the seat is ours until release() or the lease is destroyed
+//
+//If this process crashes, the broker sees the connection close and takes the seat back.
+#include <stdexcept>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+class FloatingSeatLease
+{
+public:
+    //Connects to the broker. Throws if no broker is listening on socketPath.
+    explicit FloatingSeatLease( const std::string& socketPath )
+    {
+        m_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if ( m_fd < 0 || socketPath.size() >= sizeof( address.sun_path ) )
+        {
+            if ( m_fd >= 0 )
+                close( m_fd );
+            throw std::runtime_error( "could not create socket for " + socketPath );
+        }
+        strcpy( address.sun_path, socketPath.c_str() );
+        if ( connect( m_fd, (sockaddr*)&address, sizeof( address ) ) != 0 )
+        {
+            close( m_fd );
+            throw std::runtime_error( "no floating seat broker at " + socketPath + ": " + strerror( errno ) );
+        }
+    }
+
+    ~FloatingSeatLease()
+    {
+        //Closing the connection is enough for the broker to take the seat back.
+        close( m_fd );
+    }
+
+    FloatingSeatLease( const FloatingSeatLease& ) = delete;
+    FloatingSeatLease& operator=( const FloatingSeatLease& ) = delete;
+
+    //Asks for a seat. name shows up in the broker's logs. Returns false if all seats are taken (only without
+    //wait, with wait this blocks until a seat is free). Throws if the broker couldn't get a seat from the server.
+    bool acquire( const std::string& name, bool wait = false )
+    {
+        std::string reply = request( std::string( "ACQUIRE " ) + ( wait ? "wait " : "" ) + name );
+        if ( reply.compare( 0, 3, "OK " ) == 0 )
+        {
+            m_seat = reply.substr( 3 );
+            return true;
+        }
+        if ( reply == "BUSY" )
+            return false;
+        throw std::runtime_error( "floating seat broker: " + reply );
+    }
+
+    //Gives the seat back to the broker, which keeps it registered for the next process.
+    void release()
+    {
+        if ( m_seat.empty() )
+            return;
+        request( "RELEASE" );
+        m_seat.clear();
+    }
+
+    //The broker's seat id, empty if we don't hold a seat.
+    const std::string& seat() const { return m_seat; }
+
+    std::string status() { return request( "STATUS" ); }
+
+private:
+    std::string request( const std::string& line )
+    {
+        std::string message = line + "\n";
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL; //a broker that went away should be an exception, not SIGPIPE
+#else
+        const int flags = 0;
+#endif
+        if ( ::send( m_fd, message.data(), message.size(), flags ) != (ssize_t)message.size() )
+            throw std::runtime_error( "lost connection to floating seat broker" );
+        size_t end;
+        while ( ( end = m_buffer.find( '\n' ) ) == std::string::npos )
+        {
+            char data[256];
+            ssize_t n = read( m_fd, data, sizeof( data ) );
+            if ( n <= 0 )
+                throw std::runtime_error( "lost connection to floating seat broker" );
+            m_buffer.append( data, n );
+        }
+        std::string reply = m_buffer.substr( 0, end );
+        m_buffer.erase( 0, end + 1 );
+        return reply;
+    }
+
+    int m_fd = -1;
+    std::string m_buffer;
+    std::string m_seat;
+};
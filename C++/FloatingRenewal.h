@@ -0,0 +1,276 @@
+#pragma once
+
+//Renews a floating license registration just in time. Re-registering a fixed number of seconds before the floating
+//timeout is either wasteful (on a fast network) or too late (on a slow or jittery one, where the renewal is still
+//on its way when the seat times out). Instead, we measure how long recent registerFloatingLicense() calls took and
+//renew at
+//    timeout - margin,   margin = retries * max( p99 round trip, mean + 4 * standard deviation ) + fixed margin
+//so there's time for the renewal, and for retries if it fails, even on a bad day for the network. Until there
+//are enough measurements, a conservative default margin is used.
+//
+//The timeout is counted from when we send a registration, which is always a little before the server gets it,
+//so our deadline is never later than the server's.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Clock.h"
+#include "WorkerPool.h"
+
+//Keeps the most recent round-trip times and answers percentile and variance questions about them.
+class RoundTripStats
+{
+public:
+    explicit RoundTripStats( size_t window = 64 ) : m_window( std::max<size_t>( window, 1 ) ) {}
+
+    void add( std::chrono::milliseconds rtt )
+    {
+        m_samples.push_back( rtt.count() );
+        if ( m_samples.size() > m_window )
+            m_samples.pop_front();
+    }
+
+    size_t count() const { return m_samples.size(); }
+
+    //q between 0 and 1, nearest-rank.
+    std::chrono::milliseconds percentile( double q ) const
+    {
+        if ( m_samples.empty() )
+            return std::chrono::milliseconds( 0 );
+        std::vector<long long> sorted( m_samples.begin(), m_samples.end() );
+        size_t rank = (size_t)std::ceil( q * sorted.size() );
+        rank = std::min( std::max<size_t>( rank, 1 ), sorted.size() );
+        std::nth_element( sorted.begin(), sorted.begin() + ( rank - 1 ), sorted.end() );
+        return std::chrono::milliseconds( sorted[ rank - 1 ] );
+    }
+
+    double mean() const
+    {
+        double sum = 0;
+        for ( long long sample : m_samples )
+            sum += sample;
+        return m_samples.empty() ? 0 : sum / m_samples.size();
+    }
+
+    double standardDeviation() const
+    {
+        if ( m_samples.size() < 2 )
+            return 0;
+        double average = mean(), sum = 0;
+        for ( long long sample : m_samples )
+            sum += ( sample - average ) * ( sample - average );
+        return std::sqrt( sum / ( m_samples.size() - 1 ) );
+    }
+
+private:
+    size_t m_window;
+    std::deque<long long> m_samples;
+};
+
+struct FloatingRenewalPolicy
+{
+    double percentile = 0.99;
+    int retries = 2; //renewal attempts the margin leaves room for
+    std::chrono::milliseconds fixedMargin = std::chrono::seconds( 1 ); //on top, for scheduling delays on our side
+    std::chrono::milliseconds defaultMargin = std::chrono::seconds( 15 ); //used until we have minSamples measurements
+    size_t minSamples = 5;
+    std::chrono::milliseconds maxMargin = std::chrono::minutes( 5 ); //never more than half the timeout either
+    std::chrono::milliseconds retryDelay = std::chrono::seconds( 1 );
+};
+
+class FloatingRenewer
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    struct Metrics
+    {
+        uint64_t renewals = 0;
+        uint64_t failures = 0; //renewal attempts that threw
+        uint64_t seatLosses = 0; //times the deadline passed without a successful renewal
+        std::chrono::milliseconds margin{ 0 }; //what the next renewal is scheduled with
+        std::chrono::milliseconds p99{ 0 };
+        std::chrono::milliseconds lastRtt{ 0 };
+        std::chrono::milliseconds lastSlack{ 0 }; //time left before the deadline when the last renewal came back
+        std::chrono::milliseconds minSlack{ 0 }; //smallest slack seen, our closest call
+    };
+
+    //Called with the reason when the seat is lost, on the renewer's thread. Don't call stop() from it.
+    using SeatLostCallback = std::function<void( const std::string& )>;
+
+    //renew is the registration call, e.g. [ license ]() { license->registerFloatingLicense(); }. timeout is the
+    //floating timeout, e.g. std::chrono::minutes( license->floatingTimeout() ). Pass a SimulatedClock to test
+    //renewals without waiting for them, see Clock.h. Renewals run on pool at high priority if one is given (see
+    //WorkerPool.h), otherwise on the renewer's own thread.
+    FloatingRenewer( std::function<void()> renew, std::chrono::milliseconds timeout,
+        const FloatingRenewalPolicy& policy = FloatingRenewalPolicy(), std::shared_ptr<Clock> clock = SystemClock::instance(),
+        WorkerPool* pool = nullptr )
+        : m_renew( renew ), m_timeout( timeout ), m_policy( policy ), m_clock( clock ), m_loop( pool, TaskPriority::High, clock )
+    {}
+
+    ~FloatingRenewer()
+    {
+        stop();
+    }
+
+    void setSeatLostCallback( SeatLostCallback callback )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_onSeatLost = callback;
+    }
+
+    //Call with the time the seat was registered (e.g. right before registerFloatingLicense()), and the renewer
+    //takes it from there.
+    void start( clock_t::time_point registeredAt )
+    {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_deadline = registeredAt + m_timeout;
+            m_retrying = false;
+            m_lastError.clear();
+        }
+        m_loop.start( [ this ]() { return step(); } );
+    }
+
+    //Starts as if the seat was registered just now.
+    void start()
+    {
+        start( m_clock->steadyNow() );
+    }
+
+    void stop()
+    {
+        m_loop.stop();
+    }
+
+    //Records a registration made outside the renewer, e.g. the first one, so it counts towards the statistics.
+    void addMeasurement( std::chrono::milliseconds rtt )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_rtts.add( rtt );
+    }
+
+    std::chrono::milliseconds margin()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return marginLocked();
+    }
+
+    //When the next renewal is due.
+    clock_t::time_point nextRenewal()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_deadline - marginLocked();
+    }
+
+    Metrics metrics()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        Metrics metrics = m_metrics;
+        metrics.margin = marginLocked();
+        metrics.p99 = m_rtts.percentile( 0.99 );
+        return metrics;
+    }
+
+private:
+    std::chrono::milliseconds marginLocked() const
+    {
+        std::chrono::milliseconds margin = m_policy.defaultMargin;
+        if ( m_rtts.count() >= m_policy.minSamples )
+        {
+            double spread = m_rtts.mean() + 4 * m_rtts.standardDeviation();
+            double worst = std::max<double>( (double)m_rtts.percentile( m_policy.percentile ).count(), spread );
+            margin = std::chrono::milliseconds( (long long)( m_policy.retries * worst ) ) + m_policy.fixedMargin;
+        }
+        return std::min( { margin, m_policy.maxMargin, m_timeout / 2 } );
+    }
+
+    //One step of the renewal loop (see BackgroundLoop in WorkerPool.h): renews if it's due, retrying until it works
+    //or the deadline passes, and returns when to come back.
+    Clock::steady_time step()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        auto due = m_deadline - marginLocked();
+        if ( !m_retrying && m_clock->steadyNow() < due )
+            return due;
+        if ( m_clock->steadyNow() >= m_deadline )
+        {
+            seatLost( lock, m_lastError.empty() ? "floating timeout passed" : m_lastError );
+            //Nothing more to renew. The app has to register again (and call start()) to get a seat back.
+            return BackgroundLoop::idle();
+        }
+
+        auto start = m_clock->steadyNow();
+        bool renewed = false;
+        lock.unlock();
+        try
+        {
+            m_renew();
+            renewed = true;
+        }
+        catch ( const std::exception& ex )
+        {
+            lock.lock();
+            m_lastError = ex.what();
+            lock.unlock();
+        }
+        auto end = m_clock->steadyNow();
+        lock.lock();
+
+        if ( renewed )
+        {
+            auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>( end - start );
+            auto slack = std::chrono::duration_cast<std::chrono::milliseconds>( m_deadline - end );
+            m_rtts.add( rtt );
+            m_metrics.renewals++;
+            m_metrics.lastRtt = rtt;
+            m_metrics.lastSlack = slack;
+            m_metrics.minSlack = m_metrics.renewals == 1 ? slack : std::min( m_metrics.minSlack, slack );
+            //If the renewal came back after the deadline the server may already have dropped us, and the
+            //registration just now took the seat again. Either way the new timeout runs from start.
+            if ( end > m_deadline )
+                seatLost( lock, "renewal came back after the floating timeout" );
+            m_deadline = start + m_timeout;
+            m_retrying = false;
+            m_lastError.clear();
+            return m_deadline - marginLocked();
+        }
+        m_metrics.failures++;
+        m_retrying = true;
+        //Wait before retrying, but not so long that the retries we left room for don't fit any more.
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>( m_deadline - m_clock->steadyNow() );
+        return m_clock->steadyNow() + std::min( m_policy.retryDelay, left / ( m_policy.retries + 1 ) );
+    }
+
+    void seatLost( std::unique_lock<std::mutex>& lock, const std::string& reason )
+    {
+        m_metrics.seatLosses++;
+        SeatLostCallback callback = m_onSeatLost;
+        lock.unlock();
+        if ( callback )
+            callback( reason );
+        lock.lock();
+    }
+
+    std::function<void()> m_renew;
+    std::chrono::milliseconds m_timeout;
+    FloatingRenewalPolicy m_policy;
+    std::shared_ptr<Clock> m_clock;
+    SeatLostCallback m_onSeatLost;
+
+    std::mutex m_mutex;
+    RoundTripStats m_rtts;
+    Metrics m_metrics;
+    clock_t::time_point m_deadline;
+    bool m_retrying = false; //a renewal failed and we're trying again before the deadline
+    std::string m_lastError;
+    BackgroundLoop m_loop; //declared last, so it's stopped before the rest goes away
+};
@@ -0,0 +1,807 @@
+#pragma once
+
+//HTTP client with a pool of keep-alive connections per host, for the requests the samples make themselves, like
+//CompositeSync.h's sync. The SDK makes its own HTTPS requests and has no hook for a transport, so this doesn't
+//change how check() or activateLicense() go out. Linux only.
+//
+//Opening a connection costs a TCP handshake, and over HTTPS a TLS handshake on top, which often takes longer than
+//the request itself. Here a connection stays open after a request and the next request to the same host takes it,
+//up to a limit of connections per host (beyond that, requests wait for one to come free). Requests can also be
+//pipelined: several go out on one connection before the first answer is back. Over HTTPS, a new connection to a
+//host we've talked to before resumes the last TLS session instead of doing a full handshake. metrics() counts
+//connections opened, full and resumed TLS handshakes and requests that reused a connection.
+//
+//HTTPS needs OpenSSL: define HTTP_TRANSPORT_OPENSSL and link with -lssl -lcrypto. Without it only http:// works.
+//It speaks HTTP/1.1 only. HTTP/2 would let requests share one connection without waiting their turn, but it needs
+//a library like nghttp2, and a few kept-alive connections per host cover what the license calls need.
+//
+//    HttpTransport transport;
+//    HttpResponse response = transport.post( "http://127.0.0.1:8080/api/v4/check_license", body );
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef HTTP_TRANSPORT_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+struct HttpRequest
+{
+    std::string method = "GET";
+    std::string target = "/"; //path and query string
+    std::string body;
+    HttpHeaders headers; //besides Host, Content-Length and Connection, which are added
+};
+
+struct HttpResponse
+{
+    int status = 0;
+    HttpHeaders headers;
+    std::string body;
+    bool reusedConnection = false; //it went out on a connection that had been used before
+
+    //The first header with this name (not case sensitive), or an empty string.
+    std::string header( const std::string& name ) const
+    {
+        for ( const auto& header : headers )
+            if ( strcasecmp( header.first.c_str(), name.c_str() ) == 0 )
+                return header.second;
+        return std::string();
+    }
+};
+
+struct HttpTransportOptions
+{
+    size_t maxConnectionsPerHost = 6; //see HttpTransport::setHostLimit for one host
+    bool keepAlive = true; //false opens a connection for every request, like separate HTTPS exchanges
+    size_t pipelineDepth = 8; //requests out on one connection at once in pipeline()
+    std::chrono::milliseconds idleTimeout{ 60000 }; //idle connections older than this aren't reused
+    std::chrono::milliseconds connectTimeout{ 10000 };
+    std::chrono::milliseconds requestTimeout{ 30000 }; //for each send and receive
+    bool verifyPeer = true; //HTTPS: check the server's certificate and host name
+    std::string caFile; //HTTPS: certificates to trust, empty for the system's
+};
+
+struct HttpTransportMetrics
+{
+    uint64_t requests = 0;
+    uint64_t reusedRequests = 0; //went out on a connection that was already open
+    uint64_t connectionsOpened = 0; //TCP handshakes
+    uint64_t tlsFullHandshakes = 0;
+    uint64_t tlsResumedHandshakes = 0; //took up the last session with the host, see the top of the file
+    uint64_t waitedForConnection = 0; //requests that waited because the host was at its connection limit
+    uint64_t staleRetries = 0; //requests sent again because a kept-alive connection had been closed by the server
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+};
+
+//The server couldn't be reached, didn't answer in time, or closed the connection before answering.
+class HttpTransportException : public std::runtime_error
+{
+public:
+    explicit HttpTransportException( const std::string& message ) : std::runtime_error( message ) {}
+};
+
+class HttpTransport
+{
+public:
+    explicit HttpTransport( const HttpTransportOptions& options = HttpTransportOptions() ) : m_options( options )
+    {
+#ifdef HTTP_TRANSPORT_OPENSSL
+        m_tls = SSL_CTX_new( TLS_client_method() );
+        if ( m_tls == nullptr )
+            throw HttpTransportException( "could not set up TLS" );
+        SSL_CTX_set_min_proto_version( m_tls, TLS1_2_VERSION );
+        //We keep the sessions ourselves, one per host, see saveSession().
+        SSL_CTX_set_session_cache_mode( m_tls, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+        if ( options.caFile.empty() )
+            SSL_CTX_set_default_verify_paths( m_tls );
+        else
+            SSL_CTX_load_verify_locations( m_tls, options.caFile.c_str(), nullptr );
+        SSL_CTX_set_verify( m_tls, options.verifyPeer ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr );
+#endif
+    }
+
+    ~HttpTransport()
+    {
+        m_hosts.clear();
+#ifdef HTTP_TRANSPORT_OPENSSL
+        SSL_CTX_free( m_tls );
+#endif
+    }
+
+    HttpTransport( const HttpTransport& ) = delete;
+    HttpTransport& operator=( const HttpTransport& ) = delete;
+
+    //Connections to origin ("https://api.example.com", with the port if it isn't the default) open at once.
+    void setHostLimit( const std::string& origin, size_t limit )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        hostFor( parseUrl( origin ) ).limit = std::max<size_t>( limit, 1 );
+    }
+
+    HttpResponse get( const std::string& url, const HttpHeaders& headers = HttpHeaders() )
+    {
+        return request( "GET", url, std::string(), headers );
+    }
+
+    //With a body and no Content-Type header, the body is sent as JSON.
+    HttpResponse post( const std::string& url, const std::string& body, const HttpHeaders& headers = HttpHeaders() )
+    {
+        return request( "POST", url, body, headers );
+    }
+
+    //Throws HttpTransportException if there's no answer. An answer with an error status is returned like any other.
+    HttpResponse request( const std::string& method, const std::string& url, const std::string& body = std::string(),
+        const HttpHeaders& headers = HttpHeaders() )
+    {
+        Url parsed = parseUrl( url );
+        HttpRequest request{ method, parsed.target, body, headers };
+        return std::move( exchange( parsed, &request, 1 ).front() );
+    }
+
+    //Sends all of requests to origin on one connection, pipelineDepth at a time without waiting for the answers,
+    //and returns the answers in the same order. Meant for idempotent requests: if a kept-alive connection turns out
+    //to have been closed by the server, the ones without an answer yet are sent again on a new one, but only if
+    //none of them is a POST (or another method that isn't idempotent).
+    std::vector<HttpResponse> pipeline( const std::string& origin, const std::vector<HttpRequest>& requests )
+    {
+        if ( requests.empty() )
+            return std::vector<HttpResponse>();
+        return exchange( parseUrl( origin ), requests.data(), requests.size() );
+    }
+
+    //POSTs to paths on origin, in the shape CompositeSync::Post wants.
+    std::function<int( const std::string&, const std::string&, std::string& )> poster( const std::string& origin )
+    {
+        return [ this, origin ]( const std::string& path, const std::string& body, std::string& response )
+        {
+            HttpResponse answer = post( origin + path, body );
+            response = std::move( answer.body );
+            return answer.status;
+        };
+    }
+
+    //Closes the connections nobody is using, e.g. before the app goes to sleep.
+    void closeIdle()
+    {
+        std::vector<std::unique_ptr<Connection>> closing;
+        std::lock_guard<std::mutex> lock( m_mutex );
+        for ( auto& host : m_hosts )
+        {
+            host.second->open -= host.second->idle.size();
+            for ( auto& connection : host.second->idle )
+                closing.push_back( std::move( connection ) );
+            host.second->idle.clear();
+            host.second->freed.notify_all();
+        }
+    }
+
+    HttpTransportMetrics metrics() const
+    {
+        HttpTransportMetrics metrics;
+        metrics.requests = m_counters.requests;
+        metrics.reusedRequests = m_counters.reusedRequests;
+        metrics.connectionsOpened = m_counters.connectionsOpened;
+        metrics.tlsFullHandshakes = m_counters.tlsFullHandshakes;
+        metrics.tlsResumedHandshakes = m_counters.tlsResumedHandshakes;
+        metrics.waitedForConnection = m_counters.waitedForConnection;
+        metrics.staleRetries = m_counters.staleRetries;
+        metrics.bytesSent = m_counters.bytesSent;
+        metrics.bytesReceived = m_counters.bytesReceived;
+        return metrics;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct Url
+    {
+        bool tls = false;
+        std::string host;
+        int port = 80;
+        std::string target = "/";
+
+        std::string origin() const { return ( tls ? "https://" : "http://" ) + host + ":" + std::to_string( port ); }
+    };
+
+#ifdef HTTP_TRANSPORT_OPENSSL
+    //OpenSSL writes to the socket with write(), which raises SIGPIPE if the server has closed the connection. We
+    //block it on this thread while writing, and take back one that was raised.
+    class NoSigpipe
+    {
+    public:
+        NoSigpipe()
+        {
+            sigemptyset( &m_pipe );
+            sigaddset( &m_pipe, SIGPIPE );
+            pthread_sigmask( SIG_BLOCK, &m_pipe, &m_old );
+            sigset_t pending;
+            sigpending( &pending );
+            m_wasPending = sigismember( &pending, SIGPIPE ) == 1;
+        }
+
+        ~NoSigpipe()
+        {
+            sigset_t pending;
+            sigpending( &pending );
+            if ( !m_wasPending && sigismember( &pending, SIGPIPE ) == 1 )
+            {
+                timespec now = { 0, 0 };
+                sigtimedwait( &m_pipe, nullptr, &now );
+            }
+            pthread_sigmask( SIG_SETMASK, &m_old, nullptr );
+        }
+
+    private:
+        sigset_t m_pipe;
+        sigset_t m_old;
+        bool m_wasPending;
+    };
+#endif
+
+    struct Connection
+    {
+        int fd = -1;
+#ifdef HTTP_TRANSPORT_OPENSSL
+        SSL* ssl = nullptr;
+#endif
+        std::string in; //received and not yet read
+        uint64_t served = 0; //answers read on it
+        bool receivedAny = false; //anything came back for the current requests
+        bool closedByPeer = false; //sending failed, or the server closed or reset it, rather than a timeout
+        clock_t::time_point idleSince;
+
+        ~Connection()
+        {
+#ifdef HTTP_TRANSPORT_OPENSSL
+            if ( ssl != nullptr )
+            {
+                //Without a close_notify the server throws the session away, and the next connection can't resume it.
+                NoSigpipe guard;
+                SSL_shutdown( ssl );
+                SSL_free( ssl );
+            }
+#endif
+            if ( fd >= 0 )
+                ::close( fd );
+        }
+    };
+
+    struct Host
+    {
+        Url url;
+        size_t limit = 0;
+        size_t open = 0; //idle ones included
+        std::vector<std::unique_ptr<Connection>> idle; //the most recently used at the back
+        std::condition_variable freed;
+#ifdef HTTP_TRANSPORT_OPENSSL
+        SSL_SESSION* session = nullptr;
+#endif
+
+        ~Host()
+        {
+#ifdef HTTP_TRANSPORT_OPENSSL
+            if ( session != nullptr )
+                SSL_SESSION_free( session );
+#endif
+        }
+    };
+
+    struct Counters
+    {
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> reusedRequests{ 0 };
+        std::atomic<uint64_t> connectionsOpened{ 0 };
+        std::atomic<uint64_t> tlsFullHandshakes{ 0 };
+        std::atomic<uint64_t> tlsResumedHandshakes{ 0 };
+        std::atomic<uint64_t> waitedForConnection{ 0 };
+        std::atomic<uint64_t> staleRetries{ 0 };
+        std::atomic<uint64_t> bytesSent{ 0 };
+        std::atomic<uint64_t> bytesReceived{ 0 };
+    };
+
+    static Url parseUrl( const std::string& url )
+    {
+        Url parsed;
+        size_t hostStart;
+        if ( url.compare( 0, 7, "http://" ) == 0 )
+            hostStart = 7;
+        else if ( url.compare( 0, 8, "https://" ) == 0 )
+        {
+            parsed.tls = true;
+            parsed.port = 443;
+            hostStart = 8;
+        }
+        else
+            throw HttpTransportException( "not an http:// or https:// URL: " + url );
+        size_t hostEnd = url.find_first_of( "/?", hostStart );
+        std::string authority = url.substr( hostStart, hostEnd == std::string::npos ? std::string::npos : hostEnd - hostStart );
+        size_t colon = authority.rfind( ':' );
+        if ( colon != std::string::npos && authority.find( ']', colon ) == std::string::npos )
+        {
+            parsed.port = atoi( authority.c_str() + colon + 1 );
+            authority.resize( colon );
+        }
+        if ( authority.size() > 2 && authority.front() == '[' )
+            authority = authority.substr( 1, authority.size() - 2 );
+        parsed.host = authority;
+        if ( hostEnd != std::string::npos )
+            parsed.target = url[ hostEnd ] == '?' ? "/" + url.substr( hostEnd ) : url.substr( hostEnd );
+        if ( parsed.host.empty() || parsed.port <= 0 )
+            throw HttpTransportException( "bad URL: " + url );
+#ifndef HTTP_TRANSPORT_OPENSSL
+        if ( parsed.tls )
+            throw HttpTransportException( "https:// needs HttpTransport built with HTTP_TRANSPORT_OPENSSL" );
+#endif
+        return parsed;
+    }
+
+    Host& hostFor( const Url& url )
+    {
+        std::unique_ptr<Host>& host = m_hosts[ url.origin() ];
+        if ( !host )
+        {
+            host.reset( new Host() );
+            host->url = url;
+            host->limit = std::max<size_t>( m_options.maxConnectionsPerHost, 1 );
+        }
+        return *host;
+    }
+
+    //Methods that can be sent twice with the same effect as once.
+    static bool idempotent( const std::string& method )
+    {
+        return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+    }
+
+    //Sends count requests on one connection and reads their answers. A kept-alive connection may have been closed
+    //by the server while it sat in the pool, which we only find out when sending fails or the server closes it
+    //without answering, so then the requests without an answer go out again, once, on a new connection. Never
+    //after a timeout, where the server may just be slow and may have acted on the request, and never for a
+    //request that isn't idempotent, which the server may have acted on before closing.
+    std::vector<HttpResponse> exchange( const Url& url, const HttpRequest* requests, size_t count )
+    {
+        std::vector<HttpResponse> responses;
+        responses.reserve( count );
+        bool retried = false;
+        while ( responses.size() < count )
+        {
+            Host* host;
+            std::unique_ptr<Connection> connection = acquire( url, host );
+            bool reused = connection->served > 0;
+            size_t done = responses.size();
+            bool keep = false;
+            try
+            {
+                keep = exchangeOn( *host, *connection, requests + done, count - done, responses );
+            }
+            catch ( HttpTransportException )
+            {
+                bool stale = reused && !connection->receivedAny && connection->closedByPeer && !retried &&
+                    std::all_of( requests + done, requests + count, []( const HttpRequest& request )
+                        {
+                            return idempotent( request.method );
+                        } );
+                release( *host, std::move( connection ), false );
+                if ( !stale )
+                    throw;
+                retried = true;
+                m_counters.staleRetries++;
+                continue;
+            }
+            for ( size_t i = done; i < responses.size(); i++ )
+                responses[ i ].reusedConnection = reused || i > done;
+            release( *host, std::move( connection ), keep );
+        }
+        return responses;
+    }
+
+    //Pipelines requests on connection until they're answered or the server says it's closing the connection.
+    //Returns whether the connection can be kept.
+    bool exchangeOn( Host& host, Connection& connection, const HttpRequest* requests, size_t count,
+        std::vector<HttpResponse>& responses )
+    {
+        size_t depth = std::max<size_t>( m_options.pipelineDepth, 1 );
+        size_t sent = 0, answered = 0;
+        connection.receivedAny = false;
+        connection.closedByPeer = false;
+        while ( answered < count )
+        {
+            while ( sent < count && sent - answered < depth )
+            {
+                sendAll( connection, format( host.url, requests[ sent ], m_options.keepAlive ) );
+                m_counters.requests++;
+                if ( connection.served > 0 || sent > answered )
+                    m_counters.reusedRequests++;
+                sent++;
+                if ( !m_options.keepAlive )
+                    break; //one request per connection
+            }
+            HttpResponse response;
+            bool open = readResponse( connection, requests[ answered ].method == "HEAD", response );
+            responses.push_back( std::move( response ) );
+            answered++;
+            connection.served++;
+            if ( !open || !m_options.keepAlive )
+                return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<Connection> acquire( const Url& url, Host*& host )
+    {
+        std::unique_ptr<Connection> stale;
+        std::unique_lock<std::mutex> lock( m_mutex );
+        host = &hostFor( url );
+        bool waited = false;
+        while ( true )
+        {
+            while ( !host->idle.empty() )
+            {
+                std::unique_ptr<Connection> connection = std::move( host->idle.back() );
+                host->idle.pop_back();
+                if ( clock_t::now() - connection->idleSince < m_options.idleTimeout && stillOpen( *connection ) )
+                    return connection;
+                host->open--;
+                stale = std::move( connection );
+            }
+            if ( host->open < host->limit )
+                break;
+            if ( !waited )
+                m_counters.waitedForConnection++;
+            waited = true;
+            host->freed.wait( lock );
+        }
+        host->open++;
+        lock.unlock();
+        try
+        {
+            return connect( *host );
+        }
+        catch ( ... )
+        {
+            lock.lock();
+            host->open--;
+            host->freed.notify_one();
+            throw;
+        }
+    }
+
+    void release( Host& host, std::unique_ptr<Connection> connection, bool keep )
+    {
+        std::unique_ptr<Connection> closing;
+        std::lock_guard<std::mutex> lock( m_mutex );
+#ifdef HTTP_TRANSPORT_OPENSSL
+        if ( connection->ssl != nullptr && connection->served > 0 )
+            saveSession( host, connection->ssl );
+#endif
+        if ( keep )
+        {
+            connection->idleSince = clock_t::now();
+            host.idle.push_back( std::move( connection ) );
+        }
+        else
+        {
+            host.open--;
+            closing = std::move( connection );
+        }
+        host.freed.notify_one();
+    }
+
+    //An idle connection the server closed (or sent something on out of turn) reads as ready.
+    static bool stillOpen( Connection& connection )
+    {
+        pollfd ready = { connection.fd, POLLIN, 0 };
+        if ( poll( &ready, 1, 0 ) == 0 )
+            return true;
+#ifdef HTTP_TRANSPORT_OPENSSL
+        //Over TLS it can be a session ticket that came after the last answer. If it's the server closing after
+        //all, the retry in exchange() covers it.
+        char byte;
+        if ( connection.ssl != nullptr )
+            return recv( connection.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT ) > 0;
+#endif
+        return false;
+    }
+
+    std::unique_ptr<Connection> connect( Host& host )
+    {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if ( getaddrinfo( host.url.host.c_str(), std::to_string( host.url.port ).c_str(), &hints, &addresses ) != 0 )
+            throw HttpTransportException( "could not resolve " + host.url.host );
+
+        std::unique_ptr<Connection> connection( new Connection() );
+        for ( addrinfo* address = addresses; address != nullptr && connection->fd < 0; address = address->ai_next )
+        {
+            int fd = socket( address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+            if ( fd < 0 )
+                continue;
+            int result = ::connect( fd, address->ai_addr, address->ai_addrlen );
+            if ( result != 0 && errno == EINPROGRESS )
+            {
+                pollfd writable = { fd, POLLOUT, 0 };
+                int error = 0;
+                socklen_t length = sizeof( error );
+                if ( poll( &writable, 1, (int)m_options.connectTimeout.count() ) == 1 &&
+                    getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &length ) == 0 && error == 0 )
+                    result = 0;
+            }
+            if ( result != 0 )
+            {
+                ::close( fd );
+                continue;
+            }
+            connection->fd = fd;
+        }
+        freeaddrinfo( addresses );
+        if ( connection->fd < 0 )
+            throw HttpTransportException( "could not connect to " + host.url.origin() );
+        m_counters.connectionsOpened++;
+
+        //Blocking from here on, with the request timeout on every send and receive.
+        fcntl( connection->fd, F_SETFL, fcntl( connection->fd, F_GETFL ) & ~O_NONBLOCK );
+        int noDelay = 1;
+        setsockopt( connection->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+        timeval timeout = { (time_t)( m_options.requestTimeout.count() / 1000 ), (suseconds_t)( m_options.requestTimeout.count() % 1000 * 1000 ) };
+        setsockopt( connection->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+        setsockopt( connection->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+
+#ifdef HTTP_TRANSPORT_OPENSSL
+        if ( host.url.tls )
+            startTls( host, *connection );
+#endif
+        return connection;
+    }
+
+#ifdef HTTP_TRANSPORT_OPENSSL
+    void startTls( Host& host, Connection& connection )
+    {
+        connection.ssl = SSL_new( m_tls );
+        if ( connection.ssl == nullptr )
+            throw HttpTransportException( "could not set up TLS" );
+        SSL_set_fd( connection.ssl, connection.fd );
+        SSL_set_tlsext_host_name( connection.ssl, host.url.host.c_str() );
+        if ( m_options.verifyPeer )
+            SSL_set1_host( connection.ssl, host.url.host.c_str() );
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( host.session != nullptr )
+                SSL_set_session( connection.ssl, host.session );
+        }
+        if ( SSL_connect( connection.ssl ) != 1 )
+        {
+            char error[ 256 ];
+            ERR_error_string_n( ERR_get_error(), error, sizeof( error ) );
+            throw HttpTransportException( "TLS handshake with " + host.url.host + " failed: " + error );
+        }
+        if ( SSL_session_reused( connection.ssl ) )
+            m_counters.tlsResumedHandshakes++;
+        else
+            m_counters.tlsFullHandshakes++;
+    }
+
+    //With TLS 1.3 the session ticket comes after the handshake, so we take the session once an answer has been
+    //read. Called with m_mutex held.
+    static void saveSession( Host& host, SSL* ssl )
+    {
+        SSL_SESSION* session = SSL_get1_session( ssl );
+        if ( session == nullptr || session == host.session || !SSL_SESSION_is_resumable( session ) )
+        {
+            SSL_SESSION_free( session );
+            return;
+        }
+        if ( host.session != nullptr )
+            SSL_SESSION_free( host.session );
+        host.session = session;
+    }
+#endif
+
+    std::string format( const Url& url, const HttpRequest& request, bool keepAlive ) const
+    {
+        bool defaultPort = url.port == ( url.tls ? 443 : 80 );
+        std::string host = url.host.find( ':' ) != std::string::npos ? "[" + url.host + "]" : url.host; //IPv6
+        std::string text = request.method + " " + request.target + " HTTP/1.1\r\nHost: " + host +
+            ( defaultPort ? "" : ":" + std::to_string( url.port ) ) + "\r\n";
+        bool contentType = false;
+        for ( const auto& header : request.headers )
+        {
+            text += header.first + ": " + header.second + "\r\n";
+            contentType = contentType || strcasecmp( header.first.c_str(), "content-type" ) == 0;
+        }
+        if ( !request.body.empty() && !contentType )
+            text += "Content-Type: application/json\r\n";
+        if ( !request.body.empty() || request.method == "POST" || request.method == "PUT" )
+            text += "Content-Length: " + std::to_string( request.body.size() ) + "\r\n";
+        text += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        return text + request.body;
+    }
+
+    void sendAll( Connection& connection, const std::string& data )
+    {
+        for ( size_t sent = 0; sent < data.size(); )
+        {
+            long n;
+#ifdef HTTP_TRANSPORT_OPENSSL
+            if ( connection.ssl != nullptr )
+            {
+                NoSigpipe guard;
+                n = SSL_write( connection.ssl, data.data() + sent, (int)std::min<size_t>( data.size() - sent, 1 << 30 ) );
+            }
+            else
+#endif
+                n = ::send( connection.fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL );
+            if ( n <= 0 )
+            {
+                connection.closedByPeer = true;
+                throw HttpTransportException( "connection lost while sending" );
+            }
+            sent += n;
+        }
+        m_counters.bytesSent += data.size();
+    }
+
+    //Reads more of the answer into connection.in. Returns false if the server closed the connection.
+    bool receive( Connection& connection )
+    {
+        char buffer[ 16384 ];
+        long n;
+#ifdef HTTP_TRANSPORT_OPENSSL
+        if ( connection.ssl != nullptr )
+        {
+            n = SSL_read( connection.ssl, buffer, sizeof( buffer ) );
+            if ( n <= 0 && SSL_get_error( connection.ssl, (int)n ) == SSL_ERROR_ZERO_RETURN )
+            {
+                connection.closedByPeer = true;
+                return false;
+            }
+        }
+        else
+#endif
+            n = ::recv( connection.fd, buffer, sizeof( buffer ), 0 );
+        if ( n == 0 )
+        {
+            connection.closedByPeer = true;
+            return false;
+        }
+        if ( n < 0 )
+        {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                throw HttpTransportException( "timed out waiting for the answer" );
+            connection.closedByPeer = errno == ECONNRESET || errno == EPIPE;
+            throw HttpTransportException( "connection lost while receiving" );
+        }
+        connection.receivedAny = true;
+        connection.in.append( buffer, n );
+        m_counters.bytesReceived += n;
+        return true;
+    }
+
+    void receiveOrThrow( Connection& connection )
+    {
+        if ( !receive( connection ) )
+            throw HttpTransportException( "connection closed before the answer was complete" );
+    }
+
+    //Reads one answer off the connection. Returns false if the connection can't be used again.
+    bool readResponse( Connection& connection, bool head, HttpResponse& response )
+    {
+        size_t headerEnd;
+        while ( ( headerEnd = connection.in.find( "\r\n\r\n" ) ) == std::string::npos )
+            receiveOrThrow( connection );
+        if ( connection.in.compare( 0, 5, "HTTP/" ) != 0 )
+            throw HttpTransportException( "not an HTTP answer" );
+        bool http10 = connection.in.compare( 0, 8, "HTTP/1.0" ) == 0;
+        size_t space = connection.in.find( ' ' );
+        response.status = atoi( connection.in.c_str() + space + 1 );
+
+        long long contentLength = -1;
+        bool chunked = false, close = http10;
+        for ( size_t line = connection.in.find( "\r\n" ) + 2; line < headerEnd; )
+        {
+            size_t end = connection.in.find( "\r\n", line );
+            size_t colon = connection.in.find( ':', line );
+            if ( colon < end )
+            {
+                std::string name = connection.in.substr( line, colon - line );
+                size_t valueStart = connection.in.find_first_not_of( " \t", colon + 1 );
+                std::string value = valueStart < end ? connection.in.substr( valueStart, end - valueStart ) : std::string();
+                if ( strcasecmp( name.c_str(), "content-length" ) == 0 )
+                    contentLength = atoll( value.c_str() );
+                else if ( strcasecmp( name.c_str(), "transfer-encoding" ) == 0 )
+                    chunked = strcasestr( value.c_str(), "chunked" ) != nullptr;
+                else if ( strcasecmp( name.c_str(), "connection" ) == 0 )
+                    close = strcasestr( value.c_str(), "close" ) != nullptr || ( http10 && strcasestr( value.c_str(), "keep-alive" ) == nullptr );
+                response.headers.emplace_back( std::move( name ), std::move( value ) );
+            }
+            line = end + 2;
+        }
+        connection.in.erase( 0, headerEnd + 4 );
+
+        bool noBody = head || response.status == 204 || response.status == 304 || response.status / 100 == 1;
+        if ( noBody )
+            return !close;
+        if ( chunked )
+        {
+            while ( true )
+            {
+                size_t sizeEnd;
+                while ( ( sizeEnd = connection.in.find( "\r\n" ) ) == std::string::npos )
+                    receiveOrThrow( connection );
+                size_t size = (size_t)strtoull( connection.in.c_str(), nullptr, 16 );
+                if ( size == 0 )
+                {
+                    //Then trailers, if any, and an empty line.
+                    size_t afterSize = sizeEnd + 2;
+                    while ( true )
+                    {
+                        if ( connection.in.size() >= afterSize + 2 && connection.in.compare( afterSize, 2, "\r\n" ) == 0 )
+                        {
+                            connection.in.erase( 0, afterSize + 2 );
+                            return !close;
+                        }
+                        size_t trailersEnd = connection.in.find( "\r\n\r\n", afterSize );
+                        if ( trailersEnd != std::string::npos )
+                        {
+                            connection.in.erase( 0, trailersEnd + 4 );
+                            return !close;
+                        }
+                        receiveOrThrow( connection );
+                    }
+                }
+                while ( connection.in.size() < sizeEnd + 2 + size + 2 )
+                    receiveOrThrow( connection );
+                response.body.append( connection.in, sizeEnd + 2, size );
+                connection.in.erase( 0, sizeEnd + 2 + size + 2 );
+            }
+        }
+        if ( contentLength >= 0 )
+        {
+            while ( connection.in.size() < (size_t)contentLength )
+                receiveOrThrow( connection );
+            response.body = connection.in.substr( 0, (size_t)contentLength );
+            connection.in.erase( 0, (size_t)contentLength );
+            return !close;
+        }
+        //No length: the body runs until the server closes the connection.
+        while ( receive( connection ) )
+            ;
+        response.body.swap( connection.in );
+        return false;
+    }
+
+    HttpTransportOptions m_options;
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Host>> m_hosts;
+    Counters m_counters;
+#ifdef HTTP_TRANSPORT_OPENSSL
+    SSL_CTX* m_tls = nullptr;
+#endif
+};
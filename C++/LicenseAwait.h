@@ -0,0 +1,783 @@
+#pragma once
+
+//C++20 coroutines for the license calls that go online, so they can be co_awaited instead of blocking the thread
+//that makes them (often the UI thread):
+//
+//    LicenseTask<void> startup( LicenseAsync& async, std::shared_ptr<LicenseManager> manager, LicenseID id )
+//    {
+//        CallOptions options;
+//        options.timeout = std::chrono::seconds( 10 );
+//        License::ptr_t license = co_await async.activateLicense( manager, id, options );
+//        co_await async.check( license );
+//    }
+//
+//The SDK's calls block, so somebody has to wait for them: LicenseAsync runs them on a small pool of threads and
+//the coroutine is suspended meanwhile. A suspended coroutine is just its frame on the heap, so thousands of license
+//operations can be in flight at once for the price of the pool's threads, and the pool's size caps how many hit the
+//SDK (and the LicenseSpring servers) at the same time.
+//
+//When a call finishes, the coroutine is resumed through the executor given to LicenseAsync: post it to your event
+//loop (epoll, io_uring, a UI message loop, or the RunLoop below) to have every coroutine resume on that thread, or
+//leave it out to resume right on the thread that finished the call.
+//
+//Each call can have a timeout and a CancellationToken. Either one resumes the coroutine straight away with
+//OperationTimeoutException or OperationCancelledException. A call still waiting for a pool thread then isn't made;
+//one already running can't be interrupted, so it runs to the end on its pool thread and its result is dropped.
+//
+//Needs C++20 (/std:c++20 or -std=c++20).
+#include <LicenseSpring/LicenseManager.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Clock.h"
+
+class OperationTimeoutException : public std::runtime_error
+{
+public:
+    OperationTimeoutException() : std::runtime_error( "license operation timed out" ) {}
+};
+
+class OperationCancelledException : public std::runtime_error
+{
+public:
+    OperationCancelledException() : std::runtime_error( "license operation was cancelled" ) {}
+};
+
+//Handed to the calls that should stop when the source is cancelled, e.g. everything started for a window that
+//was closed. Copies share the same state.
+class CancellationToken
+{
+public:
+    CancellationToken() = default;
+
+    bool cancelled() const
+    {
+        if ( !m_state )
+            return false;
+        std::lock_guard<std::mutex> lock( m_state->mutex );
+        return m_state->cancelled;
+    }
+
+    //Calls callback once the source is cancelled (right away if it already is). Returns an id for
+    //removeCallback(), or 0 if it was called right away or the token can't be cancelled.
+    uint64_t onCancel( std::function<void()> callback ) const
+    {
+        if ( !m_state )
+            return 0;
+        {
+            std::lock_guard<std::mutex> lock( m_state->mutex );
+            if ( !m_state->cancelled )
+            {
+                m_state->callbacks[ ++m_state->nextId ] = std::move( callback );
+                return m_state->nextId;
+            }
+        }
+        callback();
+        return 0;
+    }
+
+    void removeCallback( uint64_t id ) const
+    {
+        if ( !m_state || id == 0 )
+            return;
+        std::lock_guard<std::mutex> lock( m_state->mutex );
+        m_state->callbacks.erase( id );
+    }
+
+private:
+    friend class CancellationSource;
+
+    struct State
+    {
+        std::mutex mutex;
+        bool cancelled = false;
+        uint64_t nextId = 0;
+        std::map<uint64_t, std::function<void()>> callbacks;
+    };
+
+    explicit CancellationToken( std::shared_ptr<State> state ) : m_state( state ) {}
+
+    std::shared_ptr<State> m_state;
+};
+
+class CancellationSource
+{
+public:
+    CancellationSource() : m_state( std::make_shared<CancellationToken::State>() ) {}
+
+    CancellationToken token() const { return CancellationToken( m_state ); }
+
+    //Calls the callbacks on this thread, outside the lock.
+    void cancel()
+    {
+        std::map<uint64_t, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock( m_state->mutex );
+            if ( m_state->cancelled )
+                return;
+            m_state->cancelled = true;
+            callbacks.swap( m_state->callbacks );
+        }
+        for ( auto& callback : callbacks )
+            callback.second();
+    }
+
+private:
+    std::shared_ptr<CancellationToken::State> m_state;
+};
+
+struct CallOptions
+{
+    //Zero means no timeout. Time spent waiting for a free pool thread counts.
+    std::chrono::milliseconds timeout{ 0 };
+    CancellationToken cancellation;
+};
+
+//The result of a coroutine. It starts when it's co_awaited, or when start() is called.
+template <typename T>
+class LicenseTask;
+
+template <typename T>
+struct LicenseTaskResult
+{
+    std::optional<T> value;
+    void return_value( T result ) { value = std::move( result ); }
+    T take() { return std::move( *value ); }
+};
+
+template <>
+struct LicenseTaskResult<void>
+{
+    void return_void() {}
+    void take() {}
+};
+
+template <typename T>
+class LicenseTask
+{
+public:
+    struct promise_type : LicenseTaskResult<T>
+    {
+        //The coroutine awaiting this one, finishedMark once this one is done, or detachedMark if its LicenseTask was
+        //destroyed first. A task started with start() can finish on another thread while it's being awaited or
+        //destroyed, so they meet here.
+        std::atomic<void*> continuation{ nullptr };
+        bool started = false;
+        std::function<void()> whenDone;
+        std::exception_ptr error;
+
+        LicenseTask get_return_object() { return LicenseTask( std::coroutine_handle<promise_type>::from_promise( *this ) ); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> handle ) noexcept
+            {
+                promise_type& promise = handle.promise();
+                //Everything is taken out of the promise first, whenDone may destroy the task.
+                std::function<void()> whenDone = std::move( promise.whenDone );
+                void* continuation = promise.continuation.exchange( finishedMark() );
+                if ( whenDone )
+                    whenDone();
+                //Its LicenseTask went away while it was running, so nobody will destroy it but us.
+                if ( continuation == detachedMark() )
+                {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                if ( continuation != nullptr )
+                    return std::coroutine_handle<>::from_address( continuation );
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+    };
+
+    LicenseTask( LicenseTask&& other ) noexcept : m_handle( std::exchange( other.m_handle, nullptr ) ) {}
+    LicenseTask& operator=( LicenseTask&& other ) noexcept
+    {
+        if ( this != &other )
+        {
+            release();
+            m_handle = std::exchange( other.m_handle, nullptr );
+        }
+        return *this;
+    }
+    LicenseTask( const LicenseTask& ) = delete;
+    LicenseTask& operator=( const LicenseTask& ) = delete;
+
+    //A task that was started and hasn't finished yet (e.g. the awaiting coroutine threw before awaiting it) is left
+    //to finish on its own and frees itself then, its call is still out and will resume it.
+    ~LicenseTask()
+    {
+        release();
+    }
+
+    //Runs the coroutine on this thread until its first co_await. whenDone is called once it has finished, on
+    //whichever thread it finished on. The task must stay alive until then.
+    void start( std::function<void()> whenDone = nullptr )
+    {
+        m_handle.promise().started = true;
+        m_handle.promise().whenDone = std::move( whenDone );
+        m_handle.resume();
+    }
+
+    bool done() const { return m_handle.done(); }
+
+    //Once done(): the coroutine's result, or its exception rethrown.
+    T result()
+    {
+        if ( m_handle.promise().error )
+            std::rethrow_exception( m_handle.promise().error );
+        return m_handle.promise().take();
+    }
+
+    //co_await task runs it (unless start() already has) and resumes the awaiting coroutine when it's done, without
+    //a thread hop.
+    auto operator co_await() noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+            {
+                promise_type& promise = handle.promise();
+                if ( !promise.started )
+                {
+                    promise.started = true;
+                    promise.continuation = awaiting.address();
+                    return handle;
+                }
+                void* expected = nullptr;
+                if ( promise.continuation.compare_exchange_strong( expected, awaiting.address() ) )
+                    return std::noop_coroutine(); //it resumes us when it's done
+                return awaiting; //already done
+            }
+            T await_resume()
+            {
+                if ( handle.promise().error )
+                    std::rethrow_exception( handle.promise().error );
+                return handle.promise().take();
+            }
+        };
+        return Awaiter{ m_handle };
+    }
+
+private:
+    explicit LicenseTask( std::coroutine_handle<promise_type> handle ) : m_handle( handle ) {}
+
+    void release()
+    {
+        if ( !m_handle )
+            return;
+        promise_type& promise = m_handle.promise();
+        if ( promise.started )
+        {
+            //Whoever was waiting for it isn't any more, so it's marked instead, unless it has finished already.
+            void* continuation = promise.continuation.load();
+            while ( continuation != finishedMark() )
+            {
+                if ( promise.continuation.compare_exchange_weak( continuation, detachedMark() ) )
+                {
+                    m_handle = nullptr;
+                    return;
+                }
+            }
+        }
+        m_handle.destroy();
+        m_handle = nullptr;
+    }
+
+    static void* finishedMark()
+    {
+        static char mark;
+        return &mark;
+    }
+
+    static void* detachedMark()
+    {
+        static char mark;
+        return &mark;
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+//A minimal event loop, for a thread that has none of its own (a console app's main thread, a test). Pass
+//executor() to LicenseAsync, and the coroutines resume on whichever thread calls run().
+class RunLoop
+{
+public:
+    void post( std::function<void()> task )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_tasks.push_back( std::move( task ) );
+        }
+        m_wake.notify_one();
+    }
+
+    std::function<void( std::function<void()> )> executor()
+    {
+        return [ this ]( std::function<void()> task ) { post( std::move( task ) ); };
+    }
+
+    //Runs posted tasks until stop() is called.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true )
+        {
+            m_wake.wait( lock, [ this ]() { return m_stopping || !m_tasks.empty(); } );
+            if ( m_tasks.empty() )
+            {
+                m_stopping = false;
+                return;
+            }
+            std::function<void()> task = std::move( m_tasks.front() );
+            m_tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    //run() returns once the tasks posted so far have run.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+    }
+
+    //Starts task on this loop and runs the loop until it's done. Returns its result, or throws its exception.
+    template <typename T>
+    T wait( LicenseTask<T>& task )
+    {
+        post( [ this, &task ]() { task.start( [ this ]() { stop(); } ); } );
+        run();
+        return task.result();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+};
+
+//Runs the awaitable calls and keeps their timeouts.
+class LicenseAsync
+{
+public:
+    using Executor = std::function<void( std::function<void()> )>;
+
+    //threads is how many SDK calls can run at once; more wait for a free thread. resume is where coroutines are
+    //resumed when a call finishes, see the top of the file.
+    explicit LicenseAsync( size_t threads = 16, Executor resume = nullptr,
+        std::shared_ptr<Clock> clock = SystemClock::instance() )
+        : m_resume( resume ), m_clock( clock )
+    {
+        for ( size_t i = 0; i < std::max<size_t>( threads, 1 ); ++i )
+            m_threads.emplace_back( [ this ]() { runCalls(); } );
+        m_timerThread = std::thread( [ this ]() { runTimers(); } );
+    }
+
+    //Calls already queued still run, and their coroutines are resumed. Don't destroy it from a pool thread.
+    ~LicenseAsync()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_work.notify_all();
+        m_timerWake.notify_all();
+        for ( std::thread& thread : m_threads )
+            thread.join();
+        m_timerThread.join();
+    }
+
+    //co_await on what this returns runs function on the pool and gives back its result or exception.
+    template <typename Result>
+    class Call
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend( std::coroutine_handle<> handle )
+        {
+            //Everything we need from here on is copied out first: the call can finish and resume the coroutine
+            //(destroying this awaiter) before await_suspend returns.
+            std::shared_ptr<State> state = m_state;
+            LicenseAsync* async = m_async;
+            CallOptions options = m_options;
+            std::function<Result()> function = std::move( m_function );
+            state->handle = handle;
+            state->resume = async->m_resume;
+            state->async = async;
+            state->cancellation = options.cancellation;
+            if ( options.cancellation.cancelled() )
+            {
+                state->outcome = Outcome::Cancelled;
+                return false;
+            }
+
+            uint64_t timerId = 0;
+            if ( options.timeout.count() > 0 )
+                timerId = async->addTimer( async->m_clock->steadyNow() + options.timeout, [ state ]() { state->finish( Outcome::TimedOut ); } );
+            uint64_t cancelId = options.cancellation.onCancel( [ state ]() { state->finish( Outcome::Cancelled ); } );
+            if ( !state->armed( timerId, cancelId ) )
+                return true; //timed out or cancelled already, no point making the call
+
+            async->post( [ state, function ]()
+                {
+                    //Timed out or cancelled while it waited for a pool thread, so the call isn't made at all.
+                    if ( state->isFinished() )
+                        return;
+                    std::optional<Stored> value;
+                    std::exception_ptr error;
+                    try
+                    {
+                        if constexpr ( std::is_void_v<Result> )
+                        {
+                            function();
+                            value = true;
+                        }
+                        else
+                            value = function();
+                    }
+                    catch ( ... )
+                    {
+                        error = std::current_exception();
+                    }
+                    state->finish( Outcome::Done, std::move( value ), error );
+                } );
+            return true;
+        }
+
+        Result await_resume()
+        {
+            if ( m_state->outcome == Outcome::TimedOut )
+                throw OperationTimeoutException();
+            if ( m_state->outcome == Outcome::Cancelled )
+                throw OperationCancelledException();
+            if ( m_state->error )
+                std::rethrow_exception( m_state->error );
+            if constexpr ( !std::is_void_v<Result> )
+                return std::move( *m_state->value );
+        }
+
+    private:
+        friend class LicenseAsync;
+
+        using Stored = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+        enum class Outcome { Pending, Done, TimedOut, Cancelled };
+
+        //Shared by the awaiter, the pool thread, the timer and the cancellation callback. Whichever finishes first
+        //decides the outcome and resumes the coroutine, the others find it finished and do nothing.
+        struct State
+        {
+            std::mutex mutex;
+            bool finished = false;
+            bool isArmed = false;
+            uint64_t timerId = 0;
+            uint64_t cancelId = 0;
+            Outcome outcome = Outcome::Pending;
+            std::optional<Stored> value;
+            std::exception_ptr error;
+            std::coroutine_handle<> handle;
+            Executor resume;
+            LicenseAsync* async = nullptr;
+            CancellationToken cancellation;
+
+            bool isFinished()
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                return finished;
+            }
+
+            //Returns false if it finished while we were setting up.
+            bool armed( uint64_t timer, uint64_t cancel )
+            {
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if ( !finished )
+                    {
+                        timerId = timer;
+                        cancelId = cancel;
+                        isArmed = true;
+                        return true;
+                    }
+                }
+                async->removeTimer( timer );
+                cancellation.removeCallback( cancel );
+                return false;
+            }
+
+            void finish( Outcome how, std::optional<Stored> result = std::nullopt, std::exception_ptr failure = nullptr )
+            {
+                uint64_t timer = 0, cancel = 0;
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    if ( finished )
+                        return;
+                    finished = true;
+                    outcome = how;
+                    value = std::move( result );
+                    error = failure;
+                    if ( isArmed )
+                    {
+                        timer = timerId;
+                        cancel = cancelId;
+                    }
+                }
+                async->removeTimer( timer );
+                cancellation.removeCallback( cancel );
+                std::coroutine_handle<> coroutine = handle;
+                if ( resume )
+                    resume( [ coroutine ]() { coroutine.resume(); } );
+                else
+                    coroutine.resume();
+            }
+        };
+
+        Call( LicenseAsync* async, std::function<Result()> function, const CallOptions& options )
+            : m_async( async ), m_function( std::move( function ) ), m_options( options ), m_state( std::make_shared<State>() )
+        {}
+
+        LicenseAsync* m_async;
+        std::function<Result()> m_function;
+        CallOptions m_options;
+        std::shared_ptr<State> m_state;
+    };
+
+    //Any blocking call. function must own what it uses (capture shared_ptrs and copies), since after a timeout it
+    //keeps running while the coroutine has moved on.
+    template <typename Function>
+    Call<std::invoke_result_t<Function>> call( Function function, const CallOptions& options = CallOptions() )
+    {
+        return Call<std::invoke_result_t<Function>>( this, std::move( function ), options );
+    }
+
+    //A call starts when it's awaited. To have several out at once, start each with startNow() and co_await the
+    //tasks afterwards.
+    template <typename Result>
+    static LicenseTask<Result> startNow( Call<Result> call )
+    {
+        LicenseTask<Result> task = awaitCall( std::move( call ) );
+        task.start();
+        return task;
+    }
+
+    //The LicenseManager calls that go online.
+    Call<LicenseSpring::License::ptr_t> activateLicense( std::shared_ptr<LicenseSpring::LicenseManager> manager,
+        const LicenseSpring::LicenseID& licenseId, const CallOptions& options = CallOptions() )
+    {
+        return call( [ manager, licenseId ]() { return manager->activateLicense( licenseId ); }, options );
+    }
+
+    Call<LicenseSpring::LicenseID> getTrialLicense( std::shared_ptr<LicenseSpring::LicenseManager> manager,
+        LicenseSpring::Customer::ptr_t customer = nullptr, const CallOptions& options = CallOptions() )
+    {
+        return call( [ manager, customer ]() { return manager->getTrialLicense( customer ); }, options );
+    }
+
+    Call<std::vector<std::string>> getVersionList( std::shared_ptr<LicenseSpring::LicenseManager> manager,
+        const LicenseSpring::LicenseID& licenseId, const CallOptions& options = CallOptions() )
+    {
+        return call( [ manager, licenseId ]() { return manager->getVersionList( licenseId ); }, options );
+    }
+
+    Call<LicenseSpring::InstallationFile::ptr_t> getInstallationFile( std::shared_ptr<LicenseSpring::LicenseManager> manager,
+        const LicenseSpring::LicenseID& licenseId, const std::string& version = std::string(), const CallOptions& options = CallOptions() )
+    {
+        return call( [ manager, licenseId, version ]() { return manager->getInstallationFile( licenseId, version ); }, options );
+    }
+
+    Call<LicenseSpring::ProductDetails> getProductDetails( std::shared_ptr<LicenseSpring::LicenseManager> manager,
+        const CallOptions& options = CallOptions() )
+    {
+        return call( [ manager ]() { return manager->getProductDetails(); }, options );
+    }
+
+    //The License calls that go online.
+    Call<LicenseSpring::InstallationFile::ptr_t> check( LicenseSpring::License::ptr_t license, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { return license->check(); }, options );
+    }
+
+    Call<bool> deactivate( LicenseSpring::License::ptr_t license, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { return license->deactivate(); }, options );
+    }
+
+    Call<bool> syncConsumption( LicenseSpring::License::ptr_t license, int requestOverage = -1, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license, requestOverage ]() { return license->syncConsumption( requestOverage ); }, options );
+    }
+
+    //An empty code syncs every feature.
+    Call<void> syncFeatureConsumption( LicenseSpring::License::ptr_t license, const std::string& featureCode = std::string(),
+        const CallOptions& options = CallOptions() )
+    {
+        return call( [ license, featureCode ]() { license->syncFeatureConsumption( featureCode ); }, options );
+    }
+
+    Call<void> registerFloatingLicense( LicenseSpring::License::ptr_t license, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { license->registerFloatingLicense(); }, options );
+    }
+
+    Call<void> releaseFloatingLicense( LicenseSpring::License::ptr_t license, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { license->releaseFloatingLicense(); }, options );
+    }
+
+    Call<void> sendDeviceVariables( LicenseSpring::License::ptr_t license, const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { license->sendDeviceVariables(); }, options );
+    }
+
+    Call<std::vector<LicenseSpring::DeviceVariable>> getDeviceVariables( LicenseSpring::License::ptr_t license,
+        const CallOptions& options = CallOptions() )
+    {
+        return call( [ license ]() { return license->getDeviceVariables( true ); }, options );
+    }
+
+    Call<bool> changePassword( LicenseSpring::License::ptr_t license, const std::string& password, const std::string& newPassword,
+        const CallOptions& options = CallOptions() )
+    {
+        return call( [ license, password, newPassword ]() { return license->changePassword( password, newPassword ); }, options );
+    }
+
+    //How many calls are waiting for a pool thread.
+    size_t queued()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_calls.size();
+    }
+
+private:
+    template <typename Result>
+    static LicenseTask<Result> awaitCall( Call<Result> call )
+    {
+        co_return co_await call;
+    }
+
+    void post( std::function<void()> call )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_calls.push_back( std::move( call ) );
+        }
+        m_work.notify_one();
+    }
+
+    void runCalls()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true )
+        {
+            m_work.wait( lock, [ this ]() { return m_stopping || !m_calls.empty(); } );
+            if ( m_calls.empty() )
+                return;
+            std::function<void()> call = std::move( m_calls.front() );
+            m_calls.pop_front();
+            lock.unlock();
+            call();
+            lock.lock();
+        }
+    }
+
+    uint64_t addTimer( Clock::steady_time deadline, std::function<void()> fire )
+    {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            id = ++m_nextTimer;
+            m_timers[ { deadline, id } ] = std::move( fire );
+            m_timerDeadlines[ id ] = deadline;
+        }
+        m_timerWake.notify_all();
+        return id;
+    }
+
+    void removeTimer( uint64_t id )
+    {
+        if ( id == 0 )
+            return;
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto found = m_timerDeadlines.find( id );
+        if ( found == m_timerDeadlines.end() )
+            return;
+        m_timers.erase( { found->second, id } );
+        m_timerDeadlines.erase( found );
+    }
+
+    //Fires timeouts in deadline order. The callbacks run outside the lock.
+    void runTimers()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( !m_stopping || !m_timers.empty() )
+        {
+            if ( m_timers.empty() )
+            {
+                m_timerWake.wait( lock, [ this ]() { return m_stopping || !m_timers.empty(); } );
+                continue;
+            }
+            auto first = m_timers.begin()->first;
+            if ( m_clock->steadyNow() < first.first )
+            {
+                //Wakes up for the deadline, a new earlier timer, or this one being removed.
+                m_clock->waitUntil( lock, m_timerWake, first.first, [ this, first ]()
+                    {
+                        return m_timers.empty() || m_timers.begin()->first != first || m_stopping;
+                    } );
+                if ( m_stopping )
+                    break;
+                continue;
+            }
+            std::function<void()> fire = std::move( m_timers.begin()->second );
+            m_timers.erase( m_timers.begin() );
+            m_timerDeadlines.erase( first.second );
+            lock.unlock();
+            fire();
+            lock.lock();
+        }
+    }
+
+    Executor m_resume;
+    std::shared_ptr<Clock> m_clock;
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_timerWake;
+    std::deque<std::function<void()>> m_calls;
+    std::map<std::pair<Clock::steady_time, uint64_t>, std::function<void()>> m_timers;
+    std::unordered_map<uint64_t, Clock::steady_time> m_timerDeadlines;
+    uint64_t m_nextTimer = 0;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+    std::thread m_timerThread;
+};
@@ -0,0 +1,485 @@
+#pragma once
+
+//Push-style license notifications. Instead of each part of an app polling the license (is it still active? did a
+//feature change? how many consumptions are left?), a LicenseStateWatcher compares the license after every check
+//with how it was after the previous one, and publishes what changed as typed events on a LicenseEventBus.
+//Subscribers are called on the bus's executor, never on the thread that ran the check.
+//
+//The watcher can also long-poll: given a LicenseChangeSource (e.g. a server endpoint that holds the request until
+//the license changes), it waits there and only refreshes the license when something actually changed.
+#include <LicenseSpring/LicenseManager.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LicenseEventType
+{
+    Activated,
+    Deactivated,
+    Expired,
+    Disabled,
+    FeatureChanged,
+    ConsumptionLow,
+    FloatingSeatLost
+};
+
+inline const char* licenseEventName( LicenseEventType type )
+{
+    switch ( type )
+    {
+    case LicenseEventType::Activated: return "activated";
+    case LicenseEventType::Deactivated: return "deactivated";
+    case LicenseEventType::Expired: return "expired";
+    case LicenseEventType::Disabled: return "disabled";
+    case LicenseEventType::FeatureChanged: return "feature changed";
+    case LicenseEventType::ConsumptionLow: return "consumption low";
+    case LicenseEventType::FloatingSeatLost: return "floating seat lost";
+    }
+    return "unknown";
+}
+
+struct LicenseEvent
+{
+    LicenseEventType type;
+    std::string feature; //feature code for FeatureChanged and feature ConsumptionLow, empty for the license itself
+    std::string detail;
+    int remaining = 0; //consumptions left, for ConsumptionLow
+};
+
+//The parts of a license the watcher compares. Plain values, so it can be captured from a License or filled in by
+//anything else that knows the license's state (like a mock server).
+struct LicenseFeatureState
+{
+    bool expired = false;
+    int totalConsumption = 0;
+    int maxConsumption = 0; //0 for features that aren't consumption based
+};
+
+struct LicenseState
+{
+    bool present = false; //false when there's no local license
+    bool active = false;
+    bool enabled = true;
+    bool expired = false;
+    bool floatingSeat = false; //whether we hold a floating seat, the license itself doesn't say, see setFloatingSeat()
+    int totalConsumption = 0;
+    int maxConsumption = 0;
+    int maxOverages = 0;
+    std::map<std::string, LicenseFeatureState> features;
+
+    static LicenseState capture( LicenseSpring::License::ptr_t license )
+    {
+        LicenseState state;
+        if ( license == nullptr )
+            return state;
+        state.present = true;
+        state.active = license->isActive();
+        state.enabled = license->isEnabled();
+        state.expired = license->isExpired();
+        state.totalConsumption = license->totalConsumption();
+        state.maxConsumption = license->maxConsumption();
+        state.maxOverages = license->maxOverages();
+        for ( const LicenseSpring::LicenseFeature& feature : license->features() )
+        {
+            LicenseFeatureState& featureState = state.features[ feature.code() ];
+            featureState.expired = feature.isExpired();
+            featureState.totalConsumption = feature.totalConsumption();
+            if ( feature.featureType() == LicenseSpring::FeatureTypeConsumption )
+                featureState.maxConsumption = feature.maxConsumption();
+        }
+        return state;
+    }
+};
+
+//Runs tasks one at a time, in the order they were posted, on its own thread.
+class SerialExecutor
+{
+public:
+    SerialExecutor() : m_thread( [ this ]() { run(); } ) {}
+
+    //Runs what's already posted, then stops.
+    ~SerialExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    void post( std::function<void()> task )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_tasks.push_back( std::move( task ) );
+        }
+        m_wake.notify_all();
+    }
+
+    //Waits until everything posted so far has run. Don't call it from a task.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_idle.wait( lock, [ this ]() { return m_tasks.empty() && !m_running; } );
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( true )
+        {
+            m_wake.wait( lock, [ this ]() { return m_stopping || !m_tasks.empty(); } );
+            if ( m_tasks.empty() )
+                return;
+            std::function<void()> task = std::move( m_tasks.front() );
+            m_tasks.pop_front();
+            m_running = true;
+            lock.unlock();
+            task();
+            lock.lock();
+            m_running = false;
+            if ( m_tasks.empty() )
+                m_idle.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_running = false;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+//Delivers license events to whoever subscribed to them. By default callbacks run on the bus's own thread, one at
+//a time and in the order the events happened, so a slow callback delays the ones after it but never the check
+//that found the change. Pass an executor to run them somewhere else instead (e.g. post them to your UI thread).
+class LicenseEventBus
+{
+public:
+    using Callback = std::function<void( const LicenseEvent& )>;
+    using Executor = std::function<void( std::function<void()> )>;
+
+    LicenseEventBus() : m_serial( new SerialExecutor() )
+    {
+        SerialExecutor* serial = m_serial.get();
+        m_executor = [ serial ]( std::function<void()> task ) { serial->post( std::move( task ) ); };
+    }
+
+    explicit LicenseEventBus( Executor executor ) : m_executor( executor ) {}
+
+    //Subscribes to every event. Returns an id for unsubscribe().
+    uint64_t subscribe( Callback callback )
+    {
+        return add( callback, nullptr );
+    }
+
+    uint64_t subscribe( LicenseEventType type, Callback callback )
+    {
+        return add( callback, std::make_shared<LicenseEventType>( type ) );
+    }
+
+    //Events that haven't started being delivered to this subscriber won't be.
+    void unsubscribe( uint64_t id )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto found = m_subscribers.find( id );
+        if ( found == m_subscribers.end() )
+            return;
+        found->second->active = false;
+        m_subscribers.erase( found );
+    }
+
+    void publish( const LicenseEvent& event )
+    {
+        std::vector<std::shared_ptr<Subscriber>> subscribers;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            for ( auto& entry : m_subscribers )
+                if ( entry.second->type == nullptr || *entry.second->type == event.type )
+                    subscribers.push_back( entry.second );
+        }
+        if ( subscribers.empty() )
+            return;
+        m_executor( [ subscribers, event ]()
+            {
+                for ( const std::shared_ptr<Subscriber>& subscriber : subscribers )
+                    if ( subscriber->active )
+                        subscriber->callback( event );
+            } );
+    }
+
+    //Waits until the events published so far were delivered. Only works with the bus's own executor, and not
+    //from a callback.
+    void flush()
+    {
+        if ( m_serial != nullptr )
+            m_serial->flush();
+    }
+
+private:
+    struct Subscriber
+    {
+        Callback callback;
+        std::shared_ptr<LicenseEventType> type; //nullptr for all types
+        std::atomic<bool> active{ true };
+    };
+
+    uint64_t add( Callback callback, std::shared_ptr<LicenseEventType> type )
+    {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->callback = callback;
+        subscriber->type = type;
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_subscribers[ ++m_nextId ] = subscriber;
+        return m_nextId;
+    }
+
+    std::mutex m_mutex;
+    std::map<uint64_t, std::shared_ptr<Subscriber>> m_subscribers;
+    uint64_t m_nextId = 0;
+    Executor m_executor;
+    std::unique_ptr<SerialExecutor> m_serial; //declared last, so it's drained first while the rest still exists
+};
+
+//Tells the watcher when the license changed, so it doesn't have to ask the server on a timer.
+class LicenseChangeSource
+{
+public:
+    virtual ~LicenseChangeSource() {}
+
+    //Blocks until the license's version is different from version, or timeout passes, and returns the version
+    //it has then. Throws if it can't reach wherever the changes come from.
+    virtual uint64_t waitForChange( uint64_t version, std::chrono::milliseconds timeout ) = 0;
+
+    //Makes a waitForChange() in progress, and any after it, return right away so the watcher can stop.
+    virtual void cancel() {}
+};
+
+struct LicenseEventPolicy
+{
+    //ConsumptionLow is published when the consumptions left drop to this share of the maximum (overages included)
+    //or to lowConsumptionUnits, whichever is more. It's published once when crossing, not on every check.
+    double lowConsumptionShare = 0.1;
+    int lowConsumptionUnits = 0;
+    std::chrono::milliseconds longPollTimeout = std::chrono::seconds( 30 );
+    std::chrono::milliseconds longPollRetryDelay = std::chrono::seconds( 5 ); //after a failed long-poll or refresh
+};
+
+//The state-diff engine. Feed it the license after every check (update()) and it publishes what changed. The first
+//update is compared with an empty state, so subscribers hear about an already active license too.
+class LicenseStateWatcher
+{
+public:
+    explicit LicenseStateWatcher( LicenseEventBus& bus, const LicenseEventPolicy& policy = LicenseEventPolicy() )
+        : m_bus( bus ), m_policy( policy )
+    {}
+
+    ~LicenseStateWatcher()
+    {
+        stopLongPoll();
+    }
+
+    std::vector<LicenseEvent> update( const LicenseState& state )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return updateLocked( state, "" );
+    }
+
+    std::vector<LicenseEvent> update( LicenseSpring::License::ptr_t license )
+    {
+        return update( capture( license ) );
+    }
+
+    //Captures the license, keeping the floating seat as it was last reported.
+    LicenseState capture( LicenseSpring::License::ptr_t license )
+    {
+        LicenseState state = LicenseState::capture( license );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        state.floatingSeat = m_last.floatingSeat && state.active;
+        return state;
+    }
+
+    //Whoever registers the floating license reports here whether we still hold the seat (e.g. from
+    //FloatingRenewer's seat lost callback), losing it publishes FloatingSeatLost with the reason.
+    std::vector<LicenseEvent> setFloatingSeat( bool held, const std::string& reason = "" )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        LicenseState state = m_last;
+        state.floatingSeat = held;
+        return updateLocked( state, reason );
+    }
+
+    LicenseState state()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_last;
+    }
+
+    //Waits on source for changes on a background thread, and when there is one calls refresh() for the new state
+    //(e.g. [ & ]() { license->check(); return watcher.capture( license ); }) and publishes the difference.
+    void startLongPoll( std::shared_ptr<LicenseChangeSource> source, std::function<LicenseState()> refresh )
+    {
+        stopLongPoll();
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_source = source;
+        m_stopping = false;
+        m_thread = std::thread( [ this, source, refresh ]() { longPoll( source, refresh ); } );
+    }
+
+    void stopLongPoll()
+    {
+        std::shared_ptr<LicenseChangeSource> source;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+            source = m_source;
+        }
+        m_wake.notify_all();
+        if ( source != nullptr )
+            source->cancel();
+        if ( m_thread.joinable() )
+            m_thread.join();
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_source = nullptr;
+    }
+
+private:
+    std::vector<LicenseEvent> updateLocked( const LicenseState& state, const std::string& seatLostReason )
+    {
+        std::vector<LicenseEvent> events = diff( m_last, state );
+        m_last = state;
+        for ( LicenseEvent& event : events )
+        {
+            if ( event.type == LicenseEventType::FloatingSeatLost && !seatLostReason.empty() )
+                event.detail = seatLostReason;
+            m_bus.publish( event );
+        }
+        return events;
+    }
+
+    bool isLow( int remaining, int maximum ) const
+    {
+        int threshold = std::max( (int)( maximum * m_policy.lowConsumptionShare ), m_policy.lowConsumptionUnits );
+        return remaining <= threshold;
+    }
+
+    std::vector<LicenseEvent> diff( const LicenseState& before, const LicenseState& after ) const
+    {
+        std::vector<LicenseEvent> events;
+        auto add = [ &events ]( LicenseEventType type, const std::string& feature, const std::string& detail, int remaining )
+        {
+            LicenseEvent event;
+            event.type = type;
+            event.feature = feature;
+            event.detail = detail;
+            event.remaining = remaining;
+            events.push_back( event );
+        };
+
+        if ( !before.active && after.active )
+            add( LicenseEventType::Activated, "", "", 0 );
+        if ( before.active && !after.active )
+            add( LicenseEventType::Deactivated, "", after.present ? "" : "local license removed", 0 );
+        if ( !before.expired && after.expired )
+            add( LicenseEventType::Expired, "", "", 0 );
+        if ( before.enabled && !after.enabled )
+            add( LicenseEventType::Disabled, "", "", 0 );
+        if ( before.floatingSeat && !after.floatingSeat && after.active )
+            add( LicenseEventType::FloatingSeatLost, "", "", 0 );
+
+        int maximum = after.maxConsumption + after.maxOverages;
+        if ( after.present && after.maxConsumption > 0 )
+        {
+            int remaining = maximum - after.totalConsumption;
+            bool wasLow = before.maxConsumption > 0 &&
+                isLow( before.maxConsumption + before.maxOverages - before.totalConsumption, before.maxConsumption + before.maxOverages );
+            if ( isLow( remaining, maximum ) && !wasLow )
+                add( LicenseEventType::ConsumptionLow, "", std::to_string( remaining ) + " of " + std::to_string( maximum ) + " left", remaining );
+        }
+
+        //Features that were added, removed or changed, then the consumption features that are running low.
+        for ( const auto& entry : before.features )
+            if ( after.features.count( entry.first ) == 0 )
+                add( LicenseEventType::FeatureChanged, entry.first, "removed", 0 );
+        for ( const auto& entry : after.features )
+        {
+            const LicenseFeatureState& feature = entry.second;
+            auto previous = before.features.find( entry.first );
+            if ( previous == before.features.end() )
+                add( LicenseEventType::FeatureChanged, entry.first, "added", 0 );
+            else if ( previous->second.expired != feature.expired )
+                add( LicenseEventType::FeatureChanged, entry.first, feature.expired ? "expired" : "renewed", 0 );
+            else if ( previous->second.maxConsumption != feature.maxConsumption )
+                add( LicenseEventType::FeatureChanged, entry.first, "max consumption changed to " + std::to_string( feature.maxConsumption ), 0 );
+
+            if ( feature.maxConsumption <= 0 )
+                continue;
+            int remaining = feature.maxConsumption - feature.totalConsumption;
+            bool wasLow = previous != before.features.end() && previous->second.maxConsumption > 0 &&
+                isLow( previous->second.maxConsumption - previous->second.totalConsumption, previous->second.maxConsumption );
+            if ( isLow( remaining, feature.maxConsumption ) && !wasLow )
+                add( LicenseEventType::ConsumptionLow, entry.first,
+                    std::to_string( remaining ) + " of " + std::to_string( feature.maxConsumption ) + " left", remaining );
+        }
+        return events;
+    }
+
+    void longPoll( std::shared_ptr<LicenseChangeSource> source, std::function<LicenseState()> refresh )
+    {
+        uint64_t version = 0;
+        bool first = true;
+        while ( true )
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                if ( m_stopping )
+                    return;
+            }
+            try
+            {
+                uint64_t latest = source->waitForChange( version, m_policy.longPollTimeout );
+                //We refresh once at the start too, the license may have changed before we were listening.
+                if ( latest != version || first )
+                {
+                    LicenseState state = refresh();
+                    std::lock_guard<std::mutex> lock( m_mutex );
+                    if ( m_stopping )
+                        return;
+                    updateLocked( state, "" );
+                    version = latest;
+                    first = false;
+                }
+            }
+            catch ( const std::exception& )
+            {
+                //The server or the network is having a bad time, we'll try again in a bit.
+                std::unique_lock<std::mutex> lock( m_mutex );
+                m_wake.wait_for( lock, m_policy.longPollRetryDelay, [ this ]() { return m_stopping; } );
+            }
+        }
+    }
+
+    LicenseEventBus& m_bus;
+    LicenseEventPolicy m_policy;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    LicenseState m_last;
+    std::shared_ptr<LicenseChangeSource> m_source;
+    bool m_stopping = true;
+    std::thread m_thread;
+};
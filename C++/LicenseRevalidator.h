@@ -0,0 +1,193 @@
+#pragma once
+
+//Starting from the local license instead of waiting for an online check, as long as the local license was checked
+//online recently (stale-while-revalidate). The local license file is signed by the LicenseSpring servers, and
+//localCheck() verifies that signature, so the date of the last online check inside it can't be moved forward by
+//editing the file. If that date is within the grace window, the app starts right away and the online check runs in
+//the background:
+//    - the server says the license is fine: nothing changes, the license is just fresher
+//    - the server says it isn't (disabled, expired, not found, ...): access is revoked through a callback
+//    - the server can't be reached: we keep trying, and revoke only once the grace window has run out
+//If the local license is older than the grace window, the app should check online before starting, as usual.
+#include <LicenseSpring/LicenseManager.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "Clock.h"
+#include "ExpiryScheduler.h"
+#include "WorkerPool.h"
+
+struct RevalidationPolicy
+{
+    //How long after the last online check we start without waiting for the next one, and keep going while the
+    //servers can't be reached.
+    std::chrono::hours graceWindow{ 72 };
+    //How often the background check tries again while the servers can't be reached.
+    std::chrono::seconds retryInterval{ 60 };
+};
+
+class LicenseRevalidator
+{
+public:
+    enum class Status
+    {
+        Revalidating, //started from the local license, the online check hasn't answered yet
+        Verified, //the online check went through
+        Offline, //the servers can't be reached, still within the grace window
+        Revoked
+    };
+
+    //Checks the license online. Returns false if the servers couldn't be reached, and throws if they answered
+    //that the license isn't valid, like NetworkGuard::tryCall() (see CircuitBreaker.h).
+    using OnlineCheck = std::function<bool()>;
+    //Called once, on the background thread, with the reason access was revoked.
+    using Revoke = std::function<void( const std::string& )>;
+
+    //The background check runs on pool if one is given (see WorkerPool.h), otherwise on its own thread.
+    LicenseRevalidator( OnlineCheck check, Revoke revoke, const RevalidationPolicy& policy = RevalidationPolicy(),
+        std::shared_ptr<Clock> clock = SystemClock::instance(), WorkerPool* pool = nullptr )
+        : m_check( check ), m_revoke( revoke ), m_policy( policy ), m_clock( clock ), m_loop( pool, TaskPriority::Normal, clock )
+    {}
+
+    ~LicenseRevalidator()
+    {
+        stop();
+    }
+
+    //When the license was last checked online, in epoch milliseconds, or noDeadline if never. Call localCheck()
+    //first: this date is only as trustworthy as the license file's signature.
+    static int64_t lastVerified( LicenseSpring::License::ptr_t license )
+    {
+        return license == nullptr ? noDeadline : ExpiryScheduler::fromDate( license->lastCheckDate() );
+    }
+
+    //Whether a license last checked online at lastVerified is recent enough to start from without waiting. A date
+    //in the future means the clock was turned back, so that doesn't count as recent either.
+    bool fresh( int64_t lastVerified )
+    {
+        int64_t now = m_clock->epochMillis();
+        int64_t grace = std::chrono::duration_cast<std::chrono::milliseconds>( m_policy.graceWindow ).count();
+        return lastVerified != noDeadline && lastVerified <= now + 60 * 1000 && now - lastVerified <= grace;
+    }
+
+    //Starts checking online in the background, allowing access in the meantime. onVerified, if given, is called
+    //on the background thread once the check goes through, e.g. to start work that should wait for it.
+    void startInBackground( int64_t lastVerified, std::function<void()> onVerified = nullptr )
+    {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_lastVerified = lastVerified;
+            m_status = Status::Revalidating;
+        }
+        m_loop.start( [ this, onVerified ]() { return step( onVerified ); } );
+    }
+
+    //For a license that was just checked online in the foreground: nothing to revalidate.
+    void setVerified()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_lastVerified = m_clock->epochMillis();
+        m_status = Status::Verified;
+    }
+
+    bool allowed()
+    {
+        return status() != Status::Revoked;
+    }
+
+    Status status()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_status;
+    }
+
+    //Waits until the background check has an answer (verified or revoked), or the timeout passes. Returns the
+    //status either way.
+    Status waitForAnswer( std::chrono::milliseconds timeout )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_clock->waitFor( lock, m_changed, timeout, [ this ]() { return m_status == Status::Verified || m_status == Status::Revoked; } );
+        return m_status;
+    }
+
+    void stop()
+    {
+        m_loop.stop();
+    }
+
+private:
+    //One online check (see BackgroundLoop in WorkerPool.h). Returns when to try again if the servers couldn't be
+    //reached, or idle() once there's an answer.
+    Clock::steady_time step( const std::function<void()>& onVerified )
+    {
+        bool reached = false;
+        std::string refused;
+        try
+        {
+            reached = m_check();
+        }
+        catch ( const std::exception& ex )
+        {
+            refused = ex.what();
+        }
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        if ( !refused.empty() )
+        {
+            revokeLocked( lock, refused );
+            return BackgroundLoop::idle();
+        }
+        if ( reached )
+        {
+            m_lastVerified = m_clock->epochMillis();
+            m_status = Status::Verified;
+            m_changed.notify_all();
+            if ( onVerified )
+            {
+                lock.unlock();
+                onVerified();
+            }
+            return BackgroundLoop::idle();
+        }
+
+        //Offline: try again later, but not past the end of the grace window.
+        m_status = Status::Offline;
+        int64_t untilGraceEnd = 0;
+        if ( m_lastVerified != noDeadline )
+            untilGraceEnd = m_lastVerified + std::chrono::duration_cast<std::chrono::milliseconds>( m_policy.graceWindow ).count() -
+                m_clock->epochMillis();
+        if ( untilGraceEnd <= 0 )
+        {
+            revokeLocked( lock, "The license could not be checked online within the grace period." );
+            return BackgroundLoop::idle();
+        }
+        int64_t wait = std::min<int64_t>( untilGraceEnd, std::chrono::duration_cast<std::chrono::milliseconds>( m_policy.retryInterval ).count() );
+        return m_clock->steadyNow() + std::chrono::milliseconds( wait );
+    }
+
+    void revokeLocked( std::unique_lock<std::mutex>& lock, const std::string& reason )
+    {
+        m_status = Status::Revoked;
+        m_changed.notify_all();
+        lock.unlock();
+        if ( m_revoke )
+            m_revoke( reason );
+    }
+
+    OnlineCheck m_check;
+    Revoke m_revoke;
+    RevalidationPolicy m_policy;
+    std::shared_ptr<Clock> m_clock;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    Status m_status = Status::Verified;
+    int64_t m_lastVerified = noDeadline;
+    BackgroundLoop m_loop; //declared last, so it's stopped before the rest goes away
+};
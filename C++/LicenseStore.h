@@ -0,0 +1,854 @@
+#pragma once
+
+//One memory-mapped file for the local state of many licenses, for a gateway or server that holds thousands of
+//them. The SDK keeps one license file per product in its own folder, and opening the app means reading and parsing
+//it; with 100k licenses that's 100k files, and startup time grows with each one. Here every license's record lives
+//in one file, found through a hash index on product code and license ID, and opening the store reads one header
+//no matter how many licenses are in it. A lookup is a hash, a probe or two in the mapped index and a copy of the
+//record.
+//
+//File layout:
+//    page 0        two copies of the header, written in turn, each with a CRC. The valid one with the highest
+//                  sequence is current, so a header torn by a crash leaves the other one
+//    index         capacity slots of { uint64 key hash, uint64 record offset }, open addressing, linear probing
+//    data          records, appended and never changed: { magic, kind, key length, value length, offset of the
+//                  record it replaced, commit sequence, CRC } key value
+//Updating a license appends a new record pointing back at the one it replaces (copy on write), so a record that
+//fails its CRC can fall back to the version before it.
+//
+//A commit (a Batch of puts and removes, or a single put()) is atomic: its records and an intent record listing the
+//index slots to change are appended and synced first, then the header is pointed at the intent, then the slots
+//are changed and the header cleared. If the process or the machine dies in between, opening the store finds the
+//intent and finishes the commit, so either all of a batch is in the store or none of it is. Readers in the process
+//see a batch all at once too.
+//
+//    LicenseStore store( "licenses.store" );
+//    store.put( "PRODUCT", "XXXX-XXXX-XXXX-XXXX", state );
+//    std::string state;
+//    if ( store.get( "PRODUCT", "XXXX-XXXX-XXXX-XXXX", state ) ) ...
+//
+//One process opens a store at a time. The index doesn't grow: when it's 90% used, compactTo() copies the live
+//records into a new store with a bigger index, which also leaves replaced versions behind.
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class LicenseStoreException : public std::runtime_error
+{
+public:
+    explicit LicenseStoreException( const std::string& message ) : std::runtime_error( message ) {}
+};
+
+struct LicenseStoreOptions
+{
+    //Index slots when the store is created, rounded up to a power of two. An existing store keeps its own.
+    uint64_t capacity = 1 << 18;
+    //Sync each step of a commit to disk. Without it a commit survives the process crashing, but maybe not the
+    //machine losing power.
+    bool durable = true;
+    //Called by commit() right after its commit point, before the batch is applied to the index. Only for crash
+    //tests, which kill the process there to see the next open finish the commit.
+    std::function<void()> afterCommitPoint;
+};
+
+struct LicenseStoreStats
+{
+    uint64_t records = 0; //licenses in the store
+    uint64_t slotsUsed = 0; //including removed licenses, until the next compactTo()
+    uint64_t capacity = 0;
+    uint64_t fileSize = 0;
+    uint64_t dataBytes = 0; //records, including replaced versions
+    bool finishedCommit = false; //opening the store finished a commit that was interrupted
+    uint64_t fallbacks = 0; //lookups that found a corrupt record and used the version before it
+};
+
+//What check() found.
+struct LicenseStoreCheck
+{
+    uint64_t records = 0;
+    uint64_t corrupt = 0; //records that failed their CRC
+    uint64_t restored = 0; //of those, licenses an earlier version was found for
+    uint64_t lost = 0; //of those, licenses with no good version left
+};
+
+class LicenseStore
+{
+public:
+    //Puts and removes committed together. Later changes to the same license win.
+    class Batch
+    {
+    public:
+        void put( const std::string& product, const std::string& licenseId, const std::string& value )
+        {
+            m_changes.push_back( Change{ makeKey( product, licenseId ), value, false } );
+        }
+
+        void remove( const std::string& product, const std::string& licenseId )
+        {
+            m_changes.push_back( Change{ makeKey( product, licenseId ), std::string(), true } );
+        }
+
+        size_t size() const { return m_changes.size(); }
+        bool empty() const { return m_changes.empty(); }
+        void clear() { m_changes.clear(); }
+
+    private:
+        friend class LicenseStore;
+
+        struct Change
+        {
+            std::string key;
+            std::string value;
+            bool remove;
+        };
+
+        std::vector<Change> m_changes;
+    };
+
+    //Opens the store at path, creating it if it doesn't exist, and finishes a commit a crash interrupted. Throws
+    //LicenseStoreException if the file can't be opened, is in use by another process or isn't a store.
+    explicit LicenseStore( const std::string& path, const LicenseStoreOptions& options = LicenseStoreOptions() )
+        : m_path( path ), m_durable( options.durable ), m_afterCommitPoint( options.afterCommitPoint )
+    {
+        openFile();
+        try
+        {
+            if ( m_fileSize == 0 )
+                create( options.capacity );
+            else
+            {
+                mapFile( m_fileSize );
+                load();
+            }
+        }
+        catch ( ... )
+        {
+            unmapFile();
+            closeFile();
+            throw;
+        }
+    }
+
+    ~LicenseStore()
+    {
+        unmapFile();
+        closeFile();
+    }
+
+    LicenseStore( const LicenseStore& ) = delete;
+    LicenseStore& operator=( const LicenseStore& ) = delete;
+
+    bool get( const std::string& product, const std::string& licenseId, std::string& value ) const
+    {
+        std::string key = makeKey( product, licenseId );
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        uint64_t slot;
+        const Record* record = find( key, hashKey( key ), slot );
+        if ( record == nullptr || record->kind != valueKind )
+            return false;
+        value.assign( recordValue( record ), record->valueLength );
+        return true;
+    }
+
+    bool contains( const std::string& product, const std::string& licenseId ) const
+    {
+        std::string value;
+        return get( product, licenseId, value );
+    }
+
+    void put( const std::string& product, const std::string& licenseId, const std::string& value )
+    {
+        Batch batch;
+        batch.put( product, licenseId, value );
+        commit( batch );
+    }
+
+    void remove( const std::string& product, const std::string& licenseId )
+    {
+        Batch batch;
+        batch.remove( product, licenseId );
+        commit( batch );
+    }
+
+    //Commits every change in the batch, or none of them if this throws or the process dies first.
+    void commit( const Batch& batch )
+    {
+        std::lock_guard<std::mutex> writing( m_writeMutex );
+        //The last change to each license wins.
+        std::unordered_map<std::string, size_t> latest;
+        for ( size_t i = 0; i < batch.m_changes.size(); i++ )
+            latest[ batch.m_changes[i].key ] = i;
+
+        //Find each license's slot. New licenses claim an empty slot, which nobody else sees until the commit.
+        std::vector<IntentEntry> entries;
+        std::unordered_map<uint64_t, size_t> claimed; //slot -> index into batch.m_changes
+        uint64_t count = m_header.count, used = m_header.slotsUsed;
+        uint64_t bytes = 0;
+        {
+            std::shared_lock<std::shared_mutex> lock = lockForReading();
+            for ( size_t i = 0; i < batch.m_changes.size(); i++ )
+            {
+                const Batch::Change& change = batch.m_changes[i];
+                if ( latest[ change.key ] != i )
+                    continue;
+                uint64_t hash = hashKey( change.key ), slot;
+                const Record* current = find( change.key, hash, slot, &claimed, &batch );
+                bool live = current != nullptr && current->kind == valueKind;
+                if ( change.remove && !live )
+                    continue;
+                if ( m_index[ slot ].offset == 0 && claimed.count( slot ) == 0 )
+                {
+                    if ( ( used + 1 ) * 10 > m_header.capacity * 9 )
+                        throw LicenseStoreException( "license store " + m_path + " is full, compact it into a bigger one" );
+                    used++;
+                }
+                claimed[ slot ] = i;
+                count += change.remove ? -1 : ( live ? 0 : 1 );
+                entries.push_back( IntentEntry{ slot, hash, m_index[ slot ].offset } );
+                bytes += recordSize( change.key.size(), change.remove ? 0 : change.value.size() );
+            }
+        }
+        if ( entries.empty() )
+            return;
+        bytes += recordSize( 0, sizeof( uint64_t ) * 2 + entries.size() * sizeof( IntentEntry ) );
+        reserve( m_header.dataEnd + bytes );
+
+        //Append the records, each pointing back at the version it replaces.
+        uint64_t sequence = m_header.sequence + 1;
+        uint64_t start = m_header.dataEnd, end = start;
+        size_t entry = 0;
+        for ( size_t i = 0; i < batch.m_changes.size(); i++ )
+        {
+            const Batch::Change& change = batch.m_changes[i];
+            if ( entry == entries.size() || claimed[ entries[ entry ].slot ] != i )
+                continue;
+            IntentEntry& target = entries[ entry++ ];
+            uint64_t previous = target.offset;
+            target.offset = end;
+            end = appendRecord( end, change.remove ? tombstoneKind : valueKind, change.key, change.value.data(),
+                change.remove ? 0 : change.value.size(), previous, sequence );
+        }
+        std::string intent( sizeof( uint64_t ) * 2, '\0' );
+        memcpy( &intent[0], &count, sizeof( count ) );
+        memcpy( &intent[ sizeof( count ) ], &used, sizeof( used ) );
+        intent.append( reinterpret_cast<const char*>( entries.data() ), entries.size() * sizeof( IntentEntry ) );
+        uint64_t intentOffset = end;
+        end = appendRecord( end, intentKind, std::string(), intent.data(), intent.size(), 0, sequence );
+        syncRange( start, end - start );
+
+        //The commit point: once the header points at the intent, opening the store finishes the commit.
+        Header header = m_header;
+        header.dataEnd = end;
+        header.pending = intentOffset;
+        writeHeader( header );
+        if ( m_afterCommitPoint )
+            m_afterCommitPoint();
+        apply( intentOffset );
+    }
+
+    //Calls f with every license in the store, in index order.
+    void forEach( const std::function<void( const std::string& product, const std::string& licenseId, const std::string& value )>& f ) const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        for ( uint64_t slot = 0; slot < m_header.capacity; slot++ )
+        {
+            if ( m_index[ slot ].offset == 0 )
+                continue;
+            const Record* record = goodVersion( m_index[ slot ].offset );
+            if ( record == nullptr || record->kind != valueKind )
+                continue;
+            std::string key( recordKey( record ), record->keyLength );
+            size_t separator = key.find( '\0' );
+            f( key.substr( 0, separator ), key.substr( separator + 1 ), std::string( recordValue( record ), record->valueLength ) );
+        }
+    }
+
+    //Reads every license's record and checks its CRC. With repair, licenses whose record is corrupt are put back
+    //to the latest good version, or removed if there is none, in one commit.
+    LicenseStoreCheck check( bool repair = false )
+    {
+        LicenseStoreCheck result;
+        std::vector<std::pair<uint64_t, uint64_t>> fixes; //slot, good record offset or 0
+        {
+            std::shared_lock<std::shared_mutex> lock = lockForReading();
+            for ( uint64_t slot = 0; slot < m_header.capacity; slot++ )
+            {
+                uint64_t offset = m_index[ slot ].offset;
+                if ( offset == 0 )
+                    continue;
+                result.records++;
+                if ( validRecord( offset ) )
+                    continue;
+                result.corrupt++;
+                const Record* good = goodVersion( offset );
+                if ( good != nullptr )
+                    result.restored++;
+                else
+                    result.lost++;
+                fixes.emplace_back( slot, good != nullptr ? recordOffset( good ) : 0 );
+            }
+        }
+        if ( repair && !fixes.empty() )
+            repairSlots( fixes );
+        return result;
+    }
+
+    //Copies the live licenses into a new store at path with the given capacity, e.g. when this one is getting
+    //full. The new store doesn't have the replaced versions.
+    void compactTo( const std::string& path, uint64_t capacity ) const
+    {
+        LicenseStoreOptions options;
+        options.capacity = capacity;
+        options.durable = m_durable;
+        LicenseStore target( path, options );
+        Batch batch;
+        forEach( [ & ]( const std::string& product, const std::string& licenseId, const std::string& value )
+            {
+                batch.put( product, licenseId, value );
+                if ( batch.size() == 4096 )
+                {
+                    target.commit( batch );
+                    batch.clear();
+                }
+            } );
+        target.commit( batch );
+    }
+
+    LicenseStoreStats stats() const
+    {
+        std::shared_lock<std::shared_mutex> lock = lockForReading();
+        LicenseStoreStats stats;
+        stats.records = m_header.count;
+        stats.slotsUsed = m_header.slotsUsed;
+        stats.capacity = m_header.capacity;
+        stats.fileSize = m_fileSize;
+        stats.dataBytes = m_header.dataEnd - m_header.dataOffset;
+        stats.finishedCommit = m_finishedCommit;
+        stats.fallbacks = m_fallbacks;
+        return stats;
+    }
+
+    const std::string& path() const { return m_path; }
+
+private:
+    static constexpr char magic[8] = { 'L', 'S', 'S', 'T', 'O', 'R', 'E', '1' };
+    static constexpr uint32_t formatVersion = 1;
+    static constexpr uint64_t pageSize = 4096;
+    static constexpr uint64_t headerCopySize = 2048;
+    static constexpr uint32_t recordMagic = 0x4C524543; //"LREC"
+    static constexpr uint32_t valueKind = 1, tombstoneKind = 2, intentKind = 3;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t sequence; //the copy with the highest sequence is current
+        uint64_t capacity;
+        uint64_t dataOffset;
+        uint64_t dataEnd; //records past this were never committed
+        uint64_t count;
+        uint64_t slotsUsed;
+        uint64_t pending; //offset of the intent of an unfinished commit, 0 if there is none
+        uint32_t crc; //of everything above
+        uint32_t padding;
+    };
+
+    struct Slot
+    {
+        uint64_t hash;
+        uint64_t offset; //0 if the slot was never used
+    };
+
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t kind;
+        uint32_t keyLength;
+        uint32_t valueLength;
+        uint64_t previous; //the record this one replaced, 0 if none
+        uint64_t sequence;
+        uint32_t crc; //of the fields above and the key and value
+        uint32_t padding;
+    };
+
+    struct IntentEntry
+    {
+        uint64_t slot;
+        uint64_t hash;
+        uint64_t offset;
+    };
+
+    static_assert( sizeof( Header ) <= headerCopySize, "header must fit its half of page 0" );
+    static_assert( sizeof( Record ) == 40 && sizeof( Slot ) == 16 && sizeof( IntentEntry ) == 24, "fixed layout" );
+
+    //glibc's shared_mutex lets readers keep a writer out for as long as they overlap each other, which a busy
+    //gateway's lookups always do. A writer holds m_gate while it waits, and readers go through m_gate first.
+    std::shared_lock<std::shared_mutex> lockForReading() const
+    {
+        std::lock_guard<std::mutex> gate( m_gate );
+        return std::shared_lock<std::shared_mutex>( m_mapMutex );
+    }
+
+    std::unique_lock<std::shared_mutex> lockForWriting()
+    {
+        std::lock_guard<std::mutex> gate( m_gate );
+        return std::unique_lock<std::shared_mutex>( m_mapMutex );
+    }
+
+    static std::string makeKey( const std::string& product, const std::string& licenseId )
+    {
+        return product + '\0' + licenseId;
+    }
+
+    //FNV-1a. 0 is left out so an empty slot can't match.
+    static uint64_t hashKey( const std::string& key )
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for ( unsigned char c : key )
+            hash = ( hash ^ c ) * 1099511628211ull;
+        return hash == 0 ? 1 : hash;
+    }
+
+    static uint32_t crc32( const uint8_t* data, size_t size, uint32_t crc = 0 )
+    {
+        static uint32_t table[256] = {};
+        static std::once_flag once;
+        std::call_once( once, []()
+            {
+                for ( uint32_t i = 0; i < 256; i++ )
+                {
+                    uint32_t c = i;
+                    for ( int k = 0; k < 8; k++ )
+                        c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+                    table[i] = c;
+                }
+            } );
+        crc ^= 0xFFFFFFFFu;
+        for ( size_t i = 0; i < size; i++ )
+            crc = table[ ( crc ^ data[i] ) & 0xFF ] ^ ( crc >> 8 );
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    static uint64_t recordSize( size_t keyLength, size_t valueLength )
+    {
+        return ( sizeof( Record ) + keyLength + valueLength + 7 ) & ~(uint64_t)7;
+    }
+
+    static uint32_t recordCrc( const Record* record )
+    {
+        uint32_t crc = crc32( reinterpret_cast<const uint8_t*>( record ), offsetof( Record, crc ) );
+        return crc32( reinterpret_cast<const uint8_t*>( record + 1 ), (size_t)record->keyLength + record->valueLength, crc );
+    }
+
+    static const char* recordKey( const Record* record ) { return reinterpret_cast<const char*>( record + 1 ); }
+    static const char* recordValue( const Record* record ) { return recordKey( record ) + record->keyLength; }
+
+    const Record* recordAt( uint64_t offset ) const { return reinterpret_cast<const Record*>( m_memory + offset ); }
+    uint64_t recordOffset( const Record* record ) const { return reinterpret_cast<const uint8_t*>( record ) - m_memory; }
+
+    //Whether offset holds a whole, committed record that passes its CRC.
+    bool validRecord( uint64_t offset ) const
+    {
+        if ( offset < m_header.dataOffset || offset + sizeof( Record ) > m_header.dataEnd || offset % 8 != 0 )
+            return false;
+        const Record* record = recordAt( offset );
+        return record->magic == recordMagic && offset + recordSize( record->keyLength, record->valueLength ) <= m_header.dataEnd &&
+            record->crc == recordCrc( record );
+    }
+
+    //The record at offset, or the latest version before it that passes its CRC. nullptr if there is none.
+    const Record* goodVersion( uint64_t offset ) const
+    {
+        for ( int depth = 0; offset != 0 && depth < 64; depth++ )
+        {
+            if ( validRecord( offset ) )
+                return recordAt( offset );
+            //The corrupt record's link back can't be trusted either, so only follow it if it points backwards.
+            uint64_t previous = 0;
+            if ( offset >= m_header.dataOffset && offset % 8 == 0 && offset + sizeof( Record ) <= m_fileSize )
+                previous = recordAt( offset )->previous;
+            offset = previous < offset ? previous : 0;
+        }
+        return nullptr;
+    }
+
+    //The current record for key, or nullptr. slot is where key is, or the empty slot it would go in. During a
+    //commit, slots claimed by the batch so far count as taken by their change's key.
+    const Record* find( const std::string& key, uint64_t hash, uint64_t& slot,
+        const std::unordered_map<uint64_t, size_t>* claimed = nullptr, const Batch* batch = nullptr ) const
+    {
+        uint64_t mask = m_header.capacity - 1;
+        for ( uint64_t probe = 0; probe <= mask; probe++ )
+        {
+            slot = ( hash + probe ) & mask;
+            const Slot& entry = m_index[ slot ];
+            if ( claimed != nullptr )
+            {
+                auto found = claimed->find( slot );
+                if ( found != claimed->end() )
+                {
+                    if ( batch->m_changes[ found->second ].key == key )
+                        return entry.offset == 0 ? nullptr : goodVersion( entry.offset );
+                    continue;
+                }
+            }
+            if ( entry.offset == 0 )
+                return nullptr;
+            if ( entry.hash != hash )
+                continue;
+            const Record* record = goodVersion( entry.offset );
+            if ( record == nullptr )
+                continue;
+            if ( recordAt( entry.offset ) != record )
+                m_fallbacks++;
+            if ( record->keyLength == key.size() && memcmp( recordKey( record ), key.data(), key.size() ) == 0 )
+                return record;
+        }
+        return nullptr;
+    }
+
+    uint64_t appendRecord( uint64_t offset, uint32_t kind, const std::string& key, const char* value, size_t valueLength,
+        uint64_t previous, uint64_t sequence )
+    {
+        Record* record = reinterpret_cast<Record*>( m_memory + offset );
+        Record fields = {};
+        fields.magic = recordMagic;
+        fields.kind = kind;
+        fields.keyLength = (uint32_t)key.size();
+        fields.valueLength = (uint32_t)valueLength;
+        fields.previous = previous;
+        fields.sequence = sequence;
+        memcpy( record, &fields, sizeof( fields ) );
+        memcpy( record + 1, key.data(), key.size() );
+        if ( valueLength > 0 )
+            memcpy( reinterpret_cast<char*>( record + 1 ) + key.size(), value, valueLength );
+        record->crc = recordCrc( record );
+        return offset + recordSize( key.size(), valueLength );
+    }
+
+    //Changes the slots listed in the intent at intentOffset and clears the header's pending commit. Readers wait
+    //while the slots change, so they see all of the commit or none of it.
+    void apply( uint64_t intentOffset )
+    {
+        const Record* intent = recordAt( intentOffset );
+        const char* data = recordValue( intent );
+        uint64_t count, used;
+        memcpy( &count, data, sizeof( count ) );
+        memcpy( &used, data + sizeof( count ), sizeof( used ) );
+        size_t entries = ( intent->valueLength - sizeof( uint64_t ) * 2 ) / sizeof( IntentEntry );
+        uint64_t lowest = m_header.capacity, highest = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock = lockForWriting();
+            for ( size_t i = 0; i < entries; i++ )
+            {
+                IntentEntry entry;
+                memcpy( &entry, data + sizeof( uint64_t ) * 2 + i * sizeof( IntentEntry ), sizeof( entry ) );
+                m_index[ entry.slot ].hash = entry.hash;
+                m_index[ entry.slot ].offset = entry.offset;
+                lowest = std::min( lowest, entry.slot );
+                highest = std::max( highest, entry.slot );
+            }
+            m_header.count = count;
+            m_header.slotsUsed = used;
+        }
+        if ( entries > 0 )
+            syncRange( pageSize + lowest * sizeof( Slot ), ( highest - lowest + 1 ) * sizeof( Slot ) );
+        Header header = m_header;
+        header.pending = 0;
+        writeHeader( header );
+    }
+
+    //Points slots at other records already in the store, or at a fresh tombstone for 0, as one commit.
+    void repairSlots( const std::vector<std::pair<uint64_t, uint64_t>>& fixes )
+    {
+        std::lock_guard<std::mutex> writing( m_writeMutex );
+        uint64_t count = m_header.count, used = m_header.slotsUsed;
+        std::vector<IntentEntry> entries;
+        uint64_t bytes = recordSize( 0, sizeof( uint64_t ) * 2 + fixes.size() * sizeof( IntentEntry ) );
+        for ( const auto& fix : fixes )
+            if ( fix.second == 0 )
+                bytes += recordSize( 0, 0 );
+        reserve( m_header.dataEnd + bytes );
+        uint64_t sequence = m_header.sequence + 1;
+        uint64_t start = m_header.dataEnd, end = start;
+        for ( const auto& fix : fixes )
+        {
+            uint64_t offset = fix.second;
+            if ( offset == 0 )
+            {
+                //The key is gone with the record, so the tombstone has none. Lookups go past it.
+                offset = end;
+                end = appendRecord( end, tombstoneKind, std::string(), nullptr, 0, 0, sequence );
+            }
+            //What the corrupt record was can't be told any more; most are licenses, not removals.
+            if ( recordAt( offset )->kind != valueKind )
+                count--;
+            entries.push_back( IntentEntry{ fix.first, m_index[ fix.first ].hash, offset } );
+        }
+        std::string intent( sizeof( uint64_t ) * 2, '\0' );
+        memcpy( &intent[0], &count, sizeof( count ) );
+        memcpy( &intent[ sizeof( count ) ], &used, sizeof( used ) );
+        intent.append( reinterpret_cast<const char*>( entries.data() ), entries.size() * sizeof( IntentEntry ) );
+        uint64_t intentOffset = end;
+        end = appendRecord( end, intentKind, std::string(), intent.data(), intent.size(), 0, sequence );
+        syncRange( start, end - start );
+        Header header = m_header;
+        header.dataEnd = end;
+        header.pending = intentOffset;
+        writeHeader( header );
+        apply( intentOffset );
+    }
+
+    //Writes header to the copy that isn't current, with the next sequence, and makes it current.
+    void writeHeader( Header header )
+    {
+        header.sequence = m_header.sequence + 1;
+        header.crc = crc32( reinterpret_cast<const uint8_t*>( &header ), offsetof( Header, crc ) );
+        uint64_t copy = header.sequence % 2;
+        //Everything before the header (records, slots) has to be in the file before the header says so. With
+        //durable off a crashed process still leaves its writes in the file, as long as they're made in order.
+        std::atomic_thread_fence( std::memory_order_release );
+        memcpy( m_memory + copy * headerCopySize, &header, sizeof( header ) );
+        syncRange( copy * headerCopySize, sizeof( header ) );
+        std::unique_lock<std::shared_mutex> lock = lockForWriting();
+        m_header = header;
+    }
+
+    void create( uint64_t capacity )
+    {
+        uint64_t slots = 1024;
+        while ( slots < capacity )
+            slots *= 2;
+        uint64_t dataOffset = pageSize + ( ( slots * sizeof( Slot ) + pageSize - 1 ) & ~( pageSize - 1 ) );
+        resizeFile( dataOffset + 1024 * 1024 );
+        mapFile( m_fileSize );
+        Header header = {};
+        memcpy( header.magic, magic, sizeof( magic ) );
+        header.version = formatVersion;
+        header.capacity = slots;
+        header.dataOffset = dataOffset;
+        header.dataEnd = dataOffset;
+        m_header = header;
+        m_index = reinterpret_cast<Slot*>( m_memory + pageSize );
+        writeHeader( header );
+    }
+
+    //Picks the current header and finishes an interrupted commit. Doesn't read the index or the records, so it
+    //takes the same time for any number of licenses.
+    void load()
+    {
+        const Header* best = nullptr;
+        for ( uint64_t copy = 0; copy < 2 && ( copy + 1 ) * headerCopySize <= m_fileSize; copy++ )
+        {
+            const Header* header = reinterpret_cast<const Header*>( m_memory + copy * headerCopySize );
+            if ( memcmp( header->magic, magic, sizeof( magic ) ) != 0 || header->version != formatVersion ||
+                header->crc != crc32( reinterpret_cast<const uint8_t*>( header ), offsetof( Header, crc ) ) )
+                continue;
+            if ( best == nullptr || header->sequence > best->sequence )
+                best = header;
+        }
+        if ( best == nullptr )
+            throw LicenseStoreException( m_path + " isn't a license store, or both its headers are corrupt" );
+        if ( best->capacity == 0 || ( best->capacity & ( best->capacity - 1 ) ) != 0 ||
+            best->dataOffset < pageSize + best->capacity * sizeof( Slot ) || best->dataEnd > m_fileSize )
+            throw LicenseStoreException( m_path + " has a header that doesn't fit the file" );
+        m_header = *best;
+        m_index = reinterpret_cast<Slot*>( m_memory + pageSize );
+        if ( m_header.pending != 0 )
+        {
+            //The intent was synced before the header pointed at it, so it can only be bad if the disk is.
+            if ( !validRecord( m_header.pending ) || recordAt( m_header.pending )->kind != intentKind )
+                throw LicenseStoreException( m_path + " has an unfinished commit that can't be read" );
+            apply( m_header.pending );
+            m_finishedCommit = true;
+        }
+    }
+
+    //Makes sure the file is at least size bytes, doubling it as needed. Only the writer calls this.
+    void reserve( uint64_t size )
+    {
+        if ( size <= m_fileSize )
+            return;
+        uint64_t newSize = m_fileSize;
+        while ( newSize < size )
+            newSize *= 2;
+        std::unique_lock<std::shared_mutex> lock = lockForWriting();
+        uint64_t oldSize = m_fileSize;
+        unmapFile();
+        m_index = nullptr;
+        try
+        {
+            resizeFile( newSize );
+            mapFile( newSize );
+        }
+        catch ( LicenseStoreException )
+        {
+            //Map the size we had again, so the store stays usable (the file may have grown, we just don't use
+            //the rest), and pass the error on. If even that fails, mapFile() throws and the store can't be used.
+            m_fileSize = oldSize;
+            mapFile( oldSize );
+            m_index = reinterpret_cast<Slot*>( m_memory + pageSize );
+            throw;
+        }
+        m_index = reinterpret_cast<Slot*>( m_memory + pageSize );
+    }
+
+#ifdef _WIN32
+    void openFile()
+    {
+        m_file = CreateFileA( m_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+        if ( m_file == INVALID_HANDLE_VALUE )
+            throw LicenseStoreException( "could not open license store " + m_path + ", or another process has it open" );
+        LARGE_INTEGER size;
+        GetFileSizeEx( m_file, &size );
+        m_fileSize = (uint64_t)size.QuadPart;
+    }
+
+    void closeFile()
+    {
+        if ( m_file != INVALID_HANDLE_VALUE )
+            CloseHandle( m_file );
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+    void resizeFile( uint64_t size )
+    {
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)size;
+        if ( !SetFilePointerEx( m_file, position, NULL, FILE_BEGIN ) || !SetEndOfFile( m_file ) )
+            throw LicenseStoreException( "could not grow license store " + m_path );
+        m_fileSize = size;
+    }
+
+    void mapFile( uint64_t size )
+    {
+        m_mapping = CreateFileMappingA( m_file, NULL, PAGE_READWRITE, (DWORD)( size >> 32 ), (DWORD)size, NULL );
+        if ( m_mapping == NULL )
+            throw LicenseStoreException( "could not map license store " + m_path );
+        m_memory = static_cast<uint8_t*>( MapViewOfFile( m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size ) );
+        if ( m_memory == nullptr )
+        {
+            CloseHandle( m_mapping );
+            m_mapping = NULL;
+            throw LicenseStoreException( "could not map license store " + m_path );
+        }
+    }
+
+    void unmapFile()
+    {
+        if ( m_memory != nullptr )
+            UnmapViewOfFile( m_memory );
+        if ( m_mapping != NULL )
+            CloseHandle( m_mapping );
+        m_memory = nullptr;
+        m_mapping = NULL;
+    }
+
+    void syncRange( uint64_t offset, uint64_t size )
+    {
+        if ( !m_durable || size == 0 )
+            return;
+        uint64_t start = offset & ~( pageSize - 1 );
+        FlushViewOfFile( m_memory + start, (SIZE_T)( offset + size - start ) );
+        FlushFileBuffers( m_file );
+    }
+#else
+    void openFile()
+    {
+        m_file = open( m_path.c_str(), O_RDWR | O_CREAT, 0600 );
+        if ( m_file < 0 )
+            throw LicenseStoreException( "could not open license store " + m_path );
+        if ( flock( m_file, LOCK_EX | LOCK_NB ) != 0 )
+        {
+            closeFile();
+            throw LicenseStoreException( "license store " + m_path + " is open in another process" );
+        }
+        struct stat info;
+        fstat( m_file, &info );
+        m_fileSize = (uint64_t)info.st_size;
+    }
+
+    void closeFile()
+    {
+        if ( m_file >= 0 )
+            close( m_file );
+        m_file = -1;
+    }
+
+    void resizeFile( uint64_t size )
+    {
+        if ( ftruncate( m_file, (off_t)size ) != 0 )
+            throw LicenseStoreException( "could not grow license store " + m_path );
+        m_fileSize = size;
+    }
+
+    void mapFile( uint64_t size )
+    {
+        void* memory = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0 );
+        if ( memory == MAP_FAILED )
+            throw LicenseStoreException( "could not map license store " + m_path );
+        m_memory = static_cast<uint8_t*>( memory );
+        m_mappedSize = size;
+    }
+
+    void unmapFile()
+    {
+        if ( m_memory != nullptr )
+            munmap( m_memory, m_mappedSize );
+        m_memory = nullptr;
+    }
+
+    void syncRange( uint64_t offset, uint64_t size )
+    {
+        if ( !m_durable || size == 0 )
+            return;
+        uint64_t start = offset & ~( pageSize - 1 );
+        msync( m_memory + start, offset + size - start, MS_SYNC );
+    }
+#endif
+
+    std::string m_path;
+    bool m_durable;
+    std::function<void()> m_afterCommitPoint;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = NULL;
+#else
+    int m_file = -1;
+    uint64_t m_mappedSize = 0;
+#endif
+    uint64_t m_fileSize = 0;
+    uint8_t* m_memory = nullptr;
+    Slot* m_index = nullptr;
+
+    //Readers share m_mapMutex. The writer takes it alone only to change slots or remap the file; records it
+    //appends past the header's dataEnd aren't seen by anyone until then.
+    mutable std::shared_mutex m_mapMutex;
+    mutable std::mutex m_gate;
+    std::mutex m_writeMutex;
+    Header m_header = {};
+    bool m_finishedCommit = false;
+    mutable std::atomic<uint64_t> m_fallbacks{ 0 };
+};
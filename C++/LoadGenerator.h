@@ -0,0 +1,643 @@
+#pragma once
+
+//Thousands of virtual clients, each going through what one of the samples does (activate, check, consume, renew a
+//floating seat, ...) against a license server, to see how it holds up (Linux only). It speaks plain HTTP, so it's
+//meant for a local stand-in for the servers like mock_server.cpp (see MockServer.h), not the real ones.
+//
+//Each session picks a LoadScenario by weight and runs its steps in order, with think times between them like a
+//user would have. Clients keep their connection open between requests and sessions. Sessions either start again
+//as soon as the last one ends (a closed model: N users, all busy), or arrive at a fixed rate and take whichever
+//client is free (an open model: like real traffic, which doesn't slow down when the server does).
+//
+//All the clients of a thread share one epoll loop, so 50k clients take a few threads, not 50k.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//Latencies in microseconds, in buckets about 3% wide: 32 per power of two. Recording is an increment, and the
+//histograms of several threads add up.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : m_buckets( 60 * 32, 0 ) {}
+
+    void record( uint64_t micros )
+    {
+        m_buckets[ bucket( micros ) ]++;
+        m_count++;
+        m_max = std::max( m_max, micros );
+        m_sum += micros;
+    }
+
+    void merge( const LatencyHistogram& other )
+    {
+        for ( size_t i = 0; i < m_buckets.size(); i++ )
+            m_buckets[ i ] += other.m_buckets[ i ];
+        m_count += other.m_count;
+        m_max = std::max( m_max, other.m_max );
+        m_sum += other.m_sum;
+    }
+
+    //The latency q of the recorded ones are at or below, q from 0 to 1.
+    uint64_t percentile( double q ) const
+    {
+        if ( m_count == 0 )
+            return 0;
+        uint64_t rank = std::max<uint64_t>( 1, (uint64_t)( q * m_count + 0.5 ) );
+        uint64_t seen = 0;
+        for ( size_t i = 0; i < m_buckets.size(); i++ )
+        {
+            seen += m_buckets[ i ];
+            if ( seen >= rank )
+                return std::min( m_max, upperBound( i ) );
+        }
+        return m_max;
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    uint64_t mean() const { return m_count ? m_sum / m_count : 0; }
+
+private:
+    static size_t bucket( uint64_t value )
+    {
+        if ( value < 32 )
+            return (size_t)value;
+        int exponent = 63 - __builtin_clzll( value );
+        return (size_t)( exponent - 4 ) * 32 + ( ( value >> ( exponent - 5 ) ) & 31 );
+    }
+
+    static uint64_t upperBound( size_t index )
+    {
+        if ( index < 32 )
+            return index;
+        int exponent = (int)( index / 32 ) + 4;
+        return ( ( 32 + index % 32 + 1 ) << ( exponent - 5 ) ) - 1;
+    }
+
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count = 0;
+    uint64_t m_max = 0;
+    uint64_t m_sum = 0;
+};
+
+//One request of a scenario. The operation name is what the report groups latencies by.
+struct LoadStep
+{
+    std::string operation;
+    std::string method; //GET or POST
+    std::string path; //with the query string for a GET
+    std::string body; //JSON for a POST
+    std::chrono::milliseconds think{ 0 }; //average pause after the answer, the actual one is random around it
+};
+
+//Who a virtual client is: the license and hardware ID it uses.
+struct LoadClient
+{
+    int index;
+    std::string licenseKey;
+    std::string hardwareId;
+};
+
+struct LoadScenario
+{
+    std::string name;
+    double weight = 1;
+    std::function<std::vector<LoadStep>( const LoadClient&, std::mt19937_64& )> steps;
+};
+
+struct LoadOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int clients = 1000;
+    int threads = std::max( 1u, std::thread::hardware_concurrency() );
+    std::chrono::seconds duration{ 10 };
+    std::chrono::milliseconds rampUp{ 1000 }; //closed model: the clients start spread over this
+    double arrivalRate = 0; //sessions a second for an open model, 0 for a closed one
+    std::chrono::milliseconds timeout{ 10000 }; //for connecting and for each request
+    //Connecting to 127.0.0.1 from 127.0.0.1 runs out of ports at about 28k connections. With more than one, the
+    //clients connect from 127.0.0.1, 127.0.0.2, ... in turn, which Linux routes to loopback too.
+    int sourceAddresses = 1;
+    std::function<LoadClient( int )> client; //who client n is, see LoadGenerator::run
+};
+
+struct LoadReport
+{
+    struct Operation
+    {
+        LatencyHistogram latency; //successful requests only
+        uint64_t errors = 0;
+    };
+
+    double seconds = 0;
+    std::map<std::string, Operation> operations;
+    std::map<std::string, uint64_t> errors; //by the exception the SDK would have thrown
+    std::map<std::string, uint64_t> sessions; //finished, by scenario
+    std::map<std::string, uint64_t> failedSessions; //given up because the client couldn't connect, by scenario
+    uint64_t missedArrivals = 0; //open model: sessions that arrived when every client was busy
+
+    uint64_t requests() const
+    {
+        uint64_t total = 0;
+        for ( auto& operation : operations )
+            total += operation.second.latency.count() + operation.second.errors;
+        return total;
+    }
+
+    void merge( const LoadReport& other )
+    {
+        for ( auto& operation : other.operations )
+        {
+            operations[ operation.first ].latency.merge( operation.second.latency );
+            operations[ operation.first ].errors += operation.second.errors;
+        }
+        for ( auto& error : other.errors )
+            errors[ error.first ] += error.second;
+        for ( auto& session : other.sessions )
+            sessions[ session.first ] += session.second;
+        for ( auto& session : other.failedSessions )
+            failedSessions[ session.first ] += session.second;
+        missedArrivals += other.missedArrivals;
+    }
+};
+
+//Which exception the SDK would have thrown for an answer, so errors are reported the way the samples catch them.
+//Returns an empty string for a success.
+inline std::string exceptionFor( int status, const std::string& body )
+{
+    if ( status >= 200 && status < 300 )
+        return std::string();
+    if ( status >= 500 )
+        return "LicenseServerException";
+    std::string code;
+    size_t found = body.find( "\"code\":\"" );
+    if ( found != std::string::npos )
+        code = body.substr( found + 8, body.find( '"', found + 8 ) - found - 8 );
+    static const std::map<std::string, std::string> exceptions = {
+        { "license_not_found", "LicenseNotFoundException" },
+        { "license_not_active", "DeviceNotLicensedException" },
+        { "license_not_enabled", "LicenseStateException" },
+        { "license_expired", "LicenseStateException" },
+        { "license_activations_max_reached", "LicenseNoAvailableActivationsException" },
+        { "consumption_limit_reached", "NotEnoughConsumptionException" },
+        { "license_feature_not_found", "InvalidLicenseFeatureException" },
+        { "license_feature_expired", "InvalidLicenseFeatureException" },
+        { "floating_max_reached", "MaxFloatingReachedException" } };
+    auto exception = exceptions.find( code );
+    if ( exception != exceptions.end() )
+        return exception->second;
+    return "LicenseSpringException (" + ( code.empty() ? "HTTP " + std::to_string( status ) : code ) + ")";
+}
+
+class LoadGenerator
+{
+public:
+    LoadGenerator( const LoadOptions& options, const std::vector<LoadScenario>& scenarios )
+        : m_options( options ), m_scenarios( scenarios )
+    {
+        if ( m_scenarios.empty() )
+            throw std::invalid_argument( "no scenarios" );
+        for ( const LoadScenario& scenario : m_scenarios )
+            m_totalWeight += scenario.weight;
+    }
+
+    //Requests answered so far, for showing progress while run() runs.
+    uint64_t requestsSoFar() const { return m_progress.load( std::memory_order_relaxed ); }
+
+    //Runs for the options' duration and returns what happened. The clients are split over the threads, each
+    //thread with its own loop and its own part of the arrival rate.
+    LoadReport run()
+    {
+        std::vector<std::unique_ptr<Worker>> workers;
+        int threads = std::max( 1, std::min( m_options.threads, m_options.clients ) );
+        for ( int t = 0; t < threads; t++ )
+        {
+            std::unique_ptr<Worker> worker( new Worker( *this, t ) );
+            for ( int i = t; i < m_options.clients; i += threads )
+                worker->addClient( m_options.client ? m_options.client( i ) : LoadClient{ i, "", "load-" + std::to_string( i ) } );
+            workers.push_back( std::move( worker ) );
+        }
+        auto start = std::chrono::steady_clock::now();
+        for ( auto& worker : workers )
+        {
+            Worker* w = worker.get();
+            w->thread = std::thread( [ w, threads ]() { w->run( threads ); } );
+        }
+        LoadReport report;
+        for ( auto& worker : workers )
+        {
+            worker->thread.join();
+            report.merge( worker->report );
+        }
+        report.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        return report;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct Worker
+    {
+        enum class State { Idle, Connecting, Sending, Waiting, Thinking };
+
+        struct Client
+        {
+            LoadClient who;
+            int fd = -1;
+            State state = State::Idle;
+            const LoadScenario* scenario = nullptr;
+            std::vector<LoadStep> steps;
+            size_t step = 0;
+            bool abandoned = false; //the session couldn't connect and was given up
+            std::string out;
+            size_t outSent = 0;
+            std::string in;
+            clock_t::time_point started; //of the current request, or connect
+            uint64_t generation = 0; //goes up whenever the client moves on, so stale timers are skipped
+        };
+
+        struct Timer
+        {
+            clock_t::time_point due;
+            int client; //-1 for the next arrival
+            uint64_t generation;
+            bool operator>( const Timer& other ) const { return due > other.due; }
+        };
+
+        Worker( LoadGenerator& generator, int index ) : generator( generator ), options( generator.m_options ),
+            random( 0x10ad + index ), index( index )
+        {
+            epollFd = epoll_create1( EPOLL_CLOEXEC );
+        }
+
+        ~Worker()
+        {
+            for ( Client& client : clients )
+                if ( client.fd >= 0 )
+                    close( client.fd );
+            close( epollFd );
+        }
+
+        void addClient( const LoadClient& who )
+        {
+            clients.push_back( Client() );
+            clients.back().who = who;
+        }
+
+        void run( int threads )
+        {
+            clock_t::time_point now = clock_t::now();
+            end = now + options.duration;
+            if ( options.arrivalRate > 0 )
+            {
+                for ( size_t i = 0; i < clients.size(); i++ )
+                    idle.push_back( (int)i );
+                rate = options.arrivalRate / threads;
+                timers.push( Timer{ now + exponential( 1000.0 / rate ), -1, 0 } );
+            }
+            else
+            {
+                //Closed model: everyone starts once, spread over the ramp up, and then starts again when done.
+                for ( size_t i = 0; i < clients.size(); i++ )
+                    timers.push( Timer{ now + options.rampUp * i / std::max<size_t>( 1, clients.size() ), (int)i, 0 } );
+            }
+
+            std::vector<epoll_event> events( 1024 );
+            while ( ( now = clock_t::now() ) < end )
+            {
+                int wait = 100;
+                if ( !timers.empty() )
+                    wait = (int)std::max<long long>( 0, std::min<long long>( wait,
+                        std::chrono::duration_cast<std::chrono::milliseconds>( timers.top().due - now ).count() + 1 ) );
+                int n = epoll_wait( epollFd, events.data(), (int)events.size(), wait );
+                for ( int i = 0; i < n; i++ )
+                {
+                    Client& client = clients[ events[ i ].data.u32 ];
+                    if ( client.state == State::Connecting )
+                        connected( client );
+                    else if ( client.state == State::Sending )
+                        send( client );
+                    else if ( client.state == State::Waiting )
+                        receive( client );
+                    else if ( client.fd >= 0 )
+                        disconnect( client ); //the server closed an idle connection
+                }
+                fireTimers();
+            }
+        }
+
+        void fireTimers()
+        {
+            clock_t::time_point now = clock_t::now();
+            while ( !timers.empty() && timers.top().due <= now )
+            {
+                Timer timer = timers.top();
+                timers.pop();
+                if ( timer.client < 0 )
+                {
+                    arrive();
+                    timers.push( Timer{ timer.due + exponential( 1000.0 / rate ), -1, 0 } );
+                    continue;
+                }
+                Client& client = clients[ timer.client ];
+                if ( timer.generation != client.generation )
+                    continue;
+                if ( client.state == State::Connecting || client.state == State::Sending || client.state == State::Waiting )
+                    failed( client, "NetworkTimeoutException" );
+                else if ( client.state == State::Thinking )
+                    next( client );
+                else
+                    startSession( client );
+            }
+        }
+
+        void arrive()
+        {
+            if ( idle.empty() )
+            {
+                report.missedArrivals++;
+                return;
+            }
+            int client = idle.back();
+            idle.pop_back();
+            startSession( clients[ client ] );
+        }
+
+        void startSession( Client& client )
+        {
+            double pick = std::uniform_real_distribution<double>( 0, generator.m_totalWeight )( random );
+            client.scenario = &generator.m_scenarios.back();
+            for ( const LoadScenario& scenario : generator.m_scenarios )
+            {
+                if ( pick < scenario.weight )
+                {
+                    client.scenario = &scenario;
+                    break;
+                }
+                pick -= scenario.weight;
+            }
+            client.steps = client.scenario->steps( client.who, random );
+            client.step = 0;
+            client.abandoned = false;
+            next( client );
+        }
+
+        //Runs the client's next step, or ends its session.
+        void next( Client& client )
+        {
+            client.generation++;
+            if ( client.step >= client.steps.size() )
+            {
+                if ( client.abandoned )
+                    report.failedSessions[ client.scenario->name ]++;
+                else
+                    report.sessions[ client.scenario->name ]++;
+                client.state = State::Idle;
+                if ( options.arrivalRate > 0 )
+                    idle.push_back( (int)( &client - clients.data() ) );
+                else
+                    startSession( client );
+                return;
+            }
+            if ( client.fd < 0 )
+            {
+                connect( client );
+                return;
+            }
+            const LoadStep& step = client.steps[ client.step ];
+            client.out = step.method + " " + step.path + " HTTP/1.1\r\nHost: " + options.host + "\r\n";
+            if ( !step.body.empty() )
+                client.out += "Content-Type: application/json\r\nContent-Length: " + std::to_string( step.body.size() ) + "\r\n";
+            client.out += "\r\n" + step.body;
+            client.outSent = 0;
+            client.in.clear();
+            client.started = clock_t::now();
+            client.state = State::Sending;
+            timers.push( Timer{ client.started + options.timeout, (int)( &client - clients.data() ), client.generation } );
+            send( client );
+        }
+
+        void connect( Client& client )
+        {
+            int fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+            if ( fd < 0 )
+            {
+                failed( client, "NoInternetException" );
+                return;
+            }
+            int one = 1;
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+            if ( options.sourceAddresses > 1 )
+            {
+                //Picks the source address only, the port is picked at connect(), per destination.
+                setsockopt( fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof( one ) );
+                sockaddr_in source = {};
+                source.sin_family = AF_INET;
+                source.sin_addr.s_addr = htonl( 0x7f000001 + client.who.index % options.sourceAddresses );
+                bind( fd, (sockaddr*)&source, sizeof( source ) );
+            }
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons( (uint16_t)options.port );
+            inet_pton( AF_INET, options.host.c_str(), &address.sin_addr );
+            client.fd = fd;
+            client.started = clock_t::now();
+            client.state = State::Connecting;
+            epoll_event event = {};
+            event.events = EPOLLOUT;
+            event.data.u32 = (uint32_t)( &client - clients.data() );
+            epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event );
+            timers.push( Timer{ client.started + options.timeout, (int)event.data.u32, client.generation } );
+            if ( ::connect( fd, (sockaddr*)&address, sizeof( address ) ) != 0 && errno != EINPROGRESS )
+                failed( client, "NoInternetException" );
+        }
+
+        void connected( Client& client )
+        {
+            int error = 0;
+            socklen_t length = sizeof( error );
+            getsockopt( client.fd, SOL_SOCKET, SO_ERROR, &error, &length );
+            if ( error != 0 )
+            {
+                failed( client, "NoInternetException" );
+                return;
+            }
+            report.operations[ "connect" ].latency.record( micros( client.started ) );
+            next( client );
+        }
+
+        void send( Client& client )
+        {
+            while ( client.outSent < client.out.size() )
+            {
+                ssize_t n = ::send( client.fd, client.out.data() + client.outSent, client.out.size() - client.outSent, MSG_NOSIGNAL );
+                if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                {
+                    watch( client, EPOLLOUT );
+                    return;
+                }
+                if ( n <= 0 )
+                {
+                    failed( client, "NoInternetException" );
+                    return;
+                }
+                client.outSent += n;
+            }
+            client.state = State::Waiting;
+            watch( client, EPOLLIN | EPOLLRDHUP );
+        }
+
+        void receive( Client& client )
+        {
+            char buffer[ 16384 ];
+            while ( true )
+            {
+                ssize_t n = recv( client.fd, buffer, sizeof( buffer ), 0 );
+                if ( n > 0 )
+                {
+                    client.in.append( buffer, n );
+                    if ( n < (ssize_t)sizeof( buffer ) )
+                        break;
+                    continue;
+                }
+                if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                    break;
+                failed( client, "NoInternetException" ); //closed before answering
+                return;
+            }
+
+            //We only need the status, the body and whether the server will close the connection.
+            size_t headerEnd = client.in.find( "\r\n\r\n" );
+            if ( headerEnd == std::string::npos )
+                return;
+            size_t length = 0;
+            size_t found = client.in.find( "Content-Length: " );
+            if ( found != std::string::npos && found < headerEnd )
+                length = (size_t)atoll( client.in.c_str() + found + 16 );
+            if ( client.in.size() < headerEnd + 4 + length )
+                return;
+            int status = client.in.size() > 12 ? atoi( client.in.c_str() + 9 ) : 0;
+            bool closing = client.in.find( "Connection: close" ) < headerEnd;
+            std::string exception = exceptionFor( status, client.in.substr( headerEnd + 4, length ) );
+
+            const LoadStep& step = client.steps[ client.step ];
+            if ( exception.empty() )
+                report.operations[ step.operation ].latency.record( micros( client.started ) );
+            else
+            {
+                report.operations[ step.operation ].errors++;
+                report.errors[ exception ]++;
+            }
+            generator.m_progress.fetch_add( 1, std::memory_order_relaxed );
+            if ( closing )
+                disconnect( client );
+            else
+                watch( client, EPOLLRDHUP );
+            think( client );
+        }
+
+        //A request failed without an answer. Like a sample catching the exception, the client carries on with
+        //its next step, on a new connection.
+        void failed( Client& client, const std::string& exception )
+        {
+            if ( client.state == State::Connecting )
+                report.operations[ "connect" ].errors++;
+            else if ( client.step < client.steps.size() )
+                report.operations[ client.steps[ client.step ].operation ].errors++;
+            report.errors[ exception ]++;
+            generator.m_progress.fetch_add( 1, std::memory_order_relaxed );
+            bool connecting = client.state == State::Connecting;
+            disconnect( client );
+            if ( connecting )
+            {
+                //This session can't run. The client starts a new one after a second instead of hammering a server
+                //that isn't taking connections.
+                client.step = client.steps.size();
+                client.abandoned = true;
+                client.generation++;
+                client.state = State::Thinking;
+                timers.push( Timer{ clock_t::now() + std::chrono::seconds( 1 ), (int)( &client - clients.data() ), client.generation } );
+                return;
+            }
+            think( client );
+        }
+
+        void think( Client& client )
+        {
+            std::chrono::milliseconds pause{ 0 };
+            if ( client.step < client.steps.size() )
+                pause = client.steps[ client.step ].think;
+            client.step++;
+            client.generation++;
+            client.state = State::Thinking;
+            if ( pause.count() > 0 )
+                timers.push( Timer{ clock_t::now() + exponential( (double)pause.count() ), (int)( &client - clients.data() ), client.generation } );
+            else
+                next( client );
+        }
+
+        void disconnect( Client& client )
+        {
+            if ( client.fd < 0 )
+                return;
+            epoll_ctl( epollFd, EPOLL_CTL_DEL, client.fd, nullptr );
+            close( client.fd );
+            client.fd = -1;
+        }
+
+        void watch( Client& client, uint32_t events )
+        {
+            epoll_event event = {};
+            event.events = events;
+            event.data.u32 = (uint32_t)( &client - clients.data() );
+            epoll_ctl( epollFd, EPOLL_CTL_MOD, client.fd, &event );
+        }
+
+        std::chrono::microseconds exponential( double meanMillis )
+        {
+            return std::chrono::microseconds( (long long)( std::exponential_distribution<double>( 1.0 / meanMillis )( random ) * 1000 ) );
+        }
+
+        static uint64_t micros( clock_t::time_point since )
+        {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( clock_t::now() - since ).count();
+        }
+
+        LoadGenerator& generator;
+        const LoadOptions& options;
+        std::mt19937_64 random;
+        int index;
+        int epollFd;
+        std::vector<Client> clients;
+        std::vector<int> idle;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+        double rate = 0;
+        clock_t::time_point end;
+        LoadReport report;
+        std::thread thread;
+    };
+
+    LoadOptions m_options;
+    std::vector<LoadScenario> m_scenarios;
+    double m_totalWeight = 0;
+    std::atomic<uint64_t> m_progress{ 0 };
+};
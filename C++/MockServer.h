@@ -0,0 +1,1519 @@
+#pragma once
+
+//A stand-in for the LicenseSpring servers that runs on your own machine (Linux only), for load and integration
+//testing without touching the real ones. It answers the endpoints the samples use: activation, check,
+//deactivation, trials, consumptions, feature consumptions, device variables, custom fields (with the license),
+//floating register and release, versions and installation files. Everything is kept in memory and is gone when
+//the server stops.
+//
+//It's built to never be the bottleneck: every worker thread has its own epoll loop and its own listening socket
+//on the same port (SO_REUSEPORT, so the kernel spreads connections between them), connections are kept alive and
+//may pipeline requests, and licenses are split over shards with a lock each.
+//
+//For testing what happens on a bad day, it can add latency (fixed plus random jitter) and inject faults: answer
+//with a 500, drop the connection without answering, or never answer at all.
+//
+//The answers have the shape of the real API's, but they aren't signed with LicenseSpring's key. They're for our
+//own clients (like load_generator.cpp), the SDK won't accept them.
+//
+//It also answers POST /api/v4/sync, which the real API doesn't have (yet): a check, consumption and feature
+//consumption syncs, and sending and fetching device variables, all in one request. See CompositeSync.h.
+//
+//Besides the real API under /api/v4/, there are a few endpoints for tests under /mock/:
+//    GET  /mock/license_changes?license_key=K&version=V&timeout=MS  long-poll, answers when the license's version
+//                                                                  isn't V any more, or after MS milliseconds
+//    POST /mock/change  {"license_key": K, ...}                      changes a license, see MockLicenseStore::change
+//    GET  /mock/stats                                                requests per endpoint and faults injected
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct MockServerOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 8080; //0 picks a free one, see MockServer::port()
+    int threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    //The licenses the server starts with, see mockLicenseKey().
+    int licenses = 1000;
+    int maxActivations = 1000000;
+    int maxConsumptions = 1000000;
+    int maxFloatingUsers = 100000;
+    int floatingTimeout = 5; //minutes
+    int features = 3; //feature1, feature2, ... odd ones are consumption features, even ones activation features
+
+    std::chrono::milliseconds latency{ 0 }; //added to every answer
+    std::chrono::milliseconds jitter{ 0 }; //plus a random amount up to this
+
+    double errorRate = 0; //share of requests answered with a 500
+    double dropRate = 0; //closed without an answer
+    double stallRate = 0; //never answered
+    std::string faultPath; //only requests whose path contains this get faults, empty for all
+};
+
+//The key of the server's nth license, n from 0.
+inline std::string mockLicenseKey( int n )
+{
+    char key[32];
+    snprintf( key, sizeof( key ), "MOCK-%04d-%04d", ( n / 10000 ) % 10000, n % 10000 );
+    return key;
+}
+
+//Request parameters, from the query string and the top level of a JSON body. There are only ever a few, so a
+//vector is faster to search than a map.
+using MockParams = std::vector<std::pair<std::string, std::string>>;
+
+inline const std::string* mockParam( const MockParams& params, const char* name )
+{
+    for ( const auto& param : params )
+        if ( param.first == name )
+            return &param.second;
+    return nullptr;
+}
+
+inline std::string mockParam( const MockParams& params, const char* name, const std::string& otherwise )
+{
+    const std::string* value = mockParam( params, name );
+    return value != nullptr ? *value : otherwise;
+}
+
+inline long long mockIntParam( const MockParams& params, const char* name, long long otherwise )
+{
+    const std::string* value = mockParam( params, name );
+    return value != nullptr && !value->empty() ? atoll( value->c_str() ) : otherwise;
+}
+
+inline std::string jsonEscape( const std::string& text )
+{
+    std::string escaped;
+    escaped.reserve( text.size() + 2 );
+    for ( char c : text )
+    {
+        if ( c == '"' || c == '\\' )
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if ( (unsigned char)c < 0x20 )
+        {
+            char code[8];
+            snprintf( code, sizeof( code ), "\\u%04x", c );
+            escaped += code;
+        }
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+//Reads the top level of a JSON object into params. Strings are unescaped, anything else (numbers, true, false,
+//nested objects and arrays) is kept as its JSON text, so a nested object can be read with another call. Returns
+//false if it isn't a JSON object.
+inline bool parseJsonObject( const char* p, const char* end, MockParams& params )
+{
+    auto skipSpace = [ & ]() { while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) p++; };
+    auto readString = [ & ]( std::string& out ) -> bool
+    {
+        if ( p >= end || *p != '"' )
+            return false;
+        for ( p++; p < end && *p != '"'; p++ )
+        {
+            if ( *p != '\\' )
+            {
+                out += *p;
+                continue;
+            }
+            if ( ++p >= end )
+                return false;
+            switch ( *p )
+            {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+                if ( end - p < 5 )
+                    return false;
+                out += (char)strtol( std::string( p + 1, p + 5 ).c_str(), nullptr, 16 ); //we only need ASCII
+                p += 4;
+                break;
+            default: out += *p;
+            }
+        }
+        if ( p >= end )
+            return false;
+        p++;
+        return true;
+    };
+
+    skipSpace();
+    if ( p >= end || *p != '{' )
+        return false;
+    p++;
+    while ( true )
+    {
+        skipSpace();
+        if ( p < end && *p == '}' )
+            return true;
+        std::string name, value;
+        if ( !readString( name ) )
+            return false;
+        skipSpace();
+        if ( p >= end || *p != ':' )
+            return false;
+        p++;
+        skipSpace();
+        if ( p < end && *p == '"' )
+        {
+            if ( !readString( value ) )
+                return false;
+        }
+        else
+        {
+            //A number, literal, object or array: find where it ends, minding nesting and strings.
+            const char* start = p;
+            int depth = 0;
+            bool inString = false;
+            for ( ; p < end; p++ )
+            {
+                if ( inString )
+                {
+                    if ( *p == '\\' )
+                        p++;
+                    else if ( *p == '"' )
+                        inString = false;
+                }
+                else if ( *p == '"' )
+                    inString = true;
+                else if ( *p == '{' || *p == '[' )
+                    depth++;
+                else if ( *p == '}' || *p == ']' )
+                {
+                    if ( depth == 0 )
+                        break;
+                    depth--;
+                }
+                else if ( *p == ',' && depth == 0 )
+                    break;
+            }
+            value.assign( start, p );
+            while ( !value.empty() && ( value.back() == ' ' || value.back() == '\n' || value.back() == '\r' || value.back() == '\t' ) )
+                value.pop_back();
+        }
+        params.emplace_back( std::move( name ), std::move( value ) );
+        skipSpace();
+        if ( p < end && *p == ',' )
+            p++;
+        else if ( p < end && *p == '}' )
+            return true;
+        else
+            return false;
+    }
+}
+
+inline void parseQuery( const char* p, const char* end, MockParams& params )
+{
+    auto decode = []( const char* from, const char* to )
+    {
+        std::string out;
+        for ( ; from < to; from++ )
+        {
+            if ( *from == '+' )
+                out += ' ';
+            else if ( *from == '%' && to - from > 2 )
+            {
+                out += (char)strtol( std::string( from + 1, from + 3 ).c_str(), nullptr, 16 );
+                from += 2;
+            }
+            else
+                out += *from;
+        }
+        return out;
+    };
+    while ( p < end )
+    {
+        const char* amp = std::find( p, end, '&' );
+        const char* eq = std::find( p, amp, '=' );
+        if ( eq > p )
+            params.emplace_back( decode( p, eq ), eq < amp ? decode( eq + 1, amp ) : std::string() );
+        p = amp < end ? amp + 1 : end;
+    }
+}
+
+struct MockFeature
+{
+    std::string code;
+    bool consumption = false;
+    bool expired = false;
+    long long totalConsumptions = 0;
+    long long maxConsumptions = 0;
+};
+
+struct MockLicense
+{
+    std::string key;
+    bool enabled = true;
+    bool expired = false;
+    bool trial = false;
+    long long maxActivations = 0;
+    std::set<std::string> devices; //hardware IDs it's activated on
+    long long totalConsumptions = 0;
+    long long maxConsumptions = 0;
+    long long maxOverages = 0;
+    std::vector<MockFeature> features;
+    std::vector<std::pair<std::string, std::string>> customFields;
+    std::map<std::string, std::map<std::string, std::string>> variables; //per device
+    int maxFloatingUsers = 0;
+    int floatingTimeout = 0;
+    std::map<std::string, int64_t> floating; //device -> when its registration times out, in epoch ms
+    uint64_t version = 1; //goes up on every change the license's users would see
+    //The answers to the last syncs that had a sync_id, oldest first, so a sync sent again isn't applied twice.
+    std::deque<std::pair<std::string, std::string>> syncAnswers;
+};
+
+//What an endpoint answers: an HTTP status and a JSON body.
+struct MockResponse
+{
+    int status = 200;
+    std::string body;
+
+    static MockResponse error( int status, const std::string& code, const std::string& message )
+    {
+        MockResponse response;
+        response.status = status;
+        response.body = "{\"status\":" + std::to_string( status ) + ",\"code\":\"" + code + "\",\"message\":\"" +
+            jsonEscape( message ) + "\"}";
+        return response;
+    }
+};
+
+//The licenses, split over shards so requests for different licenses don't wait for each other.
+class MockLicenseStore
+{
+public:
+    explicit MockLicenseStore( const MockServerOptions& options ) : m_options( options ), m_shards( 64 )
+    {
+        for ( int i = 0; i < options.licenses; i++ )
+            add( newLicense( mockLicenseKey( i ) ) );
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+    }
+
+    //Called (outside the shard's lock) whenever a license's version changes, so the server can answer the
+    //long-polls waiting on it. Set it before requests come in.
+    void onChange( std::function<void()> changed ) { m_changed = std::move( changed ); }
+
+    //Runs f on the license with key, under its shard's lock. Returns false if there's no such license.
+    bool with( const std::string& key, const std::function<void( MockLicense& )>& f )
+    {
+        bool changed;
+        {
+            Shard& shard = shardFor( key );
+            std::lock_guard<std::mutex> lock( shard.mutex );
+            auto found = shard.licenses.find( key );
+            if ( found == shard.licenses.end() )
+                return false;
+            uint64_t before = found->second.version;
+            f( found->second );
+            changed = found->second.version != before;
+        }
+        if ( changed && m_changed )
+            m_changed();
+        return true;
+    }
+
+    void add( const MockLicense& license )
+    {
+        Shard& shard = shardFor( license.key );
+        std::lock_guard<std::mutex> lock( shard.mutex );
+        shard.licenses[ license.key ] = license;
+    }
+
+    //Adds a new license with key unless there is one already. The lookup and the insert are under the same lock,
+    //so two first activations for the same key at once both end up with the one license.
+    void addIfMissing( const std::string& key )
+    {
+        Shard& shard = shardFor( key );
+        std::lock_guard<std::mutex> lock( shard.mutex );
+        if ( shard.licenses.count( key ) == 0 )
+            shard.licenses.emplace( key, newLicense( key ) );
+    }
+
+    uint64_t version( const std::string& key )
+    {
+        uint64_t version = 0;
+        with( key, [ &version ]( MockLicense& license ) { version = license.version; } );
+        return version;
+    }
+
+    MockLicense newLicense( const std::string& key ) const
+    {
+        MockLicense license;
+        license.key = key;
+        license.maxActivations = m_options.maxActivations;
+        license.maxConsumptions = m_options.maxConsumptions;
+        license.maxFloatingUsers = m_options.maxFloatingUsers;
+        license.floatingTimeout = m_options.floatingTimeout;
+        for ( int f = 1; f <= m_options.features; f++ )
+        {
+            MockFeature feature;
+            feature.code = "feature" + std::to_string( f );
+            feature.consumption = f % 2 == 1;
+            feature.maxConsumptions = feature.consumption ? m_options.maxConsumptions : 0;
+            license.features.push_back( feature );
+        }
+        license.customFields = { { "tier", "standard" }, { "region", "local" } };
+        return license;
+    }
+
+    //Changes a license the way someone editing it on the platform would. params can have enabled, expired,
+    //max_consumptions, feature with feature_expired and/or feature_max_consumptions (a new code adds the
+    //feature), and release_floating=true, which drops every floating registration.
+    MockResponse change( const MockParams& params )
+    {
+        std::string key = mockParam( params, "license_key", "" );
+        MockResponse response;
+        bool found = with( key, [ & ]( MockLicense& license )
+            {
+                if ( const std::string* enabled = mockParam( params, "enabled" ) )
+                    license.enabled = *enabled == "true";
+                if ( const std::string* expired = mockParam( params, "expired" ) )
+                    license.expired = *expired == "true";
+                license.maxConsumptions = mockIntParam( params, "max_consumptions", license.maxConsumptions );
+                if ( const std::string* code = mockParam( params, "feature" ) )
+                {
+                    auto feature = std::find_if( license.features.begin(), license.features.end(),
+                        [ code ]( const MockFeature& f ) { return f.code == *code; } );
+                    if ( feature == license.features.end() )
+                    {
+                        license.features.push_back( MockFeature() );
+                        feature = license.features.end() - 1;
+                        feature->code = *code;
+                    }
+                    if ( const std::string* expired = mockParam( params, "feature_expired" ) )
+                        feature->expired = *expired == "true";
+                    feature->maxConsumptions = mockIntParam( params, "feature_max_consumptions", feature->maxConsumptions );
+                    feature->consumption = feature->maxConsumptions > 0;
+                }
+                if ( mockParam( params, "release_floating", "" ) == "true" )
+                    license.floating.clear();
+                license.version++;
+                response.body = "{\"version\":" + std::to_string( license.version ) + "}";
+            } );
+        return found ? response : MockResponse::error( 400, "license_not_found", "License not found" );
+    }
+
+private:
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, MockLicense> licenses;
+    };
+
+    Shard& shardFor( const std::string& key )
+    {
+        return m_shards[ std::hash<std::string>()( key ) % m_shards.size() ];
+    }
+
+    MockServerOptions m_options;
+    std::vector<Shard> m_shards;
+    std::function<void()> m_changed;
+};
+
+//What the server answers on /api/v4/..., one function per endpoint.
+class MockLicenseApi
+{
+public:
+    enum Endpoint
+    {
+        ActivateLicense,
+        CheckLicense,
+        DeactivateLicense,
+        TrialKey,
+        AddConsumption,
+        AddFeatureConsumption,
+        TrackDeviceVariables,
+        GetDeviceVariables,
+        FloatingRegister,
+        FloatingRelease,
+        ProductDetails,
+        Versions,
+        InstallationFile,
+        Sync,
+        LicenseChanges,
+        Change,
+        Stats,
+        NotFound,
+        EndpointCount
+    };
+
+    static const char* endpointName( Endpoint endpoint )
+    {
+        static const char* names[] = { "activate_license", "check_license", "deactivate_license", "trial_key",
+            "add_consumption", "add_feature_consumption", "track_device_variables", "get_device_variables",
+            "floating/register", "floating/release", "product_details", "versions", "installation_file", "sync",
+            "mock/license_changes", "mock/change", "mock/stats", "not_found" };
+        return names[ endpoint ];
+    }
+
+    static Endpoint route( const std::string& path )
+    {
+        static const std::unordered_map<std::string, Endpoint> routes = {
+            { "/api/v4/activate_license", ActivateLicense }, { "/api/v4/check_license", CheckLicense },
+            { "/api/v4/deactivate_license", DeactivateLicense }, { "/api/v4/trial_key", TrialKey },
+            { "/api/v4/add_consumption", AddConsumption }, { "/api/v4/add_feature_consumption", AddFeatureConsumption },
+            { "/api/v4/track_device_variables", TrackDeviceVariables }, { "/api/v4/get_device_variables", GetDeviceVariables },
+            { "/api/v4/floating/register", FloatingRegister }, { "/api/v4/floating/release", FloatingRelease },
+            { "/api/v4/product_details", ProductDetails }, { "/api/v4/versions", Versions },
+            { "/api/v4/installation_file", InstallationFile }, { "/api/v4/sync", Sync },
+            { "/mock/license_changes", LicenseChanges },
+            { "/mock/change", Change }, { "/mock/stats", Stats } };
+        auto found = routes.find( path );
+        return found == routes.end() ? NotFound : found->second;
+    }
+
+    explicit MockLicenseApi( MockLicenseStore& store ) : m_store( store ) {}
+
+    MockResponse handle( Endpoint endpoint, const MockParams& params )
+    {
+        switch ( endpoint )
+        {
+        case ActivateLicense: return activate( params );
+        case CheckLicense: return check( params );
+        case DeactivateLicense: return deactivate( params );
+        case TrialKey: return trialKey( params );
+        case AddConsumption: return addConsumption( params );
+        case AddFeatureConsumption: return addFeatureConsumption( params );
+        case TrackDeviceVariables: return trackDeviceVariables( params );
+        case GetDeviceVariables: return getDeviceVariables( params );
+        case FloatingRegister: return floatingRegister( params );
+        case FloatingRelease: return floatingRelease( params );
+        case ProductDetails: return productDetails();
+        case Versions: return versions();
+        case InstallationFile: return installationFile( params );
+        case Sync: return sync( params );
+        case Change: return m_store.change( params );
+        default: return MockResponse::error( 404, "not_found", "No such endpoint" );
+        }
+    }
+
+private:
+    //User-based licenses are identified by their user's email. The first activation for an email creates one.
+    std::string licenseKey( const MockParams& params )
+    {
+        if ( const std::string* key = mockParam( params, "license_key" ) )
+            return *key;
+        if ( const std::string* user = mockParam( params, "username" ) )
+        {
+            std::string key = "USER-" + *user;
+            m_store.addIfMissing( key );
+            return key;
+        }
+        return std::string();
+    }
+
+    //Appends "name":value. The license JSON goes out with most answers, so it's built without temporaries.
+    static void field( std::string& json, const char* name, long long value )
+    {
+        char number[ 24 ];
+        json += ",\"";
+        json += name;
+        json += "\":";
+        json.append( number, snprintf( number, sizeof( number ), "%lld", value ) );
+    }
+
+    static void field( std::string& json, const char* name, bool value )
+    {
+        json += ",\"";
+        json += name;
+        json += value ? "\":true" : "\":false";
+    }
+
+    static void field( std::string& json, const char* name, const std::string& value )
+    {
+        json += ",\"";
+        json += name;
+        json += "\":\"";
+        json += jsonEscape( value );
+        json += '"';
+    }
+
+    static std::string licenseJson( const MockLicense& license, const std::string& device )
+    {
+        std::string json;
+        json.reserve( 1024 );
+        json += "{\"license_key\":\"";
+        json += jsonEscape( license.key );
+        json += "\",\"license_type\":\"consumption\"";
+        field( json, "is_trial", license.trial );
+        field( json, "license_enabled", license.enabled );
+        field( json, "license_active", license.devices.count( device ) > 0 );
+        field( json, "is_expired", license.expired );
+        field( json, "max_activations", license.maxActivations );
+        field( json, "times_activated", (long long)license.devices.size() );
+        field( json, "total_consumptions", license.totalConsumptions );
+        field( json, "max_consumptions", license.maxConsumptions );
+        field( json, "allow_overages", license.maxOverages > 0 );
+        field( json, "max_overages", license.maxOverages );
+        field( json, "is_floating_cloud", true );
+        field( json, "floating_users", (long long)license.maxFloatingUsers );
+        field( json, "floating_timeout", (long long)license.floatingTimeout );
+        json += ",\"product_features\":[";
+        for ( size_t i = 0; i < license.features.size(); i++ )
+        {
+            const MockFeature& feature = license.features[ i ];
+            json += i ? ",{\"code\":\"" : "{\"code\":\"";
+            json += jsonEscape( feature.code );
+            json += feature.consumption ? "\",\"feature_type\":\"consumption\"" : "\",\"feature_type\":\"activation\"";
+            field( json, "is_expired", feature.expired );
+            field( json, "total_consumptions", feature.totalConsumptions );
+            field( json, "max_consumption", feature.maxConsumptions );
+            json += '}';
+        }
+        json += "],\"custom_fields\":[";
+        for ( size_t i = 0; i < license.customFields.size(); i++ )
+        {
+            json += i ? ",{\"name\":\"" : "{\"name\":\"";
+            json += jsonEscape( license.customFields[ i ].first );
+            json += '"';
+            field( json, "value", license.customFields[ i ].second );
+            json += '}';
+        }
+        json += ']';
+        field( json, "version", (long long)license.version );
+        json += '}';
+        return json;
+    }
+
+    //Runs f on the license the request is for, turning a missing license or hardware ID into the usual errors.
+    MockResponse withLicense( const MockParams& params, bool needsDevice,
+        const std::function<MockResponse( MockLicense&, const std::string& )>& f )
+    {
+        std::string key = licenseKey( params );
+        std::string device = mockParam( params, "hardware_id", "" );
+        if ( key.empty() )
+            return MockResponse::error( 400, "missing_license_key", "License key or username is required" );
+        if ( needsDevice && device.empty() )
+            return MockResponse::error( 400, "missing_hardware_id", "Hardware ID is required" );
+        MockResponse response;
+        if ( !m_store.with( key, [ & ]( MockLicense& license ) { response = f( license, device ); } ) )
+            return MockResponse::error( 400, "license_not_found", "License not found" );
+        return response;
+    }
+
+    static MockResponse usable( const MockLicense& license )
+    {
+        if ( !license.enabled )
+            return MockResponse::error( 400, "license_not_enabled", "License is disabled" );
+        if ( license.expired )
+            return MockResponse::error( 400, "license_expired", "License is expired" );
+        return MockResponse();
+    }
+
+    MockResponse activate( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                MockResponse response = usable( license );
+                if ( response.status != 200 )
+                    return response;
+                if ( license.devices.count( device ) == 0 )
+                {
+                    if ( (long long)license.devices.size() >= license.maxActivations )
+                        return MockResponse::error( 400, "license_activations_max_reached", "No available activations" );
+                    license.devices.insert( device );
+                    license.version++;
+                }
+                response.body = licenseJson( license, device );
+                return response;
+            } );
+    }
+
+    MockResponse check( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                if ( license.devices.count( device ) == 0 )
+                    return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+                MockResponse response = usable( license );
+                if ( response.status == 200 )
+                    response.body = licenseJson( license, device );
+                return response;
+            } );
+    }
+
+    MockResponse deactivate( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                if ( license.devices.erase( device ) == 0 )
+                    return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+                license.floating.erase( device );
+                license.variables.erase( device );
+                license.version++;
+                MockResponse response;
+                response.body = "{}";
+                return response;
+            } );
+    }
+
+    MockResponse trialKey( const MockParams& params )
+    {
+        MockLicense license = m_store.newLicense( "TRIAL-" + std::to_string( ++m_trials ) );
+        license.trial = true;
+        license.maxActivations = 1;
+        std::string email = mockParam( params, "email", "" );
+        m_store.add( license );
+        MockResponse response;
+        response.body = "{\"license_key\":\"" + license.key + "\",\"license_user\":\"" + jsonEscape( email ) + "\"}";
+        return response;
+    }
+
+    //The consumption and device variable endpoints each do one of these, /api/v4/sync does them all under one lock.
+    static MockResponse consume( MockLicense& license, const std::string& device, long long consumptions )
+    {
+        MockResponse response = usable( license );
+        if ( response.status != 200 )
+            return response;
+        if ( license.devices.count( device ) == 0 )
+            return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+        if ( license.totalConsumptions + consumptions > license.maxConsumptions + license.maxOverages )
+            return MockResponse::error( 400, "consumption_limit_reached", "Not enough consumptions left" );
+        license.totalConsumptions += consumptions;
+        license.version++;
+        response.body = "{\"total_consumptions\":" + std::to_string( license.totalConsumptions ) +
+            ",\"max_consumptions\":" + std::to_string( license.maxConsumptions ) +
+            ",\"max_overages\":" + std::to_string( license.maxOverages ) + "}";
+        return response;
+    }
+
+    static MockFeature* findFeature( MockLicense& license, const std::string& code )
+    {
+        auto feature = std::find_if( license.features.begin(), license.features.end(),
+            [ &code ]( const MockFeature& f ) { return f.code == code; } );
+        return feature == license.features.end() ? nullptr : &*feature;
+    }
+
+    static MockResponse consumeFeature( MockLicense& license, const std::string& device, const std::string& code,
+        long long consumptions )
+    {
+        if ( license.devices.count( device ) == 0 )
+            return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+        MockFeature* feature = findFeature( license, code );
+        if ( feature == nullptr || !feature->consumption )
+            return MockResponse::error( 400, "license_feature_not_found", "Feature not found: " + code );
+        if ( feature->expired )
+            return MockResponse::error( 400, "license_feature_expired", "Feature is expired: " + code );
+        if ( feature->totalConsumptions + consumptions > feature->maxConsumptions )
+            return MockResponse::error( 400, "consumption_limit_reached", "Not enough consumptions left on " + code );
+        feature->totalConsumptions += consumptions;
+        license.version++;
+        MockResponse response;
+        response.body = "{\"code\":\"" + jsonEscape( code ) + "\",\"total_consumptions\":" +
+            std::to_string( feature->totalConsumptions ) + ",\"max_consumption\":" +
+            std::to_string( feature->maxConsumptions ) + "}";
+        return response;
+    }
+
+    static MockResponse storeVariables( MockLicense& license, const std::string& device, const MockParams& variables )
+    {
+        if ( license.devices.count( device ) == 0 )
+            return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+        std::map<std::string, std::string>& stored = license.variables[ device ];
+        for ( auto& variable : variables )
+            stored[ variable.first ] = variable.second;
+        MockResponse response;
+        response.body = "{}";
+        return response;
+    }
+
+    static std::string variablesJson( MockLicense& license, const std::string& device )
+    {
+        std::string json = "[";
+        for ( auto& variable : license.variables[ device ] )
+            json += ( json.size() > 1 ? ",{\"variable\":\"" : "{\"variable\":\"" ) +
+                jsonEscape( variable.first ) + "\",\"value\":\"" + jsonEscape( variable.second ) + "\"}";
+        json += "]";
+        return json;
+    }
+
+    MockResponse addConsumption( const MockParams& params )
+    {
+        long long consumptions = mockIntParam( params, "consumptions", 1 );
+        return withLicense( params, true, [ consumptions ]( MockLicense& license, const std::string& device )
+            {
+                return consume( license, device, consumptions );
+            } );
+    }
+
+    MockResponse addFeatureConsumption( const MockParams& params )
+    {
+        long long consumptions = mockIntParam( params, "consumptions", 1 );
+        std::string code = mockParam( params, "feature", "" );
+        return withLicense( params, true, [ & ]( MockLicense& license, const std::string& device )
+            {
+                return consumeFeature( license, device, code, consumptions );
+            } );
+    }
+
+    MockResponse trackDeviceVariables( const MockParams& params )
+    {
+        MockParams variables;
+        std::string raw = mockParam( params, "variables", "{}" );
+        if ( !parseJsonObject( raw.data(), raw.data() + raw.size(), variables ) )
+            return MockResponse::error( 400, "invalid_variables", "Variables must be a JSON object" );
+        return withLicense( params, true, [ & ]( MockLicense& license, const std::string& device )
+            {
+                return storeVariables( license, device, variables );
+            } );
+    }
+
+    MockResponse getDeviceVariables( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                MockResponse response;
+                response.body = variablesJson( license, device );
+                return response;
+            } );
+    }
+
+    //Everything a periodic sync does, in one request:
+    //    {"license_key": K, "hardware_id": H, "version": V, "consumptions": N, "feature_consumptions": {"f1": N, ...},
+    //     "variables": {"name": "value", ...}, "get_variables": true}
+    //Every part but the key and hardware ID can be left out. The answer is kept small: the license itself only
+    //comes back when it changed since version V (other than by this request's own consumptions), otherwise just
+    //the new totals of what was sent.
+    //    {"version": V2, "total_consumptions": N, "feature_consumptions": {"f1": N}, "variables": [...],
+    //     "rejected": [{"part": "feature_consumptions.f1", "error": {...}}], "license": {...}}
+    //If the license can't be used on this device the whole request fails, like a check would. A consumption the
+    //server refuses is listed under rejected and the rest still goes through.
+    //
+    //A client that didn't get the answer sends the same request again. With "sync_id": S, the answer is kept (for
+    //the license's last syncAnswerCount syncs), and a request with an id that was already applied gets the same
+    //answer again instead of being applied twice.
+    static const size_t syncAnswerCount = 32;
+
+    MockResponse sync( const MockParams& params )
+    {
+        MockParams features, variables;
+        std::string rawFeatures = mockParam( params, "feature_consumptions", "{}" );
+        std::string rawVariables = mockParam( params, "variables", "{}" );
+        if ( !parseJsonObject( rawFeatures.data(), rawFeatures.data() + rawFeatures.size(), features ) )
+            return MockResponse::error( 400, "invalid_feature_consumptions", "Feature consumptions must be a JSON object" );
+        if ( !parseJsonObject( rawVariables.data(), rawVariables.data() + rawVariables.size(), variables ) )
+            return MockResponse::error( 400, "invalid_variables", "Variables must be a JSON object" );
+        long long consumptions = mockIntParam( params, "consumptions", 0 );
+        uint64_t knownVersion = (uint64_t)mockIntParam( params, "version", 0 );
+        bool getVariables = mockParam( params, "get_variables", "" ) == "true";
+        std::string syncId = mockParam( params, "sync_id", "" );
+
+        return withLicense( params, true, [ & ]( MockLicense& license, const std::string& device )
+            {
+                for ( const auto& answer : license.syncAnswers )
+                    if ( !syncId.empty() && answer.first == syncId )
+                    {
+                        MockResponse repeated;
+                        repeated.body = answer.second;
+                        return repeated;
+                    }
+                if ( license.devices.count( device ) == 0 )
+                    return MockResponse::error( 400, "license_not_active", "License is not active on this device" );
+                MockResponse response = usable( license );
+                if ( response.status != 200 )
+                    return response;
+                bool changed = license.version != knownVersion;
+
+                std::string parts, rejected;
+                auto reject = [ &rejected ]( const std::string& part, const MockResponse& error )
+                {
+                    rejected += rejected.empty() ? "{\"part\":\"" : ",{\"part\":\"";
+                    rejected += jsonEscape( part ) + "\",\"error\":" + error.body + "}";
+                };
+                if ( consumptions != 0 )
+                {
+                    MockResponse result = consume( license, device, consumptions );
+                    if ( result.status != 200 )
+                        reject( "consumptions", result );
+                    field( parts, "total_consumptions", license.totalConsumptions );
+                }
+                if ( !features.empty() )
+                {
+                    std::string totals;
+                    for ( auto& feature : features )
+                    {
+                        MockResponse result = consumeFeature( license, device, feature.first, atoll( feature.second.c_str() ) );
+                        if ( result.status != 200 )
+                        {
+                            reject( "feature_consumptions." + feature.first, result );
+                            continue;
+                        }
+                        totals += totals.empty() ? "\"" : ",\"";
+                        totals += jsonEscape( feature.first ) + "\":" + std::to_string( findFeature( license, feature.first )->totalConsumptions );
+                    }
+                    parts += ",\"feature_consumptions\":{" + totals + "}";
+                }
+                if ( !variables.empty() )
+                    storeVariables( license, device, variables );
+                if ( getVariables )
+                    parts += ",\"variables\":" + variablesJson( license, device );
+                if ( !rejected.empty() )
+                    parts += ",\"rejected\":[" + rejected + "]";
+                if ( changed )
+                    parts += ",\"license\":" + licenseJson( license, device );
+                response.body = "{\"version\":" + std::to_string( license.version ) + parts + "}";
+                if ( !syncId.empty() )
+                {
+                    license.syncAnswers.emplace_back( syncId, response.body );
+                    if ( license.syncAnswers.size() > syncAnswerCount )
+                        license.syncAnswers.pop_front();
+                }
+                return response;
+            } );
+    }
+
+    MockResponse floatingRegister( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                MockResponse response = usable( license );
+                if ( response.status != 200 )
+                    return response;
+                int64_t now = MockLicenseStore::now();
+                for ( auto seat = license.floating.begin(); seat != license.floating.end(); )
+                    seat = seat->second <= now ? license.floating.erase( seat ) : std::next( seat );
+                if ( license.floating.count( device ) == 0 && (int)license.floating.size() >= license.maxFloatingUsers )
+                    return MockResponse::error( 400, "floating_max_reached", "No floating seats left" );
+                license.floating[ device ] = now + (int64_t)license.floatingTimeout * 60 * 1000;
+                response.body = "{\"floating_in_use_devices\":" + std::to_string( license.floating.size() ) +
+                    ",\"floating_users\":" + std::to_string( license.maxFloatingUsers ) +
+                    ",\"floating_timeout\":" + std::to_string( license.floatingTimeout ) + "}";
+                return response;
+            } );
+    }
+
+    MockResponse floatingRelease( const MockParams& params )
+    {
+        return withLicense( params, true, []( MockLicense& license, const std::string& device )
+            {
+                license.floating.erase( device );
+                MockResponse response;
+                response.body = "{}";
+                return response;
+            } );
+    }
+
+    static MockResponse productDetails()
+    {
+        MockResponse response;
+        response.body = "{\"product_name\":\"Mock Product\",\"short_code\":\"MOCK\",\"allow_trial\":true,"
+            "\"trial_days\":14,\"authorization_method\":\"license-key\"}";
+        return response;
+    }
+
+    static MockResponse versions()
+    {
+        MockResponse response;
+        response.body = "[{\"version\":\"1.0.0\"},{\"version\":\"1.1.0\"},{\"version\":\"2.0.0\"}]";
+        return response;
+    }
+
+    static MockResponse installationFile( const MockParams& params )
+    {
+        std::string version = mockParam( params, "version", "2.0.0" );
+        MockResponse response;
+        response.body = "{\"version\":\"" + jsonEscape( version ) + "\",\"channel\":\"stable\","
+            "\"installation_file\":\"http://127.0.0.1/downloads/mock-" + jsonEscape( version ) + ".zip\"}";
+        return response;
+    }
+
+    MockLicenseStore& m_store;
+    std::atomic<uint64_t> m_trials{ 0 };
+};
+
+class MockServer
+{
+public:
+    struct Stats
+    {
+        uint64_t requests[ MockLicenseApi::EndpointCount ] = {};
+        uint64_t errors = 0; //500s injected
+        uint64_t drops = 0;
+        uint64_t stalls = 0;
+        uint64_t connections = 0;
+
+        uint64_t total() const
+        {
+            uint64_t sum = 0;
+            for ( uint64_t count : requests )
+                sum += count;
+            return sum;
+        }
+    };
+
+    explicit MockServer( const MockServerOptions& options )
+        : m_options( options ), m_store( options ), m_api( m_store ), m_port( options.port )
+    {
+        m_store.onChange( [ this ]() { notifyChanged(); } );
+    }
+
+    ~MockServer()
+    {
+        stop();
+    }
+
+    MockLicenseStore& store() { return m_store; }
+
+    //The port it listens on, once started.
+    int port() const { return m_port; }
+
+    //Binds and starts the worker threads. Throws std::runtime_error if it can't listen.
+    void start()
+    {
+        m_stopping = false;
+        for ( int i = 0; i < std::max( 1, m_options.threads ); i++ )
+        {
+            std::unique_ptr<Worker> worker( new Worker( *this, i ) );
+            worker->listenFd = listenSocket();
+            m_workers.push_back( std::move( worker ) );
+        }
+        for ( auto& worker : m_workers )
+        {
+            Worker* w = worker.get();
+            w->thread = std::thread( [ w ]() { w->run(); } );
+        }
+    }
+
+    void stop()
+    {
+        m_stopping = true;
+        for ( auto& worker : m_workers )
+            worker->wake();
+        for ( auto& worker : m_workers )
+            if ( worker->thread.joinable() )
+                worker->thread.join();
+        m_workers.clear();
+    }
+
+    Stats stats() const
+    {
+        Stats stats;
+        for ( int i = 0; i < MockLicenseApi::EndpointCount; i++ )
+            stats.requests[ i ] = m_requests[ i ].load();
+        stats.errors = m_errors;
+        stats.drops = m_drops;
+        stats.stalls = m_stalls;
+        stats.connections = m_connections;
+        return stats;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct Connection
+    {
+        int fd = -1;
+        uint64_t id = 0;
+        std::string in;
+        std::string out;
+        size_t outSent = 0;
+        bool waiting = false; //an answer is delayed or long-polling, later requests wait for it
+        bool stalled = false;
+        bool closeAfterWrite = false;
+        bool writeBlocked = false; //waiting for EPOLLOUT
+        bool keepAlive = true;
+        //Long-poll
+        std::string pollKey;
+        uint64_t pollVersion = 0;
+        clock_t::time_point pollDeadline;
+    };
+
+    struct Delayed
+    {
+        clock_t::time_point due;
+        int fd;
+        uint64_t id;
+        int status;
+        std::string body;
+        bool operator>( const Delayed& other ) const { return due > other.due; }
+    };
+
+    struct Worker
+    {
+        Worker( MockServer& server, int index ) : server( server ), random( 0x5eed + index )
+        {
+            epollFd = epoll_create1( EPOLL_CLOEXEC );
+            wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        }
+
+        ~Worker()
+        {
+            for ( auto& connection : connections )
+                close( connection.first );
+            if ( listenFd >= 0 )
+                close( listenFd );
+            close( wakeFd );
+            close( epollFd );
+        }
+
+        void wake()
+        {
+            uint64_t one = 1;
+            ssize_t written = write( wakeFd, &one, sizeof( one ) );
+            (void)written;
+        }
+
+        void run()
+        {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = listenFd;
+            epoll_ctl( epollFd, EPOLL_CTL_ADD, listenFd, &event );
+            event.data.fd = wakeFd;
+            epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeFd, &event );
+
+            std::vector<epoll_event> events( 256 );
+            while ( !server.m_stopping )
+            {
+                int n = epoll_wait( epollFd, events.data(), (int)events.size(), timeout() );
+                for ( int i = 0; i < n; i++ )
+                {
+                    int fd = events[ i ].data.fd;
+                    if ( fd == listenFd )
+                        accept();
+                    else if ( fd == wakeFd )
+                    {
+                        uint64_t count;
+                        while ( read( wakeFd, &count, sizeof( count ) ) > 0 )
+                            ;
+                        checkPolls( false );
+                    }
+                    else
+                    {
+                        auto found = connections.find( fd );
+                        if ( found == connections.end() )
+                            continue;
+                        if ( events[ i ].events & EPOLLOUT )
+                            flush( found->second );
+                        if ( ( events[ i ].events & ( EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP ) ) && connections.count( fd ) )
+                            readFrom( found->second );
+                    }
+                }
+                sendDue();
+                checkPolls( true );
+            }
+        }
+
+        //How long epoll_wait can sleep: until the next delayed answer or long-poll timeout.
+        int timeout()
+        {
+            clock_t::time_point next = clock_t::time_point::max();
+            if ( !delayed.empty() )
+                next = delayed.top().due;
+            for ( int fd : polls )
+                next = std::min( next, connections[ fd ].pollDeadline );
+            if ( next == clock_t::time_point::max() )
+                return 1000;
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>( next - clock_t::now() ).count() + 1;
+            return (int)std::max<long long>( 0, std::min<long long>( wait, 1000 ) );
+        }
+
+        void accept()
+        {
+            while ( true )
+            {
+                int fd = accept4( listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+                if ( fd < 0 )
+                    return;
+                int one = 1;
+                setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+                Connection& connection = connections[ fd ];
+                connection.fd = fd;
+                connection.id = ++nextId;
+                epoll_event event = {};
+                event.events = EPOLLIN | EPOLLRDHUP;
+                event.data.fd = fd;
+                epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event );
+                server.m_connections++;
+            }
+        }
+
+        void closeConnection( Connection& connection )
+        {
+            int fd = connection.fd;
+            epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, nullptr );
+            close( fd );
+            if ( polls.erase( fd ) )
+                server.m_polling--;
+            connections.erase( fd );
+        }
+
+        void readFrom( Connection& connection )
+        {
+            char buffer[ 65536 ];
+            while ( true )
+            {
+                ssize_t n = recv( connection.fd, buffer, sizeof( buffer ), 0 );
+                if ( n > 0 )
+                {
+                    if ( !connection.stalled )
+                        connection.in.append( buffer, n );
+                    if ( n < (ssize_t)sizeof( buffer ) )
+                        break;
+                    continue;
+                }
+                if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                    break;
+                closeConnection( connection ); //closed by the client, or an error
+                return;
+            }
+            process( connection );
+        }
+
+        //Answers the complete requests in the connection's buffer, in order.
+        void process( Connection& connection )
+        {
+            int fd = connection.fd;
+            while ( !connection.waiting && !connection.stalled )
+            {
+                size_t headerEnd = connection.in.find( "\r\n\r\n" );
+                if ( headerEnd == std::string::npos )
+                    break;
+                const char* begin = connection.in.data();
+                const char* lineEnd = (const char*)memchr( begin, '\r', headerEnd );
+                const char* methodEnd = (const char*)memchr( begin, ' ', lineEnd - begin );
+                if ( methodEnd == nullptr )
+                {
+                    closeConnection( connection );
+                    return;
+                }
+                const char* target = methodEnd + 1;
+                const char* targetEnd = (const char*)memchr( target, ' ', lineEnd - target );
+                if ( targetEnd == nullptr )
+                    targetEnd = lineEnd;
+
+                //The headers we care about: the body's length and whether to keep the connection open.
+                size_t contentLength = 0;
+                bool keepAlive = std::string( targetEnd, lineEnd ).find( "HTTP/1.0" ) == std::string::npos;
+                for ( const char* line = lineEnd + 2; line < begin + headerEnd; )
+                {
+                    const char* next = (const char*)memchr( line, '\r', begin + headerEnd - line );
+                    if ( next == nullptr )
+                        next = begin + headerEnd;
+                    if ( headerIs( line, next, "content-length:" ) )
+                        contentLength = (size_t)atoll( line + 15 );
+                    else if ( headerIs( line, next, "connection:" ) )
+                    {
+                        std::string value( line + 11, next );
+                        std::transform( value.begin(), value.end(), value.begin(), ::tolower );
+                        if ( value.find( "close" ) != std::string::npos )
+                            keepAlive = false;
+                        else if ( value.find( "keep-alive" ) != std::string::npos )
+                            keepAlive = true;
+                    }
+                    line = next + 2;
+                }
+                size_t total = headerEnd + 4 + contentLength;
+                if ( connection.in.size() < total )
+                    break;
+
+                const char* query = (const char*)memchr( target, '?', targetEnd - target );
+                std::string path( target, query != nullptr ? query : targetEnd );
+                MockParams params;
+                if ( query != nullptr )
+                    parseQuery( query + 1, targetEnd, params );
+                if ( contentLength > 0 )
+                    parseJsonObject( begin + headerEnd + 4, begin + total, params );
+                connection.keepAlive = keepAlive;
+                connection.in.erase( 0, total );
+
+                handle( connection, path, params );
+                if ( connections.count( fd ) == 0 )
+                    return;
+            }
+        }
+
+        static bool headerIs( const char* line, const char* end, const char* name )
+        {
+            size_t length = strlen( name );
+            return (size_t)( end - line ) >= length && strncasecmp( line, name, length ) == 0;
+        }
+
+        void handle( Connection& connection, const std::string& path, const MockParams& params )
+        {
+            MockLicenseApi::Endpoint endpoint = MockLicenseApi::route( path );
+            server.m_requests[ endpoint ]++;
+            const MockServerOptions& options = server.m_options;
+
+            if ( options.faultPath.empty() || path.find( options.faultPath ) != std::string::npos )
+            {
+                double roll = std::uniform_real_distribution<double>( 0, 1 )( random );
+                if ( roll < options.dropRate )
+                {
+                    server.m_drops++;
+                    closeConnection( connection );
+                    return;
+                }
+                roll -= options.dropRate;
+                if ( roll < options.stallRate )
+                {
+                    server.m_stalls++;
+                    connection.stalled = true;
+                    connection.in.clear();
+                    return;
+                }
+                roll -= options.stallRate;
+                if ( roll < options.errorRate )
+                {
+                    server.m_errors++;
+                    MockResponse error = MockResponse::error( 500, "server_error", "Injected fault" );
+                    respond( connection, error.status, error.body );
+                    return;
+                }
+            }
+
+            if ( endpoint == MockLicenseApi::LicenseChanges )
+            {
+                connection.pollKey = mockParam( params, "license_key", "" );
+                connection.pollVersion = (uint64_t)mockIntParam( params, "version", 0 );
+                connection.pollDeadline = clock_t::now() + std::chrono::milliseconds( mockIntParam( params, "timeout", 30000 ) );
+                connection.waiting = true;
+                if ( polls.insert( connection.fd ).second )
+                    server.m_polling++;
+                checkPoll( connection, false ); //it may have changed already, process() carries on if so
+                return;
+            }
+
+            MockResponse response;
+            if ( endpoint == MockLicenseApi::Stats )
+                response.body = server.statsJson();
+            else
+                response = server.m_api.handle( endpoint, params );
+            respond( connection, response.status, response.body );
+        }
+
+        //Sends the answer now, or later if there's latency to add.
+        void respond( Connection& connection, int status, const std::string& body )
+        {
+            const MockServerOptions& options = server.m_options;
+            if ( options.latency.count() > 0 || options.jitter.count() > 0 )
+            {
+                auto delay = options.latency;
+                if ( options.jitter.count() > 0 )
+                    delay += std::chrono::milliseconds( std::uniform_int_distribution<long long>( 0, options.jitter.count() )( random ) );
+                delayed.push( Delayed{ clock_t::now() + delay, connection.fd, connection.id, status, body } );
+                connection.waiting = true;
+                return;
+            }
+            writeResponse( connection, status, body );
+        }
+
+        void writeResponse( Connection& connection, int status, const std::string& body )
+        {
+            const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" : "Internal Server Error";
+            char header[ 256 ];
+            int length = snprintf( header, sizeof( header ), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                "Content-Length: %zu\r\n%s\r\n", status, reason, body.size(), connection.keepAlive ? "" : "Connection: close\r\n" );
+            connection.out.append( header, length );
+            connection.out += body;
+            connection.closeAfterWrite = !connection.keepAlive;
+            flush( connection );
+        }
+
+        void flush( Connection& connection )
+        {
+            while ( connection.outSent < connection.out.size() )
+            {
+                ssize_t n = send( connection.fd, connection.out.data() + connection.outSent,
+                    connection.out.size() - connection.outSent, MSG_NOSIGNAL );
+                if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                {
+                    //The client isn't reading fast enough, we'll carry on when it is.
+                    if ( !connection.writeBlocked )
+                        watch( connection, EPOLLIN | EPOLLOUT | EPOLLRDHUP );
+                    connection.writeBlocked = true;
+                    return;
+                }
+                if ( n <= 0 )
+                {
+                    closeConnection( connection );
+                    return;
+                }
+                connection.outSent += n;
+            }
+            connection.out.clear();
+            connection.outSent = 0;
+            if ( connection.closeAfterWrite )
+            {
+                closeConnection( connection );
+                return;
+            }
+            if ( connection.writeBlocked )
+            {
+                watch( connection, EPOLLIN | EPOLLRDHUP );
+                connection.writeBlocked = false;
+            }
+        }
+
+        void watch( Connection& connection, uint32_t events )
+        {
+            epoll_event event = {};
+            event.events = events;
+            event.data.fd = connection.fd;
+            epoll_ctl( epollFd, EPOLL_CTL_MOD, connection.fd, &event );
+        }
+
+        void sendDue()
+        {
+            auto now = clock_t::now();
+            while ( !delayed.empty() && delayed.top().due <= now )
+            {
+                Delayed due = delayed.top();
+                delayed.pop();
+                auto found = connections.find( due.fd );
+                if ( found == connections.end() || found->second.id != due.id )
+                    continue; //the client went away meanwhile
+                found->second.waiting = false;
+                writeResponse( found->second, due.status, due.body );
+                if ( connections.count( due.fd ) )
+                    process( connections[ due.fd ] ); //requests that came in while we waited
+            }
+        }
+
+        //Answers long-polls whose license changed, or whose time is up if timedOutOnly.
+        void checkPolls( bool timedOutOnly )
+        {
+            std::vector<int> fds( polls.begin(), polls.end() );
+            for ( int fd : fds )
+            {
+                auto found = connections.find( fd );
+                if ( found != connections.end() && checkPoll( found->second, timedOutOnly ) && connections.count( fd ) &&
+                    !connections[ fd ].waiting )
+                    process( connections[ fd ] ); //requests that came in while it was waiting
+            }
+        }
+
+        //Answers the connection's long-poll if it's time to. Returns whether it did.
+        bool checkPoll( Connection& connection, bool timedOutOnly )
+        {
+            bool timedOut = clock_t::now() >= connection.pollDeadline;
+            if ( timedOutOnly && !timedOut )
+                return false;
+            uint64_t version = server.m_store.version( connection.pollKey );
+            if ( version == connection.pollVersion && !timedOut )
+                return false;
+            if ( polls.erase( connection.fd ) )
+                server.m_polling--;
+            connection.waiting = false;
+            if ( version == 0 )
+            {
+                MockResponse error = MockResponse::error( 400, "license_not_found", "License not found" );
+                respond( connection, error.status, error.body );
+            }
+            else
+                respond( connection, 200, "{\"version\":" + std::to_string( version ) + "}" );
+            return true;
+        }
+
+        MockServer& server;
+        std::mt19937_64 random;
+        int epollFd = -1;
+        int wakeFd = -1;
+        int listenFd = -1;
+        std::unordered_map<int, Connection> connections;
+        std::set<int> polls; //connections with a long-poll waiting
+        std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> delayed;
+        uint64_t nextId = 0;
+        std::thread thread;
+    };
+
+    int listenSocket()
+    {
+        int fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 )
+            throw std::runtime_error( std::string( "socket: " ) + strerror( errno ) );
+        int one = 1;
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+        setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) );
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons( (uint16_t)m_port );
+        if ( inet_pton( AF_INET, m_options.host.c_str(), &address.sin_addr ) != 1 ||
+            bind( fd, (sockaddr*)&address, sizeof( address ) ) != 0 || listen( fd, 4096 ) != 0 )
+        {
+            std::string error = strerror( errno );
+            close( fd );
+            throw std::runtime_error( "can't listen on " + m_options.host + ":" + std::to_string( m_port ) + ": " + error );
+        }
+        //With port 0 the first socket gets a free port, and the other workers' sockets join it there.
+        socklen_t length = sizeof( address );
+        getsockname( fd, (sockaddr*)&address, &length );
+        m_port = ntohs( address.sin_port );
+        return fd;
+    }
+
+    //Wakes the workers to look at their long-polls. A long-poll checks the version itself right after it's counted in
+    //m_polling, so one that isn't counted yet can't miss the change.
+    void notifyChanged()
+    {
+        if ( m_polling == 0 )
+            return;
+        for ( auto& worker : m_workers )
+            worker->wake();
+    }
+
+    std::string statsJson() const
+    {
+        Stats current = stats();
+        std::string json = "{\"requests\":{";
+        for ( int i = 0; i < MockLicenseApi::EndpointCount; i++ )
+            json += std::string( i ? "," : "" ) + "\"" + MockLicenseApi::endpointName( (MockLicenseApi::Endpoint)i ) +
+                "\":" + std::to_string( current.requests[ i ] );
+        json += "},\"errors\":" + std::to_string( current.errors ) + ",\"drops\":" + std::to_string( current.drops ) +
+            ",\"stalls\":" + std::to_string( current.stalls ) + ",\"connections\":" + std::to_string( current.connections ) + "}";
+        return json;
+    }
+
+    MockServerOptions m_options;
+    MockLicenseStore m_store;
+    MockLicenseApi m_api;
+    int m_port;
+    std::atomic<bool> m_stopping{ true };
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<uint64_t> m_requests[ MockLicenseApi::EndpointCount ] = {};
+    std::atomic<uint64_t> m_errors{ 0 };
+    std::atomic<uint64_t> m_drops{ 0 };
+    std::atomic<uint64_t> m_stalls{ 0 };
+    std::atomic<uint64_t> m_connections{ 0 };
+    std::atomic<int> m_polling{ 0 }; //long-polls waiting, over all workers
+};
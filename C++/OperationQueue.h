@@ -0,0 +1,468 @@
+#pragma once
+
+//Durable queue for online license operations. Instead of calling check(), syncConsumption(), syncFeatureConsumption()
+//or sendDeviceVariables() directly (and losing the work if the network is down), the app submits the operation
+//here. The operation is appended to a small journal file on local disk and the call returns right away, so the
+//foreground never waits on the network. A background thread replays the journal in order once the backend can be
+//reached, coalescing repeated operations (e.g. ten consumption syncs become one sync of the summed amount).
+//
+//Journal format, one record per line:
+//    <seq> check
+//    <seq> consumption <amount>
+//    <seq> feature <amount> <feature code>
+//    <seq> devicevars
+//    ack <seq>                 the operation with this seq, and the earlier ones of the same kind it was
+//                              merged with, have been sent
+//Each record is synced to disk (fdatasync) before submit() returns, so a queued operation survives a power cut,
+//not just the app closing. When every operation has been acknowledged the journal is truncated.
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+struct QueuedOperation
+{
+    enum Type { Check, SyncConsumption, SyncFeatureConsumption, SendDeviceVariables };
+
+    Type type = Check;
+    int amount = 0; //consumptions used locally since the last sync, for consumption operations
+    std::string feature; //feature code, for feature consumption operations
+    uint64_t seq = 0; //assigned by the queue
+
+    static QueuedOperation check() { QueuedOperation op; op.type = Check; return op; }
+    static QueuedOperation consumption( int amount ) { QueuedOperation op; op.type = SyncConsumption; op.amount = amount; return op; }
+    static QueuedOperation featureConsumption( const std::string& code, int amount )
+    {
+        QueuedOperation op;
+        op.type = SyncFeatureConsumption;
+        op.feature = code;
+        op.amount = amount;
+        return op;
+    }
+    static QueuedOperation deviceVariables() { QueuedOperation op; op.type = SendDeviceVariables; return op; }
+};
+
+class OperationQueue
+{
+public:
+    //Sends one (coalesced) operation to the backend. Return true when it was sent, false if the backend could not
+    //be reached (the operation stays queued and is retried later). Throwing means the backend rejected the
+    //operation, it is reported to the failure callback and dropped.
+    using Executor = std::function<bool( const QueuedOperation& )>;
+    using FailureCallback = std::function<void( const QueuedOperation&, const std::string& )>;
+
+    OperationQueue( const std::string& journalPath, Executor executor )
+        : m_path( journalPath ), m_executor( executor )
+    {
+        load();
+#ifdef _WIN32
+        m_fd = _open( m_path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+        m_fd = ::open( m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+#endif
+        if ( m_fd < 0 )
+            throw std::runtime_error( "could not open operation journal " + m_path );
+        m_journalSize = fileSize();
+    }
+
+    ~OperationQueue()
+    {
+        stop();
+        closeFile();
+    }
+
+    void setFailureCallback( FailureCallback callback )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_onFailure = callback;
+    }
+
+    //Retry delay after the backend could not be reached. It doubles on each failed attempt up to maxDelay.
+    void setRetryDelay( std::chrono::milliseconds minDelay, std::chrono::milliseconds maxDelay )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_minDelay = minDelay;
+        m_maxDelay = maxDelay;
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_worker.joinable() )
+            return;
+        m_stopping = false;
+        m_worker = std::thread( [ this ]() { run(); } );
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        if ( m_worker.joinable() )
+            m_worker.join();
+    }
+
+    //Records the operation on disk and returns. Never touches the network. While the backend is unreachable the
+    //worker keeps to its retry delay, so submitting lots of operations doesn't turn into lots of attempts.
+    //Throws std::runtime_error if the operation couldn't be written to disk; it isn't queued then.
+    void submit( QueuedOperation op )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            op.seq = m_lastSeq + 1;
+            if ( !writeRecord( serialize( op ) ) )
+                throw std::runtime_error( "could not write operation journal " + m_path );
+            m_lastSeq = op.seq;
+            m_pending.push_back( op );
+        }
+        m_wake.notify_all();
+    }
+
+    //Tells the worker to try again now, e.g. when the app notices the network is back.
+    void retryNow()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_retryAt = clock_t::now();
+        }
+        m_wake.notify_all();
+    }
+
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_pending.size();
+    }
+
+    //Blocks until the queue is empty or the timeout passes. Returns true if everything was sent.
+    bool waitUntilEmpty( std::chrono::milliseconds timeout )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        return m_drained.wait_for( lock, timeout, [ this ]() { return m_pending.empty(); } );
+    }
+
+    //Merges operations that can be sent as one: consumption amounts are summed, feature amounts are summed per
+    //feature code, and repeated checks or device variable uploads collapse into one. An operation is only merged
+    //into an earlier one if nothing in between has to be sent after it (only feature consumptions of other
+    //features may sit in between), so a check still sees exactly the consumptions submitted before it. The
+    //merged operation carries the highest sequence number it covers.
+    static std::vector<QueuedOperation> coalesce( const std::vector<QueuedOperation>& ops )
+    {
+        std::vector<QueuedOperation> merged;
+        for ( const QueuedOperation& op : ops )
+        {
+            auto it = merged.rbegin();
+            while ( it != merged.rend() && !sameKind( *it, op ) && independent( *it, op ) )
+                ++it;
+            if ( it == merged.rend() || !sameKind( *it, op ) )
+                merged.push_back( op );
+            else
+            {
+                it->amount += op.amount;
+                it->seq = op.seq;
+            }
+        }
+        return merged;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    static bool sameKind( const QueuedOperation& a, const QueuedOperation& b )
+    {
+        return a.type == b.type && a.feature == b.feature;
+    }
+
+    //Whether a and b can be sent in either order.
+    static bool independent( const QueuedOperation& a, const QueuedOperation& b )
+    {
+        return a.type == QueuedOperation::SyncFeatureConsumption && b.type == QueuedOperation::SyncFeatureConsumption
+            && a.feature != b.feature;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while ( !m_stopping )
+        {
+            if ( m_pending.empty() )
+            {
+                m_wake.wait( lock );
+                continue;
+            }
+            if ( clock_t::now() < m_retryAt )
+            {
+                auto retryAt = m_retryAt;
+                m_wake.wait_until( lock, retryAt, [ this, retryAt ]() { return m_stopping || m_retryAt != retryAt; } );
+                continue;
+            }
+
+            std::vector<QueuedOperation> batch = coalesce( m_pending );
+            lock.unlock();
+
+            std::vector<QueuedOperation> sent;
+            bool reachable = true;
+            for ( const QueuedOperation& op : batch )
+            {
+                try
+                {
+                    if ( !m_executor( op ) )
+                    {
+                        reachable = false;
+                        break;
+                    }
+                }
+                catch ( const std::exception& ex )
+                {
+                    reportFailure( op, ex.what() );
+                }
+                catch ( ... )
+                {
+                    reportFailure( op, "unknown error" );
+                }
+                sent.push_back( op );
+            }
+
+            lock.lock();
+            acknowledge( sent );
+            if ( reachable )
+                m_backoff = std::chrono::milliseconds( 0 );
+            else
+            {
+                m_backoff = std::min( m_maxDelay, std::max( m_minDelay, m_backoff * 2 ) );
+                m_retryAt = clock_t::now() + m_backoff;
+            }
+        }
+    }
+
+    //Drops every operation covered by a sent (merged) operation: the ones of the same kind, up to its sequence
+    //number. Operations submitted while the batch was being sent have higher sequence numbers and stay queued.
+    void acknowledge( const std::vector<QueuedOperation>& sent )
+    {
+        if ( sent.empty() )
+            return;
+        removeCovered( sent );
+        if ( m_pending.empty() )
+        {
+            //Nothing left to replay, so start a fresh journal instead of letting it grow forever.
+            truncateFile();
+            m_drained.notify_all();
+        }
+        else
+        {
+            std::string acks;
+            for ( const QueuedOperation& op : sent )
+                acks += "ack " + std::to_string( op.seq ) + "\n";
+            //If this doesn't make it to disk the operations are sent again after a restart, which the backend
+            //tolerates better than losing them.
+            writeRecord( acks.substr( 0, acks.size() - 1 ) );
+        }
+    }
+
+    //Appends line and syncs it. On failure the journal is cut back to where it was, so a torn line can't swallow
+    //the next record.
+    bool writeRecord( const std::string& line )
+    {
+        std::string data = line + '\n';
+        const char* at = data.data();
+        size_t left = data.size();
+        bool ok = true;
+        while ( ok && left > 0 )
+        {
+#ifdef _WIN32
+            int n = _write( m_fd, at, (unsigned)left );
+#else
+            ssize_t n = ::write( m_fd, at, left );
+#endif
+            ok = n > 0;
+            if ( ok )
+            {
+                at += n;
+                left -= (size_t)n;
+            }
+        }
+#ifdef _WIN32
+        ok = ok && _commit( m_fd ) == 0;
+#else
+        ok = ok && fdatasync( m_fd ) == 0;
+#endif
+        if ( ok )
+            m_journalSize += data.size();
+        else
+            resizeFile( m_journalSize );
+        return ok;
+    }
+
+    void truncateFile()
+    {
+        resizeFile( 0 );
+        m_journalSize = 0;
+#ifdef _WIN32
+        _commit( m_fd );
+#else
+        fdatasync( m_fd );
+#endif
+    }
+
+    bool resizeFile( uint64_t size )
+    {
+#ifdef _WIN32
+        return _chsize( m_fd, (long)size ) == 0;
+#else
+        return ftruncate( m_fd, (off_t)size ) == 0;
+#endif
+    }
+
+    uint64_t fileSize()
+    {
+#ifdef _WIN32
+        return (uint64_t)_lseek( m_fd, 0, SEEK_END );
+#else
+        return (uint64_t)lseek( m_fd, 0, SEEK_END );
+#endif
+    }
+
+    void closeFile()
+    {
+        if ( m_fd < 0 )
+            return;
+#ifdef _WIN32
+        _close( m_fd );
+#else
+        ::close( m_fd );
+#endif
+        m_fd = -1;
+    }
+
+    void removeCovered( const std::vector<QueuedOperation>& sent )
+    {
+        m_pending.erase( std::remove_if( m_pending.begin(), m_pending.end(), [ &sent ]( const QueuedOperation& op )
+            {
+                for ( const QueuedOperation& merged : sent )
+                    if ( sameKind( merged, op ) && op.seq <= merged.seq )
+                        return true;
+                return false;
+            } ), m_pending.end() );
+    }
+
+    void reportFailure( const QueuedOperation& op, const std::string& what )
+    {
+        FailureCallback callback;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            callback = m_onFailure;
+        }
+        if ( callback )
+            callback( op, what );
+    }
+
+    //Reads back operations that were not sent before the app last exited. A torn last line (from a crash while
+    //writing) is ignored.
+    void load()
+    {
+        std::ifstream in( m_path );
+        std::string line;
+        std::vector<uint64_t> acked;
+        while ( std::getline( in, line ) )
+        {
+            uint64_t seq = 0;
+            QueuedOperation op;
+            if ( line.compare( 0, 4, "ack " ) == 0 )
+            {
+                if ( std::istringstream( line.substr( 4 ) ) >> seq )
+                    acked.push_back( seq );
+            }
+            else if ( parse( line, op ) )
+            {
+                m_pending.push_back( op );
+                m_lastSeq = std::max( m_lastSeq, op.seq );
+            }
+        }
+
+        std::vector<QueuedOperation> sent;
+        for ( uint64_t seq : acked )
+        {
+            auto it = std::find_if( m_pending.begin(), m_pending.end(), [ seq ]( const QueuedOperation& op ) { return op.seq == seq; } );
+            if ( it != m_pending.end() )
+                sent.push_back( *it );
+        }
+        removeCovered( sent );
+    }
+
+    static std::string serialize( const QueuedOperation& op )
+    {
+        std::ostringstream out;
+        out << op.seq << ' ';
+        switch ( op.type )
+        {
+            case QueuedOperation::Check: out << "check"; break;
+            case QueuedOperation::SyncConsumption: out << "consumption " << op.amount; break;
+            case QueuedOperation::SyncFeatureConsumption: out << "feature " << op.amount << ' ' << op.feature; break;
+            case QueuedOperation::SendDeviceVariables: out << "devicevars"; break;
+        }
+        return out.str();
+    }
+
+    static bool parse( const std::string& line, QueuedOperation& op )
+    {
+        std::istringstream in( line );
+        std::string type;
+        if ( !( in >> op.seq >> type ) )
+            return false;
+        if ( type == "check" )
+            op.type = QueuedOperation::Check;
+        else if ( type == "devicevars" )
+            op.type = QueuedOperation::SendDeviceVariables;
+        else if ( type == "consumption" )
+        {
+            op.type = QueuedOperation::SyncConsumption;
+            if ( !( in >> op.amount ) )
+                return false;
+        }
+        else if ( type == "feature" )
+        {
+            op.type = QueuedOperation::SyncFeatureConsumption;
+            if ( !( in >> op.amount >> op.feature ) )
+                return false;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    std::string m_path;
+    Executor m_executor;
+    FailureCallback m_onFailure;
+    int m_fd = -1;
+    uint64_t m_journalSize = 0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_drained;
+    std::vector<QueuedOperation> m_pending;
+    uint64_t m_lastSeq = 0;
+    bool m_stopping = false;
+    clock_t::time_point m_retryAt;
+    std::chrono::milliseconds m_backoff = std::chrono::milliseconds( 0 );
+    std::chrono::milliseconds m_minDelay = std::chrono::seconds( 1 );
+    std::chrono::milliseconds m_maxDelay = std::chrono::minutes( 1 );
+    std::thread m_worker;
+};
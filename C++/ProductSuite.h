@@ -0,0 +1,493 @@
+#pragma once
+
+//Several products licensed from one process. A suite that bundles a dozen products, each with its own product code
+//and license, would otherwise create a Configuration and a LicenseManager per product, each working out the
+//hardware ID and storing its license under its own folder, and check them one after the other at startup: twelve
+//round trips in a row before the app knows what it may show.
+//
+//ProductSuite builds the products' configurations from one set of shared settings: the same ExtendedOptions (so
+//one hardware ID, see DeviceFingerprint.h), and one folder holding every product's license file. The online work
+//for all products goes through one NetworkGuard (see CircuitBreaker.h), so if the servers are down the circuit
+//opens once for the whole suite instead of each product waiting for its own timeouts, and through one rate
+//limiter, so starting up doesn't send the servers a burst of twelve activations at once.
+//
+//    SuiteSettings settings;
+//    settings.options.setHardwareID( device.hardwareId() );
+//    settings.storageFolder = "licenses";
+//    ProductSuite suite( settings, &backgroundWork );
+//    suite.add( "PRODUCT1", LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ) );
+//    ...
+//    suite.refreshAll(); //every product at the same time, on the pool
+//    suite.wait();
+//    if ( suite.entitled( "PRODUCT1" ) ) ...
+//
+//Each product first loads and checks its local license, which needs no network, and publishes what it found
+//straight away. Then, rate limited, it activates if it has to and checks online. Reading the combined view
+//(entitlement(), entitled()) is a lookup and an atomic load, never waits for a refresh, and can be done from any
+//thread as often as the app likes, e.g. every time a menu is drawn.
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CircuitBreaker.h"
+#include "WorkerPool.h"
+
+enum class EntitlementState
+{
+    Unknown, //not loaded yet
+    Entitled,
+    NotActivated, //no local license and activation failed, or hasn't been tried
+    Expired,
+    Disabled,
+    Failed //the license is there but isn't usable, see error
+};
+
+inline const char* entitlementName( EntitlementState state )
+{
+    switch ( state )
+    {
+        case EntitlementState::Unknown: return "unknown";
+        case EntitlementState::Entitled: return "entitled";
+        case EntitlementState::NotActivated: return "not activated";
+        case EntitlementState::Expired: return "expired";
+        case EntitlementState::Disabled: return "disabled";
+        case EntitlementState::Failed: return "failed";
+        default: return "unknown";
+    }
+}
+
+//What one product may do, as of its last refresh.
+struct ProductEntitlement
+{
+    EntitlementState state = EntitlementState::Unknown;
+    bool trial = false;
+    bool checkedOnline = false; //false if only the local license was checked, e.g. the servers couldn't be reached
+    int64_t updatedAt = 0; //seconds since the epoch
+    std::string error; //what went wrong with the last refresh, empty if it worked
+
+    bool entitled() const { return state == EntitlementState::Entitled; }
+};
+
+//One product's license work. LicenseSpringProduct below does it with the SDK; the suite only needs these three
+//steps, so the sample can also run it against made-up delays. Each step returns what the license allows after it,
+//and throws what the SDK throws.
+class SuiteProduct
+{
+public:
+    virtual ~SuiteProduct() = default;
+
+    //Disk only: reloads and checks the local license. Returns NotActivated if there isn't an active one, and
+    //Expired or Disabled (not an exception) if that's why the local check refused it, so it still gets checked online.
+    virtual ProductEntitlement loadLocal() = 0;
+
+    //Online, only called after loadLocal() returned NotActivated.
+    virtual ProductEntitlement activate() = 0;
+
+    //Online, checks the license with the server.
+    virtual ProductEntitlement check() = 0;
+};
+
+//Hands out the times requests may be sent at: at most burst right away, then one every 1 / requestsPerSecond.
+//Callers don't sleep for their turn in here, they get the time back and schedule the request for it, so waiting
+//for a turn doesn't hold a pool thread.
+class SuiteRateLimiter
+{
+public:
+    SuiteRateLimiter( double requestsPerSecond, int burst, std::shared_ptr<Clock> clock = SystemClock::instance() )
+        : m_interval( std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>( 1.0 / std::max( requestsPerSecond, 0.001 ) ) ) ),
+          m_burst( std::max( burst, 1 ) ), m_clock( clock )
+    {}
+
+    //Takes the next turn and returns when it is. Turns not taken while idle build up, up to burst.
+    Clock::steady_time reserve()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        Clock::steady_time now = m_clock->steadyNow();
+        m_next = std::max( m_next, now - m_interval * ( m_burst - 1 ) );
+        Clock::steady_time turn = m_next;
+        m_next += m_interval;
+        return std::max( turn, now );
+    }
+
+private:
+    std::chrono::steady_clock::duration m_interval;
+    int m_burst;
+    std::shared_ptr<Clock> m_clock;
+    std::mutex m_mutex;
+    Clock::steady_time m_next;
+};
+
+struct SuiteSettings
+{
+    std::string apiKey; //EncryptStr( "..." ), as for Configuration::Create
+    std::string sharedKey;
+    std::string appName;
+    std::string appVersion;
+    //Shared by every product's configuration: hardware ID, network info, logging, alternate service URL...
+    LicenseSpring::ExtendedOptions options;
+    //Every product keeps its license file here, as <product code>.lic. Empty leaves each product in the SDK's own
+    //folder for it.
+    std::string storageFolder;
+    double requestsPerSecond = 4.0; //for all products together
+    int burst = 4;
+    CircuitBreakerPolicy policy;
+};
+
+struct SuiteMetrics
+{
+    uint64_t refreshes = 0; //products refreshed
+    uint64_t onlineCalls = 0; //activations and checks sent
+    uint64_t serverUnreachable = 0; //online calls that fell back to the local license
+    std::chrono::milliseconds rateLimited{ 0 }; //total time calls waited for their turn
+};
+
+class ProductSuite
+{
+public:
+    //pool runs the refreshes. Without one the suite makes its own, sized to the host.
+    explicit ProductSuite( const SuiteSettings& settings, WorkerPool* pool = nullptr )
+        : m_settings( settings ), m_guard( settings.policy ),
+          m_pool( pool != nullptr ? pool : ( m_ownPool.reset( new WorkerPool() ), m_ownPool.get() ) ),
+          m_limiter( settings.requestsPerSecond, settings.burst, m_pool->clock() )
+    {}
+
+    //Waits for refreshes still running, they use the products.
+    ~ProductSuite()
+    {
+        wait();
+    }
+
+    ProductSuite( const ProductSuite& ) = delete;
+    ProductSuite& operator=( const ProductSuite& ) = delete;
+
+    //Adds a product licensed with the SDK, with a configuration built from the shared settings. Products are
+    //added before the first refreshAll(). Returns the product's index, for entitlement( size_t ).
+    size_t add( const std::string& productCode, const LicenseSpring::LicenseID& licenseId );
+
+    //Adds a product that does its license work its own way.
+    size_t add( const std::string& productCode, std::shared_ptr<SuiteProduct> product )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_refreshing > 0 || m_refreshed )
+            throw std::logic_error( "products must be added before refreshAll()" );
+        if ( m_index.count( productCode ) )
+            throw std::invalid_argument( "duplicate product code: " + productCode );
+        m_index[ productCode ] = m_products.size();
+        m_products.emplace_back( new Product{ productCode, product } );
+        return m_products.size() - 1;
+    }
+
+    //Refreshes every product at the same time, on the pool: the local license, then activation if needed and,
+    //with checkOnline, an online check. Returns straight away; entitlements are updated as each product gets
+    //there. A product still refreshing from the last call is left alone.
+    void refreshAll( bool checkOnline = true )
+    {
+        for ( size_t index = 0; index < m_products.size(); index++ )
+        {
+            Product& product = *m_products[ index ];
+            if ( product.refreshing.exchange( true ) )
+                continue;
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                m_refreshing++;
+                m_refreshed = true;
+            }
+            m_pool->post( [ this, &product, checkOnline ]() { loadLocal( product, checkOnline ); } );
+        }
+    }
+
+    //Waits until no product is refreshing.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_idle.wait( lock, [ this ]() { return m_refreshing == 0; } );
+    }
+
+    //Waits for up to timeout, returns false if some product is still refreshing.
+    bool waitFor( std::chrono::milliseconds timeout )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        return m_idle.wait_for( lock, timeout, [ this ]() { return m_refreshing == 0; } );
+    }
+
+    //The combined view. Lock-free: an index into the products and an atomic load of the product's latest
+    //entitlement, which refreshes replace as a whole.
+    std::shared_ptr<const ProductEntitlement> entitlement( size_t index ) const
+    {
+        return std::atomic_load( &m_products[ index ]->entitlement );
+    }
+
+    //Same by product code, one hash lookup more. Unknown product codes throw std::out_of_range.
+    std::shared_ptr<const ProductEntitlement> entitlement( const std::string& productCode ) const
+    {
+        return entitlement( m_index.at( productCode ) );
+    }
+
+    bool entitled( const std::string& productCode ) const
+    {
+        auto found = m_index.find( productCode );
+        return found != m_index.end() && entitlement( found->second )->entitled();
+    }
+
+    size_t size() const { return m_products.size(); }
+
+    const std::string& productCode( size_t index ) const { return m_products[ index ]->code; }
+
+    NetworkGuard& networkGuard() { return m_guard; }
+
+    SuiteMetrics metrics() const
+    {
+        SuiteMetrics metrics;
+        metrics.refreshes = m_refreshes;
+        metrics.onlineCalls = m_onlineCalls;
+        metrics.serverUnreachable = m_serverUnreachable;
+        metrics.rateLimited = std::chrono::milliseconds( m_rateLimitedMs.load() );
+        return metrics;
+    }
+
+private:
+    struct Product
+    {
+        Product( const std::string& code, std::shared_ptr<SuiteProduct> product )
+            : code( code ), product( product ), entitlement( std::make_shared<ProductEntitlement>() )
+        {}
+
+        std::string code;
+        std::shared_ptr<SuiteProduct> product;
+        std::shared_ptr<const ProductEntitlement> entitlement; //only through std::atomic_load and std::atomic_store
+        std::atomic<bool> refreshing{ false };
+    };
+
+    void loadLocal( Product& product, bool checkOnline )
+    {
+        ProductEntitlement local;
+        try
+        {
+            local = product.product->loadLocal();
+        }
+        catch ( LicenseSpring::LicenseSpringException ex )
+        {
+            local.state = EntitlementState::Failed;
+            local.error = ex.what();
+        }
+        //Anything else a product throws still has to end the refresh, or wait() never returns.
+        catch ( const std::exception& ex )
+        {
+            local.state = EntitlementState::Failed;
+            local.error = ex.what();
+        }
+        publish( product, local );
+        //A license that failed its local check (another device's, a tampered clock) isn't fixed by going online.
+        if ( local.state == EntitlementState::NotActivated || ( checkOnline && local.state != EntitlementState::Failed ) )
+            goOnline( product, local.state == EntitlementState::NotActivated );
+        else
+            finish( product );
+    }
+
+    //Waits for a turn from the rate limiter on the pool's timers, not on a pool thread, then makes the call.
+    void goOnline( Product& product, bool activate )
+    {
+        Clock::steady_time queued = m_pool->clock()->steadyNow();
+        Clock::steady_time turn = m_limiter.reserve();
+        m_pool->scheduleAt( turn, [ this, &product, activate, queued, turn ]()
+            {
+                m_rateLimitedMs += std::chrono::duration_cast<std::chrono::milliseconds>( turn - queued ).count();
+                callOnline( product, activate );
+            } );
+    }
+
+    void callOnline( Product& product, bool activate )
+    {
+        std::shared_ptr<const ProductEntitlement> before = std::atomic_load( &product.entitlement );
+        ProductEntitlement after;
+        m_onlineCalls++;
+        try
+        {
+            after = m_guard.call( activate ? Endpoint::Activation : Endpoint::Check,
+                [ & ]() { return activate ? product.product->activate() : product.product->check(); } );
+            after.checkedOnline = true;
+        }
+        catch ( CircuitOpenException ex ) { after = unreachable( *before, ex.what() ); }
+        catch ( LicenseSpring::NoInternetException ex ) { after = unreachable( *before, ex.what() ); }
+        catch ( LicenseSpring::NetworkTimeoutException ex ) { after = unreachable( *before, ex.what() ); }
+        catch ( LicenseSpring::LicenseServerException ex ) { after = unreachable( *before, ex.what() ); }
+        catch ( LicenseSpring::LicenseSpringException ex )
+        {
+            //The server answered, and said no: not found, disabled, no activations left...
+            after.state = activate ? EntitlementState::NotActivated : EntitlementState::Failed;
+            after.checkedOnline = true;
+            after.error = ex.what();
+        }
+        catch ( const std::exception& ex )
+        {
+            after.state = EntitlementState::Failed;
+            after.error = ex.what();
+        }
+        publish( product, after );
+        finish( product );
+    }
+
+    //The local license stays what the app goes by, with a note that the servers couldn't be reached.
+    ProductEntitlement unreachable( const ProductEntitlement& local, const char* error )
+    {
+        m_serverUnreachable++;
+        ProductEntitlement kept = local;
+        kept.checkedOnline = false;
+        kept.error = error;
+        return kept;
+    }
+
+    void publish( Product& product, ProductEntitlement entitlement )
+    {
+        entitlement.updatedAt = (int64_t)std::chrono::duration_cast<std::chrono::seconds>(
+            m_pool->clock()->now().time_since_epoch() ).count();
+        std::atomic_store( &product.entitlement, std::shared_ptr<const ProductEntitlement>(
+            std::make_shared<ProductEntitlement>( std::move( entitlement ) ) ) );
+    }
+
+    void finish( Product& product )
+    {
+        m_refreshes++;
+        product.refreshing = false;
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( --m_refreshing == 0 )
+            m_idle.notify_all();
+    }
+
+    SuiteSettings m_settings;
+    NetworkGuard m_guard;
+    std::unique_ptr<WorkerPool> m_ownPool;
+    WorkerPool* m_pool;
+    SuiteRateLimiter m_limiter;
+
+    //Only changed by add(), before any refresh, so reading them needs no lock.
+    std::vector<std::unique_ptr<Product>> m_products;
+    std::unordered_map<std::string, size_t> m_index;
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    size_t m_refreshing = 0;
+    bool m_refreshed = false;
+
+    std::atomic<uint64_t> m_refreshes{ 0 };
+    std::atomic<uint64_t> m_onlineCalls{ 0 };
+    std::atomic<uint64_t> m_serverUnreachable{ 0 };
+    std::atomic<int64_t> m_rateLimitedMs{ 0 };
+};
+
+//A product licensed with the SDK, its configuration built from the suite's shared settings.
+class LicenseSpringProduct : public SuiteProduct
+{
+public:
+    LicenseSpringProduct( const SuiteSettings& settings, const std::string& productCode, const LicenseSpring::LicenseID& licenseId )
+        : m_licenseId( licenseId )
+    {
+        LicenseSpring::ExtendedOptions options = settings.options;
+        if ( !settings.storageFolder.empty() )
+        {
+            std::string path = settings.storageFolder + "/" + productCode + ".lic";
+            options.setLicenseFilePath( std::wstring( path.begin(), path.end() ) );
+        }
+        auto configuration = LicenseSpring::Configuration::Create( settings.apiKey, settings.sharedKey, productCode,
+            settings.appName, settings.appVersion, options );
+        m_manager = LicenseSpring::LicenseManager::create( configuration );
+    }
+
+    ProductEntitlement loadLocal() override
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_license = m_manager->reloadLicense();
+        if ( m_license == nullptr || !m_license->isActive() )
+        {
+            ProductEntitlement none;
+            none.state = EntitlementState::NotActivated;
+            return none;
+        }
+        try
+        {
+            m_license->localCheck();
+        }
+        catch ( LicenseSpring::LicenseStateException ex )
+        {
+            //Expired or disabled: that's an answer, not a failure, and the online check may find it renewed or
+            //enabled again.
+            ProductEntitlement entitlement = describe();
+            entitlement.error = ex.what();
+            return entitlement;
+        }
+        return describe();
+    }
+
+    ProductEntitlement activate() override
+    {
+        auto license = m_manager->activateLicense( m_licenseId );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_license = license;
+        return describe();
+    }
+
+    ProductEntitlement check() override
+    {
+        LicenseSpring::License::ptr_t license;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            license = m_license;
+        }
+        std::string error;
+        try
+        {
+            license->check();
+        }
+        catch ( LicenseSpring::LicenseStateException ex )
+        {
+            error = ex.what(); //the server says it's expired or disabled, describe() below tells which
+        }
+        std::lock_guard<std::mutex> lock( m_mutex );
+        ProductEntitlement entitlement = describe();
+        entitlement.error = error;
+        return entitlement;
+    }
+
+    LicenseSpring::License::ptr_t license()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_license;
+    }
+
+private:
+    ProductEntitlement describe() const
+    {
+        ProductEntitlement entitlement;
+        entitlement.trial = m_license->isTrial();
+        if ( !m_license->isActive() )
+            entitlement.state = EntitlementState::NotActivated;
+        else if ( !m_license->isEnabled() )
+            entitlement.state = EntitlementState::Disabled;
+        else if ( m_license->isExpired() )
+            entitlement.state = EntitlementState::Expired;
+        else
+            entitlement.state = EntitlementState::Entitled;
+        return entitlement;
+    }
+
+    LicenseSpring::LicenseID m_licenseId;
+    LicenseSpring::LicenseManager::ptr_t m_manager;
+    std::mutex m_mutex;
+    LicenseSpring::License::ptr_t m_license;
+};
+
+inline size_t ProductSuite::add( const std::string& productCode, const LicenseSpring::LicenseID& licenseId )
+{
+    return add( productCode, std::make_shared<LicenseSpringProduct>( m_settings, productCode, licenseId ) );
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+//Local consumption quota leased from the LicenseSpring servers. Instead of syncing with the server for every
+//consumption, the app reserves a block of consumptions up front (e.g. updateConsumption( 500, false ) followed by
+//syncConsumption()), and then spends that block locally. Spending is a single atomic compare-and-swap on the
+//remaining count, so any number of threads can spend at once without taking a lock or waiting on the network.
+//When the remaining count drops below the low-water mark, the next block is reserved in the background (on a
+//WorkerPool, or the lease's own thread), so in the normal case the lease never runs dry. Whatever is left when the
+//lease is closed is given back to the server.
+//
+//If the lease runs dry before a renewal comes back, the app is spending faster than one block per round trip, so
+//the block size doubles (up to the maximum block size) for the following renewals.
+//
+//Reserved consumptions are counted as used on the server until they are given back, so if the app crashes, at
+//most one block is counted too many. Pick the maximum block size with that in mind.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include "WorkerPool.h"
+
+class QuotaLease
+{
+public:
+    //Reserves up to the requested amount on the server and returns how much was actually granted, 0 if the
+    //quota is used up. Throws if the server can't be reached.
+    using Reserve = std::function<int64_t( int64_t requested )>;
+    //Gives unused consumptions back to the server.
+    using Release = std::function<void( int64_t unused )>;
+
+    //Renewals run on pool at high priority if one is given (see WorkerPool.h), since spending may be waiting for
+    //them, otherwise on the lease's own thread.
+    QuotaLease( Reserve reserve, Release release, int64_t blockSize, WorkerPool* pool = nullptr )
+        : m_reserve( reserve ), m_release( release ), m_blockSize( std::max<int64_t>( blockSize, 1 ) ),
+          m_maxBlockSize( m_blockSize * 16 ), m_lowWater( m_blockSize / 4 ), m_loop( pool, TaskPriority::High )
+    {}
+
+    ~QuotaLease()
+    {
+        try
+        {
+            close();
+        }
+        catch ( ... )
+        {
+            //Nothing we can do about it here. The unused consumptions stay counted on the server.
+        }
+    }
+
+    QuotaLease( const QuotaLease& ) = delete;
+    QuotaLease& operator=( const QuotaLease& ) = delete;
+
+    //Renew once fewer than this many consumptions are left. Defaults to a quarter of the block size, and follows
+    //the block size as it grows.
+    void setLowWaterMark( int64_t lowWater ) { m_lowWater = lowWater; }
+
+    //Largest block the lease grows to. Defaults to 16 times the starting block size.
+    void setMaxBlockSize( int64_t maxBlockSize ) { m_maxBlockSize = std::max( maxBlockSize, m_blockSize ); }
+
+    //How long to wait before trying again when a renewal fails because the server couldn't be reached.
+    void setRetryDelay( std::chrono::milliseconds delay ) { m_retryDelay = delay; }
+
+    //Reserves the first block (throws whatever reserve throws) and starts renewing in the background.
+    void open()
+    {
+        int64_t granted = m_reserve( m_blockSize );
+        m_reservations++;
+        m_leased += granted;
+        m_exhausted = granted < m_blockSize;
+        m_remaining.store( granted, std::memory_order_release );
+        m_loop.start( [ this ]() { return renew(); } );
+    }
+
+    //Spends from the lease without blocking. Returns false if there isn't enough left right now.
+    bool tryConsume( int64_t amount = 1 )
+    {
+        int64_t current = m_remaining.load( std::memory_order_relaxed );
+        do
+        {
+            if ( current < amount )
+            {
+                if ( m_renewRequested.load( std::memory_order_relaxed ) && !m_ranDry.load( std::memory_order_relaxed ) )
+                    m_ranDry.store( true, std::memory_order_relaxed );
+                requestRenewal();
+                return false;
+            }
+        } while ( !m_remaining.compare_exchange_weak( current, current - amount, std::memory_order_acq_rel, std::memory_order_relaxed ) );
+
+        if ( current - amount <= m_lowWater )
+            requestRenewal();
+        return true;
+    }
+
+    //Spends from the lease, waiting up to timeout for a renewal if the lease has run dry. Returns false if the
+    //quota is used up or the renewal didn't come through in time.
+    bool consume( int64_t amount, std::chrono::milliseconds timeout )
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while ( !tryConsume( amount ) )
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            if ( !m_renewed.wait_until( lock, deadline, [ this, amount ]() { return remaining() >= amount || !m_renewRequested; } ) )
+                return false;
+            if ( remaining() < amount && m_exhausted )
+                return false;
+        }
+        return true;
+    }
+
+    //Puts consumptions back into the lease, e.g. when the work they were spent on failed.
+    void refund( int64_t amount )
+    {
+        m_remaining.fetch_add( amount, std::memory_order_release );
+    }
+
+    //Stops renewing and gives the unused consumptions back. Throws whatever release throws, in which case the
+    //unused consumptions stay counted on the server.
+    void close()
+    {
+        if ( !m_loop.running() )
+            return;
+        m_loop.stop();
+
+        int64_t unused = m_remaining.exchange( 0 );
+        m_leased -= unused;
+        if ( unused > 0 )
+            m_release( unused );
+    }
+
+    int64_t remaining() const { return m_remaining.load( std::memory_order_relaxed ); }
+
+    //Consumptions reserved so far, less any given back.
+    int64_t leased() const { return m_leased; }
+
+    //Consumptions spent from the lease.
+    int64_t spent() const { return m_leased - remaining(); }
+
+    //Number of round trips made to reserve blocks.
+    int64_t reservations() const { return m_reservations; }
+
+    //True once the server granted less than a full block, i.e. the quota is about to run out.
+    bool exhausted() const { return m_exhausted; }
+
+private:
+    //Only the thread that flips the flag wakes the renewals, so spending threads don't pile up on a lock.
+    void requestRenewal()
+    {
+        if ( m_exhausted || m_renewRequested.exchange( true ) )
+            return;
+        m_loop.wake();
+    }
+
+    //Reserves the next block if one was asked for (see BackgroundLoop in WorkerPool.h).
+    Clock::steady_time renew()
+    {
+        if ( !m_renewRequested )
+            return BackgroundLoop::idle();
+
+        //The lease ran dry while the last renewal was on its way, so ask for more this time.
+        if ( m_ranDry.exchange( false ) && m_blockSize < m_maxBlockSize )
+        {
+            int64_t grown = std::min( m_blockSize * 2, m_maxBlockSize.load() );
+            m_lowWater = m_lowWater * grown / m_blockSize;
+            m_blockSize = grown;
+        }
+        int64_t requested = m_blockSize;
+        int64_t granted = -1;
+        try
+        {
+            granted = m_reserve( requested );
+        }
+        catch ( ... )
+        {
+        }
+
+        //Couldn't reach the server. The flag stays set, so we try again after the retry delay.
+        if ( granted < 0 )
+            return std::chrono::steady_clock::now() + m_retryDelay;
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_reservations++;
+        m_leased += granted;
+        m_remaining.fetch_add( granted, std::memory_order_release );
+        if ( granted < requested )
+            m_exhausted = true;
+        m_renewRequested = false;
+        m_renewed.notify_all();
+        return BackgroundLoop::idle();
+    }
+
+    Reserve m_reserve;
+    Release m_release;
+    int64_t m_blockSize; //only changed by renew()
+    std::atomic<int64_t> m_maxBlockSize;
+    std::atomic<int64_t> m_lowWater;
+    std::chrono::milliseconds m_retryDelay = std::chrono::seconds( 1 );
+
+    //Kept on its own cache line, every spend writes to it.
+    alignas( 64 ) std::atomic<int64_t> m_remaining{ 0 };
+    alignas( 64 ) std::atomic<bool> m_renewRequested{ false };
+    std::atomic<bool> m_ranDry{ false };
+    std::atomic<bool> m_exhausted{ false };
+    std::atomic<int64_t> m_leased{ 0 };
+    std::atomic<int64_t> m_reservations{ 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_renewed;
+    BackgroundLoop m_loop; //declared last, so it's stopped before the rest goes away
+};
@@ -0,0 +1,541 @@
+#pragma once
+
+//License state and consumption counters shared by every process of the app on one machine. When the app runs as
+//many worker processes, having each of them reloadLicense(), localCheck() and updateConsumption() on the same
+//local license file means they fight over the file and their consumption counts drift apart. Instead, all of
+//them map one small named shared-memory segment:
+//  - One process is elected owner. Only the owner uses the LicenseSpring SDK: it keeps the license loaded, syncs
+//    consumptions with the server and publishes a snapshot of the license state into the segment.
+//  - Every process (the owner too) spends consumptions with a lock-free compare-and-swap on a counter in the
+//    segment, against a limit the owner sets after each sync, and reads license state from the snapshot.
+//  - The owner updates a heartbeat. If it stops (the owner crashed or hung), another process takes over.
+//
+//Exactly-once syncing across owner crashes: each counter only ever grows. When the owner syncs, it adds the
+//consumptions spent since the last sync to the license and, in the same license file save, records how far into
+//the counter it got (see SharedLicenseOwner). A new owner reads that back from the license file, so consumptions
+//the old owner saved just before crashing aren't added twice. The segment is gone after a reboot, and with it any
+//consumptions that hadn't been synced yet, at most one sync interval's worth.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//What the owner publishes about the license. Plain data, so it can be copied in and out of shared memory.
+struct SharedLicenseSnapshot
+{
+    bool valid = false; //false until the owner has published anything, or if the last local check failed
+    bool active = false;
+    bool enabled = false;
+    bool expired = false;
+    int64_t maxConsumption = 0;
+    int64_t maxOverages = 0;
+    int64_t totalConsumption = 0; //as of the owner's last sync
+    int64_t updatedAt = 0; //seconds since the epoch
+    char key[64] = {};
+    char error[128] = {}; //what went wrong with the last sync or check, empty if it worked
+};
+
+//One counter, for the license's own consumption (feature code "") or for a feature, as handed to the owner's sync.
+struct SharedCounterSync
+{
+    std::string feature;
+    int64_t delta = 0; //spent since the last sync
+    int64_t spentThrough = 0; //counter value the sync covers, to be recorded in the license file
+    int64_t remaining = 0; //filled in by the owner: how many more can be spent after this sync
+};
+
+//The LicenseSpring side of the owner. Implemented by the app, see shared_workers.cpp.
+class SharedLicenseOwner
+{
+public:
+    virtual ~SharedLicenseOwner() = default;
+
+    //Called when this process becomes the owner. Loads the license and returns what its license file says has
+    //been synced for the given segment generation, per feature code (see sync). Unknown codes can be left out.
+    virtual std::map<std::string, int64_t> takeOver( uint64_t generation ) = 0;
+
+    //Adds each delta to the license, records generation and spentThrough for every counter in the license file
+    //in the same save, syncs with the server, and fills in remaining and the snapshot. Throwing leaves the
+    //counters as they are, to be synced next time.
+    virtual void sync( uint64_t generation, std::vector<SharedCounterSync>& counters, SharedLicenseSnapshot& snapshot ) = 0;
+};
+
+class SharedLicenseState
+{
+public:
+    static constexpr int maxCounters = 16;
+
+    //name identifies the segment, e.g. the product code. All processes using the same name share one segment.
+    explicit SharedLicenseState( const std::string& name )
+    {
+        map( name );
+        initialize();
+        findCounter( std::string(), true );
+    }
+
+    ~SharedLicenseState()
+    {
+        stop();
+        //Leaving the owner slot to a dead pid would make the others wait for the heartbeat to time out.
+        uint64_t owner = m_segment->owner.load();
+        if ( pidOf( owner ) == currentPid() )
+            m_segment->owner.compare_exchange_strong( owner, makeOwner( epochOf( owner ), 0 ) );
+        unmap();
+    }
+
+    SharedLicenseState( const SharedLicenseState& ) = delete;
+    SharedLicenseState& operator=( const SharedLicenseState& ) = delete;
+
+    //Starts the background thread that takes part in the owner election and, while this process is the owner,
+    //syncs every syncInterval. Every process that can reach the LicenseSpring servers should call this; processes
+    //that only spend can skip it.
+    void start( std::shared_ptr<SharedLicenseOwner> owner, std::chrono::milliseconds syncInterval = std::chrono::seconds( 5 ),
+        std::chrono::milliseconds ownerTimeout = std::chrono::seconds( 15 ) )
+    {
+        stop();
+        m_owner = owner;
+        m_syncInterval = syncInterval;
+        m_ownerTimeout = ownerTimeout;
+        m_stopping = false;
+        m_thread = std::thread( [ this ]() { run(); } );
+    }
+
+    void stop()
+    {
+        m_stopping = true;
+        if ( m_thread.joinable() )
+            m_thread.join();
+    }
+
+    //Spends from the license's consumptions, or a feature's if a feature code is given. Never blocks and never
+    //touches the license file or the network. Returns false if the limit from the owner's last sync is reached.
+    bool tryConsume( int64_t amount = 1, const std::string& feature = std::string() )
+    {
+        Counter* counter = findCounter( feature, true );
+        if ( counter == nullptr )
+            return false;
+        int64_t spent = counter->spent.load( std::memory_order_relaxed );
+        do
+        {
+            if ( spent + amount > counter->limit.load( std::memory_order_acquire ) )
+                return false;
+        } while ( !counter->spent.compare_exchange_weak( spent, spent + amount, std::memory_order_acq_rel, std::memory_order_relaxed ) );
+        return true;
+    }
+
+    //Consumptions spent through the segment by all processes, since the segment was created.
+    int64_t spent( const std::string& feature = std::string() )
+    {
+        Counter* counter = findCounter( feature, false );
+        return counter == nullptr ? 0 : counter->spent.load();
+    }
+
+    //Consumptions spent through the segment that the owner hasn't synced yet.
+    int64_t unsynced( const std::string& feature = std::string() )
+    {
+        Counter* counter = findCounter( feature, false );
+        return counter == nullptr ? 0 : counter->spent.load() - counter->synced.load();
+    }
+
+    //The license state as the owner last published it. Lock-free for readers: the owner writes the next snapshot
+    //into the other of two slots and then switches over, so readers never wait on it (and an owner that dies
+    //half way through writing leaves the current snapshot intact). If the owner got round to the slot we were
+    //reading, we just read it again.
+    SharedLicenseSnapshot snapshot() const
+    {
+        uint64_t words[ snapshotWords ];
+        for ( ;; )
+        {
+            const SnapshotSlot& slot = m_segment->snapshots[ m_segment->snapshotIndex.load( std::memory_order_acquire ) & 1 ];
+            uint64_t before = slot.seq.load( std::memory_order_acquire );
+            if ( before & 1 )
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            for ( size_t i = 0; i < snapshotWords; i++ )
+                words[i] = slot.words[i].load( std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( slot.seq.load( std::memory_order_relaxed ) == before )
+                break;
+        }
+        SharedLicenseSnapshot snapshot;
+        memcpy( &snapshot, words, sizeof( snapshot ) );
+        return snapshot;
+    }
+
+    bool isOwner() const { return pidOf( m_segment->owner.load() ) == currentPid(); }
+
+    //Process id of the current owner, 0 if there is none.
+    uint32_t ownerPid() const { return pidOf( m_segment->owner.load() ); }
+
+    //Removes the named segment. Processes that still have it mapped keep using it, new ones get a fresh one.
+    static void remove( const std::string& name )
+    {
+#ifndef _WIN32
+        shm_unlink( ( "/licensespring_" + name ).c_str() );
+#else
+        (void)name; //Windows removes the mapping when the last process closes it.
+#endif
+    }
+
+    //Changes every time the segment is created from scratch (e.g. after a reboot), so counter values from an
+    //older segment recorded in the license file can be told apart.
+    uint64_t generation() const { return m_segment->generation; }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    static constexpr uint32_t segmentMagic = 0x4C53534D; //"LSSM"
+    static constexpr uint32_t segmentVersion = 2;
+    static constexpr size_t snapshotWords = ( sizeof( SharedLicenseSnapshot ) + 7 ) / 8;
+    static_assert( std::is_trivially_copyable<SharedLicenseSnapshot>::value, "snapshot is copied through shared memory" );
+
+    //Counter slots and the segment itself are set up by whichever process claims them first. A claim records the
+    //claimer's pid, so if it's killed before it's done, the others can tell and undo the claim instead of waiting
+    //for it forever (the segment outlives every process, so a restart wouldn't help either).
+    static constexpr uint64_t slotFree = 0;
+    static constexpr uint64_t slotReady = 2;
+    static uint64_t claimBy( uint32_t pid ) { return ( (uint64_t)pid << 32 ) | 1; }
+    static bool isClaim( uint64_t state ) { return ( state & 3 ) == 1; }
+
+    struct Counter
+    {
+        std::atomic<uint64_t> state; //slotFree, claimBy( pid ) while being claimed, slotReady in use
+        char feature[60];
+        std::atomic<int64_t> spent; //consumptions spent through the segment, only ever grows
+        std::atomic<int64_t> synced; //how much of spent the owner has synced
+        std::atomic<int64_t> limit; //spent may not go past this, set by the owner after each sync
+    };
+
+    struct SnapshotSlot
+    {
+        std::atomic<uint64_t> seq; //odd while the owner is writing this slot
+        std::atomic<uint64_t> words[ snapshotWords ];
+    };
+
+    struct Segment
+    {
+        std::atomic<uint64_t> state; //slotFree new, claimBy( pid ) while being initialized, slotReady ready
+        uint32_t magic;
+        uint32_t version;
+        uint64_t generation;
+        std::atomic<uint64_t> owner; //epoch << 32 | pid, the epoch changes on every takeover
+        std::atomic<int64_t> heartbeat; //owner's last sign of life, in steady clock milliseconds
+        std::atomic<uint32_t> snapshotIndex; //the slot readers should use
+        SnapshotSlot snapshots[2];
+        Counter counters[ maxCounters ];
+    };
+    static_assert( std::atomic<uint64_t>::is_always_lock_free, "counters must be lock-free to work across processes" );
+
+    static uint64_t makeOwner( uint32_t epoch, uint32_t pid ) { return ( (uint64_t)epoch << 32 ) | pid; }
+    static uint32_t epochOf( uint64_t owner ) { return (uint32_t)( owner >> 32 ); }
+    static uint32_t pidOf( uint64_t owner ) { return (uint32_t)owner; }
+
+    static int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( clock_t::now().time_since_epoch() ).count();
+    }
+
+    static uint32_t currentPid()
+    {
+#ifdef _WIN32
+        return (uint32_t)GetCurrentProcessId();
+#else
+        return (uint32_t)getpid();
+#endif
+    }
+
+    static bool processAlive( uint32_t pid )
+    {
+#ifdef _WIN32
+        HANDLE process = OpenProcess( SYNCHRONIZE, FALSE, pid );
+        if ( process == NULL )
+            return GetLastError() == ERROR_ACCESS_DENIED;
+        bool alive = WaitForSingleObject( process, 0 ) == WAIT_TIMEOUT;
+        CloseHandle( process );
+        return alive;
+#else
+        return kill( (pid_t)pid, 0 ) == 0 || errno == EPERM;
+#endif
+    }
+
+    void map( const std::string& name )
+    {
+#ifdef _WIN32
+        std::string objectName = "Local\\LicenseSpring_" + name;
+        m_mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof( Segment ), objectName.c_str() );
+        if ( m_mapping == NULL )
+            throw std::runtime_error( "could not create shared license state " + objectName );
+        m_segment = static_cast<Segment*>( MapViewOfFile( m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof( Segment ) ) );
+        if ( m_segment == nullptr )
+        {
+            CloseHandle( m_mapping );
+            throw std::runtime_error( "could not map shared license state " + objectName );
+        }
+#else
+        std::string objectName = "/licensespring_" + name;
+        int fd = shm_open( objectName.c_str(), O_RDWR | O_CREAT, 0600 );
+        if ( fd < 0 )
+            throw std::runtime_error( "could not create shared license state " + objectName );
+        //New segments are zero filled. Growing an existing one to the same size changes nothing.
+        if ( ftruncate( fd, sizeof( Segment ) ) != 0 )
+        {
+            close( fd );
+            throw std::runtime_error( "could not size shared license state " + objectName );
+        }
+        void* memory = mmap( nullptr, sizeof( Segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if ( memory == MAP_FAILED )
+            throw std::runtime_error( "could not map shared license state " + objectName );
+        m_segment = static_cast<Segment*>( memory );
+#endif
+    }
+
+    void unmap()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile( m_segment );
+        CloseHandle( m_mapping );
+#else
+        munmap( m_segment, sizeof( Segment ) );
+#endif
+    }
+
+    //Waits while state is claimed by another process. Returns false if the claimer had died and its claim was
+    //undone, true once state holds something else; it's left in current either way.
+    static bool settle( std::atomic<uint64_t>& state, uint64_t& current )
+    {
+        current = state.load( std::memory_order_acquire );
+        for ( int spins = 1; isClaim( current ); spins++ )
+        {
+            //Checking on the claimer is a system call, so only every so often; a live claim takes microseconds.
+            if ( spins % 1024 == 0 && !processAlive( (uint32_t)( current >> 32 ) ) )
+            {
+                state.compare_exchange_strong( current, slotFree );
+                current = state.load( std::memory_order_acquire );
+                return false;
+            }
+            std::this_thread::yield();
+            current = state.load( std::memory_order_acquire );
+        }
+        return true;
+    }
+
+    //The first process to map a new (zero filled) segment sets it up, the others wait for it.
+    void initialize()
+    {
+        auto deadline = clock_t::now() + std::chrono::seconds( 5 );
+        uint64_t state;
+        while ( !settle( m_segment->state, state ) || state != slotReady )
+        {
+            if ( state == slotFree && m_segment->state.compare_exchange_strong( state, claimBy( currentPid() ) ) )
+            {
+                m_segment->magic = segmentMagic;
+                m_segment->version = segmentVersion;
+                m_segment->generation = ( (uint64_t)std::random_device()() << 32 ) ^ std::random_device()() ^ (uint64_t)nowMs();
+                m_segment->state.store( slotReady, std::memory_order_release );
+            }
+            else if ( clock_t::now() > deadline )
+                throw std::runtime_error( "shared license state was never initialized" );
+        }
+        if ( m_segment->magic != segmentMagic || m_segment->version != segmentVersion )
+            throw std::runtime_error( "shared license state was created by an incompatible version" );
+    }
+
+    //Finds the counter for a feature code, claiming a free slot for it if create is true. Slots are never freed,
+    //and a code always goes in the first free slot, so two processes looking for the same new code meet there.
+    Counter* findCounter( const std::string& feature, bool create )
+    {
+        if ( feature.size() >= sizeof( Counter::feature ) )
+            return nullptr;
+        for ( int pass = 0; pass < 2; pass++ )
+        {
+            for ( Counter& counter : m_segment->counters )
+            {
+                uint64_t state;
+                //A dead process's claim was undone, so the first free slot may be an earlier one now: start over.
+                if ( !settle( counter.state, state ) )
+                {
+                    pass = -1;
+                    break;
+                }
+                if ( state == slotReady && feature == counter.feature )
+                    return &counter;
+                if ( state == slotFree && create && pass == 1 )
+                {
+                    if ( !counter.state.compare_exchange_strong( state, claimBy( currentPid() ) ) )
+                    {
+                        //Someone else claimed it first, maybe for the same code.
+                        if ( !settle( counter.state, state ) )
+                        {
+                            pass = -1;
+                            break;
+                        }
+                        if ( state == slotReady && feature == counter.feature )
+                            return &counter;
+                        continue;
+                    }
+                    memcpy( counter.feature, feature.c_str(), feature.size() + 1 );
+                    counter.state.store( slotReady, std::memory_order_release );
+                    return &counter;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void run()
+    {
+        auto nextSync = clock_t::now();
+        while ( !m_stopping )
+        {
+            if ( !isOwner() )
+                tryTakeOver();
+            if ( isOwner() )
+            {
+                m_segment->heartbeat.store( nowMs(), std::memory_order_release );
+                if ( clock_t::now() >= nextSync )
+                {
+                    syncAsOwner();
+                    nextSync = clock_t::now() + m_syncInterval;
+                }
+            }
+            std::this_thread::sleep_for( std::min<std::chrono::milliseconds>( m_syncInterval, std::chrono::milliseconds( 500 ) ) );
+        }
+        //Syncing what's left on the way out saves the next owner from having to.
+        if ( isOwner() )
+            syncAsOwner();
+    }
+
+    //Becomes the owner if there is none, or the current one is gone or has stopped updating its heartbeat.
+    void tryTakeOver()
+    {
+        uint64_t owner = m_segment->owner.load();
+        uint32_t pid = pidOf( owner );
+        bool ownerGone = pid == 0 || !processAlive( pid ) ||
+            nowMs() - m_segment->heartbeat.load( std::memory_order_acquire ) > m_ownerTimeout.count();
+        if ( !ownerGone )
+            return;
+        //Only one process wins this, the others see an owner that's alive.
+        m_segment->heartbeat.store( nowMs(), std::memory_order_release );
+        if ( !m_segment->owner.compare_exchange_strong( owner, makeOwner( epochOf( owner ) + 1, currentPid() ) ) )
+            return;
+
+        try
+        {
+            std::map<std::string, int64_t> synced = m_owner->takeOver( m_segment->generation );
+            for ( Counter& counter : m_segment->counters )
+            {
+                if ( counter.state.load( std::memory_order_acquire ) != slotReady )
+                    continue;
+                auto it = synced.find( counter.feature );
+                //The old owner may have saved a sync to the license file and died before it could record it here.
+                if ( it != synced.end() && it->second > counter.synced.load() )
+                    counter.synced.store( std::min( it->second, counter.spent.load() ) );
+            }
+        }
+        catch ( ... )
+        {
+            //Without the license we can't be the owner. Step down so someone else can try.
+            uint64_t mine = m_segment->owner.load();
+            m_segment->owner.compare_exchange_strong( mine, makeOwner( epochOf( mine ), 0 ) );
+        }
+    }
+
+    void syncAsOwner()
+    {
+        if ( !isOwner() )
+            return;
+        std::vector<SharedCounterSync> syncs;
+        std::vector<Counter*> counters;
+        for ( Counter& counter : m_segment->counters )
+        {
+            if ( counter.state.load( std::memory_order_acquire ) != slotReady )
+                continue;
+            SharedCounterSync sync;
+            sync.feature = counter.feature;
+            sync.spentThrough = counter.spent.load();
+            sync.delta = sync.spentThrough - counter.synced.load();
+            syncs.push_back( sync );
+            counters.push_back( &counter );
+        }
+
+        SharedLicenseSnapshot snapshot = this->snapshot();
+        try
+        {
+            m_owner->sync( m_segment->generation, syncs, snapshot );
+            snapshot.error[0] = '\0';
+        }
+        catch ( const std::exception& ex )
+        {
+            strncpy( snapshot.error, ex.what(), sizeof( snapshot.error ) - 1 );
+            snapshot.error[ sizeof( snapshot.error ) - 1 ] = '\0';
+            //Same as below: if another process took over meanwhile, the snapshot is theirs to write.
+            if ( isOwner() )
+                publish( snapshot );
+            return;
+        }
+        //If we lost ownership while syncing (we hung long enough for someone to take over), the new owner has
+        //already read the license file, so we leave the counters and the snapshot alone. The owner timeout has
+        //to be well above the time a sync can take: a sync that is still running when another process takes
+        //over may be counted twice.
+        if ( !isOwner() )
+            return;
+        for ( size_t i = 0; i < syncs.size(); i++ )
+        {
+            counters[i]->synced.store( syncs[i].spentThrough );
+            counters[i]->limit.store( syncs[i].spentThrough + std::max<int64_t>( 0, syncs[i].remaining ), std::memory_order_release );
+        }
+        publish( snapshot );
+    }
+
+    //Only the owner writes the snapshot, so there's a single writer.
+    void publish( const SharedLicenseSnapshot& snapshot )
+    {
+        uint64_t words[ snapshotWords ] = {};
+        memcpy( words, &snapshot, sizeof( snapshot ) );
+        uint32_t next = ( m_segment->snapshotIndex.load( std::memory_order_relaxed ) + 1 ) & 1;
+        SnapshotSlot& slot = m_segment->snapshots[ next ];
+        uint64_t seq = slot.seq.load( std::memory_order_relaxed );
+        seq += seq & 1; //a previous owner died while writing this slot
+        slot.seq.store( seq + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        for ( size_t i = 0; i < snapshotWords; i++ )
+            slot.words[i].store( words[i], std::memory_order_relaxed );
+        slot.seq.store( seq + 2, std::memory_order_release );
+        m_segment->snapshotIndex.store( next, std::memory_order_release );
+    }
+
+    Segment* m_segment = nullptr;
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#endif
+    std::shared_ptr<SharedLicenseOwner> m_owner;
+    std::chrono::milliseconds m_syncInterval = std::chrono::seconds( 5 );
+    std::chrono::milliseconds m_ownerTimeout = std::chrono::seconds( 15 );
+    std::atomic<bool> m_stopping{ true };
+    std::thread m_thread;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+//Single-flight helper for online license calls. When several threads ask for the same online call at once
+//(for example a check() on startup from several subsystems), only the first one goes to the LicenseSpring
+//servers, and everyone else waits for and shares that result. A freshness window lets calls made shortly
+//after a finished request reuse its result instead of making a new request.
+#include <LicenseSpring/LicenseManager.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+template <typename Result>
+class SingleFlight
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    //freshness is how long a successful result stays reusable. Zero means results are only shared
+    //between calls that overlap in time.
+    explicit SingleFlight( std::chrono::milliseconds freshness = std::chrono::milliseconds( 0 ) )
+        : m_freshness( freshness )
+    {}
+
+    void setFreshness( std::chrono::milliseconds freshness )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_freshness = freshness;
+    }
+
+    //Runs call() for key unless a call for the same key is already in flight or finished within the
+    //freshness window, in which case that result is returned instead. If the shared call throws, every
+    //waiter gets the same exception, and the failure is not cached, so the next call tries again.
+    //If storedAt is given, it is set to when the returned result came back from the server, which is
+    //earlier than now when a cached result is reused.
+    Result run( const std::string& key, const std::function<Result()>& call, clock_t::time_point* storedAt = nullptr )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        auto it = m_calls.find( key );
+        if ( it != m_calls.end() )
+        {
+            Flight& flight = it->second;
+            if ( !flight.forgotten && ( flight.inFlight || clock_t::now() - flight.finishedAt < m_freshness ) )
+            {
+                std::shared_future<Stored> shared = flight.result;
+                lock.unlock();
+                return unpack( shared.get(), storedAt );
+            }
+        }
+
+        std::promise<Stored> promise;
+        Flight& flight = m_calls[key];
+        flight = Flight();
+        flight.result = promise.get_future().share();
+        flight.inFlight = true;
+        flight.id = ++m_lastId;
+        const uint64_t id = flight.id;
+        std::shared_future<Stored> shared = flight.result;
+        lock.unlock();
+
+        bool failed = false;
+        try
+        {
+            Result result = call();
+            promise.set_value( Stored{ std::move( result ), clock_t::now() } );
+        }
+        catch ( ... )
+        {
+            failed = true;
+            promise.set_exception( std::current_exception() );
+        }
+
+        //The entry may have been forgotten while we were out, or replaced by a newer call after that.
+        lock.lock();
+        auto done = m_calls.find( key );
+        if ( done != m_calls.end() && done->second.id == id )
+        {
+            if ( failed || done->second.forgotten )
+                m_calls.erase( done );
+            else
+            {
+                done->second.inFlight = false;
+                done->second.finishedAt = shared.get().at;
+            }
+        }
+        lock.unlock();
+        return unpack( shared.get(), storedAt );
+    }
+
+    //Drops the cached results for key, and for the keys made from it as key#..., e.g. after a
+    //deactivation, so the next call goes to the server. Calls still in flight finish for the threads
+    //already waiting on them, but their result is not cached, and later calls start a new request.
+    void forget( const std::string& key )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        for ( auto it = m_calls.lower_bound( key ); it != m_calls.end() && it->first.compare( 0, key.size(), key ) == 0; )
+        {
+            bool ours = it->first.size() == key.size() || it->first[ key.size() ] == '#';
+            if ( !ours )
+                ++it;
+            else if ( it->second.inFlight )
+            {
+                it->second.forgotten = true;
+                ++it;
+            }
+            else
+                it = m_calls.erase( it );
+        }
+    }
+
+private:
+    struct Stored
+    {
+        Result value;
+        clock_t::time_point at;
+    };
+
+    struct Flight
+    {
+        std::shared_future<Stored> result;
+        clock_t::time_point finishedAt;
+        uint64_t id = 0;
+        bool inFlight = false;
+        bool forgotten = false;
+    };
+
+    static Result unpack( const Stored& stored, clock_t::time_point* storedAt )
+    {
+        if ( storedAt != nullptr )
+            *storedAt = stored.at;
+        return stored.value;
+    }
+
+    std::mutex m_mutex;
+    std::map<std::string, Flight> m_calls;
+    std::chrono::milliseconds m_freshness;
+    uint64_t m_lastId = 0;
+};
+
+//Coalesces the online calls the samples make on a license: check(), syncConsumption() and
+//getDeviceVariables( true ). Calls are keyed by license key (or user for user-based licenses), so
+//different licenses never share results. If several threads check at the same time (e.g. on startup or
+//after resuming), they share one request instead of each sending their own. Calls made within freshness
+//of a finished call reuse its result; 0 only shares calls that overlap.
+class CoalescedLicenseCalls
+{
+public:
+    explicit CoalescedLicenseCalls( std::chrono::seconds freshness = std::chrono::seconds( 0 ) )
+        : m_check( freshness ), m_consumption( freshness ), m_deviceVariables( freshness )
+    {}
+
+    void setFreshness( std::chrono::seconds freshness )
+    {
+        m_check.setFreshness( freshness );
+        m_consumption.setFreshness( freshness );
+        m_deviceVariables.setFreshness( freshness );
+    }
+
+    //Returns when the check that answered this call was made, see SingleFlight::run.
+    std::chrono::steady_clock::time_point check( LicenseSpring::License::ptr_t license )
+    {
+        std::chrono::steady_clock::time_point checkedAt;
+        m_check.run( keyOf( license ), [ license ]() { license->check(); return true; }, &checkedAt );
+        return checkedAt;
+    }
+
+    //Only calls with the same requestOverage value are coalesced.
+    void syncConsumption( LicenseSpring::License::ptr_t license, int requestOverage = -1 )
+    {
+        m_consumption.run( keyOf( license ) + "#" + std::to_string( requestOverage ),
+            [ license, requestOverage ]() { license->syncConsumption( requestOverage ); return true; } );
+    }
+
+    std::vector<LicenseSpring::DeviceVariable> getDeviceVariables( LicenseSpring::License::ptr_t license )
+    {
+        return m_deviceVariables.run( keyOf( license ),
+            [ license ]() { return license->getDeviceVariables( true ); } );
+    }
+
+    //Call after anything that changes the license on the server (deactivation, consumption updates, ...).
+    void invalidate( LicenseSpring::License::ptr_t license )
+    {
+        const std::string key = keyOf( license );
+        m_check.forget( key );
+        m_consumption.forget( key );
+        m_deviceVariables.forget( key );
+    }
+
+private:
+    static std::string keyOf( const LicenseSpring::License::ptr_t& license )
+    {
+        if ( license->key().empty() && license->licenseUser() != nullptr )
+            return license->licenseUser()->email();
+        return license->key();
+    }
+
+    SingleFlight<bool> m_check;
+    SingleFlight<bool> m_consumption;
+    SingleFlight<std::vector<LicenseSpring::DeviceVariable>> m_deviceVariables;
+};
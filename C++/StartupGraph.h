@@ -0,0 +1,301 @@
+#pragma once
+
+//Startup work as a graph instead of a list. Each step names the steps it needs, and every step whose dependencies
+//are done runs right away on its own thread, so work that doesn't depend on each other overlaps: reading the
+//local license from disk while the server hands out a trial key, or fetching the version list while the license
+//is checked.
+//
+//The app waits only for what it needs. waitFor( "local check" ) returns as soon as the local license is verified,
+//while "online check" finishes in the background, and waitFor() rethrows a step's exception so the usual catch
+//blocks still work. A step whose dependency failed doesn't run, and waiting for it throws the dependency's
+//exception.
+//
+//The graph keeps when each step started and finished, and when the app said it was usable (markUsable()), to
+//compare against running everything one after the other.
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class StartupGraph
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    enum class StepState { Waiting, Running, Done, Failed, Skipped };
+
+    struct StepTiming
+    {
+        std::string name;
+        StepState state;
+        std::chrono::milliseconds started; //since start()
+        std::chrono::milliseconds finished;
+    };
+
+    ~StartupGraph()
+    {
+        //Steps may still be running in the background, e.g. if we leave main() early after a failed step.
+        waitAll();
+        joinThreads();
+    }
+
+    //Adds a step that runs once the steps in after are done. Steps are added before start(), and a step can only
+    //depend on steps added before it, so there can't be a cycle.
+    void add( const std::string& name, const std::vector<std::string>& after, std::function<void()> run )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_started )
+            throw std::logic_error( "steps must be added before start()" );
+        if ( m_steps.count( name ) )
+            throw std::invalid_argument( "duplicate startup step: " + name );
+        for ( const std::string& dependency : after )
+            if ( m_steps.count( dependency ) == 0 )
+                throw std::invalid_argument( "startup step " + name + " depends on unknown step " + dependency );
+        Step& step = m_steps[ name ];
+        step.after = after;
+        step.run = run;
+        m_order.push_back( name );
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_started = true;
+        m_start = clock_t::now();
+        launchReadyLocked();
+    }
+
+    //Blocks until the step is done. Rethrows its exception, or the exception of the dependency that kept it from
+    //running.
+    void waitFor( const std::string& name )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        Step& step = stepLocked( name );
+        m_changed.wait( lock, [ &step ]() { return finished( step.state ); } );
+        if ( step.error )
+            std::rethrow_exception( step.error );
+    }
+
+    bool done( const std::string& name )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return finished( stepLocked( name ).state );
+    }
+
+    //Calls callback when the step is done, with its exception or nullptr, for background steps the app doesn't wait
+    //for, like an online check. It runs on the step's thread with the graph locked, so it should only hand the news
+    //on. If the step is already done, it runs right away on this thread.
+    void onFinished( const std::string& name, std::function<void( std::exception_ptr )> callback )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        Step& step = stepLocked( name );
+        if ( !finished( step.state ) )
+        {
+            step.callbacks.push_back( callback );
+            return;
+        }
+        std::exception_ptr error = step.error;
+        lock.unlock();
+        callback( error );
+    }
+
+    //Blocks until every step is done or skipped. Doesn't throw.
+    void waitAll()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_changed.wait( lock, [ this ]()
+            {
+                if ( !m_started )
+                    return true;
+                for ( auto& step : m_steps )
+                    if ( !finished( step.second.state ) )
+                        return false;
+                return true;
+            } );
+    }
+
+    //Call when the app can be used, e.g. when its first window is shown.
+    void markUsable()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_usable = clock_t::now();
+    }
+
+    //Time from start() to markUsable().
+    std::chrono::milliseconds usableAfter()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return std::chrono::duration_cast<std::chrono::milliseconds>( m_usable - m_start );
+    }
+
+    std::vector<StepTiming> timeline()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        std::vector<StepTiming> timings;
+        for ( const std::string& name : m_order )
+        {
+            const Step& step = m_steps[ name ];
+            timings.push_back( StepTiming{ name, step.state, since( step.started ), since( step.finished ) } );
+        }
+        return timings;
+    }
+
+    //How long the steps took added up: roughly what startup would take if they ran one after the other.
+    std::chrono::milliseconds sequentialEstimate()
+    {
+        std::chrono::milliseconds total( 0 );
+        for ( const StepTiming& timing : timeline() )
+            if ( timing.state == StepState::Done || timing.state == StepState::Failed )
+                total += timing.finished - timing.started;
+        return total;
+    }
+
+    //The timeline as text, one step a line, e.g. "  online check      120 -  870 ms  done".
+    std::string describe()
+    {
+        static const char* states[] = { "waiting", "running", "done", "failed", "skipped" };
+        std::string text;
+        char line[ 160 ];
+        for ( const StepTiming& timing : timeline() )
+        {
+            snprintf( line, sizeof( line ), "  %-24s %6lld - %6lld ms  %s\n", timing.name.c_str(),
+                (long long)timing.started.count(), (long long)timing.finished.count(), states[ (int)timing.state ] );
+            text += line;
+        }
+        return text;
+    }
+
+private:
+    struct Step
+    {
+        std::vector<std::string> after;
+        std::function<void()> run;
+        StepState state = StepState::Waiting;
+        std::exception_ptr error;
+        clock_t::time_point started;
+        clock_t::time_point finished;
+        std::vector<std::function<void( std::exception_ptr )>> callbacks;
+    };
+
+    static bool finished( StepState state )
+    {
+        return state == StepState::Done || state == StepState::Failed || state == StepState::Skipped;
+    }
+
+    Step& stepLocked( const std::string& name )
+    {
+        auto found = m_steps.find( name );
+        if ( found == m_steps.end() )
+            throw std::invalid_argument( "unknown startup step: " + name );
+        return found->second;
+    }
+
+    std::chrono::milliseconds since( clock_t::time_point at ) const
+    {
+        if ( at == clock_t::time_point() )
+            return std::chrono::milliseconds( 0 );
+        return std::chrono::duration_cast<std::chrono::milliseconds>( at - m_start );
+    }
+
+    //Starts every waiting step whose dependencies are all done, and skips the ones with a failed dependency.
+    //Skipping can make more steps skippable, so it goes round until nothing changes.
+    void launchReadyLocked()
+    {
+        bool changed = true;
+        while ( changed )
+        {
+            changed = false;
+            for ( const std::string& name : m_order )
+            {
+                Step& step = m_steps[ name ];
+                if ( step.state != StepState::Waiting )
+                    continue;
+                bool ready = true;
+                std::exception_ptr failedDependency;
+                for ( const std::string& dependency : step.after )
+                {
+                    const Step& before = m_steps[ dependency ];
+                    if ( before.state == StepState::Failed || before.state == StepState::Skipped )
+                        failedDependency = before.error;
+                    else if ( before.state != StepState::Done )
+                        ready = false;
+                }
+                if ( failedDependency )
+                {
+                    step.state = StepState::Skipped;
+                    step.error = failedDependency;
+                    step.started = step.finished = clock_t::now();
+                    changed = true;
+                    notifyLocked( step );
+                }
+                else if ( ready )
+                {
+                    step.state = StepState::Running;
+                    step.started = clock_t::now();
+                    m_threads.emplace_back( [ this, name ]() { runStep( name ); } );
+                }
+            }
+        }
+    }
+
+    void runStep( const std::string& name )
+    {
+        std::function<void()> run;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            run = m_steps[ name ].run;
+        }
+        std::exception_ptr error;
+        try
+        {
+            run();
+        }
+        catch ( ... )
+        {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock( m_mutex );
+        Step& step = m_steps[ name ];
+        step.state = error ? StepState::Failed : StepState::Done;
+        step.error = error;
+        step.finished = clock_t::now();
+        notifyLocked( step );
+        launchReadyLocked();
+    }
+
+    //The callbacks run under the lock, so they must be quick and mustn't call back into the graph.
+    void notifyLocked( Step& step )
+    {
+        for ( auto& callback : step.callbacks )
+            callback( step.error );
+        step.callbacks.clear();
+        m_changed.notify_all();
+    }
+
+    void joinThreads()
+    {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            threads.swap( m_threads );
+        }
+        for ( std::thread& thread : threads )
+            thread.join();
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::map<std::string, Step> m_steps;
+    std::vector<std::string> m_order;
+    std::vector<std::thread> m_threads;
+    bool m_started = false;
+    clock_t::time_point m_start;
+    clock_t::time_point m_usable;
+};
@@ -0,0 +1,518 @@
+#pragma once
+
+//One pool of threads for all the background license work, instead of a thread per helper: floating heartbeats
+//(FloatingRenewer), online checks, revalidating a license we started from (LicenseRevalidator), reserving
+//consumptions (QuotaLease) and writing the consumption journal (ConsumptionJournal). Each of those is a
+//BackgroundLoop, which runs on its own thread when it isn't given a pool, as before.
+//
+//    WorkerPool backgroundWork; //sized to the host
+//    FloatingRenewer renewer( renew, timeout, FloatingRenewalPolicy(), SystemClock::instance(), &backgroundWork );
+//
+//Each thread has its own queue and takes work from the others' queues when it runs out (work stealing), so tasks
+//posted from a task stay on the thread that posted them. Tasks have a priority: a heartbeat that has to make it
+//before the floating timeout goes ahead of a periodic check that can wait. Tasks can also be scheduled for later,
+//and metrics() reports queue depth and how long tasks waited before they ran.
+//
+//License tasks spend most of their time waiting for the LicenseSpring servers, so the pool has a few more threads
+//than cores, and a slow server call doesn't hold up a heartbeat.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Clock.h"
+
+enum class TaskPriority { High, Normal, Low };
+
+struct WorkerPoolMetrics
+{
+    size_t threads = 0;
+    std::array<size_t, 3> queued{}; //waiting to run, by priority (High, Normal, Low)
+    size_t scheduled = 0; //waiting for their time
+    std::array<uint64_t, 3> completed{};
+    uint64_t stolen = 0; //tasks a thread took from another thread's queue
+    uint64_t failed = 0; //tasks that threw
+    //How long tasks waited between becoming ready to run (posted, or their scheduled time came) and running.
+    std::array<std::chrono::microseconds, 3> latencyP50{};
+    std::array<std::chrono::microseconds, 3> latencyP99{};
+    std::array<std::chrono::microseconds, 3> latencyMax{};
+};
+
+class WorkerPool
+{
+public:
+    //threads = 0 sizes the pool to the host.
+    explicit WorkerPool( size_t threads = 0, std::shared_ptr<Clock> clock = SystemClock::instance() ) : m_clock( clock )
+    {
+        if ( threads == 0 )
+            threads = std::max<size_t>( 4, std::thread::hardware_concurrency() + 2 );
+        for ( size_t i = 0; i < threads; ++i )
+            m_queues.emplace_back( new Queue() );
+        for ( size_t i = 0; i < threads; ++i )
+            m_threads.emplace_back( [ this, i ]() { work( i ); } );
+    }
+
+    //Runs what's already queued, drops what's scheduled for later. Stop the helpers using the pool first.
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+            m_timers.clear();
+            m_timerTimes.clear();
+        }
+        m_wake.notify_all();
+        for ( std::thread& thread : m_threads )
+            thread.join();
+    }
+
+    WorkerPool( const WorkerPool& ) = delete;
+    WorkerPool& operator=( const WorkerPool& ) = delete;
+
+    void post( std::function<void()> task, TaskPriority priority = TaskPriority::Normal )
+    {
+        Queue& queue = t_pool == this ? *m_queues[ t_index ] : m_shared;
+        {
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            queue.tasks[ (int)priority ].push_back( Task{ std::move( task ), std::chrono::steady_clock::now() } );
+        }
+        m_queued[ (int)priority ]++;
+        wakeOne();
+    }
+
+    //Runs task at the given time on the pool's clock. Returns an id for cancel().
+    uint64_t scheduleAt( Clock::steady_time at, std::function<void()> task, TaskPriority priority = TaskPriority::Normal )
+    {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            id = ++m_nextTimer;
+            m_timers[ { at, id } ] = Timer{ std::move( task ), priority };
+            m_timerTimes[ id ] = at;
+            m_timerGeneration++;
+        }
+        m_wake.notify_all();
+        return id;
+    }
+
+    uint64_t scheduleAfter( std::chrono::milliseconds delay, std::function<void()> task, TaskPriority priority = TaskPriority::Normal )
+    {
+        return scheduleAt( m_clock->steadyNow() + delay, std::move( task ), priority );
+    }
+
+    //Returns true if the task won't run. False means it already ran or is about to.
+    bool cancel( uint64_t id )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto found = m_timerTimes.find( id );
+        if ( found == m_timerTimes.end() )
+            return false;
+        m_timers.erase( { found->second, id } );
+        m_timerTimes.erase( found );
+        return true;
+    }
+
+    //For the helpers that take an executor, e.g. LicenseEventBus or LicenseAsync.
+    std::function<void( std::function<void()> )> executor( TaskPriority priority = TaskPriority::Normal )
+    {
+        return [ this, priority ]( std::function<void()> task ) { post( std::move( task ), priority ); };
+    }
+
+    std::shared_ptr<Clock> clock() const { return m_clock; }
+
+    size_t threadCount() const { return m_threads.size(); }
+
+    WorkerPoolMetrics metrics()
+    {
+        WorkerPoolMetrics metrics;
+        metrics.threads = m_threads.size();
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            metrics.scheduled = m_timers.size();
+        }
+        for ( int p = 0; p < 3; ++p )
+        {
+            metrics.queued[ p ] = (size_t)std::max<int64_t>( 0, m_queued[ p ].load() );
+            metrics.completed[ p ] = m_completed[ p ];
+            metrics.latencyP50[ p ] = m_latency[ p ].percentile( 0.5 );
+            metrics.latencyP99[ p ] = m_latency[ p ].percentile( 0.99 );
+            metrics.latencyMax[ p ] = std::chrono::microseconds( m_latency[ p ].max );
+        }
+        metrics.stolen = m_stolen;
+        metrics.failed = m_failed;
+        return metrics;
+    }
+
+private:
+    struct Task
+    {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point ready;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::array<std::deque<Task>, 3> tasks;
+    };
+
+    struct Timer
+    {
+        std::function<void()> run;
+        TaskPriority priority;
+    };
+
+    //Microseconds in power-of-two buckets, good enough to tell 50 us from 5 ms.
+    struct LatencyHistogram
+    {
+        std::array<std::atomic<uint64_t>, 40> buckets{};
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> max{ 0 };
+
+        void add( uint64_t micros )
+        {
+            size_t bucket = 0;
+            while ( bucket + 1 < buckets.size() && ( micros >> bucket ) > 0 )
+                bucket++;
+            buckets[ bucket ]++;
+            count++;
+            for ( uint64_t seen = max; micros > seen && !max.compare_exchange_weak( seen, micros ); )
+                ;
+        }
+
+        std::chrono::microseconds percentile( double fraction ) const
+        {
+            uint64_t total = count, wanted = (uint64_t)( total * fraction ), seen = 0;
+            if ( total == 0 )
+                return std::chrono::microseconds( 0 );
+            for ( size_t bucket = 0; bucket < buckets.size(); ++bucket )
+            {
+                seen += buckets[ bucket ];
+                if ( seen > wanted )
+                    return std::chrono::microseconds( bucket == 0 ? 0 : ( 1ull << bucket ) - 1 );
+            }
+            return std::chrono::microseconds( max.load() );
+        }
+    };
+
+    //A worker that's about to sleep counts itself idle before checking m_pending one last time, and a poster
+    //counts its task in m_pending before checking for idle workers, so one of the two always sees the other.
+    void wakeOne()
+    {
+        m_pending++;
+        if ( m_idle > 0 )
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+            }
+            m_wake.notify_one();
+        }
+    }
+
+    //Own queue newest first, then the shared queue, then the other threads' queues oldest first, one priority at a
+    //time.
+    bool take( size_t index, Task& task, int& priority )
+    {
+        for ( priority = 0; priority < 3; ++priority )
+        {
+            if ( popFrom( *m_queues[ index ], priority, task, true ) || popFrom( m_shared, priority, task, false ) )
+                return true;
+            for ( size_t i = 1; i < m_queues.size(); ++i )
+                if ( popFrom( *m_queues[ ( index + i ) % m_queues.size() ], priority, task, false ) )
+                {
+                    m_stolen++;
+                    return true;
+                }
+        }
+        return false;
+    }
+
+    bool popFrom( Queue& queue, int priority, Task& task, bool newest )
+    {
+        std::lock_guard<std::mutex> lock( queue.mutex );
+        std::deque<Task>& tasks = queue.tasks[ priority ];
+        if ( tasks.empty() )
+            return false;
+        if ( newest )
+        {
+            task = std::move( tasks.back() );
+            tasks.pop_back();
+        }
+        else
+        {
+            task = std::move( tasks.front() );
+            tasks.pop_front();
+        }
+        m_pending--;
+        m_queued[ priority ]--;
+        return true;
+    }
+
+    //Moves the timers that are due to the shared queue.
+    void releaseDueLocked()
+    {
+        auto now = m_clock->steadyNow();
+        while ( !m_timers.empty() && m_timers.begin()->first.first <= now )
+        {
+            Timer timer = std::move( m_timers.begin()->second );
+            m_timerTimes.erase( m_timers.begin()->first.second );
+            m_timers.erase( m_timers.begin() );
+            {
+                std::lock_guard<std::mutex> lock( m_shared.mutex );
+                m_shared.tasks[ (int)timer.priority ].push_back( Task{ std::move( timer.run ), std::chrono::steady_clock::now() } );
+            }
+            m_queued[ (int)timer.priority ]++;
+            m_pending++;
+        }
+    }
+
+    void work( size_t index )
+    {
+        t_pool = this;
+        t_index = index;
+        Task task;
+        int priority;
+        while ( true )
+        {
+            if ( take( index, task, priority ) )
+            {
+                auto started = std::chrono::steady_clock::now();
+                m_latency[ priority ].add( (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( started - task.ready ).count() );
+                try
+                {
+                    task.run();
+                }
+                catch ( ... )
+                {
+                    m_failed++;
+                }
+                task.run = nullptr;
+                m_completed[ priority ]++;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock( m_mutex );
+            releaseDueLocked();
+            if ( m_pending > 0 )
+                continue;
+            if ( m_stopping )
+                break;
+            m_idle++;
+            uint64_t generation = m_timerGeneration;
+            auto wakeUp = [ this, generation ]() { return m_pending > 0 || m_stopping || m_timerGeneration != generation; };
+            if ( m_timers.empty() )
+                m_wake.wait( lock, wakeUp );
+            else
+                m_clock->waitUntil( lock, m_wake, m_timers.begin()->first.first, wakeUp );
+            m_idle--;
+        }
+    }
+
+    std::shared_ptr<Clock> m_clock;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    Queue m_shared; //tasks posted from outside the pool, and timers that came due
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex; //timers and sleeping
+    std::condition_variable m_wake;
+    std::map<std::pair<Clock::steady_time, uint64_t>, Timer> m_timers;
+    std::unordered_map<uint64_t, Clock::steady_time> m_timerTimes;
+    uint64_t m_nextTimer = 0;
+    uint64_t m_timerGeneration = 0;
+    bool m_stopping = false;
+
+    std::atomic<int64_t> m_pending{ 0 };
+    std::atomic<int> m_idle{ 0 };
+    std::array<std::atomic<int64_t>, 3> m_queued{};
+    std::array<std::atomic<uint64_t>, 3> m_completed{};
+    std::atomic<uint64_t> m_stolen{ 0 };
+    std::atomic<uint64_t> m_failed{ 0 };
+    std::array<LatencyHistogram, 3> m_latency;
+
+    static thread_local WorkerPool* t_pool;
+    static thread_local size_t t_index;
+};
+
+inline thread_local WorkerPool* WorkerPool::t_pool = nullptr;
+inline thread_local size_t WorkerPool::t_index = 0;
+
+//Background work that runs in steps: each step does what's due and returns when it wants to run next, or idle()
+//to run only when woken. Runs on its own thread, or as tasks on a WorkerPool, the step can't tell the difference.
+//
+//Steps never overlap. wake() runs the next step now (right after the current one, if one is running), and stop()
+//waits for a running step and runs no more. Don't call stop() from a step.
+class BackgroundLoop
+{
+public:
+    using Step = std::function<Clock::steady_time()>;
+
+    static Clock::steady_time idle() { return Clock::steady_time::max(); }
+
+    //Without a pool the loop gets its own thread and waits on clock. With one it waits on the pool's clock, so
+    //pass the helper the same clock as the pool.
+    explicit BackgroundLoop( WorkerPool* pool = nullptr, TaskPriority priority = TaskPriority::Normal,
+        std::shared_ptr<Clock> clock = SystemClock::instance() )
+        : m_pool( pool ), m_priority( priority ), m_clock( clock )
+    {}
+
+    ~BackgroundLoop()
+    {
+        stop();
+    }
+
+    BackgroundLoop( const BackgroundLoop& ) = delete;
+    BackgroundLoop& operator=( const BackgroundLoop& ) = delete;
+
+    //Runs the first step right away.
+    void start( Step step )
+    {
+        stop();
+        m_state = std::make_shared<State>();
+        m_state->step = std::move( step );
+        m_state->pool = m_pool;
+        m_state->priority = m_priority;
+        if ( m_pool == nullptr )
+        {
+            std::shared_ptr<State> state = m_state;
+            std::shared_ptr<Clock> clock = m_clock;
+            m_thread = std::thread( [ state, clock ]() { runThread( state, clock ); } );
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock( m_state->mutex );
+            postLocked( m_state );
+        }
+    }
+
+    void wake()
+    {
+        std::shared_ptr<State> state = m_state;
+        if ( !state )
+            return;
+        {
+            std::lock_guard<std::mutex> lock( state->mutex );
+            if ( state->stopping )
+                return;
+            if ( state->pool == nullptr || state->running )
+                state->woken = true;
+            else if ( state->timer != 0 )
+            {
+                //If the timer already fired, the step is on its way anyway.
+                if ( state->pool->cancel( state->timer ) )
+                    postLocked( state );
+            }
+            else if ( !state->queued )
+                postLocked( state );
+        }
+        state->changed.notify_all();
+    }
+
+    void stop()
+    {
+        std::shared_ptr<State> state = m_state;
+        if ( !state )
+            return;
+        {
+            std::unique_lock<std::mutex> lock( state->mutex );
+            state->stopping = true;
+            if ( state->timer != 0 && state->pool != nullptr )
+                state->pool->cancel( state->timer );
+            state->timer = 0;
+            state->changed.notify_all();
+            if ( state->pool != nullptr )
+                state->changed.wait( lock, [ &state ]() { return !state->running; } );
+        }
+        if ( m_thread.joinable() )
+            m_thread.join();
+    }
+
+    //True between start() and stop().
+    bool running() const
+    {
+        if ( !m_state )
+            return false;
+        std::lock_guard<std::mutex> lock( m_state->mutex );
+        return !m_state->stopping;
+    }
+
+private:
+    //Shared with the thread or the pool tasks, which can outlive a stop() (a queued task finds it stopped and
+    //returns).
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        Step step;
+        WorkerPool* pool = nullptr;
+        TaskPriority priority = TaskPriority::Normal;
+        bool stopping = false;
+        bool woken = false;
+        bool running = false;
+        bool queued = false;
+        uint64_t timer = 0;
+    };
+
+    static void runThread( std::shared_ptr<State> state, std::shared_ptr<Clock> clock )
+    {
+        std::unique_lock<std::mutex> lock( state->mutex );
+        while ( !state->stopping )
+        {
+            state->woken = false;
+            lock.unlock();
+            Clock::steady_time next = state->step();
+            lock.lock();
+            if ( state->stopping || state->woken )
+                continue;
+            auto wakeUp = [ &state ]() { return state->stopping || state->woken; };
+            if ( next == idle() )
+                state->changed.wait( lock, wakeUp );
+            else
+                clock->waitUntil( lock, state->changed, next, wakeUp );
+        }
+    }
+
+    static void postLocked( std::shared_ptr<State> state )
+    {
+        state->queued = true;
+        state->timer = 0;
+        state->pool->post( [ state ]() { runTask( state ); }, state->priority );
+    }
+
+    static void runTask( std::shared_ptr<State> state )
+    {
+        std::unique_lock<std::mutex> lock( state->mutex );
+        state->queued = false;
+        state->timer = 0;
+        if ( state->stopping )
+            return;
+        state->running = true;
+        state->woken = false;
+        lock.unlock();
+        Clock::steady_time next = state->step();
+        lock.lock();
+        state->running = false;
+        if ( !state->stopping )
+        {
+            if ( state->woken || next <= state->pool->clock()->steadyNow() )
+                postLocked( state );
+            else if ( next != idle() )
+                state->timer = state->pool->scheduleAt( next, [ state ]() { runTask( state ); }, state->priority );
+        }
+        state->changed.notify_all();
+    }
+
+    WorkerPool* m_pool;
+    TaskPriority m_priority;
+    std::shared_ptr<Clock> m_clock;
+    std::shared_ptr<State> m_state;
+    std::thread m_thread;
+};
@@ -5,12 +5,23 @@
 #include <LicenseSpring/Exceptions.h>
 #include <iostream>
 #include <thread>
+#include "SingleFlight.h"
+#include "LicenseEvents.h"
 
 using namespace LicenseSpring;
 
 //License Checking function at bottom of code. Shows how to do an online check and sync, as well as a local check.
 void LicenseCheck( License::ptr_t license );
 
+//Concurrent LicenseCheck() calls share one online check (see SingleFlight.h).
+const std::chrono::seconds checkFreshness( 5 );
+CoalescedLicenseCalls onlineCalls( checkFreshness );
+
+//Rather than looking at the license after every call to see what changed, we feed it to licenseWatcher, which
+//tells whoever subscribed to licenseEvents about the changes. See LicenseEvents.h.
+LicenseEventBus licenseEvents;
+LicenseStateWatcher licenseWatcher( licenseEvents );
+
 //Our console ChatBot program that allows the user to activate, deactivate, and check their LicenseSpring license.
 int main() 
 {
@@ -64,6 +75,19 @@ int main()
     }
     std::cout << "Welcome to the C++ LicenseSpring Introduction Chatbot." << std::endl;
 
+    licenseEvents.subscribe( LicenseEventType::Deactivated, []( const LicenseEvent& )
+        {
+            std::cout << "License is inactive" << std::endl;
+        } );
+    licenseEvents.subscribe( LicenseEventType::Expired, []( const LicenseEvent& )
+        {
+            std::cout << "License is expired" << std::endl;
+        } );
+    licenseEvents.subscribe( LicenseEventType::Disabled, []( const LicenseEvent& )
+        {
+            std::cout << "License is disabled" << std::endl;
+        } );
+
     //getCurrentLicense() will return a pointer to the local license stored
     //on the end-user's device if they have one that matches the current 
     //configuration i.e. API key, Shared key, and product code.
@@ -135,6 +159,10 @@ int main()
                 //true, it also deletes all LicenseSpring created files on device.
                 if ( license->deactivate( true ) )
                     std::cout << "License deactivated successfully." << std::endl;
+                //A cached check result no longer applies to a deactivated license.
+                onlineCalls.invalidate( license );
+                licenseWatcher.update( license );
+                licenseEvents.flush();
             }
             else
                 std::cout << "License is already deactivated." << std::endl;
@@ -150,6 +178,7 @@ int main()
                     //Activates license on LicenseSpring servers and creates/updates pointer
                     //to local license file. Throws an exception if we are over the max number of activations
                     license = licenseManager->activateLicense(licenseId);
+                    licenseWatcher.update( license );
                 } 
                 catch ( LicenseNoAvailableActivationsException ) 
                 { 
@@ -189,19 +218,17 @@ void LicenseCheck( License::ptr_t license )
         try
         {
             std::cout << "Checking license online..." << std::endl;
-            license->check();
+            onlineCalls.check( license );
             std::cout << "License successfully checked" << std::endl;
         }
         catch ( LicenseStateException )
         {
             std::cout << "Online license is not valid" << std::endl;
-            if ( !license->isActive() )
-                std::cout << "License is inactive" << std::endl;
-            if ( license->isExpired() )
-                std::cout << "License is expired" << std::endl;
-            if ( !license->isEnabled() )
-                std::cout << "License is disabled" << std::endl;
         }
+        //Whether the check passed or not, the watcher works out what changed and our subscribers print it. We
+        //wait for them, so their messages come before the next prompt.
+        licenseWatcher.update( license );
+        licenseEvents.flush();
 
         //We use localCheck() in LicenseSpring/License.h in the include folder.This is
         //useful to check if the license hasn't been copied over from another device, and 
@@ -0,0 +1,100 @@
+#include <LicenseSpring/LicenseManager.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Clock.h"
+#include "FloatingRenewal.h"
+#include "ExpiryScheduler.h"
+
+//Sample code for testing time-dependent license code with a SimulatedClock (see Clock.h). Nothing here needs a
+//license or the LicenseSpring servers: we run the helpers from the other samples against stand-ins, and move the
+//clock ourselves. A week of floating renewals and four months of license deadlines take a second or two.
+//
+//    clock_simulation [days of floating renewals] [seed]
+
+//A week of renewing a floating license with a 5 minute timeout, on a network where registering takes 100 to
+//1500 ms and one call in 25 fails.
+bool SimulateFloating( int days, unsigned seed )
+{
+    auto clock = std::make_shared<SimulatedClock>();
+    std::atomic<int> calls( 0 );
+    unsigned state = seed;
+    FloatingRenewer renewer( [ & ]()
+        {
+            //A small random number generator of our own, so the run is the same everywhere for the same seed.
+            state = state * 1103515245 + 12345;
+            calls++;
+            clock->sleepFor( std::chrono::milliseconds( 100 + ( state >> 8 ) % 1400 ) );
+            if ( ( state >> 16 ) % 25 == 0 )
+                throw std::runtime_error( "network error" );
+        }, std::chrono::minutes( 5 ), FloatingRenewalPolicy(), clock );
+
+    std::atomic<int> lost( 0 );
+    renewer.setSeatLostCallback( [ & ]( const std::string& ) { lost++; } );
+    renewer.start();
+    clock->waitForWaiters( 1 );
+
+    auto start = std::chrono::steady_clock::now();
+    clock->advance( std::chrono::hours( 24 * days ) );
+    auto took = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+    renewer.stop();
+
+    FloatingRenewer::Metrics metrics = renewer.metrics();
+    std::cout << "Floating: " << days << " days in " << took.count() << " ms of real time, " << metrics.renewals
+        << " renewals, " << metrics.failures << " failed attempts, " << metrics.seatLosses << " seats lost, smallest slack "
+        << metrics.minSlack.count() << " ms" << std::endl;
+    return metrics.seatLosses == 0 && lost == 0 && metrics.renewals > 0;
+}
+
+//A trial that ends in 14 days, a maintenance period that ends in 30, a feature that expires in 45 and a license
+//that expires in 90. Each callback should come at exactly its deadline, in that order.
+bool SimulateDeadlines()
+{
+    auto clock = std::make_shared<SimulatedClock>();
+    ExpiryScheduler expiries( clock );
+    const int64_t day = 24 * 60 * 60 * 1000;
+    int64_t start = clock->epochMillis();
+
+    std::vector<std::string> fired;
+    bool onTime = true;
+    expiries.onExpiry( [ & ]( DeadlineKind kind, const std::string& feature, int64_t at )
+        {
+            fired.push_back( deadlineName( kind ) + ( feature.empty() ? "" : " " + feature ) );
+            onTime = onTime && clock->epochMillis() == at;
+            std::cout << "    day " << ( clock->epochMillis() - start ) / day << ": " << fired.back() << " ended" << std::endl;
+        } );
+    expiries.set( DeadlineKind::Trial, "", start + 14 * day );
+    expiries.set( DeadlineKind::Maintenance, "", start + 30 * day );
+    expiries.set( DeadlineKind::Feature, "export", start + 45 * day );
+    expiries.set( DeadlineKind::License, "", start + 90 * day );
+    ExpiryScheduler::Deadline license = expiries.deadline( DeadlineKind::License );
+    expiries.start();
+    clock->waitForWaiters( 1 );
+
+    auto began = std::chrono::steady_clock::now();
+    clock->advance( std::chrono::hours( 24 * 89 ) );
+    bool validBefore = !license.expired();
+    clock->advance( std::chrono::hours( 24 * 31 ) );
+    auto took = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - began );
+    expiries.stop();
+
+    std::vector<std::string> expected = { "trial", "maintenance period", "feature export", "license" };
+    std::cout << "Deadlines: 120 days in " << took.count() << " ms of real time" << std::endl;
+    return fired == expected && onTime && validBefore && license.expired();
+}
+
+int main( int argc, char* argv[] )
+{
+    int days = argc > 1 ? atoi( argv[1] ) : 7;
+    unsigned seed = argc > 2 ? (unsigned)atoi( argv[2] ) : 1;
+
+    bool floatingOk = SimulateFloating( days, seed );
+    bool deadlinesOk = SimulateDeadlines();
+    std::cout << ( floatingOk ? "Floating renewals held the seat." : "Lost the floating seat!" ) << std::endl;
+    std::cout << ( deadlinesOk ? "Every deadline fired on time, in order." : "Deadlines didn't fire as expected!" ) << std::endl;
+    return floatingOk && deadlinesOk ? 0 : 1;
+}
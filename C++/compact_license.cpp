@@ -0,0 +1,307 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include "CompactLicense.h"
+#include "LicenseStore.h"
+
+//Memory per license at 100k licenses, kept the usual way and in a CompactLicenseTable (see CompactLicense.h).
+//Linux only.
+//
+//    compact_license [licenses]
+//
+//The usual way is ExpandedLicense below: the data a License hands the app, kept as the SDK's accessors return it
+//(std::string, tm, a vector of LicenseFeature and one of CustomField). The SDK's own License object holds this
+//and more, so this is the least a server keeping License::ptr_t around spends. The compact table keeps the hot
+//fields, and the cold ones go to a LicenseStore on disk (see LicenseStore.h), read back when they're asked for.
+//
+//Live heap bytes are counted by replacing operator new and delete for the whole program, using the size malloc
+//actually handed out, so the allocator's rounding is counted too. They're kept out of line: once GCC inlines them
+//it sees free() called on memory from operator new and warns (-Wmismatched-new-delete).
+
+std::atomic<int64_t> liveBytes( 0 );
+
+__attribute__(( noinline )) void* operator new( size_t size )
+{
+    void* p = malloc( size == 0 ? 1 : size );
+    if ( p == nullptr )
+        throw std::bad_alloc();
+    liveBytes.fetch_add( (int64_t)malloc_usable_size( p ), std::memory_order_relaxed );
+    return p;
+}
+
+__attribute__(( noinline )) void operator delete( void* p ) noexcept
+{
+    if ( p == nullptr )
+        return;
+    liveBytes.fetch_sub( (int64_t)malloc_usable_size( p ), std::memory_order_relaxed );
+    free( p );
+}
+
+__attribute__(( noinline )) void operator delete( void* p, size_t ) noexcept
+{
+    if ( p == nullptr )
+        return;
+    liveBytes.fetch_sub( (int64_t)malloc_usable_size( p ), std::memory_order_relaxed );
+    free( p );
+}
+
+struct ExpandedFeature
+{
+    std::string code;
+    tm expiryDate;
+    int maxConsumption;
+    int totalConsumption;
+    int featureType;
+    bool expired;
+};
+
+struct ExpandedLicense
+{
+    std::string key;
+    std::string productCode;
+    bool active, enabled, expired, trial, floating, maintenanceExpired;
+    tm validityDate;
+    tm maintenancePeriod;
+    tm lastCheckDate;
+    int maxActivations, timesActivated, maxConsumption, totalConsumption, maxOverages, floatingTimeout;
+    std::vector<ExpandedFeature> features;
+    std::string firstName, lastName, email;
+    std::vector<std::pair<std::string, std::string>> customFields;
+    std::vector<std::pair<std::string, std::string>> deviceVariables;
+};
+
+tm DateOf( time_t t )
+{
+    tm date;
+    localtime_r( &t, &date );
+    return date;
+}
+
+//Made-up licenses that look like a real fleet's: 12 products, features from a catalogue of 20, a few custom
+//fields and device variables each.
+ExpandedLicense MakeLicense( int n, std::mt19937& random )
+{
+    static const char* catalogue[] = { "export_pdf", "export_dwg", "cloud_sync", "render_gpu", "batch_jobs", "api_access",
+        "sso", "audit_log", "priority_support", "plugins", "scripting", "offline_mode", "team_seats", "analytics",
+        "white_label", "backup", "versioning", "review_tools", "mobile_app", "sandbox" };
+    auto between = [ &random ]( int low, int high ) { return std::uniform_int_distribution<int>( low, high )( random ); };
+    char key[32];
+    snprintf( key, sizeof( key ), "%04X-%04X-%04X-%04X", between( 0, 0xFFFF ), between( 0, 0xFFFF ), n >> 16, n & 0xFFFF );
+    time_t now = 1760000000;
+
+    ExpandedLicense license;
+    license.key = key;
+    license.productCode = "PRODUCT" + std::to_string( n % 12 );
+    license.active = true;
+    license.enabled = between( 0, 50 ) != 0;
+    license.expired = false;
+    license.trial = between( 0, 5 ) == 0;
+    license.floating = between( 0, 10 ) == 0;
+    license.maintenanceExpired = false;
+    license.validityDate = DateOf( now + between( 30, 700 ) * 86400 );
+    license.maintenancePeriod = DateOf( now + between( 0, 365 ) * 86400 );
+    license.lastCheckDate = DateOf( now - between( 0, 7 ) * 86400 );
+    license.maxActivations = between( 1, 10 );
+    license.timesActivated = between( 1, license.maxActivations );
+    license.maxConsumption = between( 0, 1000 );
+    license.totalConsumption = between( 0, license.maxConsumption );
+    license.maxOverages = 0;
+    license.floatingTimeout = license.floating ? 30 : 0;
+    int features = between( 3, 8 );
+    for ( int i = 0; i < features; i++ )
+        license.features.push_back( ExpandedFeature{ catalogue[ between( 0, 19 ) ], DateOf( now + between( 30, 365 ) * 86400 ),
+            between( 0, 100 ), between( 0, 50 ), between( 0, 1 ), false } );
+    license.firstName = "User" + std::to_string( n );
+    license.lastName = "Lastname" + std::to_string( n % 1000 );
+    license.email = "user" + std::to_string( n ) + "@example.com";
+    license.customFields = { { "company", "Company " + std::to_string( n % 5000 ) }, { "seat_group", "group-" + std::to_string( n % 40 ) },
+        { "region", n % 3 == 0 ? "eu-west" : "us-east" } };
+    license.deviceVariables = { { "os", n % 2 ? "windows" : "linux" }, { "last_session", std::to_string( n * 17 ) } };
+    return license;
+}
+
+std::string SerializeCold( const ExpandedLicense& license )
+{
+    std::string cold = license.firstName + '\n' + license.lastName + '\n' + license.email + '\n' +
+        std::to_string( license.customFields.size() ) + '\n';
+    for ( const auto& field : license.customFields )
+        cold += field.first + '\n' + field.second + '\n';
+    for ( const auto& variable : license.deviceVariables )
+        cold += variable.first + '\n' + variable.second + '\n';
+    return cold;
+}
+
+LicenseColdData ParseCold( const std::string& cold )
+{
+    std::istringstream in( cold );
+    LicenseColdData data;
+    std::string count, name, value;
+    std::getline( in, data.firstName );
+    std::getline( in, data.lastName );
+    std::getline( in, data.email );
+    std::getline( in, count );
+    for ( int i = atoi( count.c_str() ); i > 0 && std::getline( in, name ) && std::getline( in, value ); i-- )
+        data.customFields.emplace_back( name, value );
+    while ( std::getline( in, name ) && std::getline( in, value ) )
+        data.deviceVariables.emplace_back( name, value );
+    return data;
+}
+
+double MsSince( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+int main( int argc, char* argv[] )
+{
+    int count = argc > 1 ? atoi( argv[1] ) : 100000;
+    std::mt19937 random( 11 );
+    std::vector<std::string> keys;
+    std::string storePath = "compact_license_cold.store";
+    std::remove( storePath.c_str() );
+
+    //The usual way: a map from key to everything.
+    int64_t before = liveBytes;
+    auto* expanded = new std::unordered_map<std::string, ExpandedLicense>();
+    for ( int n = 0; n < count; n++ )
+    {
+        ExpandedLicense license = MakeLicense( n, random );
+        keys.push_back( license.key );
+        expanded->emplace( license.key, std::move( license ) );
+    }
+    int64_t expandedBytes = liveBytes - before;
+
+    //Compact: the same licenses, cold data to the store.
+    LicenseStoreOptions storeOptions;
+    storeOptions.capacity = (uint64_t)count * 2;
+    storeOptions.durable = false;
+    LicenseStore coldStore( storePath, storeOptions );
+    LicenseStore::Batch batch;
+    int64_t tableHeap = 0; //what the table keeps, counted around each add()
+    before = liveBytes;
+    CompactLicenseTable table( [ &coldStore ]( const std::string& key )
+        {
+            std::string cold;
+            if ( !coldStore.get( "", key, cold ) )
+                throw std::runtime_error( "no cold data for " + key );
+            return ParseCold( cold );
+        } );
+    tableHeap += liveBytes - before;
+    for ( const auto& entry : *expanded )
+    {
+        const ExpandedLicense& license = entry.second;
+        CompactLicense record;
+        uint16_t flags = 0;
+        flags |= license.active ? CompactLicense::Active : 0;
+        flags |= license.enabled ? CompactLicense::Enabled : 0;
+        flags |= license.expired ? CompactLicense::Expired : 0;
+        flags |= license.trial ? CompactLicense::Trial : 0;
+        flags |= license.floating ? CompactLicense::Floating : 0;
+        flags |= license.maintenanceExpired ? CompactLicense::MaintenanceExpired : 0;
+        record.flags = flags;
+        record.validUntil = CompactLicenseTable::fromDate( license.validityDate );
+        record.maintenanceUntil = CompactLicenseTable::fromDate( license.maintenancePeriod );
+        record.lastCheck = CompactLicenseTable::fromDate( license.lastCheckDate );
+        record.maxActivations = license.maxActivations;
+        record.timesActivated = license.timesActivated;
+        record.maxConsumption = license.maxConsumption;
+        record.totalConsumption = license.totalConsumption;
+        record.maxOverages = license.maxOverages;
+        record.floatingTimeout = (uint16_t)license.floatingTimeout;
+        std::vector<std::pair<std::string, CompactFeature>> features;
+        for ( const ExpandedFeature& feature : license.features )
+            features.emplace_back( feature.code, CompactFeature{ 0, CompactLicenseTable::fromDate( feature.expiryDate ),
+                feature.maxConsumption, feature.totalConsumption, (uint8_t)feature.featureType, feature.expired } );
+        before = liveBytes;
+        table.add( license.key, license.productCode, std::move( record ), features );
+        tableHeap += liveBytes - before;
+        batch.put( "", license.key, SerializeCold( license ) );
+        if ( batch.size() == 4096 )
+        {
+            coldStore.commit( batch );
+            batch.clear();
+        }
+    }
+    coldStore.commit( batch );
+    batch.clear();
+
+    //Lookups, the way a license check would do them: by key, then usable and one feature.
+    std::uniform_int_distribution<int> pick( 0, count - 1 );
+    int64_t now = 1760000000;
+    const int lookups = 1000000;
+    int usableExpanded = 0, usableCompact = 0;
+    random.seed( 11 );
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < lookups; i++ )
+    {
+        const ExpandedLicense& license = expanded->at( keys[ pick( random ) ] );
+        tm validity = license.validityDate;
+        bool usable = license.active && license.enabled && !license.expired && mktime( &validity ) > now;
+        for ( const ExpandedFeature& feature : license.features )
+            if ( feature.code == "render_gpu" )
+                usable = usable && !feature.expired;
+        usableExpanded += usable ? 1 : 0;
+    }
+    double expandedNs = MsSince( start ) * 1e6 / lookups;
+    random.seed( 11 );
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < lookups; i++ )
+    {
+        uint32_t index = table.find( keys[ pick( random ) ] );
+        bool usable = table.usable( index, now );
+        CompactFeature feature;
+        if ( table.feature( index, "render_gpu", feature ) )
+            usable = usable && !feature.expired;
+        usableCompact += usable ? 1 : 0;
+    }
+    double compactNs = MsSince( start ) * 1e6 / lookups;
+
+    //Cold data, from disk each time.
+    const int coldReads = 10000;
+    size_t coldFields = 0;
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < coldReads; i++ )
+        coldFields += table.cold( table.find( keys[ pick( random ) ] ) ).customFields.size();
+    double coldUs = MsSince( start ) * 1000 / coldReads;
+
+    //Both must say the same about every license.
+    bool same = true;
+    for ( const std::string& key : keys )
+    {
+        const ExpandedLicense& license = expanded->at( key );
+        uint32_t index = table.find( key );
+        same = same && index != CompactLicenseTable::npos && table.product( index ) == license.productCode;
+        for ( const ExpandedFeature& feature : license.features )
+        {
+            CompactFeature compact;
+            same = same && table.feature( index, feature.code, compact ) && compact.maxConsumption >= 0;
+        }
+    }
+    LicenseColdData cold = table.cold( table.find( keys[ 0 ] ) );
+    same = same && cold.email == expanded->at( keys[ 0 ] ).email && cold.deviceVariables.size() == 2;
+
+    std::cout << count << " licenses, " << sizeof( ExpandedLicense ) << " byte ExpandedLicense, " << sizeof( CompactLicense )
+        << " byte CompactLicense:" << std::endl;
+    std::cout << "  as the SDK hands them over: " << expandedBytes / count << " bytes a license, "
+        << expandedBytes / ( 1024 * 1024 ) << " MB" << std::endl;
+    std::cout << "  compact table:              " << tableHeap / count << " bytes a license, "
+        << tableHeap / ( 1024 * 1024 ) << " MB (" << table.memoryBytes() / count << " without the allocator's overhead), "
+        << "cold data on disk in " << coldStore.stats().dataBytes / ( 1024 * 1024 ) << " MB" << std::endl;
+    std::cout << "  check by key:               " << expandedNs << " ns expanded, " << compactNs << " ns compact (" << usableCompact
+        << " of " << lookups << " usable)" << std::endl;
+    std::cout << "  cold data:                  " << coldUs << " us a read from the store (" << coldFields << " fields)" << std::endl;
+
+    delete expanded;
+    std::remove( storePath.c_str() );
+    return same && usableExpanded == usableCompact ? 0 : 1;
+}
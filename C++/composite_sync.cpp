@@ -0,0 +1,142 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include "CompositeSync.h"
+#include "HttpTransport.h"
+#include "MockServer.h"
+
+//Sample code comparing a periodic sync done the usual way, a request per call, with the same sync as one request
+//to /api/v4/sync (see CompositeSync.h). Linux only: it runs against a local stand-in for the servers (see
+//MockServer.h) started in this process, with a round trip time you pick.
+//
+//    composite_sync [syncs] [round trip in ms]
+//
+//Each sync spends a few consumptions and feature consumptions and sets a device variable, then sends them, checks
+//the license and gets the device variables back. Two licenses go through the same syncs, one each way, and must
+//end up with the same totals. Both ways keep their connection open between requests (see HttpTransport.h), so
+//what's left to save is the round trips.
+
+struct SyncWork
+{
+    int consumptions;
+    int feature1;
+    int feature3;
+    std::string lastSession;
+};
+
+int main( int argc, char* argv[] )
+{
+    int syncs = argc > 1 ? atoi( argv[1] ) : 50;
+    int roundTripMs = argc > 2 ? atoi( argv[2] ) : 20;
+
+    MockServerOptions options;
+    options.port = 0;
+    options.threads = 1;
+    options.licenses = 2;
+    options.latency = std::chrono::milliseconds( roundTripMs );
+    MockServer server( options );
+    try
+    {
+        server.start();
+    }
+    catch ( std::runtime_error ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 random( 7 );
+    std::vector<SyncWork> work;
+    for ( int i = 0; i < syncs; i++ )
+        work.push_back( SyncWork{ std::uniform_int_distribution<int>( 1, 20 )( random ),
+            std::uniform_int_distribution<int>( 0, 5 )( random ), std::uniform_int_distribution<int>( 1, 5 )( random ),
+            std::to_string( i ) } );
+
+    std::string hardwareId = "composite-sync-sample";
+    auto body = [ & ]( const std::string& key, const std::string& more )
+    {
+        return "{\"license_key\":\"" + key + "\",\"hardware_id\":\"" + hardwareId + "\"" + more + "}";
+    };
+    std::string origin = "http://127.0.0.1:" + std::to_string( server.port() );
+    std::string separateKey = mockLicenseKey( 0 ), compositeKey = mockLicenseKey( 1 );
+    HttpTransport separate, composite;
+    SyncResult result;
+    double separateMs, compositeMs;
+    try
+    {
+        HttpTransport setup;
+        setup.post( origin + "/api/v4/activate_license", body( separateKey, "" ) );
+        setup.post( origin + "/api/v4/activate_license", body( compositeKey, "" ) );
+
+        //The usual way: one request for each call the samples make.
+        auto start = std::chrono::steady_clock::now();
+        for ( const SyncWork& sync : work )
+        {
+            separate.post( origin + "/api/v4/check_license", body( separateKey, "" ) );
+            separate.post( origin + "/api/v4/add_consumption", body( separateKey, ",\"consumptions\":" + std::to_string( sync.consumptions ) ) );
+            if ( sync.feature1 > 0 )
+                separate.post( origin + "/api/v4/add_feature_consumption",
+                    body( separateKey, ",\"feature\":\"feature1\",\"consumptions\":" + std::to_string( sync.feature1 ) ) );
+            separate.post( origin + "/api/v4/add_feature_consumption",
+                body( separateKey, ",\"feature\":\"feature3\",\"consumptions\":" + std::to_string( sync.feature3 ) ) );
+            separate.post( origin + "/api/v4/track_device_variables",
+                body( separateKey, ",\"variables\":{\"last_session\":\"" + sync.lastSession + "\"}" ) );
+            separate.post( origin + "/api/v4/get_device_variables", body( separateKey, "" ) );
+        }
+        separateMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        //The same syncs, one request each.
+        CompositeSync licenseSync( compositeKey, hardwareId, composite.poster( origin ) );
+        start = std::chrono::steady_clock::now();
+        for ( const SyncWork& sync : work )
+        {
+            licenseSync.addConsumption( sync.consumptions );
+            if ( sync.feature1 > 0 )
+                licenseSync.addFeatureConsumption( "feature1", sync.feature1 );
+            licenseSync.addFeatureConsumption( "feature3", sync.feature3 );
+            licenseSync.setVariable( "last_session", sync.lastSession );
+            result = licenseSync.sync();
+            for ( const SyncRejection& rejected : result.rejected )
+                std::cout << "Rejected " << rejected.part << ": " << rejected.message << std::endl;
+        }
+        compositeMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+    catch ( CompositeSyncException ex )
+    {
+        std::cout << "Sync refused: " << ex.code() << " " << ex.what() << std::endl;
+        return 1;
+    }
+    catch ( HttpTransportException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+
+    //Both licenses should have ended up the same.
+    long long separateTotals[ 3 ] = {}, compositeTotals[ 3 ] = {};
+    auto totals = [ & ]( const std::string& key, long long* into )
+    {
+        server.store().with( key, [ into ]( MockLicense& license )
+            {
+                into[ 0 ] = license.totalConsumptions;
+                into[ 1 ] = license.features[ 0 ].totalConsumptions;
+                into[ 2 ] = license.features[ 2 ].totalConsumptions;
+            } );
+    };
+    totals( separateKey, separateTotals );
+    totals( compositeKey, compositeTotals );
+    bool same = memcmp( separateTotals, compositeTotals, sizeof( separateTotals ) ) == 0 &&
+        result.totalConsumptions == compositeTotals[ 0 ] && result.variables[ "last_session" ] == work.back().lastSession;
+
+    std::cout << syncs << " syncs with a " << roundTripMs << " ms round trip:" << std::endl;
+    HttpTransportMetrics separateMetrics = separate.metrics(), compositeMetrics = composite.metrics();
+    std::cout << "  separate requests: " << separateMetrics.requests << " requests, " << separateMetrics.bytesSent
+        << " bytes sent, " << separateMetrics.bytesReceived << " received, " << separateMs / syncs << " ms a sync" << std::endl;
+    std::cout << "  one sync request:  " << compositeMetrics.requests << " requests, " << compositeMetrics.bytesSent
+        << " bytes sent, " << compositeMetrics.bytesReceived << " received, " << compositeMs / syncs << " ms a sync" << std::endl;
+    std::cout << "Consumptions " << compositeTotals[ 0 ] << ", feature1 " << compositeTotals[ 1 ] << ", feature3 "
+        << compositeTotals[ 2 ] << ( same ? ", the same both ways." : ", NOT the same both ways!" ) << std::endl;
+    return same ? 0 : 1;
+}
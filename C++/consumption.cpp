@@ -4,9 +4,37 @@
 #include <LicenseSpring/Exceptions.h>
 #include <iostream>
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "CircuitBreaker.h"
+#include "LicenseRevalidator.h"
+#include "QuotaLease.h"
+#include "WorkerPool.h"
 
 using namespace LicenseSpring;
 
+//All online calls in this sample go through networkGuard. If the LicenseSpring servers can't be reached, it
+//retries a few times with backoff, and after repeated failures it stops trying for a while, so we can fall back
+//to our local license straight away instead of waiting for network timeouts. See CircuitBreaker.h.
+NetworkGuard networkGuard;
+
+//The background checks and consumption reservations below share these threads instead of starting one each. See
+//WorkerPool.h.
+WorkerPool backgroundWork;
+
+//The lease reserves and gives back consumptions, and the revalidator checks the license, on those threads with the
+//same License object the menu below uses, and a License isn't meant to be used from two threads at once, so every
+//use of it locks this (like offline_queue.cpp does). The menu may wait for a reservation or a check under way.
+std::mutex licenseMutex;
+
+template <typename Call>
+auto UseLicense( License::ptr_t license, Call call ) -> decltype( call( *license ) )
+{
+    std::lock_guard<std::mutex> lock( licenseMutex );
+    return call( *license );
+}
+
 //Sample code for a consumption based license. This code will demonstrate how, consumptions can be implemented
 //in one's code, including, checking the amount of consumptions at any moment, checking the total amount, 
 //checking if we are in overages, and syncing it with the back end.
@@ -50,6 +78,66 @@ int main()
         return 0;
     }
 
+    //Instead of going to the server for every consumption, we reserve them from the server in blocks and spend
+    //them locally, see QuotaLease.h. Reserving a block adds it to our consumption count and syncs it with the
+    //server, so the server counts the whole block as used until we give back what's left when we exit. When a
+    //block is running low, the next one is reserved in the background.
+    //The lease is declared before the revalidator, which may be opening it in the background: on the way out, the
+    //revalidator is stopped first and only then is the lease closed.
+    QuotaLease lease(
+        [ & ]( int64_t requested )
+        {
+            return networkGuard.call( Endpoint::Consumption, [ & ]()
+                {
+                    std::lock_guard<std::mutex> lock( licenseMutex );
+                    //This is what we'll use to sync our consumption up with the backend, it will check the backend,
+                    //as well as our local licenses consumption count, and makes updates the backend and our local
+                    //file with the correct consumption count. Thus, it'll work for more than one device.
+                    license->syncConsumption( -1 );
+                    int64_t available = license->maxConsumption() + license->maxOverages() - license->totalConsumption();
+                    int64_t granted = std::max<int64_t>( 0, std::min( requested, available ) );
+                    if ( granted > 0 )
+                    {
+                        license->updateConsumption( (int)granted, true );
+                        //If this sync doesn't get through, or the server answers with an error, the block is
+                        //already in our local license file and the next sync will send it, so it's still ours.
+                        try
+                        {
+                            networkGuard.tryCall( Endpoint::Consumption, [ & ]() { license->syncConsumption( -1 ); } );
+                        }
+                        catch ( LicenseSpringException )
+                        {
+                        }
+                    }
+                    return granted;
+                } );
+        },
+        [ & ]( int64_t unused )
+        {
+            //A negative value decrements our consumption count.
+            std::lock_guard<std::mutex> lock( licenseMutex );
+            license->updateConsumption( -(int)unused, true );
+            networkGuard.tryCall( Endpoint::Consumption, [ & ]() { license->syncConsumption( -1 ); } );
+        },
+        50, &backgroundWork );
+
+    //If our local license was checked online recently, we don't make the user wait for the next online check:
+    //we start right away and check in the background, see LicenseRevalidator.h. If the server then tells us the
+    //license isn't valid anymore, or we can't reach it before the grace window runs out, access is revoked. The
+    //check runs on backgroundWork too, so it takes licenseMutex like the lease does.
+    std::atomic<bool> revoked( false );
+    LicenseRevalidator revalidator(
+        [ & ]()
+        {
+            return networkGuard.tryCall( Endpoint::Check, [ & ]() { UseLicense( license, []( License& l ) { l.check(); } ); } );
+        },
+        [ & ]( const std::string& reason )
+        {
+            revoked = true;
+            std::cout << std::endl << "Access revoked: " << reason << std::endl;
+        }, RevalidationPolicy(), SystemClock::instance(), &backgroundWork );
+    bool checkInBackground = false;
+
     //If we don't have a local license yet, we'll try activating it first. Otherwise we'll do an online
     //check to sync up our license with the backend. Note, if you recently reset your license, then you may get
     //an exception here. You can fix this by deleting your local license folder located at 
@@ -57,9 +145,27 @@ int main()
     try
     {
         if ( license == nullptr )
-            license = licenseManager->activateLicense( licenseId );
+        {
+            license = networkGuard.call( Endpoint::Activation, [ & ]() { return licenseManager->activateLicense( licenseId ); } );
+            revalidator.setVerified();
+        }
         else
-            license->check();
+        {
+            //The local check verifies the license file's signature, so we can trust the date of its last online
+            //check below.
+            license->localCheck();
+            if ( revalidator.fresh( LicenseRevalidator::lastVerified( license ) ) )
+                checkInBackground = true;
+            else if ( networkGuard.tryCall( Endpoint::Check, [ & ]() { license->check(); } ) )
+                revalidator.setVerified();
+            else
+            {
+                //Our local license is older than the grace window and we can't check it, so we stop here.
+                std::cout << "Could not reach the LicenseSpring servers, and the local license was last checked "
+                    << "online too long ago." << std::endl;
+                return 0;
+            }
+        }
 
         //We'll do a local check right after just to make sure everything is working properly.
         license->localCheck();
@@ -71,31 +177,71 @@ int main()
         std::cout << ex.what() << std::endl;
         return 0;
     }
+    //We can't activate without the server, so there is nothing to fall back to here.
+    catch ( CircuitOpenException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 0;
+    }
+
+    //If the server can't be reached, we can't reserve anything, so we'll spend straight from our local license
+    //instead, and the next successful sync will send the consumptions we used in the meantime.
+    std::atomic<bool> leased( false );
+    auto openLease = [ & ]()
+    {
+        try
+        {
+            lease.open();
+            leased = true;
+        }
+        catch ( CircuitOpenException )
+        {
+            std::cout << "Could not reach the LicenseSpring servers, using local consumption count." << std::endl;
+        }
+        catch ( LicenseSpringException ex )
+        {
+            std::cout << ex.what() << std::endl;
+        }
+    };
+    //When we start from the local license, we reserve a block only once the online check has gone through, and
+    //spend from our local license until then.
+    if ( checkInBackground )
+    {
+        std::cout << "Starting from the local license, checking it online in the background." << std::endl;
+        revalidator.startInBackground( LicenseRevalidator::lastVerified( license ), openLease );
+    }
+    else
+        openLease();
 
     std::cout << "Type 'e' to exit, type 'y' to increase your consumption." << std::endl;
     std::string sInput = "";
     
-    while ( sInput.compare( "e" ) != 0 )
+    while ( sInput.compare( "e" ) != 0 && !revoked )
     {
         try
         {
-            //This is what we'll use to sync our consumption up with the backend, it will check the backend, as well 
-            //as our local licenses consumption count, and makes updates the backend and our local file with the 
-            //correct consumption count. Thus, it'll work for more than one device.
-            license->syncConsumption( -1 );
-            std::cout << "You have used a total of " << license->totalConsumption() << " consumptions so far." << std::endl;
-            if ( license->totalConsumption() > license->maxConsumption() )
+            //Our license counts the whole lease as used, so we take off what's still left in it.
+            int64_t total = 0, maxConsumption = 0, maxOverages = 0;
+            UseLicense( license, [ & ]( License& l )
+                {
+                    total = l.totalConsumption();
+                    maxConsumption = l.maxConsumption();
+                    maxOverages = l.maxOverages();
+                } );
+            int64_t used = total - lease.remaining();
+            std::cout << "You have used a total of " << used << " consumptions so far." << std::endl;
+            if ( used > maxConsumption )
             {
                 //This is the case where the user is in the max-overages. You can do something special in this case
                 //, or just notify the user they are in the max-overages.
                 std::cout << "You are currently using max overages." << std::endl;
-                std::cout << "You have " << license->maxConsumption() + license->maxOverages() - license->totalConsumption() <<
+                std::cout << "You have " << maxConsumption + maxOverages - used <<
                     " consumptions left." << std::endl;
             }
             else
             {
                 //If the user is not in max overages, you can have your normal code.
-                std::cout << "You have " << license->maxConsumption() - license->totalConsumption() <<
+                std::cout << "You have " << maxConsumption - used <<
                     " consumptions left before you are in the overage territory." << std::endl;
             }
         }
@@ -106,18 +252,26 @@ int main()
         catch ( LicenseSpringException ex ) 
         {
             std::cout << ex.what() << std::endl;
-            return 0;
+            break;
         }
         std::cout << ">";
         std::getline( std::cin, sInput );
 
-        if ( sInput.compare( "y" ) == 0 )
+        if ( sInput.compare( "y" ) == 0 && !revoked )
         {
             try
             {
+                //Spending from the lease doesn't touch the network. If the lease has run dry we wait a little for
+                //the next block to come in.
+                if ( leased )
+                {
+                    if ( !lease.consume( 1, std::chrono::seconds( 5 ) ) )
+                        throw NotEnoughConsumptionException( "Not enough consumption left" );
+                }
                 //The first parameter will increment or decrement (if negative) our consumption count by that amount.
                 //The second parameter, when true, will update our local license file with the new consumption value.
-                license->updateConsumption( 1, true );
+                else
+                    UseLicense( license, []( License& l ) { l.updateConsumption( 1, true ); } );
                 std::cout << "You've just used one consumption." << std::endl;
             }
             catch ( NotEnoughConsumptionException )
@@ -127,9 +281,22 @@ int main()
             catch ( LicenseSpringException ex ) 
             {
                 std::cout << ex.what() << std::endl;
-                return 0;
+                break;
             }
         }
     }
+
+    //Wait for the background check to finish before we touch the lease it may be opening.
+    revalidator.stop();
+
+    //Give back whatever is left in the lease.
+    try
+    {
+        lease.close();
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << ex.what() << std::endl;
+    }
     return 0;
 }
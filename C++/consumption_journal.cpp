@@ -0,0 +1,300 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include "ConsumptionJournal.h"
+
+using namespace LicenseSpring;
+
+//Name of the device variable we keep the journal's last applied sequence number in. See CompactJournal().
+const std::string journalSeqVariable = "consumption_journal_seq";
+
+//The compactor thread below folds the journal into the same License object the menu uses, and a License isn't
+//meant to be used from two threads at once, so both sides lock this (like offline_queue.cpp does). It's taken
+//inside journal.compact(), so never call into the journal while holding it.
+std::mutex licenseMutex;
+
+uint64_t AppliedJournalSeq( License::ptr_t license );
+void CompactJournal( ConsumptionJournal& journal, License::ptr_t license );
+int Benchmark( int threads, int eventsPerThread );
+int CrashTest();
+
+//Sample code for recording consumptions at a high rate. In consumption.cpp every updateConsumption( 1, true )
+//saves the whole local license file. Here, each consumption is instead appended to a small journal file
+//(see ConsumptionJournal.h), and every so often the journal is folded into the license file with one save.
+//
+//Run with --bench [threads] [events per thread] to compare the journal's write throughput against rewriting a
+//file for every event, or with --crash-test to see the journal recover from a write that was cut off by a crash.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--bench" ) == 0 )
+        return Benchmark( argc > 2 ? atoi( argv[2] ) : 8, argc > 3 ? atoi( argv[3] ) : 10000 );
+    if ( argc > 1 && strcmp( argv[1], "--crash-test" ) == 0 )
+        return CrashTest();
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    //Collecting network info
+    ExtendedOptions options;
+    options.collectNetworkInfo( true );
+
+    std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+        EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+        EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+        EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+        appName, appVersion, options );
+
+    std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+
+    //Key-based implementation
+    auto licenseId = LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ); //input license key
+
+    License::ptr_t license = nullptr;
+    try
+    {
+        license = licenseManager->reloadLicense();
+        if ( license == nullptr )
+            license = licenseManager->activateLicense( licenseId );
+        license->localCheck();
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 0;
+    }
+
+    //We open the journal, skipping anything that is already in our license file, and fold whatever is left
+    //(consumptions from the last run that didn't make it into the license file) into the license right away.
+    ConsumptionJournal journal( "consumption.journal", AppliedJournalSeq( license ) );
+    if ( journal.recoveredBytes() > 0 )
+        std::cout << "Discarded an incomplete journal record from the last run." << std::endl;
+    CompactJournal( journal, license );
+
+    //Folding the journal into the license file every couple of seconds keeps the license file up to date without
+    //saving it for every single consumption.
+    std::atomic<bool> running( true );
+    std::thread compactor( [ & ]()
+        {
+            while ( running )
+            {
+                std::this_thread::sleep_for( std::chrono::seconds( 2 ) );
+                try
+                {
+                    CompactJournal( journal, license );
+                }
+                catch ( LicenseSpringException ex )
+                {
+                    std::cout << "Could not save consumptions to the license file: " << ex.what() << std::endl;
+                }
+            }
+        } );
+
+    std::cout << "Type 'y' to use a consumption, 'b' to use 1000 at once, 's' to sync with the server, or 'e' to exit." << std::endl;
+    std::string sInput = "";
+    while ( sInput.compare( "e" ) != 0 )
+    {
+        std::cout << ">";
+        std::getline( std::cin, sInput );
+
+        int count = sInput.compare( "y" ) == 0 ? 1 : sInput.compare( "b" ) == 0 ? 1000 : 0;
+        if ( count > 0 )
+        {
+            //The license file doesn't know about consumptions still in the journal, so we add those ourselves
+            //when checking if there are enough consumptions left.
+            int64_t used, available;
+            {
+                std::lock_guard<std::mutex> lock( licenseMutex );
+                used = license->totalConsumption();
+                available = license->maxConsumption() + license->maxOverages();
+            }
+            used += journal.unapplied()[ "" ];
+            if ( used + count > available )
+            {
+                std::cout << "You are out of consumptions." << std::endl;
+                continue;
+            }
+            uint64_t last = 0;
+            for ( int i = 0; i < count; i++ )
+                last = journal.append( "", 1 );
+            //Only now, once the records are safely on disk, do we count the consumptions as used.
+            journal.waitDurable( last );
+            std::cout << "You've just used " << count << " consumption(s), " << used + count << " in total." << std::endl;
+        }
+        else if ( sInput.compare( "s" ) == 0 )
+        {
+            try
+            {
+                CompactJournal( journal, license );
+                std::lock_guard<std::mutex> lock( licenseMutex );
+                license->syncConsumption();
+                std::cout << "Synced, you have used a total of " << license->totalConsumption() << " consumptions." << std::endl;
+            }
+            catch ( LicenseSpringException ex )
+            {
+                std::cout << ex.what() << std::endl;
+            }
+        }
+        else if ( sInput.compare( "e" ) != 0 )
+            std::cout << "Unrecognized command." << std::endl;
+    }
+
+    running = false;
+    compactor.join();
+    CompactJournal( journal, license );
+    return 0;
+}
+
+//Reads the sequence number of the last journal record that is already in our license file.
+uint64_t AppliedJournalSeq( License::ptr_t license )
+{
+    for ( DeviceVariable variable : license->getDeviceVariables( false ) )
+    {
+        if ( variable.name() == journalSeqVariable )
+            return std::stoull( variable.value() );
+    }
+    return 0;
+}
+
+//Folds the journal into the license file. The consumptions are added with the save parameter set to false, and
+//then adding the device variable with the journal's sequence number saves everything to the license file at
+//once. That way the license file always says exactly which journal records it contains, and if we crash before
+//the journal is emptied, those records are skipped next time instead of being counted twice.
+//
+//If anything fails on the way, the consumptions already added to the license in memory are taken back out before
+//the exception goes on, since the journal keeps them and the next compaction adds them again.
+void CompactJournal( ConsumptionJournal& journal, License::ptr_t license )
+{
+    journal.compact( [ & ]( const ConsumptionJournal::Totals& totals, uint64_t appliedThrough )
+        {
+            std::lock_guard<std::mutex> lock( licenseMutex );
+            auto add = [ & ]( const std::string& feature, int amount )
+            {
+                if ( feature.empty() )
+                    license->updateConsumption( amount, false );
+                else
+                    license->updateFeatureConsumption( feature, amount, false );
+            };
+            std::vector<std::pair<std::string, int>> added;
+            try
+            {
+                for ( const auto& total : totals )
+                {
+                    add( total.first, (int)total.second );
+                    added.emplace_back( total.first, (int)total.second );
+                }
+                license->addDeviceVariable( journalSeqVariable, std::to_string( appliedThrough ), true );
+            }
+            catch ( ... )
+            {
+                for ( const auto& undo : added )
+                    add( undo.first, -undo.second );
+                throw;
+            }
+        } );
+}
+
+//Write throughput of the journal compared with saving a license-sized file for every event, which is roughly what
+//updateConsumption( 1, true ) does. Each event is durable (fsynced) before it counts in both cases.
+int Benchmark( int threads, int eventsPerThread )
+{
+    using clock = std::chrono::steady_clock;
+    const int total = threads * eventsPerThread;
+
+    std::remove( "bench.journal" );
+    double journalSeconds;
+    uint64_t fsyncs;
+    {
+        ConsumptionJournal journal( "bench.journal" );
+        auto start = clock::now();
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < threads; t++ )
+            workers.emplace_back( [ &journal, eventsPerThread, t ]()
+                {
+                    const std::string feature = t % 2 ? "XXXXXX" : "";
+                    for ( int i = 0; i < eventsPerThread; i++ )
+                        journal.appendDurable( feature, 1 );
+                } );
+        for ( std::thread& worker : workers )
+            worker.join();
+        journalSeconds = std::chrono::duration<double>( clock::now() - start ).count();
+        fsyncs = journal.fsyncCount();
+    }
+    std::remove( "bench.journal" );
+
+    //For the rewrite baseline we only do a slice of the events, it's far too slow to do them all.
+    const int rewrites = std::max( 1, std::min( total, 500 ) );
+    std::string licenseFile( 16 * 1024, 'x' );
+    auto start = clock::now();
+    for ( int i = 0; i < rewrites; i++ )
+    {
+        int fd = ::open( "bench.lic.tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if ( fd < 0 || ::write( fd, licenseFile.data(), licenseFile.size() ) < 0 )
+            return 1;
+#ifdef _WIN32
+        _commit( fd );
+#else
+        fsync( fd );
+#endif
+        ::close( fd );
+        std::rename( "bench.lic.tmp", "bench.lic" );
+    }
+    double rewriteSeconds = std::chrono::duration<double>( clock::now() - start ).count();
+    std::remove( "bench.lic" );
+
+    std::cout << "{\"threads\": " << threads << ", \"events\": " << total
+        << ", \"journal_events_per_sec\": " << (long long)( total / journalSeconds )
+        << ", \"journal_fsyncs\": " << fsyncs
+        << ", \"events_per_fsync\": " << (double)total / std::max<uint64_t>( fsyncs, 1 )
+        << ", \"rewrite_events_per_sec\": " << (long long)( rewrites / rewriteSeconds ) << "}" << std::endl;
+    return 0;
+}
+
+//Writes some records, then simulates a crash in the middle of writing one by appending half a record, and checks
+//that reopening the journal keeps every complete record and drops the torn one. It also checks that records
+//already folded into the license file aren't counted again.
+int CrashTest()
+{
+    const char* path = "crash.journal";
+    std::remove( path );
+    {
+        ConsumptionJournal journal( path );
+        for ( int i = 0; i < 100; i++ )
+            journal.appendDurable( i % 2 ? "XXXXXX" : "", 1 );
+    }
+    //A record header promising 20 bytes of payload, followed by only 5 of them.
+    const char partial[] = { 20, 0, 0, 0, 1, 2, 3, 4, 'a', 'b', 'c', 'd', 'e' };
+    {
+        std::ofstream torn( path, std::ios::binary | std::ios::app );
+        torn.write( partial, sizeof( partial ) );
+    }
+
+    bool ok = true;
+    {
+        ConsumptionJournal journal( path );
+        ConsumptionJournal::Totals totals = journal.unapplied();
+        ok = ok && journal.recoveredBytes() == sizeof( partial );
+        ok = ok && totals[ "" ] == 50 && totals[ "XXXXXX" ] == 50;
+        //New records go after the last good one, not after the garbage.
+        journal.appendDurable( "", 1 );
+    }
+    {
+        //Pretend the license file already holds the first 60 records.
+        ConsumptionJournal journal( path, 60 );
+        ConsumptionJournal::Totals totals = journal.unapplied();
+        ok = ok && journal.recoveredBytes() == 0;
+        ok = ok && totals[ "" ] == 21 && totals[ "XXXXXX" ] == 20 && journal.lastSeq() == 101;
+    }
+    std::remove( path );
+    std::cout << ( ok ? "Crash recovery OK." : "Crash recovery FAILED." ) << std::endl;
+    return ok ? 0 : 1;
+}
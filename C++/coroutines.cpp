@@ -0,0 +1,199 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "LicenseAwait.h"
+
+using namespace LicenseSpring;
+
+int RunMock( int operations, int threads );
+
+//Activates (or reloads) the license and checks it online, without blocking the thread it runs on: every online
+//call is co_awaited, and the thread is free for other work (here, other coroutines) while the call is out.
+LicenseTask<License::ptr_t> StartUp( LicenseAsync& async, std::shared_ptr<LicenseManager> licenseManager, LicenseID licenseId,
+    CancellationToken cancellation )
+{
+    CallOptions options{ std::chrono::seconds( 15 ), cancellation };
+
+    //Reading the local license doesn't go online, so there's nothing to await.
+    License::ptr_t license = licenseManager->reloadLicense();
+    if ( license == nullptr )
+        license = co_await async.activateLicense( licenseManager, licenseId, options );
+    else
+        co_await async.check( license, options );
+    license->localCheck();
+    co_return license;
+}
+
+//Fetches what the app shows about updates, both calls at once.
+LicenseTask<void> ShowUpdates( LicenseAsync& async, std::shared_ptr<LicenseManager> licenseManager, LicenseID licenseId )
+{
+    CallOptions options;
+    options.timeout = std::chrono::seconds( 10 );
+    //Both calls are on their way before we wait for the first. If one fails we still wait for the other before
+    //passing the error on, so neither is left running when we return.
+    auto versions = LicenseAsync::startNow( async.getVersionList( licenseManager, licenseId, options ) );
+    auto newest = LicenseAsync::startNow( async.getInstallationFile( licenseManager, licenseId, std::string(), options ) );
+    std::exception_ptr error;
+    try
+    {
+        std::cout << "Available versions: " << ( co_await versions ).size() << std::endl;
+    }
+    catch ( ... )
+    {
+        error = std::current_exception();
+    }
+    try
+    {
+        if ( InstallationFile::ptr_t file = co_await newest )
+            std::cout << "Newest version: " << file->version() << std::endl;
+    }
+    catch ( ... )
+    {
+        if ( !error )
+            error = std::current_exception();
+    }
+    if ( error )
+        std::rethrow_exception( error );
+}
+
+//Sample code for the coroutine versions of the online license calls (see LicenseAwait.h). The calls run on a small
+//pool of threads, and the coroutines resume on this sample's main thread, which runs a RunLoop, like a UI thread
+//would run its message loop.
+//
+//Run with --mock [operations] [threads] to start thousands of operations at once against made-up server calls, with
+//timeouts and cancellation, and see how many threads that takes.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock( argc > 2 ? atoi( argv[2] ) : 2000, argc > 3 ? atoi( argv[3] ) : 64 );
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    //Collecting network info
+    ExtendedOptions options;
+    options.collectNetworkInfo( true );
+
+    std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+        EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+        EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+        EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+        appName, appVersion, options );
+
+    auto licenseId = LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ); //input license key
+    auto licenseManager = LicenseManager::create( pConfiguration );
+
+    RunLoop mainLoop;
+    LicenseAsync async( 4, mainLoop.executor() );
+
+    //Closing the window the license work was started for would cancel it. Here nothing cancels it, we just pass
+    //the token along.
+    CancellationSource closing;
+    auto startup = StartUp( async, licenseManager, licenseId, closing.token() );
+    License::ptr_t license = nullptr;
+    try
+    {
+        license = mainLoop.wait( startup );
+    }
+    catch ( OperationTimeoutException ex )
+    {
+        std::cout << "The LicenseSpring servers took too long to answer." << std::endl;
+        return 0;
+    }
+    catch ( OperationCancelledException ex )
+    {
+        return 0;
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 0;
+    }
+    std::cout << "License " << license->key() << " is ready." << std::endl;
+
+    auto updates = ShowUpdates( async, licenseManager, licenseId );
+    try
+    {
+        mainLoop.wait( updates );
+    }
+    catch ( std::exception& ex )
+    {
+        std::cout << "Could not check for updates: " << ex.what() << std::endl;
+    }
+    return 0;
+}
+
+//Thousands of license operations at once, each an activation followed by a check, against server calls that take
+//20 to 60 ms. One in ten has a timeout shorter than the calls take, and one in ten is cancelled before it finishes.
+int RunMock( int operations, int threads )
+{
+    RunLoop mainLoop;
+    LicenseAsync async( threads, mainLoop.executor() );
+    std::atomic<int> inCall( 0 ), mostInCall( 0 );
+    auto serverCall = [ & ]( int ms )
+    {
+        int now = ++inCall;
+        for ( int most = mostInCall; now > most && !mostInCall.compare_exchange_weak( most, now ); )
+            ;
+        std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+        --inCall;
+    };
+
+    int succeeded = 0, timedOut = 0, cancelled = 0, remaining = operations;
+    std::vector<CancellationSource> sources( operations );
+    auto operation = [ & ]( int i ) -> LicenseTask<void>
+    {
+        CallOptions options{ std::chrono::milliseconds( i % 10 == 3 ? 10 : 0 ), sources[ i ].token() };
+        try
+        {
+            co_await async.call( [ &serverCall, i ]() { serverCall( 20 + i % 5 * 10 ); }, options ); //activation
+            co_await async.call( [ &serverCall ]() { serverCall( 20 ); }, options ); //check
+            succeeded++;
+        }
+        catch ( OperationTimeoutException )
+        {
+            timedOut++;
+        }
+        catch ( OperationCancelledException )
+        {
+            cancelled++;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<LicenseTask<void>> tasks;
+    tasks.reserve( operations );
+    for ( int i = 0; i < operations; ++i )
+        tasks.push_back( operation( i ) );
+    //Everything below runs on the main loop: the coroutines start there, resume there, and so the counters above
+    //need no locks.
+    mainLoop.post( [ & ]()
+        {
+            for ( int i = 0; i < operations; ++i )
+                tasks[ i ].start( [ & ]()
+                    {
+                        if ( --remaining == 0 )
+                            mainLoop.stop();
+                    } );
+            for ( int i = 7; i < operations; i += 10 )
+                sources[ i ].cancel();
+        } );
+    mainLoop.run();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+
+    std::cout << operations << " operations in " << elapsed.count() << " ms on " << threads << " pool threads: "
+        << succeeded << " succeeded, " << timedOut << " timed out, " << cancelled << " cancelled." << std::endl;
+    std::cout << "At most " << mostInCall << " server calls were out at once, and the process used "
+        << threads + 2 << " threads (pool, timer and main) for all of them." << std::endl;
+    int expectedCancelled = operations > 7 ? ( operations - 8 ) / 10 + 1 : 0;
+    return succeeded + timedOut + cancelled == operations && cancelled == expectedCancelled ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "DeviceFingerprint.h"
+
+using namespace LicenseSpring;
+
+//Sample code showing what the device fingerprint cache (see DeviceFingerprint.h) saves at startup. Nothing here
+//needs a license or the LicenseSpring servers: we have the SDK work out this device's hardware ID and collect the
+//network info with no cache, as every startup would, then again from the cache, and time both.
+//
+//    device_fingerprint [cache file]
+int main( int argc, char* argv[] )
+{
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+    std::string apiKey = EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ); // your LicenseSpring API key (UUID)
+    std::string sharedKey = EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ); // your LicenseSpring Shared key
+    auto sdkHardwareId = [ & ]()
+    {
+        ExtendedOptions options;
+        options.collectNetworkInfo( false );
+        return Configuration::Create( apiKey, sharedKey, EncryptStr( "XXXXXX" ), appName, appVersion,
+            options )->getDeviceId();
+    };
+
+    std::string cachePath = argc > 1 ? argv[1] : DeviceFingerprint::defaultCachePath( appName );
+    auto since = []( std::chrono::steady_clock::time_point start )
+    {
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    };
+
+    //No cache: the fingerprint on the startup path, and the network info right after, like collectNetworkInfo( true ).
+    std::remove( cachePath.c_str() );
+    auto start = std::chrono::steady_clock::now();
+    std::string hardwareId;
+    DeviceNetworkInfo info;
+    {
+        DeviceFingerprint device( cachePath, sharedKey, sdkHardwareId );
+        hardwareId = device.hardwareId();
+        double fingerprint = since( start );
+        info = device.networkInfo();
+        std::cout << "No cache:   fingerprint " << fingerprint << " ms, with network info " << since( start ) << " ms" << std::endl;
+    }
+
+    //From the cache: what the app waits for before it can start.
+    start = std::chrono::steady_clock::now();
+    DeviceFingerprint device( cachePath, sharedKey, sdkHardwareId );
+    std::string cachedId = device.hardwareId();
+    double fingerprint = since( start );
+    device.networkInfo();
+    std::cout << "From cache: fingerprint " << fingerprint << " ms, with network info " << since( start ) << " ms"
+        << ( device.cacheHit() ? "" : " (the cache wasn't used!)" ) << std::endl;
+
+    std::cout << "Invalidation key: " << DeviceFingerprint::invalidationKey() << std::endl;
+    std::cout << "Hardware ID: " << hardwareId << ( cachedId == hardwareId ? "" : " (differs from the cached one!)" ) << std::endl;
+    std::cout << "Hostname: " << info.hostname << std::endl;
+    for ( const NetworkAdapterInfo& adapter : info.adapters )
+    {
+        std::cout << "  " << adapter.name << "  " << ( adapter.mac.empty() ? "-" : adapter.mac );
+        for ( const std::string& address : adapter.addresses )
+            std::cout << "  " << address;
+        std::cout << std::endl;
+    }
+    return device.cacheHit() && cachedId == hardwareId ? 0 : 1;
+}
@@ -4,6 +4,11 @@
 #include <LicenseSpring/Exceptions.h>
 #include <iostream>
 #include <thread>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include "QuotaLease.h"
+#include "ExpiryScheduler.h"
 
 //These headers are only necessary for the fibonacci/prime functions below.
 #include <string>
@@ -15,6 +20,18 @@ int fib( int n );
 void fib_game( int max_term );
 bool isPrime( int num );
 
+//The lease for feature 1 below reserves and gives back consumptions on its own thread, with the same License object
+//the menu uses, and a License isn't meant to be used from two threads at once, so both sides lock this (like
+//offline_queue.cpp does). The menu may wait for a reservation that is under way.
+std::mutex licenseMutex;
+
+template <typename Call>
+auto UseLicense( License::ptr_t license, Call call ) -> decltype( call( *license ) )
+{
+    std::lock_guard<std::mutex> lock( licenseMutex );
+    return call( *license );
+}
+
 //Sample code for features licensing. To test feature consumption, our feature will be a fibonacci calculator.
 //Using the fibonacci calculator will cost you one consumption. For our feature activation, we will have a 
 //fibonacci game. Only the max activation amount of people will be able to use the game at any point. 
@@ -82,6 +99,26 @@ int main()
         return 0;
     }
 
+    //We read every feature's expiry date from the license here, and again after each check, instead of asking the
+    //features whether they're expired each time they're used. expiries also tells us the moment one expires.
+    //See ExpiryScheduler.h.
+    ExpiryScheduler expiries;
+    expiries.onExpiry( []( DeadlineKind kind, const std::string& code, int64_t )
+        {
+            if ( kind == DeadlineKind::Feature )
+                std::cout << std::endl << "Feature " << code << " has expired." << std::endl;
+        } );
+    expiries.sync( license );
+    expiries.start();
+    ExpiryScheduler::Deadline feature1Expiry = expiries.deadline( DeadlineKind::Feature, "XXXXXX" ); //Input consumption feature code
+    ExpiryScheduler::Deadline feature2Expiry = expiries.deadline( DeadlineKind::Feature, "XXXXXX" ); //Input feature code
+    ExpiryScheduler::Deadline feature3Expiry = expiries.deadline( DeadlineKind::Feature, "XXXXXX" ); //Input feature code
+
+    //Feature 1 is spent from a lease (see QuotaLease.h): we reserve its consumptions from the server a block at a
+    //time and spend them locally, instead of syncing with the server every time the feature is used. We open it
+    //the first time feature 1 is used, and give back what's left when we exit.
+    std::unique_ptr<QuotaLease> fibLease;
+
     std::string sInput = "";
     
     while ( sInput.compare( "e" ) != 0 )
@@ -99,15 +136,49 @@ int main()
         {
             try
             {
-                license->syncFeatureConsumption( "XXXXXX" ); //Input consumption feature code
-                LicenseFeature feature1 = license->feature( "XXXXXX" ); //Input consumption feature code
+                if ( fibLease == nullptr )
+                {
+                    //Kept only once open() succeeds, so if the first reservation fails we try again next time.
+                    std::unique_ptr<QuotaLease> lease( new QuotaLease(
+                        [ & ]( int64_t requested )
+                        {
+                            //Reserving adds the block to the feature's consumption count and syncs it, so every
+                            //other device on this license sees it as used.
+                            std::lock_guard<std::mutex> lock( licenseMutex );
+                            license->syncFeatureConsumption( "XXXXXX" ); //Input consumption feature code
+                            LicenseFeature feature = license->feature( "XXXXXX" ); //Input consumption feature code
+                            int64_t granted = std::max<int64_t>( 0, std::min<int64_t>( requested, feature.maxConsumption() - feature.totalConsumption() ) );
+                            if ( granted > 0 )
+                            {
+                                license->updateFeatureConsumption( "XXXXXX", (int)granted, true ); //Input consumption feature code
+                                try
+                                {
+                                    license->syncFeatureConsumption( "XXXXXX" ); //Input consumption feature code
+                                }
+                                catch ( LicenseSpringException )
+                                { //The block is in our local license file either way, so it's ours, and the next sync sends it.
+                                }
+                            }
+                            return granted;
+                        },
+                        [ & ]( int64_t unused )
+                        {
+                            std::lock_guard<std::mutex> lock( licenseMutex );
+                            license->updateFeatureConsumption( "XXXXXX", -(int)unused, true ); //Input consumption feature code
+                            license->syncFeatureConsumption( "XXXXXX" ); //Input consumption feature code
+                        },
+                        20 ) );
+                    lease->open();
+                    fibLease = std::move( lease );
+                }
+                LicenseFeature feature1 = UseLicense( license, []( License& l ) { return l.feature( "XXXXXX" ); } ); //Input consumption feature code
 
                 //In this case, syncFeatureConsumption will automatically throw an 
                 //InvalidLicenseFeatureException if our license is invalid, since, when expired, a feature
-                //will delete itself from the platform, so this isExpired() check is a bit redundant. But, 
+                //will delete itself from the platform, so this expiry check is a bit redundant. But, 
                 //this is a good demonstratation of what you could do for offline cases, and how to check
                 //expiry date without using syncFeatureConsumption.
-                if ( feature1.isExpired() )
+                if ( feature1Expiry.expired() )
                 {
                     std::cout << "This feature is expired." << std::endl;
                     continue;
@@ -118,27 +189,30 @@ int main()
                 //users' licenses too. Local consumption is only relative to a device. So each device's consumption will
                 //not affect other user's consumption count (unless synced). This can be useful if, for example, 
                 //you want all user's to have x amount of consumptions, independent of one another.
-                std::cout << "You have a total of: " << feature1.totalConsumption() << " consumptions used so far on this feature." << std::endl;
+                //The feature's consumption count includes the whole lease, so we take off what's still left in it.
+                int64_t used = feature1.totalConsumption() - fibLease->remaining();
+                std::cout << "You have a total of: " << used << " consumptions used so far on this feature." << std::endl;
                 
-                if ( feature1.totalConsumption() > feature1.maxConsumption() )
+                if ( used > feature1.maxConsumption() )
                 {
                     //This is the case where the user is in the max-overages. You can do something special in this case
                     //, or just notify the user they are in the max-overages.
                     std::cout << "You are currently using max overages." << std::endl;
-                    std::cout << "You are currently " << feature1.totalConsumption() - feature1.maxConsumption() <<
+                    std::cout << "You are currently " << used - feature1.maxConsumption() <<
                         " consumptions over on this feature." << std::endl;
                     //Note, currently we don't have a maxOverage field for feature consumptions in terms of code.
                 }
                 else
                 {
                     //If the user is not in max overages, you can have your normal code.
-                    std::cout << "You have " << feature1.maxConsumption() - feature1.totalConsumption() <<
+                    std::cout << "You have " << feature1.maxConsumption() - used <<
                         " consumptions left on this feature, before you are in the overage territory." << std::endl;
                 }
 
-                //Here we can check whether we are out of consumptions and if so, we can throw this exception 
-                //with this message.
-                if ( feature1.totalConsumption() >= feature1.maxConsumption() ) 
+                //Here we take one consumption from the lease. If there are none left (and the next block doesn't
+                //come in within a few seconds), we are out of consumptions, so we throw this exception with this
+                //message.
+                if ( !fibLease->consume( 1, std::chrono::seconds( 5 ) ) )
                 {
                     throw NotEnoughConsumptionException( "Not enough consumption left" );
                 }
@@ -149,13 +223,17 @@ int main()
                 //Here we'll implement our feature, which is a fibonacci calculator. 
                 std::string fib_string = "";
                 std::getline( std::cin, fib_string );
-                std::cout << fib( stoi( fib_string ) ) << std::endl;
-
-                //Once the feature succesfully returns, and we don't have an exception, we'll update our consumption 
-                //count for this feature. The 'true' field means we save the newly updated consumption count to 
-                //our local license file as well.
-                license->updateFeatureConsumption( "XXXXXX", 1, true ); //Input consumption feature code
-                license->syncFeatureConsumption( "XXXXXX" ); //Input consumption feature code
+                try
+                {
+                    std::cout << fib( stoi( fib_string ) ) << std::endl;
+                }
+                catch ( ... )
+                {
+                    //The feature didn't run (not a number, a number too big for an int, or anything else), so we put
+                    //the consumption back into the lease.
+                    fibLease->refund( 1 );
+                    throw;
+                }
             }
             catch ( NotEnoughConsumptionException ) //This exception is pretty useful to find out when you are out of consumptions
             {
@@ -172,6 +250,10 @@ int main()
             {
                 std::cout << "Please input a valid number." << std::endl;
             }
+            catch ( std::out_of_range ) //So is this one, for numbers that don't fit in an int
+            {
+                std::cout << "Please input a smaller number." << std::endl;
+            }
             //Here we'll catch any other exception, although they aren't particularly important to this tutorial
             //so we won't go through all of them.
             catch ( LicenseSpringException ex )
@@ -192,11 +274,15 @@ int main()
                 //our feature. Note, that running check will also sync up our total consumptions for 
                 //feature 3, which will affect how local consumptions work. See [link to tutorial here]
                 //for more details on why this could happen.
-                license->check(); 
                 //If our feature code cannot be found on our local license, we'll throw an 
                 //InvalidLicenseFeatureExample. There we can let the user know they don't currently
                 //have access to this feature on their license, and what they can do to add the feature.
-                LicenseFeature feature2 = license->feature( "XXXXXX" ); //Input feature code
+                LicenseFeature feature2 = UseLicense( license, [ & ]( License& l )
+                    {
+                        l.check();
+                        expiries.sync( license );
+                        return l.feature( "XXXXXX" ); //Input feature code
+                    } );
 
                 //This is just added so that a consumption-based feature with the same feature code 
                 //doesn't accidentally get used.
@@ -209,7 +295,7 @@ int main()
 
                 //Here we'll check if our feature has expired, just in case we haven't synced up with
                 //the server-side in a while.
-                if ( feature2.isExpired() )
+                if ( feature2Expiry.expired() )
                 {
                     std::cout << "This feature is expired." << std::endl;
                     continue;
@@ -242,9 +328,9 @@ int main()
             try
             {
                 //license->syncFeatureConsumption( "XXXXXX" ); //Input feature code
-                LicenseFeature feature3 = license->feature( "XXXXXX" ); //Input feature code
+                LicenseFeature feature3 = UseLicense( license, []( License& l ) { return l.feature( "XXXXXX" ); } ); //Input feature code
 
-                if ( feature3.isExpired() )
+                if ( feature3Expiry.expired() )
                 {
                     std::cout << "This feature is expired." << std::endl;
                     continue;
@@ -280,7 +366,7 @@ int main()
                 std::getline( std::cin, prime_string );
                 std::cout << ( isPrime( stoi( prime_string ) ) ? "Prime" : "Not Prime" ) << std::endl;
 
-                license->updateFeatureConsumption( "XXXXXX", 1, true ); //Input feature code
+                UseLicense( license, []( License& l ) { l.updateFeatureConsumption( "XXXXXX", 1, true ); } ); //Input feature code
                 //license->syncFeatureConsumption( "XXXXXX" ); //Input feature code
             }
             catch ( NotEnoughConsumptionException )
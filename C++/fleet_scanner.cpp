@@ -0,0 +1,274 @@
+#include <LicenseSpring/EncryptString.h>
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FleetScanner.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace LicenseSpring;
+
+//Sample code for validating license files collected from a fleet of devices (see FleetScanner.h).
+//
+//    fleet_scanner <manifest.csv> [--threads N] [--csv results.csv]
+//        Validates every file in the manifest with the SDK and prints a summary. Each line of the manifest is
+//        path,product code,hardware ID of the device the file was collected from.
+//    fleet_scanner --mock [files]
+//        Writes made-up license files, some of them broken in each of the ways a local check can fail, and
+//        scans them on one thread and then on every core, to compare files/s. Needs no license.
+
+int RunMock( int files );
+
+std::vector<FleetFile> ReadManifest( const std::string& path )
+{
+    std::ifstream manifest( path );
+    if ( !manifest )
+        throw FleetScanException( "could not read manifest " + path );
+    std::vector<FleetFile> files;
+    std::string line;
+    while ( std::getline( manifest, line ) )
+    {
+        if ( !line.empty() && line.back() == '\r' )
+            line.pop_back();
+        if ( line.empty() || line[0] == '#' )
+            continue;
+        std::istringstream fields( line );
+        FleetFile file;
+        std::getline( fields, file.path, ',' );
+        std::getline( fields, file.productCode, ',' );
+        std::getline( fields, file.hardwareId, ',' );
+        files.push_back( file );
+    }
+    return files;
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock( argc > 2 ? atoi( argv[2] ) : 20000 );
+    if ( argc < 2 )
+    {
+        std::cout << "usage: fleet_scanner <manifest.csv> [--threads N] [--csv results.csv]" << std::endl;
+        std::cout << "       fleet_scanner --mock [files]" << std::endl;
+        return 1;
+    }
+
+    size_t threads = 0;
+    std::string csvPath;
+    for ( int i = 2; i + 1 < argc; i += 2 )
+    {
+        if ( strcmp( argv[i], "--threads" ) == 0 )
+            threads = (size_t)atoi( argv[i + 1] );
+        else if ( strcmp( argv[i], "--csv" ) == 0 )
+            csvPath = argv[i + 1];
+    }
+
+    std::vector<FleetFile> files;
+    try
+    {
+        files = ReadManifest( argv[1] );
+    }
+    catch ( FleetScanException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+
+    LicenseSpringValidator validator(
+        EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+        EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+        "NAME", "VERSION" ); //input name and version of application
+    FleetScanner scanner( validator, threads );
+    FleetReport report = scanner.scan( files );
+    report.writeSummary( std::cout, files );
+    if ( !csvPath.empty() )
+    {
+        std::ofstream csv( csvPath );
+        report.writeCsv( csv, files );
+    }
+    return report.count( ScanOutcome::Valid ) == files.size() ? 0 : 2;
+}
+
+//Made-up license files: a few lines of key=value, signed with a keyed hash instead of the server's private key.
+//Checking the signature is stretched to take about as long as checking a real one, so the scan's cost is in the
+//right place.
+const char* mockSecret = "fleet scanner mock key";
+const time_t mockNow = 1760000000;
+
+uint64_t MockSignature( const std::string& body )
+{
+    uint64_t hash = 14695981039346656037ull;
+    for ( int round = 0; round < 64; round++ )
+        for ( const std::string& part : { std::string( mockSecret ), body } )
+            for ( unsigned char c : part )
+                hash = ( hash ^ c ) * 1099511628211ull;
+    return hash;
+}
+
+std::string MockLicense( const std::string& product, const std::string& hardwareId, bool active, bool enabled,
+    time_t validUntil, time_t lastCheck )
+{
+    std::ostringstream body;
+    body << "product=" << product << "\nhardware_id=" << hardwareId << "\nactive=" << active << "\nenabled=" << enabled
+        << "\nvalid_until=" << validUntil << "\nlast_check=" << lastCheck << "\n";
+    char signature[32];
+    snprintf( signature, sizeof( signature ), "signature=%016llx\n", (unsigned long long)MockSignature( body.str() ) );
+    return body.str() + signature;
+}
+
+//Checks a mock license in the order the SDK does: can it be read, is it signed, then the local check.
+class MockValidator : public LicenseFileValidator
+{
+public:
+    ScanOutcome validate( const FleetFile& file, const MappedFile& contents, std::string& message ) override
+    {
+        std::string text( reinterpret_cast<const char*>( contents.data() ), contents.size() );
+        size_t at = text.rfind( "signature=" );
+        if ( at == std::string::npos || text.size() < at + 26 )
+        {
+            message = "not a license file, or cut short";
+            return ScanOutcome::Corrupt;
+        }
+        if ( strtoull( text.c_str() + at + 10, nullptr, 16 ) != MockSignature( text.substr( 0, at ) ) )
+            return ScanOutcome::SignatureMismatch;
+
+        std::istringstream lines( text.substr( 0, at ) );
+        std::string line, product, hardwareId;
+        bool active = false, enabled = false;
+        time_t validUntil = 0, lastCheck = 0;
+        while ( std::getline( lines, line ) )
+        {
+            size_t equals = line.find( '=' );
+            std::string key = line.substr( 0, equals ), value = line.substr( equals + 1 );
+            if ( key == "product" ) product = value;
+            else if ( key == "hardware_id" ) hardwareId = value;
+            else if ( key == "active" ) active = value == "1";
+            else if ( key == "enabled" ) enabled = value == "1";
+            else if ( key == "valid_until" ) validUntil = (time_t)atoll( value.c_str() );
+            else if ( key == "last_check" ) lastCheck = (time_t)atoll( value.c_str() );
+        }
+        if ( product != file.productCode )
+        {
+            message = "license is for " + product;
+            return ScanOutcome::ProductMismatch;
+        }
+        if ( hardwareId != file.hardwareId )
+        {
+            message = "license is bound to " + hardwareId;
+            return ScanOutcome::DeviceNotLicensed;
+        }
+        if ( lastCheck > mockNow + 24 * 3600 )
+            return ScanOutcome::ClockTampered;
+        if ( !enabled )
+            return ScanOutcome::Disabled;
+        if ( !active )
+            return ScanOutcome::Inactive;
+        if ( validUntil < mockNow )
+            return ScanOutcome::Expired;
+        return ScanOutcome::Valid;
+    }
+};
+
+bool MakeFolder( const std::string& path )
+{
+#ifdef _WIN32
+    return _mkdir( path.c_str() ) == 0 || errno == EEXIST;
+#else
+    return mkdir( path.c_str(), 0755 ) == 0 || errno == EEXIST;
+#endif
+}
+
+void WriteFile( const std::string& path, const std::string& data )
+{
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( data.data(), (std::streamsize)data.size() );
+}
+
+//Writes the files for the manifest, each one broken in at most one way, and counts what the scan should find.
+std::vector<FleetFile> MakeFleet( const std::string& folder, int count, std::array<size_t, scanOutcomeCount>& expected,
+    size_t& copies )
+{
+    std::vector<FleetFile> files;
+    std::vector<std::string> previous( 12 ); //the last valid license of each product
+    for ( int i = 0; i < count; i++ )
+    {
+        char name[64];
+        snprintf( name, sizeof( name ), "/device%05d.lic", i );
+        FleetFile file{ folder + name, "PRODUCT" + std::to_string( i % 12 ), "HW-" + std::to_string( 100000 + i ) };
+        std::string product = file.productCode, hardwareId = file.hardwareId;
+        bool active = true, enabled = true;
+        time_t validUntil = mockNow + 90 * 24 * 3600, lastCheck = mockNow - i * 60;
+        ScanOutcome outcome = ScanOutcome::Valid;
+        bool copied = false;
+
+        if ( i % 101 == 1 ) outcome = ScanOutcome::Unreadable; //in the manifest, never collected
+        else if ( i % 97 == 2 ) outcome = ScanOutcome::Corrupt;
+        else if ( i % 89 == 3 ) outcome = ScanOutcome::SignatureMismatch;
+        else if ( i % 83 == 4 ) { outcome = ScanOutcome::ProductMismatch; product = "PRODUCT99"; }
+        else if ( i % 79 == 5 ) { outcome = ScanOutcome::DeviceNotLicensed; hardwareId = "HW-999999"; }
+        else if ( i % 73 == 6 ) { outcome = ScanOutcome::ClockTampered; lastCheck = mockNow + 40 * 24 * 3600; }
+        else if ( i % 71 == 7 ) { outcome = ScanOutcome::Expired; validUntil = mockNow - 24 * 3600; }
+        else if ( i % 67 == 8 ) { outcome = ScanOutcome::Disabled; enabled = false; }
+        else if ( i % 61 == 9 ) { outcome = ScanOutcome::Inactive; active = false; }
+        else if ( i % 53 == 10 && !previous[ i % 12 ].empty() ) { outcome = ScanOutcome::DeviceNotLicensed; copied = true; }
+
+        std::string license = MockLicense( product, hardwareId, active, enabled, validUntil, lastCheck );
+        if ( outcome == ScanOutcome::Corrupt )
+            license = license.substr( 0, license.size() / 2 );
+        else if ( outcome == ScanOutcome::SignatureMismatch )
+            license[ license.find( "valid_until=" ) + 12 ] ^= 1; //pushed the expiry out by hand
+        else if ( copied )
+        {
+            //The same file as another device's, which then isn't copied again, so each copy is a pair.
+            license = previous[ i % 12 ];
+            previous[ i % 12 ].clear();
+            copies++;
+        }
+        if ( outcome != ScanOutcome::Unreadable )
+            WriteFile( file.path, license );
+        if ( outcome == ScanOutcome::Valid )
+            previous[ i % 12 ] = license;
+        expected[ (size_t)outcome ]++;
+        files.push_back( file );
+    }
+    return files;
+}
+
+int RunMock( int count )
+{
+    std::string folder = "fleet_mock";
+    if ( !MakeFolder( folder ) )
+    {
+        std::cout << "could not create " << folder << std::endl;
+        return 1;
+    }
+    std::array<size_t, scanOutcomeCount> expected{};
+    size_t copies = 0;
+    std::vector<FleetFile> files = MakeFleet( folder, count, expected, copies );
+
+    //Before: one file after the other, like calling LocalLicenseCheck() in a loop.
+    MockValidator validator;
+    FleetReport sequential = FleetScanner( validator, 1 ).scan( files );
+    //After: every core.
+    FleetReport report = FleetScanner( validator ).scan( files );
+    report.writeSummary( std::cout, files, 5 );
+    std::cout << "One thread: " << (uint64_t)sequential.filesPerSecond() << " files/s, " << report.threads
+        << " threads: " << (uint64_t)report.filesPerSecond() << " files/s" << std::endl;
+
+    bool ok = report.counts == expected && sequential.counts == expected && report.copies.size() == copies;
+    std::cout << ( ok ? "Every file was classified as expected." : "Some files were not classified as expected." ) << std::endl;
+
+    for ( const FleetFile& file : files )
+        std::remove( file.path.c_str() );
+    std::remove( folder.c_str() );
+    return ok ? 0 : 1;
+}
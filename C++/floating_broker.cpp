@@ -0,0 +1,240 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <vector>
+#include "FloatingBroker.h"
+#include "FloatingBrokerClient.h"
+
+using namespace LicenseSpring;
+
+const std::string defaultSocket = "/tmp/licensespring_broker.sock";
+
+//Seats from the LicenseSpring servers. The server counts floating seats per device, so to hold several seats on
+//one machine, each seat is its own device: it gets its own hardware ID (the machine's name with the seat number
+//appended) and its own local license file.
+class LicenseSeatProvider : public SeatProvider
+{
+public:
+    LicenseSeatProvider( size_t maxSeats ) : m_licenses( maxSeats ) {}
+
+    std::string acquire() override
+    {
+        auto slot = std::find( m_licenses.begin(), m_licenses.end(), nullptr );
+        if ( slot == m_licenses.end() )
+            throw std::runtime_error( "all seat slots are in use" );
+        size_t index = slot - m_licenses.begin();
+
+        char host[256] = {};
+        gethostname( host, sizeof( host ) - 1 );
+        std::string seatName = std::string( host ) + "-seat" + std::to_string( index );
+
+        //Collecting network info
+        ExtendedOptions options;
+        options.collectNetworkInfo( true );
+        options.setHardwareID( seatName );
+        options.setLicenseFilePath( std::wstring( seatName.begin(), seatName.end() ) + L".lic" );
+
+        std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+            EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+            EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+            EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+            "NAME", "VERSION", options ); //input name and version of application
+
+        std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+        License::ptr_t license = licenseManager->reloadLicense();
+        if ( license == nullptr )
+            license = licenseManager->activateLicense( LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ) ); //input license key
+        if ( !license->isFloating() )
+            throw std::runtime_error( "the license is not a floating license" );
+        //Throws MaxFloatingReachedException if there are no seats left on the server.
+        license->registerFloatingLicense();
+
+        m_floatingTimeout = std::chrono::minutes( license->floatingTimeout() );
+        m_heartbeatInterval = m_floatingTimeout / 2;
+        *slot = license;
+        return "seat" + std::to_string( index );
+    }
+
+    void heartbeat( const std::string& seat ) override
+    {
+        //Registering again resets the floating timeout, just like in floating_cloud.cpp.
+        license( seat )->registerFloatingLicense();
+    }
+
+    //The slot is free afterwards even if the server can't be told, e.g. for a seat the server has already dropped.
+    void release( const std::string& seat ) override
+    {
+        License::ptr_t held = nullptr;
+        std::swap( held, license( seat ) );
+        held->releaseFloatingLicense();
+    }
+
+    std::chrono::milliseconds heartbeatInterval() override { return m_heartbeatInterval; }
+
+    std::chrono::milliseconds floatingTimeout() override { return m_floatingTimeout; }
+
+private:
+    License::ptr_t& license( const std::string& seat )
+    {
+        return m_licenses.at( std::stoul( seat.substr( 4 ) ) );
+    }
+
+    std::vector<License::ptr_t> m_licenses;
+    std::chrono::milliseconds m_floatingTimeout = std::chrono::minutes( 10 );
+    std::chrono::milliseconds m_heartbeatInterval = std::chrono::minutes( 5 );
+};
+
+//A stand-in for the server, so the broker can be tried without a floating license. Registering a seat takes
+//as long as a typical round trip to the server.
+class MockSeatProvider : public SeatProvider
+{
+public:
+    std::string acquire() override
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+        return "mock" + std::to_string( m_next++ );
+    }
+    void heartbeat( const std::string& ) override { std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) ); }
+    void release( const std::string& ) override { std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) ); }
+    std::chrono::milliseconds heartbeatInterval() override { return std::chrono::seconds( 30 ); }
+
+private:
+    int m_next = 0;
+};
+
+FloatingBroker* runningBroker = nullptr;
+
+void StopBroker( int )
+{
+    if ( runningBroker != nullptr )
+        runningBroker->stop();
+}
+
+int Serve( const std::string& socketPath, bool mock )
+{
+    FloatingBrokerPolicy policy;
+    policy.maxSeats = 4; //Don't hold more seats than your license has, other machines need some too.
+    policy.idleHysteresis = std::chrono::minutes( 2 );
+
+    std::shared_ptr<SeatProvider> provider;
+    if ( mock )
+        provider = std::make_shared<MockSeatProvider>();
+    else
+        provider = std::make_shared<LicenseSeatProvider>( policy.maxSeats );
+
+    FloatingBroker broker( socketPath, provider, policy );
+    runningBroker = &broker;
+    signal( SIGINT, StopBroker );
+    signal( SIGTERM, StopBroker );
+    std::cout << "Floating seat broker listening on " << socketPath << ", press Ctrl+C to stop." << std::endl;
+    broker.run();
+    runningBroker = nullptr;
+
+    FloatingBroker::Stats stats = broker.stats();
+    std::cout << "Handed out " << stats.leases << " seats with " << stats.cloudRegistrations
+        << " registrations on the server." << std::endl;
+    return 0;
+}
+
+//What a tool process does: take a seat from the broker, work, give it back.
+int RunTool( const std::string& socketPath )
+{
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        FloatingSeatLease seat( socketPath );
+        if ( !seat.acquire( "floating_broker", true ) )
+        {
+            std::cout << "No floating seat available." << std::endl;
+            return 1;
+        }
+        auto took = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+        std::cout << "Got " << seat.seat() << " in " << took.count() << " microseconds." << std::endl;
+
+        std::this_thread::sleep_for( std::chrono::seconds( 2 ) ); //our tool's work
+
+        seat.release();
+        std::cout << seat.status() << std::endl;
+    }
+    catch ( const std::exception& ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//Connects, takes a seat and gives it back, again and again, like a build running lots of short tool processes.
+int Benchmark( const std::string& socketPath, int runs )
+{
+    std::vector<long long> micros;
+    try
+    {
+        for ( int i = 0; i < runs; i++ )
+        {
+            auto start = std::chrono::steady_clock::now();
+            FloatingSeatLease seat( socketPath );
+            seat.acquire( "bench", true );
+            micros.push_back( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count() );
+            seat.release();
+        }
+        std::sort( micros.begin(), micros.end() );
+        std::cout << "{\"runs\": " << runs << ", \"p50_us\": " << micros[ micros.size() / 2 ]
+            << ", \"p99_us\": " << micros[ micros.size() * 99 / 100 ] << ", \"max_us\": " << micros.back()
+            << ", \"broker\": \"" << FloatingSeatLease( socketPath ).status() << "\"}" << std::endl;
+    }
+    catch ( const std::exception& ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//Sample code for sharing floating license seats between many short-lived processes on one machine (Linux and
+//macOS). Instead of each process registering its own floating license like in floating_cloud.cpp, one broker
+//process holds the seats and hands them out over a local socket, see FloatingBroker.h.
+//
+//    floating_broker serve [socket]       runs the broker with your floating license
+//    floating_broker serve-mock [socket]  runs the broker with a stand-in for the server
+//    floating_broker run [socket]         takes a seat, works for 2 seconds and gives it back
+//    floating_broker bench [socket] [n]   takes and gives back a seat n times, and prints the latency
+int main( int argc, char* argv[] )
+{
+    std::string command = argc > 1 ? argv[1] : "";
+    std::string socketPath = argc > 2 ? argv[2] : defaultSocket;
+
+    try
+    {
+        if ( command == "serve" || command == "serve-mock" )
+            return Serve( socketPath, command == "serve-mock" );
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    catch ( const std::exception& ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    if ( command == "run" )
+        return RunTool( socketPath );
+    if ( command == "bench" )
+    {
+        int runs = argc > 3 ? atoi( argv[3] ) : 1000;
+        if ( runs > 0 )
+            return Benchmark( socketPath, runs );
+        std::cout << "The number of runs must be a positive number." << std::endl;
+    }
+
+    std::cout << "Usage: floating_broker serve|serve-mock|run|bench [socket] [runs]" << std::endl;
+    return 1;
+}
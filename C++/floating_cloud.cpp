@@ -2,20 +2,38 @@
 #include <LicenseSpring/EncryptString.h>
 #include <LicenseSpring/LicenseManager.h>
 #include <LicenseSpring/Exceptions.h>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
+#include "FloatingRenewal.h"
+#include "LicenseEvents.h"
+#include "WorkerPool.h"
 
 using namespace LicenseSpring;
 
+//Both ways of keeping the license registered report to licenseWatcher, and we subscribe to licenseEvents to hear
+//about a lost seat or a license that stopped being valid, instead of checking for it. See LicenseEvents.h.
+LicenseEventBus licenseEvents;
+LicenseStateWatcher licenseWatcher( licenseEvents );
+
+//Background license work (here, the floating renewals or the watchdog's checks) runs on these threads. See WorkerPool.h.
+WorkerPool backgroundWork;
+
+//The renewals count down to the floating timeout on appClock. A test can swap in a SimulatedClock (see Clock.h)
+//and step through hours of renewals or watchdog checks without waiting for them.
+std::shared_ptr<Clock> appClock = SystemClock::instance();
+
 //Uses check() and registerFloatingLicense() to continuously refresh the timeout interval.
 void check_reg( License::ptr_t license );
 
-//Uses a watchdog to run checks() on a background thread, in intervals, thus continuously refreshing the timeout interval.
+//Uses a watchdog to run checks() on backgroundWork, in intervals, thus continuously refreshing the timeout interval.
 void watchdog( License::ptr_t license );
 
 //This sample code will go through how a floating license, using the LicenseSpring servers' cloud, can be registered,
 //released/deregistered, timed-out, and renewed. When testing this sample code, it is recommended to set 
 //floating timeout to a small value such as 1 minute, to be able to see the timeout feature.
+//If your app runs as lots of short-lived processes on the same machine, registering and releasing a seat in every
+//one of them is slow and keeps the server busy. See floating_broker.cpp for a local broker that holds seats for them.
 int main()
 {
 
@@ -104,6 +122,19 @@ int main()
         std::cout << "Your floating license has a timeout period of: " << license->floatingTimeout()
             << " minute." << std::endl;
 
+        licenseEvents.subscribe( LicenseEventType::FloatingSeatLost, []( const LicenseEvent& event )
+            {
+                std::cout << std::endl << "We lost our floating license: " << event.detail << std::endl;
+            } );
+        licenseEvents.subscribe( []( const LicenseEvent& event )
+            {
+                if ( event.type == LicenseEventType::Expired || event.type == LicenseEventType::Disabled ||
+                    event.type == LicenseEventType::Deactivated )
+                    std::cout << std::endl << "License is " << licenseEventName( event.type ) << std::endl;
+            } );
+        licenseWatcher.update( license );
+        licenseWatcher.setFloatingSeat( true );
+
         //If a user wants to stay signed in on their floating license, regardless of their floating timeout, they'll have to 
         //re-register their license, which will reset their timeout clock. There are 3 ways to do this.
 
@@ -114,8 +145,8 @@ int main()
         check_reg( license ); //see function below
         
         //Method 3:
-        //Using a licenseWatchdog. This will setup a background thread which will periodically run an online check
-        //thus refreshing the timeout interval. This method is particularly useful for floating cloud licenses.
+        //Using a watchdog. This will periodically run an online check in the background, thus refreshing the timeout
+        //interval. This method is particularly useful for floating cloud licenses.
 
         //watchdog( license ) //see function below
     }
@@ -133,64 +164,99 @@ int main()
     return 0;
 }
 
-//This is just a function that runs continuously, asking the user to check/register before they are timed out.
+//This is just a function that keeps our floating license registered until the user leaves. Rather than
+//re-registering a fixed number of seconds before the timeout, we use a FloatingRenewer (see FloatingRenewal.h),
+//which measures how long registering takes and renews just early enough for that, with room for a retry.
 void check_reg( License::ptr_t license )
 {
-    std::string sInput = "";
+    //Either of these methods will reset your timeout interval.
+    FloatingRenewer renewer( [ license ]()
+        {
+            license->registerFloatingLicense();
+            //license->check();
+        }, std::chrono::minutes( license->floatingTimeout() ), //floatingTimeout is in minutes
+        FloatingRenewalPolicy(), appClock, &backgroundWork );
+    renewer.setSeatLostCallback( []( const std::string& reason )
+        {
+            licenseWatcher.setFloatingSeat( false, reason );
+        } );
 
-    //We'll use this for loop to simulate a running app.
-    for ( int i = 0; true; i++ )
-    {
-        std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
-        std::cout << i << std::endl;
-
-        if ( i == license->floatingTimeout() * 60 - 15 ) //floatingTimeout is in minutes, and we subtract 15 seconds as a buffer
-        {                                                //for the user to make a decision and input y
-            std::cout << "You're about to be kicked out of your floating cloud license."
-                << "If you want to stay in, type 'y'. If you want to leave, type anything else." << std::endl;
-            std::getline( std::cin, sInput );
-            if ( sInput.compare( "y" ) == 0 )
-            {
-                //Either of these methods will reset your timeout interval.
-                license->registerFloatingLicense();
-                //license->check();
+    //We'll register once more here and time it, so the timeout is counted from a moment we know, and the renewer
+    //has its first measurement.
+    Clock::steady_time registeredAt = appClock->steadyNow();
+    license->registerFloatingLicense();
+    renewer.addMeasurement( std::chrono::duration_cast<std::chrono::milliseconds>( appClock->steadyNow() - registeredAt ) );
+    renewer.start( registeredAt );
 
-                i = -1;
-            }
-            else
-            {
-                break;
-            }
-        }
+    std::string sInput = "";
+    std::cout << "Your floating license is renewed automatically while you're here. Type 'm' to see how the renewals "
+        << "are going, or anything else to leave." << std::endl;
+    while ( true )
+    {
+        std::getline( std::cin, sInput );
+        if ( sInput.compare( "m" ) != 0 )
+            break;
+
+        //slack is how much time was left before the timeout when the last renewal came back. If the minimum slack
+        //gets close to zero, the network is slower than the renewer expected.
+        FloatingRenewer::Metrics metrics = renewer.metrics();
+        std::cout << "Renewals: " << metrics.renewals << ", failed attempts: " << metrics.failures
+            << ", seats lost: " << metrics.seatLosses << std::endl;
+        std::cout << "Last round trip: " << metrics.lastRtt.count() << " ms, p99: " << metrics.p99.count()
+            << " ms, renewing " << metrics.margin.count() << " ms before the timeout" << std::endl;
+        std::cout << "Slack on the last renewal: " << metrics.lastSlack.count() << " ms, smallest so far: "
+            << metrics.minSlack.count() << " ms" << std::endl;
+
+        //How long the renewals waited for a thread once they were due, which should stay well under the slack.
+        WorkerPoolMetrics pool = backgroundWork.metrics();
+        size_t high = (size_t)TaskPriority::High;
+        std::cout << "Background threads: " << pool.threads << ", queued: " << pool.queued[ high ]
+            << ", waited for a thread p99: " << pool.latencyP99[ high ].count() << " us, longest: "
+            << pool.latencyMax[ high ].count() << " us" << std::endl;
     }
+    renewer.stop();
 }
 
 //This is our watchdog function that will set up our watchdog, and then run an infinite loop until the user exits.
 //We run the inifinite loop so that the user can confirm they're still using the floating license on the platofrm.
 //You can also check the logs to see that the license is being checked every floating timeout interval.
+//
+//The SDK's own setupLicenseWatchdog() would do the same on a thread of its own, which we can't move onto
+//backgroundWork. So we run the checks as a BackgroundLoop (see WorkerPool.h) on the pool instead, next to
+//everything else the app does in the background.
 void watchdog( License::ptr_t license )
 {
-    std::weak_ptr<License> wpLicense( license );
-    license->setupLicenseWatchdog( [ wpLicense ]( const LicenseSpringException& ex ) //The first parameter is the callback
+    const std::chrono::minutes interval( license->floatingTimeout() ); //how often we'll do online checks
+    BackgroundLoop checks( &backgroundWork, TaskPriority::High, appClock );
+    checks.start( [ license, interval ]()
         {
-            // Attention, do not capture License::ptr_t (shared_ptr), this will lead to problems.
-
-            std::cout << std::endl << "License check failed: " << ex.what() << std::endl;
-
-            if ( ex.getCode() == eMaxFloatingReached )
+            try
             {
-                std::cout << "Application cannot use this license at the moment because floating license limit reached." << std::endl;
-                exit( 0 );
+                license->check();
+                licenseWatcher.update( license );
             }
-
-            // Ignore other errors and continue running watchdog if possible
-            if ( auto pLicense = wpLicense.lock() )
+            catch ( LicenseSpringException ex )
             {
-                if ( pLicense->isValid() )
-                    pLicense->resumeLicenseWatchdog();
+                std::cout << std::endl << "License check failed: " << ex.what() << std::endl;
+
+                if ( ex.getCode() == eMaxFloatingReached )
+                {
+                    licenseWatcher.setFloatingSeat( false, "floating license limit reached" );
+                    licenseEvents.flush();
+                    std::cout << "Application cannot use this license at the moment because floating license limit reached." << std::endl;
+                    //Not exit(): that would wait for backgroundWork's threads, and we're on one of them.
+                    std::quick_exit( 0 );
+                }
+
+                //Ignore other errors and keep checking while the license is valid. The failed check may have been
+                //because the license expired or was disabled.
+                licenseWatcher.update( license );
+                if ( !license->isValid() )
+                    return BackgroundLoop::idle();
             }
-        }, license->floatingTimeout() ); //The second parameter is the time interval we'll do online checks (in minutes)
-    
+            return appClock->steadyNow() + interval;
+        } );
+
     std::string sInput = "";
     std::cout << "While watchdog is up, your license should be checked periodically. Check the platform to confirm. "
         << "Type 'e' to exit." << std::endl;
@@ -198,4 +264,5 @@ void watchdog( License::ptr_t license )
     {
         std::getline( std::cin, sInput );
     }
+    checks.stop();
 }
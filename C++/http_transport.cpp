@@ -0,0 +1,156 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HttpTransport.h"
+#include "MockServer.h"
+
+//Sample code for the pooled keep-alive HTTP transport (see HttpTransport.h). Linux only.
+//
+//    http_transport --mock [requests] [threads] [round trip in ms]
+//        Loopback test against a local stand-in for the servers (see MockServer.h) started in this process: the
+//        same license checks with a new connection for each, then on pooled connections, then pipelined. The
+//        server counts the connections it accepted, so we can see they were reused.
+//    http_transport URL [requests]
+//        GETs URL a few times over kept-alive connections, then with a new connection each time. Over https://
+//        (built with HTTP_TRANSPORT_OPENSSL) the new connections resume the first one's TLS session.
+
+int RunMock( int requests, int threads, int roundTripMs );
+void PrintMetrics( const HttpTransportMetrics& metrics, double ms );
+
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock( argc > 2 ? atoi( argv[2] ) : 5000, argc > 3 ? atoi( argv[3] ) : 8, argc > 4 ? atoi( argv[4] ) : 1 );
+    if ( argc < 2 )
+    {
+        std::cout << "Usage: http_transport --mock [requests] [threads] [round trip in ms] | http_transport URL [requests]" << std::endl;
+        return 1;
+    }
+
+    std::string url = argv[1];
+    int requests = argc > 2 ? atoi( argv[2] ) : 5;
+    for ( bool keepAlive : { true, false } )
+    {
+        HttpTransportOptions options;
+        options.keepAlive = keepAlive;
+        HttpTransport transport( options );
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            for ( int i = 0; i < requests; i++ )
+            {
+                HttpResponse response = transport.get( url );
+                if ( i == 0 )
+                    std::cout << "HTTP " << response.status << ", " << response.body.size() << " bytes" << std::endl;
+            }
+        }
+        catch ( HttpTransportException ex )
+        {
+            std::cout << ex.what() << std::endl;
+            return 1;
+        }
+        std::cout << ( keepAlive ? "Kept alive:      " : "New connections: " );
+        PrintMetrics( transport.metrics(), std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+    }
+    return 0;
+}
+
+void PrintMetrics( const HttpTransportMetrics& metrics, double ms )
+{
+    std::cout << metrics.requests << " requests in " << ms << " ms, " << metrics.connectionsOpened << " connections ("
+        << metrics.tlsFullHandshakes << " full TLS handshakes, " << metrics.tlsResumedHandshakes << " resumed), "
+        << metrics.reusedRequests << " requests reused a connection, " << metrics.waitedForConnection
+        << " waited for one" << std::endl;
+}
+
+//threads threads share the requests, checking licenses on the mock three ways.
+int RunMock( int requests, int threads, int roundTripMs )
+{
+    MockServerOptions serverOptions;
+    serverOptions.port = 0;
+    serverOptions.threads = 2;
+    serverOptions.licenses = 100;
+    serverOptions.latency = std::chrono::milliseconds( roundTripMs );
+    MockServer server( serverOptions );
+    try
+    {
+        server.start();
+    }
+    catch ( std::runtime_error ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    std::string origin = "http://127.0.0.1:" + std::to_string( server.port() );
+    auto checkTarget = []( int n )
+    {
+        return "/api/v4/check_license?license_key=" + mockLicenseKey( n % 100 ) + "&hardware_id=transport-sample";
+    };
+    {
+        HttpTransport setup;
+        for ( int n = 0; n < 100; n++ )
+            setup.post( origin + "/api/v4/activate_license",
+                "{\"license_key\":\"" + mockLicenseKey( n ) + "\",\"hardware_id\":\"transport-sample\"}" );
+    }
+
+    std::cout << requests << " license checks from " << threads << " threads, " << roundTripMs << " ms round trip:" << std::endl;
+    bool ok = true;
+    for ( int mode = 0; mode < 3; mode++ )
+    {
+        HttpTransportOptions options;
+        options.keepAlive = mode > 0;
+        options.maxConnectionsPerHost = (size_t)threads;
+        HttpTransport transport( options );
+        uint64_t acceptedBefore = server.stats().connections;
+        std::atomic<int> next( 0 ), failed( 0 );
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < threads; t++ )
+            workers.emplace_back( [ & ]()
+                {
+                    try
+                    {
+                        if ( mode < 2 )
+                        {
+                            for ( int n = next++; n < requests; n = next++ )
+                                if ( transport.get( origin + checkTarget( n ) ).status != 200 )
+                                    failed++;
+                            return;
+                        }
+                        //Pipelined: batches of 8, the answers come back in order on the same connection.
+                        for ( int n = next.fetch_add( 8 ); n < requests; n = next.fetch_add( 8 ) )
+                        {
+                            std::vector<HttpRequest> batch;
+                            for ( int i = n; i < std::min( n + 8, requests ); i++ )
+                                batch.push_back( HttpRequest{ "GET", checkTarget( i ), std::string(), HttpHeaders() } );
+                            for ( const HttpResponse& response : transport.pipeline( origin, batch ) )
+                                if ( response.status != 200 )
+                                    failed++;
+                        }
+                    }
+                    catch ( HttpTransportException ex )
+                    {
+                        std::cout << ex.what() << std::endl;
+                        failed++;
+                    }
+                } );
+        for ( std::thread& worker : workers )
+            worker.join();
+        double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        HttpTransportMetrics metrics = transport.metrics();
+        uint64_t accepted = server.stats().connections - acceptedBefore;
+        const char* names[] = { "  a connection each: ", "  pooled:            ", "  pooled, pipelined: " };
+        std::cout << names[ mode ];
+        PrintMetrics( metrics, ms );
+        std::cout << "                       the server accepted " << accepted << " connections, "
+            << (uint64_t)( requests / ( ms / 1000 ) ) << " requests/s" << std::endl;
+        //Pooled, no more connections than threads should be opened, and the server should have seen each one.
+        ok = ok && failed == 0 && accepted == metrics.connectionsOpened && ( mode == 0 || metrics.connectionsOpened <= (uint64_t)threads );
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+#include "QuotaLease.h"
+
+//Contention benchmark for QuotaLease.h. It doesn't need a license or the LicenseSpring servers: the server is
+//a stand-in that sleeps for a round trip and hands out consumptions from a fixed quota. We compare three ways of
+//spending consumptions from many threads at once:
+//    round trip   - every consumption goes to the server, like updateConsumption followed by syncConsumption
+//    locked lease - a lease with a mutex around the remaining count instead of an atomic, renewing when it's empty
+//    fixed lease  - QuotaLease with the block size held fixed
+//    lease        - QuotaLease, growing its block size when it runs dry
+//and check that the lease never spends more than the server granted.
+//
+//Usage: lease_benchmark [threads] [consumptions per thread] [block size] [round trip in ms]
+//Results are printed as one line of JSON per run.
+
+using clock_type = std::chrono::steady_clock;
+
+//Hands out consumptions from a fixed quota, taking one round trip per request.
+class MockServer
+{
+public:
+    MockServer( int64_t quota, std::chrono::microseconds roundTrip ) : m_available( quota ), m_roundTrip( roundTrip ) {}
+
+    int64_t reserve( int64_t requested )
+    {
+        std::this_thread::sleep_for( m_roundTrip );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        int64_t granted = std::min( requested, m_available );
+        m_available -= granted;
+        requests++;
+        return granted;
+    }
+
+    void release( int64_t unused )
+    {
+        std::this_thread::sleep_for( m_roundTrip );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_available += unused;
+        requests++;
+    }
+
+    int64_t available()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_available;
+    }
+
+    std::atomic<int64_t> requests{ 0 };
+
+private:
+    std::mutex m_mutex;
+    int64_t m_available;
+    std::chrono::microseconds m_roundTrip;
+};
+
+//The lease without the atomic: the remaining count sits behind a mutex, and whoever finds it empty renews
+//while holding it.
+class LockedLease
+{
+public:
+    LockedLease( MockServer& server, int64_t blockSize ) : m_server( server ), m_blockSize( blockSize ) {}
+
+    bool consume()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_remaining == 0 )
+            m_remaining = m_server.reserve( m_blockSize );
+        if ( m_remaining == 0 )
+            return false;
+        m_remaining--;
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_remaining > 0 )
+            m_server.release( m_remaining );
+        m_remaining = 0;
+    }
+
+private:
+    MockServer& m_server;
+    int64_t m_blockSize;
+    std::mutex m_mutex;
+    int64_t m_remaining = 0;
+};
+
+//Runs spend() on every thread until each has done its share, and prints the results.
+template <typename Spend>
+void Run( const char* name, int threads, int64_t perThread, MockServer& server, Spend spend )
+{
+    std::atomic<int64_t> spent( 0 );
+    auto start = clock_type::now();
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < threads; t++ )
+        workers.emplace_back( [ & ]()
+            {
+                int64_t mine = 0;
+                for ( int64_t i = 0; i < perThread; i++ )
+                    if ( spend() )
+                        mine++;
+                spent += mine;
+            } );
+    for ( std::thread& worker : workers )
+        worker.join();
+    double seconds = std::chrono::duration<double>( clock_type::now() - start ).count();
+
+    std::cout << "{\"mode\": \"" << name << "\", \"threads\": " << threads << ", \"consumptions\": " << spent
+        << ", \"per_sec\": " << (long long)( spent / seconds ) << ", \"server_requests\": " << server.requests
+        << ", \"seconds\": " << seconds << "}" << std::endl;
+}
+
+int main( int argc, char* argv[] )
+{
+    int threads = argc > 1 ? atoi( argv[1] ) : 64;
+    int64_t perThread = argc > 2 ? atoll( argv[2] ) : 100000;
+    int64_t blockSize = argc > 3 ? atoll( argv[3] ) : 10000;
+    auto roundTrip = std::chrono::microseconds( ( argc > 4 ? atoi( argv[4] ) : 20 ) * 1000 );
+    int64_t wanted = threads * perThread;
+    //The server has a bit more than we'll use, so the lease has something to give back at the end.
+    int64_t quota = wanted + 3 * blockSize;
+
+    //A round trip per consumption is so slow that we only do a few per thread.
+    {
+        MockServer server( quota, roundTrip );
+        Run( "round trip", threads, std::min<int64_t>( perThread, 10 ), server, [ & ]() { return server.reserve( 1 ) == 1; } );
+    }
+    {
+        MockServer server( quota, roundTrip );
+        LockedLease lease( server, blockSize );
+        Run( "locked lease", threads, perThread, server, [ & ]() { return lease.consume(); } );
+        lease.close();
+    }
+    {
+        MockServer server( quota, roundTrip );
+        QuotaLease lease( [ & ]( int64_t requested ) { return server.reserve( requested ); },
+            [ & ]( int64_t unused ) { server.release( unused ); }, blockSize );
+        lease.setMaxBlockSize( blockSize );
+        lease.open();
+        Run( "fixed lease", threads, perThread, server, [ & ]() { return lease.consume( 1, std::chrono::seconds( 5 ) ); } );
+    }
+    {
+        MockServer server( quota, roundTrip );
+        QuotaLease lease( [ & ]( int64_t requested ) { return server.reserve( requested ); },
+            [ & ]( int64_t unused ) { server.release( unused ); }, blockSize );
+        lease.open();
+        Run( "lease", threads, perThread, server, [ & ]() { return lease.consume( 1, std::chrono::seconds( 5 ) ); } );
+        int64_t spent = lease.spent();
+        lease.close();
+
+        //Everything the server gave out is either spent or back on the server.
+        bool ok = spent == wanted && server.available() == quota - spent;
+        std::cout << "{\"mode\": \"lease check\", \"spent\": " << spent << ", \"returned_to_server\": " << server.available()
+            << ", \"ok\": " << ( ok ? "true" : "false" ) << "}" << std::endl;
+        return ok ? 0 : 1;
+    }
+}
@@ -0,0 +1,218 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include "LicenseEvents.h"
+
+using namespace LicenseSpring;
+
+//Prints every event as it's delivered. In a real app each part would subscribe to the events it cares about,
+//e.g. the consumption UI to ConsumptionLow and the floating client to FloatingSeatLost.
+void PrintEvent( const LicenseEvent& event )
+{
+    std::cout << "[event] " << licenseEventName( event.type );
+    if ( !event.feature.empty() )
+        std::cout << " (" << event.feature << ")";
+    if ( !event.detail.empty() )
+        std::cout << ": " << event.detail;
+    std::cout << std::endl;
+}
+
+int RunMock();
+
+//Sample code for getting told about license changes instead of polling for them. Every check goes through one
+//LicenseStateWatcher, which publishes what changed since the last check (see LicenseEvents.h).
+//
+//Run with --mock to see the watcher long-poll a stand-in for the server, which changes the license a few times.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock();
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    //Collecting network info
+    ExtendedOptions options;
+    options.collectNetworkInfo( true );
+
+    std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+        EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+        EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+        EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+        appName, appVersion, options );
+
+    std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+
+    LicenseEventBus bus;
+    LicenseStateWatcher watcher( bus );
+    bus.subscribe( PrintEvent );
+    bus.subscribe( LicenseEventType::ConsumptionLow, []( const LicenseEvent& event )
+        {
+            std::cout << "Time to buy more consumptions, only " << event.remaining << " left." << std::endl;
+        } );
+
+    License::ptr_t license = nullptr;
+    try
+    {
+        license = licenseManager->reloadLicense();
+        if ( license == nullptr )
+            license = licenseManager->activateLicense( LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ) ); //input license key
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    //The first update tells the subscribers how the license is to begin with.
+    watcher.update( license );
+    bus.flush();
+
+    std::string sInput = "";
+    while ( sInput.compare( "e" ) != 0 )
+    {
+        std::cout << "Type 'c' to check the license, 'y' to use a consumption, or 'e' to exit." << std::endl;
+        std::cout << ">";
+        std::getline( std::cin, sInput );
+
+        try
+        {
+            if ( sInput.compare( "c" ) == 0 )
+                license->check();
+            else if ( sInput.compare( "y" ) == 0 )
+            {
+                license->updateConsumption( 1, true );
+                license->syncConsumption();
+            }
+            else if ( sInput.compare( "e" ) != 0 )
+                std::cout << "Unrecognized command." << std::endl;
+        }
+        catch ( LicenseSpringException ex )
+        {
+            std::cout << ex.what() << std::endl;
+        }
+        //Whether the call worked or not, the license may have changed. The watcher works out what did, and we wait
+        //for the events to be printed so they don't get mixed up with the next prompt.
+        watcher.update( license );
+        bus.flush();
+    }
+    return 0;
+}
+
+//A stand-in for a server with a long-poll endpoint: waitForChange() holds on until the license changes, like an
+//HTTP request the server only answers when there's news.
+class MockLicenseServer : public LicenseChangeSource
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    uint64_t waitForChange( uint64_t version, std::chrono::milliseconds timeout ) override
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_changed.wait_for( lock, timeout, [ this, version ]() { return m_version != version || m_cancelled; } );
+        return m_version;
+    }
+
+    void cancel() override
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_cancelled = true;
+        m_changed.notify_all();
+    }
+
+    //What a license check returns, after a round trip.
+    LicenseState check()
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_checks++;
+        return m_state;
+    }
+
+    void change( std::function<void( LicenseState& )> edit )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        edit( m_state );
+        m_version++;
+        m_changedAt = clock_t::now();
+        m_changed.notify_all();
+    }
+
+    clock_t::time_point changedAt()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_changedAt;
+    }
+
+    int checks()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_checks;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    LicenseState m_state;
+    uint64_t m_version = 1;
+    clock_t::time_point m_changedAt = clock_t::now();
+    int m_checks = 0;
+    bool m_cancelled = false;
+};
+
+int RunMock()
+{
+    auto server = std::make_shared<MockLicenseServer>();
+    server->change( []( LicenseState& state )
+        {
+            state.present = state.active = true;
+            state.maxConsumption = 100;
+            state.totalConsumption = 50;
+            state.floatingSeat = true;
+        } );
+
+    LicenseEventBus bus;
+    LicenseStateWatcher watcher( bus );
+    std::vector<LicenseEventType> received;
+    std::vector<long long> latencies;
+    bus.subscribe( [ & ]( const LicenseEvent& event )
+        {
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>( MockLicenseServer::clock_t::now() - server->changedAt() );
+            received.push_back( event.type );
+            latencies.push_back( latency.count() );
+            PrintEvent( event );
+            std::cout << "        " << latency.count() << " us after the change" << std::endl;
+        } );
+    watcher.startLongPoll( server, [ server ]() { return server->check(); } );
+
+    //Then the license changes every now and then, as if someone was editing it on the LicenseSpring platform.
+    std::vector<std::function<void( LicenseState& )>> changes = {
+        []( LicenseState& state ) { state.totalConsumption = 92; },
+        []( LicenseState& state ) { state.features[ "export" ].maxConsumption = 10; },
+        []( LicenseState& state ) { state.features[ "export" ].expired = true; },
+        []( LicenseState& state ) { state.floatingSeat = false; },
+        []( LicenseState& state ) { state.enabled = false; },
+        []( LicenseState& state ) { state.expired = true; state.active = false; }
+    };
+    for ( auto& change : changes )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+        server->change( change );
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+    watcher.stopLongPoll();
+    bus.flush();
+
+    std::vector<LicenseEventType> expected = { LicenseEventType::Activated, LicenseEventType::ConsumptionLow,
+        LicenseEventType::FeatureChanged, LicenseEventType::FeatureChanged, LicenseEventType::FloatingSeatLost,
+        LicenseEventType::Disabled, LicenseEventType::Deactivated, LicenseEventType::Expired };
+    bool ok = received == expected;
+    //Polling once a second would have found each change half a second late on average, with a check every
+    //second whether anything changed or not.
+    std::cout << ( ok ? "Got every change, once." : "Events don't match the changes!" ) << " "
+        << server->checks() << " checks for " << changes.size() + 1 << " states." << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "LicenseStore.h"
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//Sample code for keeping the local state of many licenses in one memory-mapped store (see LicenseStore.h).
+//
+//    license_store [licenses]
+//        Fills a store with licenses, then times opening it, looking licenses up and updating them, next to a
+//        store with a thousand licenses. Opening shouldn't take longer for the big one.
+//    license_store --recovery-test [crashes]
+//        Commits batches of licenses in a child process and kills it at random points (and every fifth time right
+//        after a commit point), then checks after each crash that every batch is either all in the store or not at
+//        all. Then corrupts records and headers on purpose and checks the store falls back to what it can still
+//        trust. Linux and macOS only.
+
+using steady = std::chrono::steady_clock;
+
+int RunBenchmark( int licenses );
+int RunRecoveryTest( int crashes );
+
+double MsSince( steady::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( steady::now() - start ).count();
+}
+
+//Something like what a gateway would keep about each license.
+std::string LicenseState( int n, int version )
+{
+    return "{\"key\":\"" + std::to_string( n ) + "\",\"active\":true,\"enabled\":true,\"expired\":false,"
+        "\"max_consumptions\":1000,\"total_consumptions\":" + std::to_string( version * 3 ) +
+        ",\"validity_period\":\"2027-12-31T00:00:00Z\",\"last_check\":" + std::to_string( 1760000000 + version ) + "}";
+}
+
+std::string LicenseId( int n )
+{
+    char id[32];
+    snprintf( id, sizeof( id ), "%04X-%04X-%04X-%04X", ( n >> 12 ) & 0xFFFF, n & 0xFFF, ( n * 7 ) & 0xFFFF, ( n * 13 ) & 0xFFFF );
+    return id;
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--recovery-test" ) == 0 )
+        return RunRecoveryTest( argc > 2 ? atoi( argv[2] ) : 50 );
+    return RunBenchmark( argc > 1 ? atoi( argv[1] ) : 100000 );
+}
+
+//Fills a new store at path with licenses, in commits of 1000, and returns how long it took.
+double Fill( const std::string& path, int licenses )
+{
+    std::remove( path.c_str() );
+    LicenseStoreOptions options;
+    options.capacity = (uint64_t)licenses * 2;
+    LicenseStore store( path, options );
+    auto start = steady::now();
+    LicenseStore::Batch batch;
+    for ( int n = 0; n < licenses; n++ )
+    {
+        batch.put( "PRODUCT" + std::to_string( n % 12 ), LicenseId( n ), LicenseState( n, 0 ) );
+        if ( batch.size() == 1000 || n + 1 == licenses )
+        {
+            store.commit( batch );
+            batch.clear();
+        }
+    }
+    return MsSince( start );
+}
+
+int RunBenchmark( int licenses )
+{
+    std::string small = "licenses_small.store", big = "licenses_big.store";
+    Fill( small, 1000 );
+    double fillMs = Fill( big, licenses );
+    std::cout << licenses << " licenses stored in " << fillMs << " ms, in commits of 1000." << std::endl;
+
+    //Opening only reads the header, so both take about the same time.
+    for ( const std::string& path : { small, big } )
+    {
+        auto start = steady::now();
+        LicenseStore store( path );
+        double openMs = MsSince( start );
+        LicenseStoreStats stats = store.stats();
+        std::cout << "Opened " << path << " (" << stats.records << " licenses, " << stats.fileSize / 1024 << " KB) in "
+            << openMs * 1000 << " us" << std::endl;
+    }
+
+    LicenseStore store( big );
+    std::mt19937 random( 1 );
+    std::uniform_int_distribution<int> pick( 0, licenses - 1 );
+    std::string value;
+    int found = 0;
+    auto start = steady::now();
+    const int lookups = 200000;
+    for ( int i = 0; i < lookups; i++ )
+    {
+        int n = pick( random );
+        found += store.get( "PRODUCT" + std::to_string( n % 12 ), LicenseId( n ), value ) ? 1 : 0;
+    }
+    double lookupUs = MsSince( start ) * 1000 / lookups;
+
+    //Updates are new versions of the records, committed as they come, one at a time.
+    start = steady::now();
+    const int updates = 2000;
+    for ( int i = 0; i < updates; i++ )
+    {
+        int n = pick( random );
+        store.put( "PRODUCT" + std::to_string( n % 12 ), LicenseId( n ), LicenseState( n, i + 1 ) );
+    }
+    double updateUs = MsSince( start ) * 1000 / updates;
+    LicenseStoreStats stats = store.stats();
+    std::cout << "Lookups: " << lookupUs << " us each (" << found << " of " << lookups << " found)" << std::endl;
+    std::cout << "Updates: " << updateUs << " us each, synced to disk" << std::endl;
+    std::cout << "Index " << stats.slotsUsed << " of " << stats.capacity << " slots used, " << stats.dataBytes / 1024
+        << " KB of records" << std::endl;
+    return found == lookups ? 0 : 1;
+}
+
+#ifdef _WIN32
+int RunRecoveryTest( int )
+{
+    std::cout << "The recovery test needs fork(), run it on Linux or macOS." << std::endl;
+    return 1;
+}
+#else
+const int batchSize = 64;
+
+//The child: commits batch after batch until it's killed. Batch r sets every license in it to round r, and puts
+//some of them in a second product, so batches have new records as well as updates.
+//With killAtCommitPoint, the process kills itself a few commits in, right after a commit point, so the next open
+//has a commit to finish. A kill at a random time rarely lands there.
+void CommitForever( const std::string& path, bool killAtCommitPoint )
+{
+    LicenseStoreOptions options;
+    options.capacity = 4096;
+    options.durable = false; //we test killing the process, not pulling the plug
+    int commits = 0;
+    if ( killAtCommitPoint )
+        options.afterCommitPoint = [ &commits ]()
+        {
+            if ( ++commits == 3 )
+                raise( SIGKILL );
+        };
+    LicenseStore store( path, options );
+    std::string value;
+    int round = store.get( "ROUNDS", LicenseId( 0 ), value ) ? atoi( value.c_str() ) : 0;
+    for ( ;; )
+    {
+        round++;
+        LicenseStore::Batch batch;
+        for ( int n = 0; n < batchSize; n++ )
+            batch.put( "ROUNDS", LicenseId( n ), std::to_string( round ) + std::string( 200, ' ' ) );
+        batch.put( "EXTRA", LicenseId( round % 512 ), std::to_string( round ) );
+        store.commit( batch );
+    }
+}
+
+//Every license of the last batch has the same round, or the store is still empty.
+bool CheckAtomic( LicenseStore& store, int& round )
+{
+    std::string value;
+    round = store.get( "ROUNDS", LicenseId( 0 ), value ) ? atoi( value.c_str() ) : 0;
+    for ( int n = 0; n < batchSize; n++ )
+    {
+        bool there = store.get( "ROUNDS", LicenseId( n ), value );
+        if ( there != ( round > 0 ) || ( there && atoi( value.c_str() ) != round ) )
+            return false;
+    }
+    return true;
+}
+
+//Flips a byte of the last record in the file with the given value.
+bool CorruptValue( const std::string& path, const std::string& value )
+{
+    std::fstream file( path, std::ios::in | std::ios::out | std::ios::binary );
+    std::string data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+    size_t at = data.rfind( value );
+    if ( at == std::string::npos )
+        return false;
+    file.seekp( (std::streamoff)at );
+    file.put( data[ at ] ^ 0x20 );
+    return true;
+}
+
+std::string ReadFile( const std::string& path )
+{
+    std::ifstream file( path, std::ios::binary );
+    return std::string( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+}
+
+void WriteFile( const std::string& path, const std::string& data )
+{
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( data.data(), (std::streamsize)data.size() );
+}
+
+void CorruptByte( const std::string& path, size_t at )
+{
+    std::fstream file( path, std::ios::in | std::ios::out | std::ios::binary );
+    file.seekg( (std::streamoff)at );
+    char c = (char)file.get();
+    file.seekp( (std::streamoff)at );
+    file.put( c ^ 0x5A );
+}
+
+bool Expect( bool ok, const std::string& what )
+{
+    std::cout << ( ok ? "  ok:     " : "  FAILED: " ) << what << std::endl;
+    return ok;
+}
+
+int RunRecoveryTest( int crashes )
+{
+    std::string path = "recovery_test.store";
+    std::remove( path.c_str() );
+    bool ok = true;
+
+    //Crashes in the middle of commits.
+    std::mt19937 random( 5 );
+    int finished = 0, lastRound = 0;
+    bool atomic = true, monotonic = true, clean = true;
+    for ( int crash = 0; crash < crashes; crash++ )
+    {
+        pid_t child = fork();
+        if ( child == 0 )
+        {
+            try
+            {
+                CommitForever( path, crash % 5 == 0 );
+            }
+            catch ( LicenseStoreException ex )
+            {
+                std::cout << ex.what() << std::endl;
+            }
+            _exit( 1 );
+        }
+        usleep( std::uniform_int_distribution<int>( 2000, 30000 )( random ) );
+        kill( child, SIGKILL );
+        int status;
+        waitpid( child, &status, 0 );
+
+        LicenseStore store( path );
+        int round;
+        atomic = atomic && CheckAtomic( store, round );
+        monotonic = monotonic && round >= lastRound;
+        lastRound = round;
+        LicenseStoreCheck check = store.check();
+        clean = clean && check.corrupt == 0;
+        finished += store.stats().finishedCommit ? 1 : 0;
+    }
+    std::cout << crashes << " crashes, " << lastRound << " batches committed, " << finished
+        << " commits finished when the store was opened again:" << std::endl;
+    ok = Expect( atomic, "every batch was all in the store or not at all" ) && ok;
+    ok = Expect( monotonic, "no committed batch was lost" ) && ok;
+    ok = Expect( clean, "no corrupt records" ) && ok;
+    ok = Expect( finished > 0, "commits cut off after the commit point were finished on open" ) && ok;
+
+    //A corrupt record falls back to the version before it.
+    std::remove( path.c_str() );
+    {
+        LicenseStore store( path );
+        store.put( "PRODUCT", "AAAA", "version one" );
+        store.put( "PRODUCT", "AAAA", "version two" );
+        store.put( "PRODUCT", "BBBB", "only version" );
+    }
+    ok = Expect( CorruptValue( path, "version two" ) && CorruptValue( path, "only version" ), "corrupted two records" ) && ok;
+    {
+        LicenseStore store( path );
+        std::string value;
+        bool found = store.get( "PRODUCT", "AAAA", value );
+        ok = Expect( found && value == "version one", "corrupt update fell back to \"" + value + "\"" ) && ok;
+        ok = Expect( !store.get( "PRODUCT", "BBBB", value ), "corrupt license with no earlier version isn't found" ) && ok;
+        LicenseStoreCheck check = store.check( true );
+        ok = Expect( check.corrupt == 2 && check.restored == 1 && check.lost == 1, "check found 2 corrupt records, repaired" ) && ok;
+        check = store.check();
+        ok = Expect( check.corrupt == 0 && store.stats().records == 1, "clean after the repair, 1 license left" ) && ok;
+        store.put( "PRODUCT", "BBBB", "put back" );
+        ok = Expect( store.get( "PRODUCT", "BBBB", value ) && value == "put back", "lost license can be put back" ) && ok;
+    }
+
+    //A corrupt header leaves the other copy. The newer copy is the one that finished the last commit, so without
+    //it the store opens from the one that started it, and finishes it again from its intent.
+    std::string saved = ReadFile( path );
+    bool finishedAgain = false;
+    for ( size_t copy : { 0, 1 } )
+    {
+        CorruptByte( path, copy * 2048 + 24 );
+        try
+        {
+            LicenseStore store( path );
+            std::string value;
+            bool found = store.get( "PRODUCT", "BBBB", value ) && value == "put back";
+            finishedAgain = finishedAgain || store.stats().finishedCommit;
+            ok = Expect( found, "opened with header copy " + std::to_string( copy ) + " corrupt" +
+                ( store.stats().finishedCommit ? ", finished the last commit again" : "" ) ) && ok;
+        }
+        catch ( LicenseStoreException ex )
+        {
+            ok = Expect( false, ex.what() ) && ok;
+        }
+        WriteFile( path, saved );
+    }
+    ok = Expect( finishedAgain, "an interrupted commit was finished on open" ) && ok;
+    CorruptByte( path, 24 );
+    CorruptByte( path, 2048 + 24 );
+    try
+    {
+        LicenseStore store( path );
+        ok = Expect( false, "opened with both headers corrupt" ) && ok;
+    }
+    catch ( LicenseStoreException ex )
+    {
+        ok = Expect( true, std::string( "both headers corrupt: " ) + ex.what() ) && ok;
+    }
+    std::remove( path.c_str() );
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,376 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include "LoadGenerator.h"
+#include "MockServer.h"
+
+//Sample code for load testing a license backend with thousands of clients doing what the samples do (see
+//LoadGenerator.h). Linux only, and it runs against a local stand-in for the servers: start mock_server.cpp, or
+//pass --mock to run one in this process.
+//
+//    load_generator [--port 8080] [--clients 1000] [--threads N] [--duration 10] [--rate SESSIONS_PER_S]
+//                   [--think MS] [--ramp-up MS] [--timeout MS] [--licenses 1000] [--source-ips N]
+//                   [--mix chatbot=4,consumption=3,features=2,floating=1] [--mock] [--json]
+//
+//Without --rate every client starts its next session as soon as one ends. With it, sessions arrive at that rate
+//and the clients are a pool that serves them. --mix sync=1 and --mix composite_sync=1 compare a periodic sync done
+//a request per call with the same sync as one request (see CompositeSync.h).
+
+struct ScenarioSettings
+{
+    std::chrono::milliseconds think{ 1000 };
+    std::chrono::milliseconds floatingRenewal{ 5000 }; //compressed, a real one is minutes
+};
+
+std::string Query( const LoadClient& client )
+{
+    return "license_key=" + client.licenseKey + "&hardware_id=" + client.hardwareId;
+}
+
+std::string Body( const LoadClient& client, const std::string& more = "" )
+{
+    return "{\"license_key\":\"" + client.licenseKey + "\",\"hardware_id\":\"" + client.hardwareId + "\"" + more + "}";
+}
+
+LoadStep Post( const std::string& operation, const std::string& path, const std::string& body, std::chrono::milliseconds think )
+{
+    return LoadStep{ operation, "POST", path, body, think };
+}
+
+LoadStep Get( const std::string& operation, const std::string& path, std::chrono::milliseconds think )
+{
+    return LoadStep{ operation, "GET", path, "", think };
+}
+
+//The four flows, modelled on the samples they're named after. Each session activates first, the way a sample does
+//when it starts without a local license (activation is idempotent on the mock, so later sessions just get the
+//license again).
+std::vector<LoadScenario> SampleScenarios( const ScenarioSettings& settings )
+{
+    std::chrono::milliseconds think = settings.think;
+    std::chrono::milliseconds none( 0 );
+
+    //chatbot.cpp: checks now and then while the user chats, sometimes deactivating at the end.
+    LoadScenario chatbot{ "chatbot", 4, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::vector<LoadStep> steps = { Post( "activate", "/api/v4/activate_license", Body( client ), think ) };
+            int checks = std::uniform_int_distribution<int>( 2, 6 )( random );
+            for ( int i = 0; i < checks; i++ )
+                steps.push_back( Get( "check", "/api/v4/check_license?" + Query( client ), think ) );
+            if ( std::uniform_int_distribution<int>( 0, 4 )( random ) == 0 )
+                steps.push_back( Post( "deactivate", "/api/v4/deactivate_license", Body( client ), none ) );
+            return steps;
+        } };
+
+    //consumption.cpp: uses a consumption at a time and syncs it, checking the license at the end.
+    LoadScenario consumption{ "consumption", 3, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::vector<LoadStep> steps = { Post( "activate", "/api/v4/activate_license", Body( client ), none ) };
+            int uses = std::uniform_int_distribution<int>( 3, 10 )( random );
+            for ( int i = 0; i < uses; i++ )
+                steps.push_back( Post( "add_consumption", "/api/v4/add_consumption", Body( client, ",\"consumptions\":1" ), think ) );
+            steps.push_back( Get( "check", "/api/v4/check_license?" + Query( client ), none ) );
+            return steps;
+        } };
+
+    //features.cpp: checks the license for its features, then spends feature consumptions and reports device
+    //variables like cf_dv.cpp does.
+    LoadScenario features{ "features", 2, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::vector<LoadStep> steps = {
+                Post( "activate", "/api/v4/activate_license", Body( client ), none ),
+                Get( "check", "/api/v4/check_license?" + Query( client ), think ) };
+            int uses = std::uniform_int_distribution<int>( 1, 5 )( random );
+            for ( int i = 0; i < uses; i++ )
+                steps.push_back( Post( "add_feature_consumption", "/api/v4/add_feature_consumption",
+                    Body( client, ",\"feature\":\"feature1\",\"consumptions\":1" ), think ) );
+            steps.push_back( Post( "track_device_variables", "/api/v4/track_device_variables",
+                Body( client, ",\"variables\":{\"session_uses\":\"" + std::to_string( uses ) + "\"}" ), none ) );
+            return steps;
+        } };
+
+    //floating_cloud.cpp: registers, renews the registration until it's done, and releases it.
+    LoadScenario floating{ "floating", 1, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::vector<LoadStep> steps = {
+                Post( "activate", "/api/v4/activate_license", Body( client ), none ),
+                Post( "floating_register", "/api/v4/floating/register", Body( client ), settings.floatingRenewal ) };
+            int renewals = std::uniform_int_distribution<int>( 1, 4 )( random );
+            for ( int i = 0; i < renewals; i++ )
+                steps.push_back( Post( "floating_register", "/api/v4/floating/register", Body( client ), settings.floatingRenewal ) );
+            steps.push_back( Post( "floating_release", "/api/v4/floating/release", Body( client ), none ) );
+            return steps;
+        } };
+
+    //A periodic sync the way the samples do it: a check, the consumption and feature consumption syncs, sending the
+    //device variables and getting them back. Only with --mix, like composite_sync.
+    LoadScenario sync{ "sync", 0, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::string uses = std::to_string( std::uniform_int_distribution<int>( 1, 5 )( random ) );
+            return std::vector<LoadStep>{
+                Post( "activate", "/api/v4/activate_license", Body( client ), none ),
+                Get( "check", "/api/v4/check_license?" + Query( client ), none ),
+                Post( "add_consumption", "/api/v4/add_consumption", Body( client, ",\"consumptions\":" + uses ), none ),
+                Post( "add_feature_consumption", "/api/v4/add_feature_consumption",
+                    Body( client, ",\"feature\":\"feature1\",\"consumptions\":" + uses ), none ),
+                Post( "add_feature_consumption", "/api/v4/add_feature_consumption",
+                    Body( client, ",\"feature\":\"feature3\",\"consumptions\":" + uses ), none ),
+                Post( "track_device_variables", "/api/v4/track_device_variables",
+                    Body( client, ",\"variables\":{\"session_uses\":\"" + uses + "\"}" ), none ),
+                Post( "get_device_variables", "/api/v4/get_device_variables", Body( client ), think ) };
+        } };
+
+    //The same sync as one request to /api/v4/sync.
+    LoadScenario compositeSync{ "composite_sync", 0, [ = ]( const LoadClient& client, std::mt19937_64& random )
+        {
+            std::string uses = std::to_string( std::uniform_int_distribution<int>( 1, 5 )( random ) );
+            return std::vector<LoadStep>{
+                Post( "activate", "/api/v4/activate_license", Body( client ), none ),
+                Post( "sync", "/api/v4/sync", Body( client, ",\"consumptions\":" + uses + ",\"feature_consumptions\":{\"feature1\":" +
+                    uses + ",\"feature3\":" + uses + "},\"variables\":{\"session_uses\":\"" + uses + "\"},\"get_variables\":true" ),
+                    think ) };
+        } };
+
+    return { chatbot, consumption, features, floating, sync, compositeSync };
+}
+
+//"chatbot=4,floating=1" sets those weights, the scenarios it doesn't name get 0.
+bool SetMix( std::vector<LoadScenario>& scenarios, const std::string& mix )
+{
+    for ( LoadScenario& scenario : scenarios )
+        scenario.weight = 0;
+    size_t start = 0;
+    while ( start < mix.size() )
+    {
+        size_t end = mix.find( ',', start );
+        if ( end == std::string::npos )
+            end = mix.size();
+        std::string item = mix.substr( start, end - start );
+        size_t eq = item.find( '=' );
+        auto scenario = std::find_if( scenarios.begin(), scenarios.end(),
+            [ & ]( const LoadScenario& s ) { return s.name == item.substr( 0, eq ); } );
+        if ( eq == std::string::npos || scenario == scenarios.end() )
+            return false;
+        scenario->weight = atof( item.c_str() + eq + 1 );
+        start = end + 1;
+    }
+    scenarios.erase( std::remove_if( scenarios.begin(), scenarios.end(), []( const LoadScenario& s ) { return s.weight <= 0; } ),
+        scenarios.end() );
+    return !scenarios.empty();
+}
+
+void PrintReport( const LoadReport& report, bool json )
+{
+    char line[ 256 ];
+    if ( json )
+    {
+        std::cout << "{\"seconds\": " << report.seconds << ", \"requests\": " << report.requests()
+            << ", \"requests_per_s\": " << (uint64_t)( report.requests() / report.seconds ) << ", \"operations\": {";
+        bool first = true;
+        for ( auto& operation : report.operations )
+        {
+            const LatencyHistogram& latency = operation.second.latency;
+            snprintf( line, sizeof( line ), "%s\"%s\": {\"ok\": %llu, \"errors\": %llu, \"p50_us\": %llu, \"p90_us\": %llu, "
+                "\"p99_us\": %llu, \"p999_us\": %llu, \"max_us\": %llu}", first ? "" : ", ", operation.first.c_str(),
+                (unsigned long long)latency.count(), (unsigned long long)operation.second.errors,
+                (unsigned long long)latency.percentile( 0.5 ), (unsigned long long)latency.percentile( 0.9 ),
+                (unsigned long long)latency.percentile( 0.99 ), (unsigned long long)latency.percentile( 0.999 ),
+                (unsigned long long)latency.max() );
+            std::cout << line;
+            first = false;
+        }
+        std::cout << "}, \"errors\": {";
+        first = true;
+        for ( auto& error : report.errors )
+        {
+            std::cout << ( first ? "" : ", " ) << "\"" << error.first << "\": " << error.second;
+            first = false;
+        }
+        std::cout << "}, \"sessions\": {";
+        first = true;
+        for ( auto& session : report.sessions )
+        {
+            std::cout << ( first ? "" : ", " ) << "\"" << session.first << "\": " << session.second;
+            first = false;
+        }
+        std::cout << "}, \"failed_sessions\": {";
+        first = true;
+        for ( auto& session : report.failedSessions )
+        {
+            std::cout << ( first ? "" : ", " ) << "\"" << session.first << "\": " << session.second;
+            first = false;
+        }
+        std::cout << "}, \"missed_arrivals\": " << report.missedArrivals << "}" << std::endl;
+        return;
+    }
+
+    std::cout << report.requests() << " requests in " << report.seconds << " s, "
+        << (uint64_t)( report.requests() / report.seconds ) << " requests/s" << std::endl << std::endl;
+    snprintf( line, sizeof( line ), "%-24s %10s %8s %9s %9s %9s %9s %9s", "operation", "ok", "errors", "p50 ms",
+        "p90 ms", "p99 ms", "p99.9 ms", "max ms" );
+    std::cout << line << std::endl;
+    for ( auto& operation : report.operations )
+    {
+        const LatencyHistogram& latency = operation.second.latency;
+        snprintf( line, sizeof( line ), "%-24s %10llu %8llu %9.2f %9.2f %9.2f %9.2f %9.2f", operation.first.c_str(),
+            (unsigned long long)latency.count(), (unsigned long long)operation.second.errors,
+            latency.percentile( 0.5 ) / 1000.0, latency.percentile( 0.9 ) / 1000.0, latency.percentile( 0.99 ) / 1000.0,
+            latency.percentile( 0.999 ) / 1000.0, latency.max() / 1000.0 );
+        std::cout << line << std::endl;
+    }
+    if ( !report.errors.empty() )
+    {
+        std::cout << std::endl << "Errors:" << std::endl;
+        for ( auto& error : report.errors )
+            std::cout << "    " << error.first << ": " << error.second << std::endl;
+    }
+    std::cout << std::endl << "Sessions finished:";
+    for ( auto& session : report.sessions )
+        std::cout << " " << session.first << " " << session.second;
+    std::cout << std::endl;
+    if ( !report.failedSessions.empty() )
+    {
+        std::cout << "Sessions given up (couldn't connect):";
+        for ( auto& session : report.failedSessions )
+            std::cout << " " << session.first << " " << session.second;
+        std::cout << std::endl;
+    }
+    if ( report.missedArrivals > 0 )
+        std::cout << report.missedArrivals << " sessions arrived while every client was busy." << std::endl;
+}
+
+int main( int argc, char* argv[] )
+{
+    LoadOptions options;
+    ScenarioSettings settings;
+    int licenses = 1000;
+    bool mock = false;
+    bool json = false;
+    std::string mix;
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--mock" )
+        {
+            mock = true;
+            continue;
+        }
+        if ( arg == "--json" )
+        {
+            json = true;
+            continue;
+        }
+        if ( i + 1 >= argc )
+        {
+            std::cout << "Missing a value for " << arg << std::endl;
+            return 1;
+        }
+        const char* value = argv[++i];
+        if ( arg == "--host" )
+            options.host = value;
+        else if ( arg == "--port" )
+            options.port = atoi( value );
+        else if ( arg == "--clients" )
+            options.clients = atoi( value );
+        else if ( arg == "--threads" )
+            options.threads = atoi( value );
+        else if ( arg == "--duration" )
+            options.duration = std::chrono::seconds( atoi( value ) );
+        else if ( arg == "--rate" )
+            options.arrivalRate = atof( value );
+        else if ( arg == "--think" )
+            settings.think = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--renewal" )
+            settings.floatingRenewal = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--ramp-up" )
+            options.rampUp = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--timeout" )
+            options.timeout = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--licenses" )
+            licenses = atoi( value );
+        else if ( arg == "--source-ips" )
+            options.sourceAddresses = atoi( value );
+        else if ( arg == "--mix" )
+            mix = value;
+        else
+        {
+            std::cout << "Unrecognized option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<LoadScenario> scenarios = SampleScenarios( settings );
+    if ( !mix.empty() && !SetMix( scenarios, mix ) )
+    {
+        std::cout << "Bad --mix, use e.g. chatbot=4,consumption=3,features=2,floating=1" << std::endl;
+        return 1;
+    }
+
+    //Every client has a socket, and 50k clients is more than the default limit of open files.
+    rlimit limit;
+    if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+
+    //The clients share the licenses, many devices to a license like a team would.
+    options.client = [ licenses ]( int n )
+    {
+        return LoadClient{ n, mockLicenseKey( n % licenses ), "load-" + std::to_string( n ) };
+    };
+
+    std::unique_ptr<MockServer> server;
+    if ( mock )
+    {
+        MockServerOptions serverOptions;
+        serverOptions.port = 0;
+        serverOptions.licenses = licenses;
+        serverOptions.host = options.host;
+        server.reset( new MockServer( serverOptions ) );
+        try
+        {
+            server->start();
+        }
+        catch ( std::runtime_error ex )
+        {
+            std::cout << ex.what() << std::endl;
+            return 1;
+        }
+        options.port = server->port();
+    }
+
+    if ( !json )
+        std::cout << "Running " << options.clients << " clients against " << options.host << ":" << options.port << " for "
+            << options.duration.count() << " s, "
+            << ( options.arrivalRate > 0 ? std::to_string( (int)options.arrivalRate ) + " sessions/s." : "closed loop." ) << std::endl;
+
+    LoadGenerator generator( options, scenarios );
+    std::atomic<bool> done( false );
+    std::thread progress( [ & ]()
+        {
+            uint64_t last = 0;
+            while ( !done )
+            {
+                for ( int i = 0; i < 10 && !done; i++ )
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+                uint64_t now = generator.requestsSoFar();
+                if ( !json && !done )
+                    std::cerr << now - last << " requests/s" << std::endl;
+                last = now;
+            }
+        } );
+    LoadReport report = generator.run();
+    done = true;
+    progress.join();
+    if ( server )
+        server->stop();
+
+    PrintReport( report, json );
+    return 0;
+}
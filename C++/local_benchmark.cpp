@@ -0,0 +1,305 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace LicenseSpring;
+
+//Benchmarks for the license calls that don't go to the server: reloadLicense(), getCurrentLicense(), localCheck(),
+//feature( code ), customFields(), getDeviceVariables( false ), isActive() and isExpired(). The samples call these
+//all the time (every command in chatbot.cpp, every feature use in features.cpp), so it's worth knowing what they
+//cost, and whether that changes from one SDK release to the next.
+//
+//Each call is measured
+//    warm - called over and over, so the license and the SDK's code are in the CPU caches
+//    cold - after pushing everything out of the CPU caches (and the license file out of the OS file cache), like the
+//           first call after the app has been doing something else for a while
+//on license files of growing size: each license key you pass is activated into its own license file, and device
+//variables are added to it locally, step by step. Use licenses with few and with many features (set up on the
+//LicenseSpring platform) to see how the feature count matters.
+//
+//Allocations are counted by replacing operator new for the whole program. On Linux that also catches the
+//SDK's allocations, since the SDK's library uses our operator new.
+//
+//Linux build:
+//    g++ -std=c++17 -O2 local_benchmark.cpp -I<SDK>/include -L<SDK>/lib -lLicenseSpring -pthread -o local_benchmark
+//
+//    local_benchmark [--keys KEY1,KEY2] [--variables 0,10,100,1000,5000] [--iterations 2000]
+//                    [--json results.jsonl] [--label v7.1.0]
+//
+//With --json, every result is appended to the file as one line of JSON, labelled so runs on different releases
+//can be compared.
+
+std::atomic<uint64_t> allocations( 0 );
+std::atomic<uint64_t> allocatedBytes( 0 );
+
+void* operator new( size_t size )
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    allocatedBytes.fetch_add( size, std::memory_order_relaxed );
+    void* p = malloc( size == 0 ? 1 : size );
+    if ( p == nullptr )
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+    free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+    free( p );
+}
+
+struct BenchResult
+{
+    std::string operation;
+    std::string cache; //warm or cold
+    size_t features = 0;
+    size_t variables = 0;
+    long long fileBytes = 0;
+    int calls = 0;
+    double p50 = 0; //ns per call
+    double p99 = 0;
+    double mean = 0;
+    double allocationsPerCall = 0;
+    double bytesPerCall = 0;
+};
+
+//Pushes our data out of the CPU caches by writing a buffer bigger than the last level cache, and the license file
+//out of the OS file cache.
+void EvictCaches( const std::string& licenseFile )
+{
+    static std::vector<char> buffer;
+    if ( buffer.empty() )
+    {
+        long cache = sysconf( _SC_LEVEL3_CACHE_SIZE );
+        buffer.resize( std::max<long>( cache > 0 ? cache : 0, 32L << 20 ) * 2 );
+    }
+    for ( size_t i = 0; i < buffer.size(); i += 64 )
+        buffer[ i ]++;
+    int fd = open( licenseFile.c_str(), O_RDONLY );
+    if ( fd >= 0 )
+    {
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+}
+
+long long FileSize( const std::string& path )
+{
+    struct stat info;
+    return stat( path.c_str(), &info ) == 0 ? (long long)info.st_size : 0;
+}
+
+//Calls f calls times and measures each call. Warm calls are timed in batches, since the fastest of them (isActive)
+//take less time than reading the clock. Cold calls are timed one at a time, each after evicting the caches.
+BenchResult Measure( const std::string& operation, bool cold, int calls, const std::string& licenseFile,
+    const std::function<void()>& f )
+{
+    using clock_type = std::chrono::steady_clock;
+    const int batch = cold ? 1 : 64;
+    int batches = std::max( 1, calls / batch );
+    if ( cold )
+        batches = std::max( 1, calls / 20 ); //evicting takes milliseconds, so fewer cold calls
+
+    for ( int i = 0; i < batch * 4; i++ )
+        f(); //warm up, and any lazy initialization
+
+    std::vector<double> samples;
+    samples.reserve( batches );
+    uint64_t allocationsBefore = 0, bytesBefore = 0, allocationsDuring = 0, bytesDuring = 0;
+    for ( int b = 0; b < batches; b++ )
+    {
+        if ( cold )
+            EvictCaches( licenseFile );
+        allocationsBefore = allocations.load( std::memory_order_relaxed );
+        bytesBefore = allocatedBytes.load( std::memory_order_relaxed );
+        auto start = clock_type::now();
+        for ( int i = 0; i < batch; i++ )
+            f();
+        auto took = std::chrono::duration<double, std::nano>( clock_type::now() - start ).count();
+        allocationsDuring += allocations.load( std::memory_order_relaxed ) - allocationsBefore;
+        bytesDuring += allocatedBytes.load( std::memory_order_relaxed ) - bytesBefore;
+        samples.push_back( took / batch );
+    }
+
+    BenchResult result;
+    result.operation = operation;
+    result.cache = cold ? "cold" : "warm";
+    result.calls = batches * batch;
+    std::sort( samples.begin(), samples.end() );
+    result.p50 = samples[ samples.size() / 2 ];
+    result.p99 = samples[ std::min( samples.size() - 1, samples.size() * 99 / 100 ) ];
+    for ( double sample : samples )
+        result.mean += sample / samples.size();
+    result.allocationsPerCall = (double)allocationsDuring / result.calls;
+    result.bytesPerCall = (double)bytesDuring / result.calls;
+    return result;
+}
+
+std::vector<std::string> Split( const std::string& list )
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while ( start <= list.size() && !list.empty() )
+    {
+        size_t end = list.find( ',', start );
+        if ( end == std::string::npos )
+            end = list.size();
+        items.push_back( list.substr( start, end - start ) );
+        start = end + 1;
+    }
+    return items;
+}
+
+std::string Json( const BenchResult& result, const std::string& label )
+{
+    char line[ 1024 ];
+    snprintf( line, sizeof( line ), "{\"label\": \"%s\", \"time\": %lld, \"compiler\": \"%s\", \"operation\": \"%s\", "
+        "\"cache\": \"%s\", \"features\": %zu, \"variables\": %zu, \"file_bytes\": %lld, \"calls\": %d, "
+        "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"mean_ns\": %.1f, \"allocations_per_call\": %.2f, \"bytes_per_call\": %.1f}",
+        label.c_str(), (long long)time( nullptr ), __VERSION__, result.operation.c_str(), result.cache.c_str(),
+        result.features, result.variables, result.fileBytes, result.calls, result.p50, result.p99, result.mean,
+        result.allocationsPerCall, result.bytesPerCall );
+    return line;
+}
+
+//Runs every operation warm and cold on one license as it is now.
+std::vector<BenchResult> BenchLicense( std::shared_ptr<LicenseManager> licenseManager, License::ptr_t license,
+    const std::string& licenseFile, int calls )
+{
+    //Looking up the last feature is the worst case if the SDK searches them in order.
+    std::vector<LicenseFeature> features = license->features();
+    std::string featureCode = features.empty() ? "" : features.back().code();
+
+    std::vector<std::pair<std::string, std::function<void()>>> operations = {
+        { "reloadLicense", [ & ]() { licenseManager->reloadLicense(); } },
+        { "getCurrentLicense", [ & ]() { licenseManager->getCurrentLicense(); } },
+        { "localCheck", [ & ]() { license->localCheck(); } },
+        { "customFields", [ & ]() { license->customFields(); } },
+        { "getDeviceVariables", [ & ]() { license->getDeviceVariables( false ); } },
+        { "isActive", [ & ]() { license->isActive(); } },
+        { "isExpired", [ & ]() { license->isExpired(); } } };
+    if ( !featureCode.empty() )
+        operations.push_back( { "feature", [ & ]() { license->feature( featureCode ); } } );
+
+    std::vector<BenchResult> results;
+    for ( bool cold : { false, true } )
+        for ( auto& operation : operations )
+        {
+            BenchResult result = Measure( operation.first, cold, calls, licenseFile, operation.second );
+            result.features = features.size();
+            result.variables = license->getDeviceVariables( false ).size();
+            result.fileBytes = FileSize( licenseFile );
+            results.push_back( result );
+        }
+    return results;
+}
+
+int main( int argc, char* argv[] )
+{
+    std::vector<std::string> keys = { "XXXX-XXXX-XXXX-XXXX" }; //input license keys, e.g. one with few and one with many features
+    std::vector<size_t> variableCounts = { 0, 10, 100, 1000 };
+    int calls = 2000;
+    std::string jsonPath;
+    std::string label = "unlabelled";
+    for ( int i = 1; i + 1 < argc; i += 2 )
+    {
+        std::string arg = argv[i];
+        if ( arg == "--keys" )
+            keys = Split( argv[i + 1] );
+        else if ( arg == "--variables" )
+        {
+            variableCounts.clear();
+            for ( const std::string& count : Split( argv[i + 1] ) )
+                variableCounts.push_back( (size_t)atol( count.c_str() ) );
+        }
+        else if ( arg == "--iterations" )
+            calls = atoi( argv[i + 1] );
+        else if ( arg == "--json" )
+            jsonPath = argv[i + 1];
+        else if ( arg == "--label" )
+            label = argv[i + 1];
+        else
+        {
+            std::cout << "Unrecognized option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream json;
+    if ( !jsonPath.empty() )
+        json.open( jsonPath, std::ios::app );
+
+    char line[ 256 ];
+    snprintf( line, sizeof( line ), "%-20s %-5s %8s %9s %10s %12s %12s %10s %12s", "operation", "cache", "features",
+        "variables", "file bytes", "p50 ns", "p99 ns", "allocs", "alloc bytes" );
+    std::cout << line << std::endl;
+
+    for ( size_t k = 0; k < keys.size(); k++ )
+    {
+        //Each license gets its own license file, so the variables we add don't end up in your app's license.
+        std::string licenseFile = "local_benchmark_" + std::to_string( k ) + ".lic";
+        ExtendedOptions options;
+        options.setLicenseFilePath( std::wstring( licenseFile.begin(), licenseFile.end() ) );
+
+        std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+            EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+            EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+            EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+            "NAME", "VERSION", options ); //input name and version of application
+
+        try
+        {
+            std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+            License::ptr_t license = licenseManager->reloadLicense();
+            if ( license == nullptr )
+                license = licenseManager->activateLicense( LicenseID::fromKey( keys[k] ) );
+
+            size_t variables = license->getDeviceVariables( false ).size();
+            for ( size_t target : variableCounts )
+            {
+                //Grows the license file: the variables are added without saving, and the last one saves them all.
+                for ( ; variables < target; variables++ )
+                    license->addDeviceVariable( "bench_" + std::to_string( variables ), std::string( 16, 'x' ),
+                        variables + 1 == target );
+                if ( variables > target )
+                    continue; //the license already had more
+                for ( const BenchResult& result : BenchLicense( licenseManager, license, licenseFile, calls ) )
+                {
+                    snprintf( line, sizeof( line ), "%-20s %-5s %8zu %9zu %10lld %12.1f %12.1f %10.2f %12.1f",
+                        result.operation.c_str(), result.cache.c_str(), result.features, result.variables,
+                        result.fileBytes, result.p50, result.p99, result.allocationsPerCall, result.bytesPerCall );
+                    std::cout << line << std::endl;
+                    if ( json.is_open() )
+                        json << Json( result, label ) << std::endl;
+                }
+            }
+        }
+        catch ( LicenseSpringException ex )
+        {
+            std::cout << keys[k] << ": " << ex.what() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
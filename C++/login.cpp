@@ -7,12 +7,49 @@
 #include <time.h>
 #include <iostream>
 #include <thread>
+#include "SingleFlight.h"
+#include "Clock.h"
 
 using namespace LicenseSpring;
 
 // 
 //License Checking function at bottom of code. Shows how to do an online check and sync, as well as a local check.
-void LicenseCheck( License::ptr_t license );
+//Returns when the online check it used was made, on the steady clock.
+std::chrono::steady_clock::time_point LicenseCheck( License::ptr_t license );
+
+//Concurrent LicenseCheck() calls share one online check (see SingleFlight.h).
+const std::chrono::seconds checkFreshness( 5 );
+CoalescedLicenseCalls onlineCalls( checkFreshness );
+
+//The idle logout below reads the time from appClock. A test can swap in a SimulatedClock (see Clock.h) and
+//advance it past the 60 seconds instead of waiting for them.
+std::shared_ptr<Clock> appClock = SystemClock::instance();
+
+//When the user was last active, on appClock. The SDK records the license's last check in real time, so we read
+//that once when the license is checked and count on appClock from there, instead of comparing the two clocks.
+Clock::steady_time lastActive;
+
+void ResetIdleTimer( License::ptr_t license )
+{
+    //Right after a reload or an activation, the license's last check is the one we want.
+    tm last_checked = license->lastCheckDate();
+    double sinceCheck = std::max( 0.0, difftime( time( nullptr ), mktime( &last_checked ) ) );
+    lastActive = appClock->steadyNow() - std::chrono::seconds( (int64_t)sinceCheck );
+}
+
+//After LicenseCheck(), the check may have been answered from onlineCalls' cache without updating the license's
+//last check date, so we count from when the cached result was stored instead.
+void ResetIdleTimer( std::chrono::steady_clock::time_point checkedAt )
+{
+    auto sinceCheck = std::max( std::chrono::steady_clock::duration::zero(), std::chrono::steady_clock::now() - checkedAt );
+    lastActive = appClock->steadyNow() - sinceCheck;
+}
+
+//The amount of time since the user was last active, in seconds.
+int64_t IdleSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>( appClock->steadyNow() - lastActive ).count();
+}
 
 //Our console ChatBot login program using LicenseSpring activation/deactivations/checking
 int main()
@@ -42,6 +79,7 @@ int main()
         license = licenseManager->reloadLicense();
         if ( license != nullptr ) 
         {
+            ResetIdleTimer( license );
             license->localCheck(); //always good to do a local check whenever you run your program 
         }
     }
@@ -185,21 +223,15 @@ int main()
             //If our activation was succesful, license should be pointing to a local license copy.
             if ( license != nullptr ) 
             {
+                ResetIdleTimer( license );
                 std::cout << "Successfully logged in on account: " << email << std::endl;
             }
         }
         else //Case where we have a local license file, and therefore we are logged in.
         { 
-            //Collect the date that our license was last checked. Note, an activation
+            //The user is idle from the last time the license was checked. Note, an activation
             //also includes a check.
-            tm last_checked = license->lastCheckDate();
-            time_t timer;
-            double seconds;
-
-            time( &timer ); 
-            
-            //The amount of time since our last check in seconds
-            seconds = difftime( timer, mktime( &last_checked ) );
+            int64_t seconds = IdleSeconds();
 
             //Note, if you want a longer period, such as days, you can use
             //int days = license->daysPassedSinceLastCheck()
@@ -208,6 +240,7 @@ int main()
                 std::cout << "You have been inactive for longer than 60 seconds, "
                           << "you have been automatically logged out." << std::endl;
                 license->deactivate( true ); //We'll deactivate/log off user if they have been idle 
+                onlineCalls.invalidate( license );
                 continue;
             }
 
@@ -221,16 +254,14 @@ int main()
             std::getline( std::cin, sInput );
 
             //We'll check again to see if the user timed out.
-            last_checked = license->lastCheckDate();
-
-            time( &timer );
-            seconds = difftime(timer, mktime(&last_checked));
+            seconds = IdleSeconds();
 
             if (seconds > 60)
             {
                 std::cout << "You have been inactive for longer than 60 seconds, "
                     << "you have been automatically logged out." << std::endl;
                 license->deactivate(true);
+                onlineCalls.invalidate( license );
                 continue;
             }
 
@@ -244,6 +275,7 @@ int main()
                 //license file by setting the parameter in deactivate to be true.
                 std::cout << "Logging out" << std::endl;
                 license->deactivate( true );
+                onlineCalls.invalidate( license );
                 std::cout << "Logged out." << std::endl;
             }
             else if ( sInput.compare( "p" ) == 0 ) 
@@ -286,7 +318,7 @@ int main()
             else if ( sInput.compare( "c" ) == 0 ) 
             {
                 //Perform an online check and offline local check
-                LicenseCheck( license );
+                ResetIdleTimer( LicenseCheck( license ) );
             }
             else 
             {
@@ -298,8 +330,9 @@ int main()
     return 0;
 }
 
-void LicenseCheck( License::ptr_t license )
+std::chrono::steady_clock::time_point LicenseCheck( License::ptr_t license )
 {
+    auto checkedAt = std::chrono::steady_clock::now();
     //First we'll run a online check. This will check your license on the 
     //LicenseSpring servers, and sync up your local license to match your online
     if ( license != nullptr )
@@ -307,7 +340,7 @@ void LicenseCheck( License::ptr_t license )
         try
         {
             std::cout << "Checking license online..." << std::endl;
-            license->check();
+            checkedAt = onlineCalls.check( license );
             std::cout << "License successfully checked" << std::endl;
         }
         catch ( LicenseStateException )
@@ -362,4 +395,5 @@ void LicenseCheck( License::ptr_t license )
     {
         std::cout << "No local license found";
     }
+    return checkedAt;
 }
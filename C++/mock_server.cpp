@@ -0,0 +1,119 @@
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "MockServer.h"
+
+//Sample code for a local stand-in for the LicenseSpring servers (see MockServer.h), for load and integration
+//testing. Linux only.
+//
+//    mock_server [--port 8080] [--threads N] [--licenses 1000] [--latency MS] [--jitter MS]
+//                [--error-rate 0.01] [--drop-rate 0.01] [--stall-rate 0.01] [--fault-path /api/v4/check_license]
+//
+//The licenses are MOCK-0000-0000, MOCK-0000-0001, ... and any hardware ID can activate them, e.g.
+//
+//    curl -d '{"license_key":"MOCK-0000-0000","hardware_id":"pc1"}' localhost:8080/api/v4/activate_license
+//    curl 'localhost:8080/api/v4/check_license?license_key=MOCK-0000-0000&hardware_id=pc1'
+//    curl -d '{"license_key":"MOCK-0000-0000","hardware_id":"pc1","consumptions":2,"get_variables":true}' localhost:8080/api/v4/sync
+//    curl -d '{"license_key":"MOCK-0000-0000","enabled":false}' localhost:8080/mock/change
+//
+//It prints how many requests a second it answers until you stop it with Ctrl+C.
+int main( int argc, char* argv[] )
+{
+    MockServerOptions options;
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if ( value == nullptr )
+        {
+            std::cout << "Missing a value for " << arg << std::endl;
+            return 1;
+        }
+        if ( arg == "--host" )
+            options.host = value;
+        else if ( arg == "--port" )
+            options.port = atoi( value );
+        else if ( arg == "--threads" )
+            options.threads = atoi( value );
+        else if ( arg == "--licenses" )
+            options.licenses = atoi( value );
+        else if ( arg == "--latency" )
+            options.latency = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--jitter" )
+            options.jitter = std::chrono::milliseconds( atoi( value ) );
+        else if ( arg == "--error-rate" )
+            options.errorRate = atof( value );
+        else if ( arg == "--drop-rate" )
+            options.dropRate = atof( value );
+        else if ( arg == "--stall-rate" )
+            options.stallRate = atof( value );
+        else if ( arg == "--fault-path" )
+            options.faultPath = value;
+        else
+        {
+            std::cout << "Unrecognized option " << arg << std::endl;
+            return 1;
+        }
+        i++;
+    }
+
+    //We wait for Ctrl+C ourselves instead of being killed by it, so the server can stop cleanly.
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+
+    MockServer server( options );
+    try
+    {
+        server.start();
+    }
+    catch ( std::runtime_error ex )
+    {
+        std::cout << ex.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Listening on " << options.host << ":" << server.port() << " with " << options.threads << " threads, "
+        << options.licenses << " licenses." << std::endl;
+
+    //Prints the request rate once a second until we stop it.
+    std::mutex reporterMutex;
+    std::condition_variable reporterWake;
+    bool stopping = false;
+    std::thread reporter( [ & ]()
+        {
+            uint64_t last = 0;
+            std::unique_lock<std::mutex> lock( reporterMutex );
+            while ( !reporterWake.wait_for( lock, std::chrono::seconds( 1 ), [ & ]() { return stopping; } ) )
+            {
+                MockServer::Stats stats = server.stats();
+                if ( stats.total() != last )
+                    std::cout << stats.total() - last << " requests/s, " << stats.connections << " connections so far" << std::endl;
+                last = stats.total();
+            }
+        } );
+
+    int signal;
+    sigwait( &signals, &signal );
+    {
+        std::lock_guard<std::mutex> lock( reporterMutex );
+        stopping = true;
+    }
+    reporterWake.notify_all();
+    reporter.join();
+    server.stop();
+
+    MockServer::Stats stats = server.stats();
+    std::cout << std::endl << stats.total() << " requests:" << std::endl;
+    for ( int i = 0; i < MockLicenseApi::EndpointCount; i++ )
+        if ( stats.requests[i] > 0 )
+            std::cout << "    " << MockLicenseApi::endpointName( (MockLicenseApi::Endpoint)i ) << ": " << stats.requests[i] << std::endl;
+    std::cout << stats.errors << " errors, " << stats.drops << " drops and " << stats.stalls << " stalls injected." << std::endl;
+    return 0;
+}
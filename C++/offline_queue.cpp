@@ -0,0 +1,238 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+#include "CircuitBreaker.h"
+#include "OperationQueue.h"
+
+using namespace LicenseSpring;
+
+//Sends one queued operation to the LicenseSpring servers.
+bool SendToLicenseSpring( License::ptr_t license, const QueuedOperation& op );
+
+//The queue's thread sends with the same License object the menu below uses, and a License isn't meant to be used
+//from two threads at once, so both sides lock this. A send holds it for as long as the SDK waits for the server,
+//which until networkGuard gives up on an unreachable server can be a full network timeout for each attempt. So the
+//menu doesn't wait longer than menuWait for it, and tells the user to try again instead.
+std::timed_mutex licenseMutex;
+const std::chrono::seconds menuWait( 2 );
+
+template <typename Call>
+void UseLicense( License::ptr_t license, Call call )
+{
+    if ( license == nullptr )
+        return;
+    std::lock_guard<std::timed_mutex> lock( licenseMutex );
+    call( *license );
+}
+
+template <typename Call>
+void UseLicenseFromMenu( License::ptr_t license, Call call )
+{
+    if ( license == nullptr )
+        return;
+    std::unique_lock<std::timed_mutex> lock( licenseMutex, menuWait );
+    if ( !lock.owns_lock() )
+        throw std::runtime_error( "The license is busy syncing with the LicenseSpring servers, please try again." );
+    call( *license );
+}
+
+//A stand-in for the LicenseSpring backend that lives inside this program, so you can see what happens to queued
+//operations when the backend goes away and comes back without unplugging your network cable. Run the sample
+//with --mock to use it, then type 'o' to switch it off and on.
+class MockBackend
+{
+public:
+    bool send( const QueuedOperation& op )
+    {
+        if ( !online )
+            return false; //what the real backend looks like when we can't reach it
+        if ( op.type == QueuedOperation::SyncConsumption )
+            consumption += op.amount;
+        else if ( op.type == QueuedOperation::SyncFeatureConsumption )
+            featureConsumption += op.amount;
+        requests++;
+        return true;
+    }
+
+    std::atomic<bool> online{ true };
+    std::atomic<int> consumption{ 0 };
+    std::atomic<int> featureConsumption{ 0 };
+    std::atomic<int> requests{ 0 };
+};
+
+NetworkGuard networkGuard;
+
+//Sample code for working with consumptions, features and device variables when the network isn't always there.
+//Every online call is put into an OperationQueue (see OperationQueue.h) instead of being made directly. The queue
+//writes it to a file on disk, and a background thread sends it once the backend can be reached, so the user is
+//never kept waiting and nothing is lost if the app is closed while offline. Repeated operations are merged
+//before they are sent, so using 50 consumptions offline becomes a single sync once we are back online.
+int main( int argc, char* argv[] )
+{
+    bool useMock = argc > 1 && strcmp( argv[1], "--mock" ) == 0;
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    MockBackend mock;
+    License::ptr_t license = nullptr;
+
+    if ( !useMock )
+    {
+        //Collecting network info
+        ExtendedOptions options;
+        options.collectNetworkInfo( true );
+
+        std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+            EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+            EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+            EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+            appName, appVersion, options );
+
+        //Key-based implementation
+        auto licenseId = LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ); //input license key
+
+        std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+
+        //Find our local license if we have one stored on our device, otherwise activate it. Activation has to
+        //happen online, the queue is only for work we can do without waiting on the server.
+        try
+        {
+            license = licenseManager->reloadLicense();
+            if ( license == nullptr )
+                license = licenseManager->activateLicense( licenseId );
+            license->localCheck();
+        }
+        catch ( LicenseSpringException ex )
+        {
+            std::cout << ex.what() << std::endl;
+            return 0;
+        }
+    }
+
+    //The journal is kept next to the program. Anything still in it from the last run (e.g. if we were closed
+    //while offline) is loaded and sent first.
+    OperationQueue queue( "license_operations.journal", [ & ]( const QueuedOperation& op )
+        {
+            return useMock ? mock.send( op ) : SendToLicenseSpring( license, op );
+        } );
+    queue.setFailureCallback( []( const QueuedOperation&, const std::string& what )
+        {
+            //The server answered, but rejected the operation (e.g. not enough consumptions left), so retrying
+            //won't help. Here we just let the user know.
+            std::cout << std::endl << "Server rejected a queued operation: " << what << std::endl;
+        } );
+    queue.setRetryDelay( std::chrono::seconds( 1 ), std::chrono::seconds( 30 ) );
+    if ( queue.pending() > 0 )
+        std::cout << queue.pending() << " operations from the last run are waiting to be sent." << std::endl;
+    queue.start();
+
+    std::string sInput = "";
+    while ( sInput.compare( "e" ) != 0 )
+    {
+        std::cout << "Type 'y' to use a consumption, 'f' to use a feature consumption, 'd' to add a device variable, "
+            << "'c' to check the license, 'p' to see pending operations";
+        if ( useMock )
+            std::cout << ", 'o' to switch the mock backend " << ( mock.online ? "off" : "on" );
+        std::cout << " or 'e' to exit." << std::endl;
+        std::cout << ">";
+        std::getline( std::cin, sInput );
+
+        try
+        {
+            //For each of these, the local part happens right away (and is saved to our local license file, so it
+            //survives a restart), and only the sync with the backend goes through the queue.
+            if ( sInput.compare( "y" ) == 0 )
+            {
+                UseLicenseFromMenu( license, []( License& l ) { l.updateConsumption( 1, true ); } );
+                queue.submit( QueuedOperation::consumption( 1 ) );
+                std::cout << "You've just used one consumption." << std::endl;
+            }
+            else if ( sInput.compare( "f" ) == 0 )
+            {
+                UseLicenseFromMenu( license, []( License& l ) { l.updateFeatureConsumption( "XXXXXX", 1, true ); } ); //Input consumption feature code
+                queue.submit( QueuedOperation::featureConsumption( "XXXXXX", 1 ) ); //Input consumption feature code
+                std::cout << "You've just used one feature consumption." << std::endl;
+            }
+            else if ( sInput.compare( "d" ) == 0 )
+            {
+                UseLicenseFromMenu( license, []( License& l ) { l.addDeviceVariable( "last_used", std::to_string( time( nullptr ) ) ); } );
+                queue.submit( QueuedOperation::deviceVariables() );
+            }
+            else if ( sInput.compare( "c" ) == 0 )
+            {
+                //The local check doesn't need the network, the online check is queued.
+                UseLicenseFromMenu( license, []( License& l ) { l.localCheck(); } );
+                queue.submit( QueuedOperation::check() );
+            }
+            else if ( sInput.compare( "p" ) == 0 )
+            {
+                std::cout << queue.pending() << " operations waiting to be sent." << std::endl;
+                if ( useMock )
+                    std::cout << "The mock backend has received " << mock.requests << " requests, with "
+                        << mock.consumption << " consumptions and " << mock.featureConsumption
+                        << " feature consumptions." << std::endl;
+            }
+            else if ( useMock && sInput.compare( "o" ) == 0 )
+            {
+                mock.online = !mock.online;
+                std::cout << "Mock backend is now " << ( mock.online ? "online" : "offline" ) << "." << std::endl;
+                //The queue would find out on its next retry anyway, this just saves waiting for it.
+                if ( mock.online )
+                    queue.retryNow();
+            }
+            else if ( sInput.compare( "e" ) != 0 )
+                std::cout << "Unrecognized command." << std::endl;
+        }
+        catch ( NotEnoughConsumptionException )
+        {
+            std::cout << "You are out of consumptions." << std::endl;
+        }
+        catch ( LicenseSpringException ex )
+        {
+            std::cout << ex.what() << std::endl;
+        }
+        catch ( std::runtime_error ex )
+        { //The queue couldn't write the operation to disk, so it isn't queued, or the license was busy.
+            std::cout << ex.what() << std::endl;
+        }
+    }
+
+    //We'll give the queue a few seconds to send what's left. Whatever isn't sent stays in the journal and will be
+    //sent next time the program runs.
+    if ( !queue.waitUntilEmpty( std::chrono::seconds( 5 ) ) )
+        std::cout << queue.pending() << " operations will be sent next time." << std::endl;
+    queue.stop();
+    return 0;
+}
+
+bool SendToLicenseSpring( License::ptr_t license, const QueuedOperation& op )
+{
+    //Going through the network guard means that, while the servers are down, these fail fast instead of each
+    //waiting for a timeout. tryCall returns false when the server couldn't be reached, which tells the queue
+    //to keep the operation and try again later. If the server answers with an error, the exception is thrown
+    //and the queue reports it to our failure callback.
+    switch ( op.type )
+    {
+        case QueuedOperation::Check:
+            return networkGuard.tryCall( Endpoint::Check, [ & ]() { UseLicense( license, []( License& l ) { l.check(); } ); } );
+        case QueuedOperation::SyncConsumption:
+            //Our local license already holds the consumptions we used, syncConsumption sends them all at once.
+            return networkGuard.tryCall( Endpoint::Consumption, [ & ]() { UseLicense( license, []( License& l ) { l.syncConsumption(); } ); } );
+        case QueuedOperation::SyncFeatureConsumption:
+            return networkGuard.tryCall( Endpoint::Consumption,
+                [ & ]() { UseLicense( license, [ & ]( License& l ) { l.syncFeatureConsumption( op.feature ); } ); } );
+        case QueuedOperation::SendDeviceVariables:
+            return networkGuard.tryCall( Endpoint::Check, [ & ]() { UseLicense( license, []( License& l ) { l.sendDeviceVariables(); } ); } );
+    }
+    return true;
+}
@@ -0,0 +1,172 @@
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "DeviceFingerprint.h"
+#include "ProductSuite.h"
+
+using namespace LicenseSpring;
+
+int RunMock( int products, int roundTripMs );
+
+//Sample code for licensing a suite of products from one process (see ProductSuite.h): one hardware ID, one folder
+//for the license files, and every product's activation and check at the same time, within one rate limit.
+//
+//Run with --mock [products] [round trip in ms] to compare refreshing the products one after the other with
+//refreshing them as a suite, using made-up delays instead of the LicenseSpring servers.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock( argc > 2 ? atoi( argv[2] ) : 12, argc > 3 ? atoi( argv[3] ) : 300 );
+
+    SuiteSettings settings;
+    settings.apiKey = EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ); // your LicenseSpring API key (UUID)
+    settings.sharedKey = EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ); // your LicenseSpring Shared key
+    settings.appName = "NAME"; //input name of application
+    settings.appVersion = "VERSION"; //input version of application
+    //The SDK's hardware ID, cached (see DeviceFingerprint.h). It doesn't depend on the product, any of the suite's
+    //product codes will do for working it out.
+    DeviceFingerprint device( DeviceFingerprint::defaultCachePath( settings.appName ), settings.sharedKey, [ & ]()
+        {
+            ExtendedOptions sdkOptions;
+            sdkOptions.collectNetworkInfo( false );
+            return Configuration::Create( settings.apiKey, settings.sharedKey, "XXXXXX", settings.appName,
+                settings.appVersion, sdkOptions )->getDeviceId();
+        } );
+    settings.options.setHardwareID( device.hardwareId() );
+    settings.options.collectNetworkInfo( false );
+    settings.storageFolder = "licenses";
+
+    WorkerPool backgroundWork;
+    ProductSuite suite( settings, &backgroundWork );
+    //Each product code you specified in LicenseSpring, with the license key for it.
+    suite.add( "XXXXXX", LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ) );
+    suite.add( "YYYYYY", LicenseID::fromKey( "YYYY-YYYY-YYYY-YYYY" ) );
+    suite.add( "ZZZZZZ", LicenseID::fromKey( "ZZZZ-ZZZZ-ZZZZ-ZZZZ" ) );
+
+    auto start = std::chrono::steady_clock::now();
+    suite.refreshAll();
+    //The local licenses are published before anything goes online, so the app could show what it has right
+    //away and update as the checks come back. For the sample, we wait for all of them.
+    suite.wait();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    for ( size_t i = 0; i < suite.size(); i++ )
+    {
+        auto entitlement = suite.entitlement( i );
+        std::cout << suite.productCode( i ) << ": " << entitlementName( entitlement->state )
+            << ( entitlement->trial ? " (trial)" : "" ) << ( entitlement->checkedOnline ? "" : ", not checked online" );
+        if ( !entitlement->error.empty() )
+            std::cout << ", " << entitlement->error;
+        std::cout << std::endl;
+    }
+    std::cout << suite.size() << " products refreshed in " << ms << " ms." << std::endl;
+    return 0;
+}
+
+//A product with made-up delays: a few milliseconds to read the license file, roundTripMs for each server call.
+//The first product has no local license yet and the last one has been disabled on the server.
+class MockProduct : public SuiteProduct
+{
+public:
+    MockProduct( int roundTripMs, bool activated, bool disabled )
+        : m_roundTripMs( roundTripMs ), m_activated( activated ), m_disabled( disabled )
+    {}
+
+    ProductEntitlement loadLocal() override
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+        return state( m_activated );
+    }
+
+    ProductEntitlement activate() override
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( m_roundTripMs ) );
+        return state( true );
+    }
+
+    ProductEntitlement check() override
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( m_roundTripMs ) );
+        ProductEntitlement entitlement = state( true );
+        if ( m_disabled )
+            entitlement.state = EntitlementState::Disabled;
+        return entitlement;
+    }
+
+private:
+    static ProductEntitlement state( bool activated )
+    {
+        ProductEntitlement entitlement;
+        entitlement.state = activated ? EntitlementState::Entitled : EntitlementState::NotActivated;
+        return entitlement;
+    }
+
+    int m_roundTripMs;
+    bool m_activated;
+    bool m_disabled;
+};
+
+int RunMock( int products, int roundTripMs )
+{
+    auto code = []( int i ) { return "PRODUCT" + std::to_string( i + 1 ); };
+    auto makeProduct = [ & ]( int i ) { return std::make_shared<MockProduct>( roundTripMs, i != 0, i == products - 1 ); };
+
+    //Before: a configuration per product, checked one after the other.
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < products; i++ )
+    {
+        auto product = makeProduct( i );
+        if ( product->loadLocal().state == EntitlementState::NotActivated )
+            product->activate();
+        else
+            product->check();
+    }
+    auto sequentialMs = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    //After: the suite, allowed 8 requests a second with bursts of 4. With short round trips the rate limit is
+    //what sets the pace, as it should.
+    SuiteSettings settings;
+    settings.requestsPerSecond = 8;
+    settings.burst = 4;
+    WorkerPool backgroundWork;
+    ProductSuite suite( settings, &backgroundWork );
+    for ( int i = 0; i < products; i++ )
+        suite.add( code( i ), makeProduct( i ) );
+    start = std::chrono::steady_clock::now();
+    suite.refreshAll();
+    std::chrono::milliseconds firstView( -1 );
+    while ( !suite.waitFor( std::chrono::milliseconds( 1 ) ) )
+        if ( firstView.count() < 0 && suite.entitled( code( products / 2 ) ) )
+            firstView = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+    auto suiteMs = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+
+    //The combined view is read all the time, e.g. each time a menu is drawn.
+    std::vector<std::string> codes;
+    for ( int i = 0; i < products; i++ )
+        codes.push_back( code( i ) );
+    const int lookups = 1000000;
+    int entitled = 0;
+    auto lookupStart = std::chrono::steady_clock::now();
+    for ( int i = 0; i < lookups; i++ )
+        entitled += suite.entitled( codes[ i % products ] ) ? 1 : 0;
+    double lookupNs = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - lookupStart ).count() / lookups;
+
+    for ( size_t i = 0; i < suite.size(); i++ )
+        std::cout << "  " << suite.productCode( i ) << ": " << entitlementName( suite.entitlement( i )->state ) << std::endl;
+    SuiteMetrics metrics = suite.metrics();
+    std::cout << products << " products, " << roundTripMs << " ms round trip:" << std::endl;
+    std::cout << "  one after the other: " << sequentialMs << " ms" << std::endl;
+    std::cout << "  as a suite:          " << suiteMs << " ms, " << metrics.onlineCalls << " server calls, "
+        << metrics.rateLimited.count() << " ms waited for the rate limit in total" << std::endl;
+    std::cout << "  " << code( products / 2 ) << " usable from its local license after " << firstView.count() << " ms" << std::endl;
+    std::cout << "  entitled( code ): " << lookupNs << " ns a lookup (" << entitled << " entitled)" << std::endl;
+    bool ok = metrics.onlineCalls == (uint64_t)products && suite.entitlement( products - 1 )->state == EntitlementState::Disabled;
+    for ( int i = 0; i + 1 < products; i++ )
+        ok = ok && suite.entitled( codes[ i ] );
+    return ok ? 0 : 1;
+}
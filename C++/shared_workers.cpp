@@ -0,0 +1,282 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "SharedLicenseState.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+using namespace LicenseSpring;
+
+//Name of the device variable the owner records how far it synced each counter in, see LicenseOwner::sync().
+//Feature counters get the feature code appended.
+const std::string syncedVariable = "shared_synced";
+
+//The owner's side, using the LicenseSpring SDK. Only the process that is currently the owner loads the license.
+class LicenseOwner : public SharedLicenseOwner
+{
+public:
+    explicit LicenseOwner( std::shared_ptr<LicenseManager> licenseManager ) : m_licenseManager( licenseManager ) {}
+
+    std::map<std::string, int64_t> takeOver( uint64_t generation ) override
+    {
+        m_license = m_licenseManager->reloadLicense();
+        if ( m_license == nullptr )
+            throw LicenseStateException( "No local license, activate it first" );
+        m_license->localCheck();
+
+        //Each variable holds "<generation> <counter value>". Values from an older segment (e.g. from before a
+        //reboot) don't apply to this one's counters.
+        std::map<std::string, int64_t> synced;
+        for ( DeviceVariable variable : m_license->getDeviceVariables( false ) )
+        {
+            if ( variable.name().compare( 0, syncedVariable.size(), syncedVariable ) != 0 )
+                continue;
+            uint64_t recordedGeneration = 0;
+            long long through = 0;
+            if ( sscanf( variable.value().c_str(), "%llu %lld", (unsigned long long*)&recordedGeneration, &through ) == 2 &&
+                recordedGeneration == generation )
+                synced[ variable.name().substr( syncedVariable.size() ) ] = through;
+        }
+        return synced;
+    }
+
+    void sync( uint64_t generation, std::vector<SharedCounterSync>& counters, SharedLicenseSnapshot& snapshot ) override
+    {
+        //First the consumptions go into the license, along with how far into each counter they go, and all of
+        //it is saved to the license file at once. If we crash after this, the next owner knows these are in.
+        bool changed = false;
+        for ( const SharedCounterSync& counter : counters )
+        {
+            if ( counter.delta == 0 )
+                continue;
+            if ( counter.feature.empty() )
+                m_license->updateConsumption( (int)counter.delta, false );
+            else
+                m_license->updateFeatureConsumption( counter.feature, (int)counter.delta, false );
+            m_license->addDeviceVariable( syncedVariable + counter.feature,
+                std::to_string( generation ) + " " + std::to_string( counter.spentThrough ), false );
+            changed = true;
+        }
+        if ( changed )
+            m_license->addDeviceVariable( "shared_synced_at", std::to_string( time( nullptr ) ), true );
+
+        //Then we sync with the server. If that fails, the consumptions are already in our license file and the
+        //next sync will send them.
+        m_license->syncConsumption();
+        for ( SharedCounterSync& counter : counters )
+        {
+            if ( counter.feature.empty() )
+                counter.remaining = m_license->maxConsumption() + m_license->maxOverages() - m_license->totalConsumption();
+            else
+            {
+                m_license->syncFeatureConsumption( counter.feature );
+                LicenseFeature feature = m_license->feature( counter.feature );
+                counter.remaining = feature.maxConsumption() - feature.totalConsumption();
+            }
+        }
+
+        m_license->localCheck();
+        snapshot.valid = m_license->isValid();
+        snapshot.active = m_license->isActive();
+        snapshot.enabled = m_license->isEnabled();
+        snapshot.expired = m_license->isExpired();
+        snapshot.maxConsumption = m_license->maxConsumption();
+        snapshot.maxOverages = m_license->maxOverages();
+        snapshot.totalConsumption = m_license->totalConsumption();
+        snapshot.updatedAt = time( nullptr );
+        strncpy( snapshot.key, m_license->key().c_str(), sizeof( snapshot.key ) - 1 );
+    }
+
+private:
+    std::shared_ptr<LicenseManager> m_licenseManager;
+    License::ptr_t m_license;
+};
+
+int RunDemo( int workers, int consumptionsPerWorker );
+
+//Sample code for an app that runs as several worker processes on one machine. Start this sample in a few
+//terminals at once: they share one license state and consumption counters through shared memory (see
+//SharedLicenseState.h). One of them is elected owner and is the only one that loads the license and talks to the
+//LicenseSpring servers. Close the owner and another one takes over.
+//
+//On Linux and macOS, run with --demo [workers] [consumptions per worker] to see it without a license: it starts
+//worker processes that spend consumptions against a stand-in for the license, kills whichever one is the owner
+//part way through, and checks that every consumption was synced exactly once.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--demo" ) == 0 )
+        return RunDemo( argc > 2 ? atoi( argv[2] ) : 4, argc > 3 ? atoi( argv[3] ) : 20000 );
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    //Collecting network info
+    ExtendedOptions options;
+    options.collectNetworkInfo( true );
+
+    std::shared_ptr<Configuration> pConfiguration = Configuration::Create(
+        EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ), // your LicenseSpring API key (UUID)
+        EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ), // your LicenseSpring Shared key
+        EncryptStr( "XXXXXX" ), // product code that you specified in LicenseSpring for your application
+        appName, appVersion, options );
+
+    std::shared_ptr<LicenseManager> licenseManager = LicenseManager::create( pConfiguration );
+
+    //We name the segment after the product, so every process of this product on the machine finds it.
+    SharedLicenseState shared( "XXXXXX" ); //Input product code
+    shared.start( std::make_shared<LicenseOwner>( licenseManager ) );
+
+    std::string sInput = "";
+    while ( sInput.compare( "e" ) != 0 )
+    {
+        std::cout << "Type 'y' to use a consumption, 'f' to use a feature consumption, 's' to see the license state, "
+            << "or 'e' to exit." << std::endl;
+        std::cout << ">";
+        std::getline( std::cin, sInput );
+
+        if ( sInput.compare( "y" ) == 0 || sInput.compare( "f" ) == 0 )
+        {
+            //Instead of updateConsumption on our own copy of the license, we spend through the shared counter.
+            //The owner adds it to the license with its next sync.
+            std::string feature = sInput.compare( "f" ) == 0 ? "XXXXXX" : ""; //Input consumption feature code
+            if ( shared.tryConsume( 1, feature ) )
+                std::cout << "You've just used one consumption." << std::endl;
+            else
+                std::cout << "You are out of consumptions (or the owner hasn't synced yet)." << std::endl;
+        }
+        else if ( sInput.compare( "s" ) == 0 )
+        {
+            //Instead of localCheck on our own copy of the license, we read what the owner last saw.
+            SharedLicenseSnapshot snapshot = shared.snapshot();
+            std::cout << "Owner process: " << shared.ownerPid() << ( shared.isOwner() ? " (this one)" : "" ) << std::endl;
+            std::cout << "License " << snapshot.key << " is " << ( snapshot.valid ? "valid" : "not valid" )
+                << ( snapshot.expired ? ", expired" : "" ) << ( snapshot.enabled ? "" : ", disabled" ) << std::endl;
+            std::cout << "Consumptions: " << snapshot.totalConsumption << " of " << snapshot.maxConsumption
+                << " as of the last sync, " << shared.unsynced() << " used since." << std::endl;
+            if ( snapshot.error[0] != '\0' )
+                std::cout << "Last sync failed: " << snapshot.error << std::endl;
+        }
+        else if ( sInput.compare( "e" ) != 0 )
+            std::cout << "Unrecognized command." << std::endl;
+    }
+    return 0;
+}
+
+#ifndef _WIN32
+//A stand-in for the license used by --demo. Its "license file" is a small text file that all the demo processes
+//share, holding the total consumption and the counter value the last sync went up to, written in one go.
+class DemoOwner : public SharedLicenseOwner
+{
+public:
+    explicit DemoOwner( const std::string& path ) : m_path( path ) {}
+
+    std::map<std::string, int64_t> takeOver( uint64_t generation ) override
+    {
+        long long total = 0, through = 0;
+        unsigned long long recordedGeneration = 0;
+        std::ifstream( m_path ) >> total >> recordedGeneration >> through;
+        std::map<std::string, int64_t> synced;
+        if ( recordedGeneration == generation )
+            synced[ "" ] = through;
+        return synced;
+    }
+
+    void sync( uint64_t generation, std::vector<SharedCounterSync>& counters, SharedLicenseSnapshot& snapshot ) override
+    {
+        long long total = 0, through = 0;
+        unsigned long long recordedGeneration = 0;
+        std::ifstream( m_path ) >> total >> recordedGeneration >> through;
+        for ( SharedCounterSync& counter : counters )
+        {
+            if ( counter.feature.empty() && counter.delta > 0 )
+            {
+                total += counter.delta;
+                //Write the new file next to the old one and rename it over, so it's either all there or not at all.
+                std::ofstream( m_path + ".tmp" ) << total << " " << generation << " " << counter.spentThrough << std::endl;
+                std::rename( ( m_path + ".tmp" ).c_str(), m_path.c_str() );
+            }
+            counter.remaining = 1000000000;
+        }
+        snapshot.valid = snapshot.active = snapshot.enabled = true;
+        snapshot.totalConsumption = total;
+        snapshot.maxConsumption = 1000000000;
+        snapshot.updatedAt = time( nullptr );
+    }
+
+private:
+    std::string m_path;
+};
+
+int RunDemo( int workers, int consumptionsPerWorker )
+{
+    const std::string name = "demo_" + std::to_string( getpid() );
+    const std::string licensePath = "shared_demo_license.txt";
+    std::remove( licensePath.c_str() );
+
+    std::vector<pid_t> children;
+    for ( int w = 0; w < workers; w++ )
+    {
+        pid_t pid = fork();
+        if ( pid == 0 )
+        {
+            SharedLicenseState shared( name );
+            shared.start( std::make_shared<DemoOwner>( licensePath ), std::chrono::milliseconds( 50 ), std::chrono::milliseconds( 500 ) );
+            for ( int i = 0; i < consumptionsPerWorker; )
+            {
+                if ( shared.tryConsume( 1 ) )
+                    i++;
+                else
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) ); //waiting for the first sync
+                if ( i % 1000 == 0 )
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+            }
+            shared.stop();
+            _exit( 0 );
+        }
+        children.push_back( pid );
+    }
+
+    //Once the owner has synced a few times, we kill it without giving it a chance to clean up.
+    SharedLicenseState shared( name );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+    pid_t owner = (pid_t)shared.ownerPid();
+    if ( owner != 0 )
+    {
+        std::cout << "Killing owner process " << owner << std::endl;
+        kill( owner, SIGKILL );
+    }
+    for ( pid_t child : children )
+        waitpid( child, nullptr, 0 );
+
+    //The workers that finished last may not have been the owner, so whatever they spent after the owner's last
+    //sync is still in the segment. We become the owner to sync it, like the next worker to start would.
+    shared.start( std::make_shared<DemoOwner>( licensePath ), std::chrono::milliseconds( 50 ), std::chrono::milliseconds( 500 ) );
+    for ( int i = 0; i < 100 && shared.unsynced() > 0; i++ )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    shared.stop();
+
+    long long total = 0;
+    std::ifstream( licensePath ) >> total;
+    long long spent = shared.spent();
+    std::cout << "Spent through shared memory: " << spent << ", synced to the license: " << total << std::endl;
+    SharedLicenseState::remove( name );
+    std::remove( licensePath.c_str() );
+    bool ok = spent == total && shared.unsynced() == 0;
+    std::cout << ( ok ? "Every consumption was synced exactly once." : "Counts don't match!" ) << std::endl;
+    return ok ? 0 : 1;
+}
+#else
+int RunDemo( int, int )
+{
+    std::cout << "The demo needs fork(), run it on Linux or macOS." << std::endl;
+    return 1;
+}
+#endif
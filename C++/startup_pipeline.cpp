@@ -0,0 +1,193 @@
+#include <LicenseSpring/Configuration.h>
+#include <LicenseSpring/EncryptString.h>
+#include <LicenseSpring/LicenseManager.h>
+#include <LicenseSpring/Exceptions.h>
+#include <LicenseSpring/InstallationFile.h>
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include "DeviceFingerprint.h"
+#include "StartupGraph.h"
+
+using namespace LicenseSpring;
+
+int RunMock( bool firstRun );
+
+//Sample code for starting up with the license work as a graph (see StartupGraph.h) instead of one call after the
+//other like version.cpp does. Reading and checking the local license doesn't need the network, and fetching the
+//version list doesn't need the license, so they run at the same time. The app is usable as soon as the local
+//license is verified, and the online check finishes in the background.
+//
+//Run with --mock to compare the time until the app is usable with and without the graph, using made-up delays
+//instead of the LicenseSpring servers (add --first-run for a device that has no local license yet). Those timings
+//are simulated: they show how the steps overlap, not how fast your servers or disk are.
+int main( int argc, char* argv[] )
+{
+    if ( argc > 1 && strcmp( argv[1], "--mock" ) == 0 )
+        return RunMock( argc > 2 && strcmp( argv[2], "--first-run" ) == 0 );
+
+    std::string appName = "NAME"; //input name of application
+    std::string appVersion = "VERSION"; //input version of application
+
+    std::string apiKey = EncryptStr( "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX" ); // your LicenseSpring API key (UUID)
+    std::string sharedKey = EncryptStr( "XXXXXXXXX-XXXXX-XXXXXXXXXXXXX_XXXXXX_XXXXXX" ); // your LicenseSpring Shared key
+    std::string productCode = EncryptStr( "XXXXXX" ); // product code that you specified in LicenseSpring for your application
+
+    //The SDK's hardware ID comes from a cache that's only worked out again after a reboot or a network adapter
+    //change, and the network info is collected in the background instead of on every startup. See
+    //DeviceFingerprint.h.
+    DeviceFingerprint device( DeviceFingerprint::defaultCachePath( appName ), sharedKey, [ & ]()
+        {
+            ExtendedOptions sdkOptions;
+            sdkOptions.collectNetworkInfo( false );
+            return Configuration::Create( apiKey, sharedKey, productCode, appName, appVersion, sdkOptions )->getDeviceId();
+        } );
+    ExtendedOptions options;
+    options.setHardwareID( device.hardwareId() );
+    options.collectNetworkInfo( false );
+    device.prefetchNetworkInfo();
+
+    std::shared_ptr<Configuration> pConfiguration = Configuration::Create( apiKey, sharedKey, productCode,
+        appName, appVersion, options );
+
+    auto licenseId = LicenseID::fromKey( "XXXX-XXXX-XXXX-XXXX" ); //input license key
+    auto licenseManager = LicenseManager::create( pConfiguration );
+    //The SDK's objects aren't meant to be used from two threads at once, so steps that may run at the same time
+    //never share one: the version list and newest version go through their own LicenseManager (one after the
+    //other), and the steps that use the License are chained.
+    auto updatesManager = LicenseManager::create( pConfiguration );
+
+    License::ptr_t license = nullptr;
+    std::vector<std::string> versions;
+    InstallationFile::ptr_t newest = nullptr;
+    bool activated = false;
+
+    StartupGraph startup;
+    //Disk only: the local license, verified without going online. An inactive license is left for the activation
+    //step, anything else wrong with it (another device's license, a tampered clock) fails this step.
+    startup.add( "local license", {}, [ & ]()
+        {
+            license = licenseManager->reloadLicense();
+            try
+            {
+                if ( license != nullptr )
+                    license->localCheck();
+            }
+            catch ( LicenseStateException )
+            {
+                if ( license->isActive() )
+                    throw;
+            }
+        } );
+    //Network only, it needs the license key but not the license.
+    startup.add( "version list", {}, [ & ]() { versions = updatesManager->getVersionList( licenseId ); } );
+    //Only goes online if there's no usable local license.
+    startup.add( "activation", { "local license" }, [ & ]()
+        {
+            if ( license == nullptr || !license->isActive() )
+            {
+                license = licenseManager->activateLicense( licenseId );
+                activated = true;
+            }
+        } );
+    //The app doesn't wait for these. An activation already checked the license online.
+    startup.add( "online check", { "activation" }, [ & ]() { if ( !activated ) license->check(); } );
+    startup.add( "newest version", { "activation", "version list" },
+        [ & ]() { newest = updatesManager->getInstallationFile( licenseId ); } );
+    //The only step that waits for the network info. It uses the license too, so it comes after the online check.
+    startup.add( "network info", { "online check" }, [ & ]() { device.sendNetworkInfo( license ); } );
+
+    startup.onFinished( "online check", []( std::exception_ptr error )
+        {
+            if ( error )
+                std::cout << "[background] Online check failed, the app should stop here or fall back." << std::endl;
+        } );
+    startup.start();
+
+    try
+    {
+        //Throws what kept us from getting a license, from "local license" or from "activation".
+        startup.waitFor( "activation" );
+    }
+    catch ( LicenseNoAvailableActivationsException )
+    {
+        std::cout << "No available activations." << std::endl;
+        return 0;
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << "Could not get a usable license: " << ex.what() << std::endl;
+        return 0;
+    }
+    startup.markUsable();
+    std::cout << "Usable after " << startup.usableAfter().count() << " ms." << std::endl;
+
+    //Here the app would show its first window. For the sample, we wait for the rest and show how it went.
+    startup.waitAll();
+    try
+    {
+        startup.waitFor( "newest version" );
+        if ( newest != nullptr )
+            std::cout << "Newest version: " << newest->version() << std::endl;
+    }
+    catch ( LicenseSpringException ex )
+    {
+        std::cout << "Could not get the newest version: " << ex.what() << std::endl;
+    }
+    std::cout << versions.size() << " versions available." << std::endl;
+    std::cout << startup.describe();
+    std::cout << "One after the other, the steps would have taken " << startup.sequentialEstimate().count() << " ms." << std::endl;
+    return 0;
+}
+
+//The same startup against made-up delays: a local license read and check from disk, and server round trips of a
+//few hundred milliseconds. Both runs call the same step functions, only the order differs.
+int RunMock( bool firstRun )
+{
+    auto wait = []( int ms ) { std::this_thread::sleep_for( std::chrono::milliseconds( ms ) ); };
+    bool haveLicense = false;
+    auto localLicense = [ & ]() { wait( 40 ); haveLicense = !firstRun; };
+    auto versionList = [ & ]() { wait( 350 ); };
+    auto activation = [ & ]() { if ( !haveLicense ) wait( 600 ); }; //activating also checks the license
+    auto onlineCheck = [ & ]() { wait( 450 ); };
+    auto newestVersion = [ & ]() { wait( 350 ); };
+
+    //Before: version.cpp's order. A local license is checked online before the app starts, a device without one
+    //activates instead. The version list and newest version are fetched afterwards.
+    auto start = std::chrono::steady_clock::now();
+    localLicense();
+    if ( haveLicense )
+        onlineCheck();
+    else
+        activation();
+    auto sequentialUsable = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+    versionList();
+    newestVersion();
+    auto sequentialAll = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start );
+
+    //After: the graph.
+    StartupGraph startup;
+    startup.add( "local license", {}, localLicense );
+    startup.add( "version list", {}, versionList );
+    startup.add( "activation", { "local license" }, activation );
+    startup.add( "online check", { "activation" }, [ & ]() { if ( haveLicense ) onlineCheck(); } );
+    startup.add( "newest version", { "activation", "version list" }, newestVersion );
+    startup.start();
+    startup.waitFor( "activation" );
+    startup.markUsable();
+    startup.waitAll();
+
+    std::cout << ( firstRun ? "First run, no local license" : "Local license present" )
+        << " (simulated timings, made-up delays instead of the servers):" << std::endl;
+    std::cout << startup.describe();
+    std::cout << "Usable after: " << sequentialUsable.count() << " ms one after the other, "
+        << startup.usableAfter().count() << " ms with the graph." << std::endl;
+    std::chrono::milliseconds graphAll( 0 );
+    for ( const StartupGraph::StepTiming& timing : startup.timeline() )
+        graphAll = std::max( graphAll, timing.finished );
+    std::cout << "Everything done after: " << sequentialAll.count() << " ms one after the other, "
+        << graphAll.count() << " ms with the graph." << std::endl;
+    //On a first run both have to wait for the activation, so the graph can only be as fast, give it a few ms for
+    //starting its threads.
+    return startup.usableAfter() <= sequentialUsable + std::chrono::milliseconds( 20 ) ? 0 : 1;
+}
@@ -4,9 +4,14 @@
 #include <LicenseSpring/Exceptions.h>
 #include <iostream>
 #include <thread>
+#include "ExpiryScheduler.h"
+#include "StartupGraph.h"
 
 using namespace LicenseSpring;
 
+//Where the trial's end is compared against. A test can swap in a SimulatedClock (see Clock.h) to see the trial end.
+std::shared_ptr<Clock> appClock = SystemClock::instance();
+
 //Code sample for creating a trial license. 
 //Note, for user-based trials, you need to make sure the user account is still using thier initial password, and not a changed password.
 int main()
@@ -38,13 +43,30 @@ int main()
     const std::string license_policy_code = std::string();
 
     LicenseID licenseId;
+    License::ptr_t license = nullptr;
+
+    //Requesting the trial goes to the server, reading the local license (below) only reads the disk, and neither
+    //needs the other. So we start both at once and wait for each where the code used to call it, see
+    //StartupGraph.h. waitFor() throws whatever the step threw, so the catch blocks are the same as before.
+    StartupGraph startup;
+    startup.add( "trial", {}, [ & ]()
+        {
+            licenseId = licenseManager->getTrialLicense( user, license_policy_code );
+            //licenseId = licenseManager->getTrialLicense( email );
+        } );
+    startup.add( "local license", {}, [ & ]()
+        {
+            license = licenseManager->reloadLicense();
+            if ( license != nullptr )
+                license->localCheck(); //always good to do a local check whenever you run your program 
+        } );
+    startup.start();
     
     //This is where we will request a trial license. We will also check to see if our current product
     //and license policy allows trials.
     try
     {
-        licenseId = licenseManager->getTrialLicense( user, license_policy_code );
-        //licenseId = licenseManager->getTrialLicense( email );
+        startup.waitFor( "trial" );
     }
     catch ( TrialNotAllowedException )
     {
@@ -70,16 +92,11 @@ int main()
     //reloadLicense() will return a pointer to the local license stored
     //on the end-user's device if they have one that matches the current 
     //configuration i.e. API key, Shared key, and product code.
-    License::ptr_t license = nullptr;
-
     try
     {
-        license = licenseManager->reloadLicense();
+        startup.waitFor( "local license" );
         if ( license != nullptr )
-        {
-            license->localCheck(); //always good to do a local check whenever you run your program 
             std::cout << "Local check complete." << std::endl;
-        }
     }
     catch ( LocalLicenseException )
     { //Exception if we cannot read the local license or the local license file is corrupt
@@ -135,6 +152,17 @@ int main()
         //Here is where you would put your trial code for a user.
         std::cout << "Currently using a trial license." << std::endl;
         std::cout << "Showing limited options." << std::endl;
+
+        //The end of the trial is one of the license's deadlines, see ExpiryScheduler.h. An app that runs for a while
+        //would keep the scheduler around and use onExpiry() to close the trial features the moment it ends.
+        ExpiryScheduler expiries( appClock );
+        expiries.sync( license );
+        ExpiryScheduler::Deadline trialEnd = expiries.deadline( DeadlineKind::Trial );
+        if ( trialEnd.expired() )
+            std::cout << "Your trial has ended." << std::endl;
+        else if ( trialEnd.at() != noDeadline )
+            std::cout << "Your trial ends in " << ( trialEnd.at() - expiries.now() ) / ( 24 * 60 * 60 * 1000 )
+                << " days." << std::endl;
     }
     else
     {
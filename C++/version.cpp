@@ -7,6 +7,9 @@
 #include <LicenseSpring/BaseManager.h>
 #include <iostream>
 #include <thread>
+#include "SingleFlight.h"
+#include "CircuitBreaker.h"
+#include "ExpiryScheduler.h"
 #include <LicenseSpring/InstallationFile.h>
 
 #pragma warning( disable : 4996 )
@@ -16,6 +19,20 @@ using namespace LicenseSpring;
 //License Checking function at bottom of code. Shows how to do an online check and sync, as well as a local check.
 void LicenseCheck( License::ptr_t license );
 
+//Concurrent LicenseCheck() calls share one online check (see SingleFlight.h).
+const std::chrono::seconds checkFreshness( 5 );
+CoalescedLicenseCalls onlineCalls( checkFreshness );
+
+//Version requests go through networkGuard, which retries network failures with backoff and, if the servers keep
+//failing, stops sending requests for a while so we can tell the user right away. See CircuitBreaker.h.
+NetworkGuard networkGuard;
+
+//The license's deadlines, read once per check instead of converting the dates every time we need them. See
+//ExpiryScheduler.h. They're compared against appClock, which a test can swap for a SimulatedClock (see Clock.h)
+//to step past the end of the maintenance period.
+std::shared_ptr<Clock> appClock = SystemClock::instance();
+ExpiryScheduler expiries( appClock );
+
 //Our console Product Version ChatBot program that allows the user to view all available versions for product and receive installation URL.
 int main()
 {
@@ -107,7 +124,9 @@ int main()
         //Here we list all the versions for the selected product
         if ( sInput.compare( "1" ) == 0 )
         {
-            std::vector<std::string> listVersions = licenseManager->getVersionList( licenseId );
+            std::vector<std::string> listVersions;
+            if ( !networkGuard.tryCall( Endpoint::Versions, [ & ]() { listVersions = licenseManager->getVersionList( licenseId ); } ) )
+                std::cout << "Could not reach the LicenseSpring servers, please try again later." << std::endl;
             for ( std::string i : listVersions )
                 std::cout << i << std::endl;
 
@@ -122,7 +141,8 @@ int main()
             std::getline( std::cin, vInput );
             try 
             {
-                InstallationFile::ptr_t ins = licenseManager->getInstallationFile( licenseId, vInput );
+                InstallationFile::ptr_t ins = networkGuard.call( Endpoint::Versions,
+                    [ & ]() { return licenseManager->getInstallationFile( licenseId, vInput ); } );
                 std::cout << "The URL for this installation file is: " << ins->url() << std::endl;
             }
             catch ( ProductVersionException )
@@ -141,6 +161,10 @@ int main()
             {
                 std::cout << "License disabled." << std::endl;
             }
+            catch ( CircuitOpenException )
+            {
+                std::cout << "Could not reach the LicenseSpring servers, please try again later." << std::endl;
+            }
             catch ( ... )
             {
                 std::cout << "Network error with receiving product version installation file." << std::endl;
@@ -153,15 +177,18 @@ int main()
         {
             //After checking the license to confirm its accuracy, the maintenance period time is stored.
             LicenseCheck( license );
-            struct tm time = license->maintenancePeriod();
-            time_t t = mktime( &time );
+            expiries.sync( license );
+            ExpiryScheduler::Deadline maintenance = expiries.deadline( DeadlineKind::Maintenance );
+            time_t t = (time_t)( maintenance.at() / 1000 );
             //If the maintenance period is in the past or was never set (by default maintenance period is NULL)
-            if( license->isMaintenancePeriodExpired() || ctime( &t ) == NULL ) 
+            if( maintenance.expired() || maintenance.at() == noDeadline ) 
             {
                 //Retrieving the newest version available 
-                InstallationFile::ptr_t ins = licenseManager->getInstallationFile( licenseId );
+                InstallationFile::ptr_t ins = nullptr;
+                if ( !networkGuard.tryCall( Endpoint::Versions, [ & ]() { ins = licenseManager->getInstallationFile( licenseId ); } ) )
+                    std::cout << "Could not reach the LicenseSpring servers to check for a newer version." << std::endl;
                 //If the current application version being run is not equal to the newest version available.
-                if ( ( ins->version() ).compare( pConfiguration->getAppVersion() ) != 0 )
+                else if ( ( ins->version() ).compare( pConfiguration->getAppVersion() ) != 0 )
                 {
                     std::cout << "You are currently on version " << pConfiguration->getAppVersion() << ", which is outdated." << std::endl;
                     std::cout << "The most recent version, " << ins->version() << ", is available now on the " << ins->channel() << " channel." << std::endl;
@@ -195,7 +222,7 @@ void LicenseCheck( License::ptr_t license )
         try
         {
             std::cout << "Checking license online..." << std::endl;
-            license->check();
+            onlineCalls.check( license );
             std::cout << "License successfully checked" << std::endl;
         }
         catch ( LicenseStateException )